@@ -0,0 +1,115 @@
+////////////////////////////////////////////////////
+// File: flow_callback.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+// Example of the libp2nprobe library: aggregates a pcap file read by the application itself,
+// prints the expired flows as CSV through a custom exporter and sums them in a callback.
+// With --v5 the flows are written as NetFlow v5 datagrams by the exporter of the command line tool.
+//
+// Usage: ./flow_callback <pcap_file> [active_timeout_s inactive_timeout_s] [--v5 <output_file>]
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <arpa/inet.h>
+
+#include "FileSink.h"
+#include "NetFlowV5Exporter.h"
+#include "Probe.h"
+
+namespace {
+    std::string address(uint32_t host_order) {
+        char text[INET_ADDRSTRLEN];
+        struct in_addr addr;
+        addr.s_addr = htonl(host_order);
+        inet_ntop(AF_INET, &addr, text, sizeof(text));
+        return text;
+    }
+
+    /**
+     * @brief Custom exporter, writes one CSV line per flow to the standard output.
+     */
+    class CsvExporter : public Exporter {
+    public:
+        CsvExporter() {
+            std::cout << "src,dst,src_port,dst_port,packets,bytes,first_ms,last_ms\n";
+        }
+
+        void export_flows(const std::vector<Flow>& flows, uint32_t, uint32_t) override {
+            for (const Flow& flow : flows) {
+                std::cout << address(flow.record.srcaddr) << "," << address(flow.record.dstaddr) << ","
+                          << flow.record.srcport << "," << flow.record.dstport << ","
+                          << flow.packets << "," << flow.octets << ","
+                          << flow.first_ms << "," << flow.last_ms << "\n";
+            }
+        }
+
+        size_t max_flows_per_export() const override { return 64; }
+    };
+}
+
+int main(int argc, char* argv[]) {
+    std::string v5_path;
+    if (argc >= 4 && std::string(argv[argc - 2]) == "--v5") {
+        v5_path = argv[argc - 1];
+        argc -= 2;
+    }
+    if (argc != 2 && argc != 4) {
+        std::cerr << "Usage: " << argv[0] << " <pcap_file> [active_timeout_s inactive_timeout_s] [--v5 <output_file>]\n";
+        return 2;
+    }
+
+    char errbuf[PCAP_ERRBUF_SIZE];
+    pcap_t* handle = pcap_open_offline(argv[1], errbuf);
+    if (handle == nullptr) {
+        std::cerr << "Error: " << errbuf << "\n";
+        return 3;
+    }
+
+    Probe::Options options;
+    if (argc == 4) {
+        options.active_timeout_ms = static_cast<uint32_t>(std::stoul(argv[2])) * 1000;
+        options.inactive_timeout_ms = static_cast<uint32_t>(std::stoul(argv[3])) * 1000;
+    }
+    Probe probe(options);
+    if (v5_path.empty()) {
+        probe.set_exporter(std::make_unique<CsvExporter>());
+    }
+    else {
+        probe.set_exporter(std::make_unique<NetFlowV5Exporter>(
+            std::make_unique<FileSink>(v5_path, Config::Compression::NONE, false)));
+    }
+
+    // Bytes per destination port, summed from the expired flows
+    std::map<uint16_t, uint64_t> port_bytes;
+    probe.set_callback([&port_bytes](const Flow& flow) {
+        port_bytes[flow.record.dstport] += flow.octets;
+    });
+
+    // libpcap reuses its buffer on the next read, so packets are pushed one by one
+    struct pcap_pkthdr* header;
+    const u_char* packet;
+    while (pcap_next_ex(handle, &header, &packet) == 1) {
+        probe.add_packet(header, packet);
+    }
+    pcap_close(handle);
+    probe.finish();
+
+    std::cerr << "Flows: " << probe.flows_created() << " created, " << probe.flows_expired() << " expired\n";
+    std::vector<std::pair<uint64_t, uint16_t>> ports;
+    for (const auto& entry : port_bytes) {
+        ports.emplace_back(entry.second, entry.first);
+    }
+    std::sort(ports.rbegin(), ports.rend());
+    for (size_t i = 0; i < ports.size() && i < 5; i++) {
+        std::cerr << "  port " << ports[i].second << ": " << ports[i].first << " bytes\n";
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+////////////////////////////////////////////////////
+// File: shm_reader.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+// Reference reader of the shared memory ring written by p2nprobe --shm <name>: takes the export
+// datagrams out of the ring in place and prints a summary, the NetFlow v5 records are also summed.
+// Start it before or after p2nprobe, it ends when p2nprobe closed the ring and everything was read.
+//
+// Usage: ./shm_reader <name> [attach_timeout_s]
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <arpa/inet.h>
+
+#include "Config.h"
+#include "ShmRing.h"
+
+namespace {
+    uint16_t get_u16(const uint8_t* buffer) {
+        uint16_t value;
+        memcpy(&value, buffer, sizeof(value));
+        return ntohs(value);
+    }
+
+    uint32_t get_u32(const uint8_t* buffer) {
+        uint32_t value;
+        memcpy(&value, buffer, sizeof(value));
+        return ntohl(value);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2 && argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <name> [attach_timeout_s]\n";
+        return 2;
+    }
+    int timeout_ms = argc == 3 ? std::stoi(argv[2]) * 1000 : -1;
+
+    ShmRingReader reader;
+    if (!reader.attach(argv[1], timeout_ms)) {
+        std::cerr << "Error: Shared memory ring '" << argv[1] << "' is not available.\n";
+        return 3;
+    }
+    std::cerr << "Attached to " << ShmRing::segment_name(argv[1]) << " (" << (reader.capacity() >> 20) << " MiB)\n";
+
+    uint64_t datagrams = 0;
+    uint64_t bytes = 0;
+    uint64_t v5_flows = 0;
+    uint64_t v5_packets = 0;
+    uint64_t v5_octets = 0;
+
+    const uint8_t* datagram;
+    size_t size;
+    while (reader.next(datagram, size)) {
+        datagrams++;
+        bytes += size;
+
+        // NetFlow v5: count at offset 2 of the header, dPkts and dOctets at offset 16 and 20 of a record
+        if (size >= Config::NETFLOW_HEADER_SIZE && get_u16(datagram) == 5) {
+            uint16_t count = get_u16(datagram + 2);
+            for (uint16_t i = 0; i < count; i++) {
+                const uint8_t* record = datagram + Config::NETFLOW_HEADER_SIZE + i * Config::NETFLOW_RECORD_SIZE;
+                if (record + Config::NETFLOW_RECORD_SIZE > datagram + size) {
+                    break;
+                }
+                v5_flows++;
+                v5_packets += get_u32(record + 16);
+                v5_octets += get_u32(record + 20);
+            }
+        }
+    }
+    reader.unlink();
+
+    std::cout << "Datagrams: " << datagrams << ", bytes: " << bytes << "\n";
+    if (v5_flows > 0) {
+        std::cout << "NetFlow v5 flows: " << v5_flows << ", packets: " << v5_packets << ", octets: " << v5_octets << "\n";
+    }
+    return 0;
+}
@@ -10,7 +10,10 @@
 #define ARG_PARSER_H
 
 #include <string>
+#include <cstdint>
 #include "Config.h"
+#include "Pacer.h"
+#include "Rollup.h"
 
 
 /**
@@ -32,12 +35,64 @@ public:
     const std::string& getPCAPFilePath() const;
     int getActiveTimeout() const;
     int getInactiveTimeout() const;
+    Config::ExportFormat getExportFormat() const;
+    int getExportMtu() const;
+    int getTemplateRefresh() const;
+    const std::string& getOutputPath() const;
+    Config::Compression getCompression() const;
+    bool getDirectIo() const;
+    int getRowGroupSize() const;
+    Pacer::RateUnit getRateUnit() const;
+    double getRate() const;
+    double getReplaySpeed() const;
+    int getSendBuffer() const;
+    int getStatsInterval() const;
+    int getPrometheusPort() const;
+    const std::string& getTracePath() const;
+    const std::string& getCheckpointPath() const;
+    const std::string& getResumePath() const;
+    bool hasTimeRange() const;
+    int64_t getFromTime() const;
+    int64_t getToTime() const;
+    bool getBuildIndex() const;
+    uint32_t getIndexInterval() const;
+    int getThreads() const;
+    Config::InputReader getInputReader() const;
+    bool getDirectRead() const;
+    bool getBiflow() const;
+    bool getTcpEnd() const;
+    int getFinLinger() const;
+    const std::string& getFlowSpillPath() const;
+    int getHotFlows() const;
+    bool getAdmission() const;
+    bool getDedup() const;
+    int getDedupWindow() const;
+    bool getSketches() const;
+    int getSketchInterval() const;
+    int getTopK() const;
+    bool getRollup() const;
+    const Rollup::Spec& getRollupSpec() const;
+    int getRollupInterval() const;
+    bool getRollupOnly() const;
+    const std::string& getRoutesPath() const;
+    const std::string& getShmName() const;
+    size_t getShmSize() const;
+    const std::string& getSpoolPath() const;
+    size_t getSpoolSize() const;
+    double getSpoolRate() const;
 
 private:
     void parseArgs(int argc, char* argv[]);
     void parseHostAndPort(const std::string& collectorAddress, size_t colonIndex);
     void validateTimeout(int timeout, const std::string& timeoutName);
     void validatePcapFile(const std::string& filePath);
+    int parseIntOption(int argc, char* argv[], int& i, const std::string& optionName, int minValue, int maxValue);
+    void parseExportFormat(const std::string& format);
+    void parseCompression(const std::string& compression);
+    void parseInputReader(const std::string& name);
+    void parseRate(const std::string& rate);
+    void parseReplaySpeed(const std::string& speed);
+    int64_t parseTime(const std::string& value, const std::string& optionName);
     void printUsage() const;
     void printHelp() const;
 
@@ -49,6 +104,50 @@ private:
     // Optional args with default values
     int activeTimeout;
     int inactiveTimeout;
+    Config::ExportFormat exportFormat;
+    int exportMtu;
+    int templateRefresh;
+    std::string outputPath;
+    Config::Compression compression;
+    bool directIo;
+    int rowGroupSize;
+    Pacer::RateUnit rateUnit;
+    double rate;
+    double replaySpeed;
+    int sendBuffer;
+    int statsInterval;
+    int prometheusPort;
+    std::string tracePath;
+    std::string checkpointPath;
+    std::string resumePath;
+    int64_t fromTime;
+    int64_t toTime;
+    bool buildIndex;
+    uint32_t indexInterval;
+    int threads;
+    Config::InputReader inputReader;
+    bool directRead;
+    bool biflow;
+    bool tcpEnd;
+    int finLinger;
+    std::string flowSpillPath;
+    int hotFlows;
+    bool admission;
+    bool dedup;
+    int dedupWindow;
+    bool sketches;
+    int sketchInterval;
+    int topK;
+    bool rollup;
+    Rollup::Spec rollupSpec;
+    int rollupInterval;
+    bool rollupOnly;
+    std::string routesPath;
+    std::string shmName;
+    int shmSize;
+    std::string spoolPath;
+    int spoolSize;
+    int spoolRate;
 };
 
 #endif // ARG_PARSER_H
@@ -0,0 +1,51 @@
+////////////////////////////////////////////////////
+// File: BlockSource.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef BLOCK_SOURCE_H
+#define BLOCK_SOURCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Capture data delivered in large blocks that PcapReader parses in place.
+ *
+ * Implementations fill the blocks in the background (decompression, asynchronous reads), read
+ * returns views into the current block and copies only the data that spans two blocks.
+ */
+class BlockSource {
+public:
+    virtual ~BlockSource() = default;
+
+    virtual bool start() = 0;
+    virtual bool failed() const = 0;
+    virtual std::string error() const = 0;
+
+    size_t read(size_t size, const uint8_t*& data);
+
+protected:
+    /**
+     * @brief Releases the current block and waits for the next one.
+     *
+     * @param data Set to the data of the next block
+     * @param size Set to the size of the next block
+     *
+     * @return false at the end of the data or on an error
+     */
+    virtual bool next_block(const uint8_t*& data, size_t& size) = 0;
+
+private:
+    const uint8_t* block = nullptr;
+    size_t block_size = 0;
+    size_t position = 0;
+    bool ended = false;
+    std::vector<uint8_t> scratch;   // Data spanning two blocks
+};
+
+#endif // BLOCK_SOURCE_H
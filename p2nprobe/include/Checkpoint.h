@@ -0,0 +1,74 @@
+////////////////////////////////////////////////////
+// File: Checkpoint.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <list>
+#include <string>
+
+#include "Config.h"
+#include "Flow.h"
+
+/**
+ * @brief Snapshot of the flow table and export state, so processing of rotated capture
+ * files one per run behaves like one continuous run.
+ *
+ * File layout, integers in host byte order so the records can be used directly from the mapping:
+ *  - Header (32 bytes): magic "P2NC", uint16 version (1), uint16 byte order mark (0x0102),
+ *    uint8 export format, uint8 flags (bit 0: biflow), 2 bytes reserved, uint32 flow count,
+ *    uint32 exporter sequence, uint32 time_start, uint32 time_end, uint32 reserved
+ *  - Flow count records (80 bytes): NetFlowV5record (48 bytes) followed by uint64 packets,
+ *    octets, first_ms and last_ms. Records are in the order of arrival of the flows.
+ *  - Biflow checkpoints only: flow count Flow::Reverse records (48 bytes) in the same order.
+ */
+class Checkpoint {
+public:
+    /**
+     * @brief Export state carried between the runs.
+     */
+    struct State {
+        Config::ExportFormat format = Config::DEFAULT_EXPORT_FORMAT;
+        uint32_t sequence = 0;      // Exporter sequence number
+        uint32_t time_start = 0;    // Start time of the device
+        uint32_t time_end = 0;      // Last time of the device
+        bool biflow = false;        // Flows carry the reverse direction
+    };
+
+    static bool save(const std::string& path, const State& state, const std::list<Flow>& flows);
+    static bool load(const std::string& path, State& state, std::list<Flow>& flows);
+
+private:
+    struct Header {
+        char magic[4];
+        uint16_t version;
+        uint16_t byte_order;
+        uint8_t format;
+        uint8_t flags;
+        uint8_t reserved[2];
+        uint32_t flow_count;
+        uint32_t sequence;
+        uint32_t time_start;
+        uint32_t time_end;
+        uint32_t reserved2;
+    };
+
+    struct Record {
+        NetFlowV5record record;
+        uint64_t packets;
+        uint64_t octets;
+        uint64_t first_ms;
+        uint64_t last_ms;
+    };
+
+    static_assert(sizeof(Header) == 32, "Checkpoint header must be 32 bytes");
+    static_assert(sizeof(Record) == 80, "Checkpoint record must be 80 bytes");
+    static_assert(sizeof(Flow::Reverse) == 48, "Checkpoint reverse record must be 48 bytes");
+};
+
+#endif // CHECKPOINT_H
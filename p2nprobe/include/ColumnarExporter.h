@@ -0,0 +1,64 @@
+////////////////////////////////////////////////////
+// File: ColumnarExporter.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+
+#ifndef COLUMNAR_EXPORTER_H
+#define COLUMNAR_EXPORTER_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "Exporter.h"
+#include "DatagramSink.h"
+#include "Flow.h"
+
+/**
+ * @brief Class for writing expired flows as Apache Arrow IPC stream (record batches) for analytics engines.
+ *
+ * Flows are appended into one vector per column and every row_group_size rows the columns
+ * are written as one record batch. Column vectors keep their capacity between batches,
+ * so no memory is allocated per flow once the first batch is full.
+ *
+ * Columns: src_addr, dst_addr (uint32, host byte order), src_port, dst_port (uint16),
+ * protocol, tcp_flags (uint8), packets, bytes (uint64), first, last (timestamp[ms, UTC]).
+ * The stream can be read e.g. with pyarrow.ipc.open_stream().
+ */
+class ColumnarExporter : public Exporter {
+public:
+    ColumnarExporter(std::unique_ptr<DatagramSink> sink, size_t row_group_size);
+    ~ColumnarExporter() override;
+
+    void export_flows(const std::vector<Flow>& flows, uint32_t time_start, uint32_t time_end) override;
+    size_t max_flows_per_export() const override;
+    void flush() override;
+
+private:
+    void write_schema();
+    void write_record_batch();
+    void write_message(const std::vector<uint8_t>& metadata);
+
+    std::unique_ptr<DatagramSink> sink; // Output file
+    size_t row_group_size;              // Rows in one record batch
+    bool finished;
+
+    // Column vectors, reused for every batch
+    std::vector<uint32_t> src_addr;
+    std::vector<uint32_t> dst_addr;
+    std::vector<uint16_t> src_port;
+    std::vector<uint16_t> dst_port;
+    std::vector<uint8_t> protocol;
+    std::vector<uint8_t> tcp_flags;
+    std::vector<uint64_t> packets;
+    std::vector<uint64_t> bytes;
+    std::vector<int64_t> first;
+    std::vector<int64_t> last;
+
+    std::vector<uint8_t> body;          // Body of the record batch message, reused
+};
+
+#endif // COLUMNAR_EXPORTER_H
@@ -9,8 +9,19 @@
 #define CONFIG_H
 
 #include <cstdint>
+#include <cstddef>
 
 namespace Config {
+    /**
+     * @brief Format of the exported flow records.
+     */
+    enum class ExportFormat : uint8_t {
+        NETFLOW_V5,     // Fixed 48 byte records, max 30 per datagram
+        NETFLOW_V9,     // Template based, RFC 3954
+        IPFIX,          // Template based, RFC 7011
+        ARROW           // Apache Arrow IPC stream written to the output file
+    };
+
     // Version information
     constexpr const char* VERSION = "1.0.0";
     constexpr const char* AUTHOR = "Michal Balogh (xbalog06)";
@@ -29,6 +40,141 @@ namespace Config {
     constexpr size_t NETFLOW_HEADER_SIZE = 24;
     constexpr size_t NETFLOW_RECORD_SIZE = 48;
 
+    // Template based export (NetFlow v9 / IPFIX)
+    constexpr ExportFormat DEFAULT_EXPORT_FORMAT = ExportFormat::NETFLOW_V5;
+    constexpr int DEFAULT_TEMPLATE_REFRESH = 20;        // datagrams between template resends
+    constexpr int MIN_TEMPLATE_REFRESH = 1;
+    constexpr int MAX_TEMPLATE_REFRESH = 100000;
+    constexpr int DEFAULT_EXPORT_MTU = 0;               // 0 = query path MTU of the collector route
+    constexpr int FALLBACK_EXPORT_MTU = 1500;           // used when the path MTU cannot be queried
+    constexpr int MIN_EXPORT_MTU = 576;
+    constexpr int MAX_EXPORT_MTU = 65535;
+    constexpr size_t IP_UDP_HEADER_SIZE = 28;           // IPv4 header + UDP header
+
+    /**
+     * @brief Block compression used by the file sink.
+     */
+    enum class Compression : uint8_t {
+        NONE = 0,       // Raw datagrams written back to back
+        ZLIB = 1,
+        LZ4 = 2,
+        ZSTD = 3
+    };
+
+    // File output
+    constexpr size_t FILE_SINK_BUFFER_SIZE = 4 * 1024 * 1024;  // bytes collected before one write()
+    constexpr size_t FILE_SINK_ALIGNMENT = 4096;               // O_DIRECT buffer and write alignment
+    constexpr size_t FILE_SINK_BLOCK_SIZE = 1024 * 1024;       // uncompressed bytes per compressed block
+
+    // Spool of datagrams the collector did not get
+    constexpr int DEFAULT_SPOOL_SIZE = 256;                     // MiB cap of the spool file
+    constexpr int MIN_SPOOL_SIZE = 1;
+    constexpr int MAX_SPOOL_SIZE = 65536;
+    constexpr int DEFAULT_SPOOL_RATE = 1000;                    // replayed datagrams per second
+    constexpr int MIN_SPOOL_RATE = 1;
+    constexpr int MAX_SPOOL_RATE = 1000000;
+    constexpr int SPOOL_RETRY_MS = 1000;                        // probe period while the collector refuses datagrams
+    constexpr int SPOOL_CONFIRM_MS = 200;                       // replayed datagrams without an ICMP error for this long are removed
+    constexpr int SPOOL_EXIT_WAIT_MS = 5000;                    // replay time at exit, the rest stays in the file
+    constexpr size_t SPOOL_RECENT_DATAGRAMS = 64;               // sent datagrams kept to spool those refused by ICMP
+
+    // Shared memory ring output
+    constexpr int DEFAULT_SHM_RING_SIZE = 64;                  // MiB of the data area
+    constexpr int MIN_SHM_RING_SIZE = 1;
+    constexpr int MAX_SHM_RING_SIZE = 4096;
+    constexpr int SHM_RING_WAIT_MS = 1000;                      // longest futex sleep, a missed wake up costs at most this
+
+    // Export pacing
+    constexpr int PACER_BURST_MS = 10;                          // token bucket capacity in miliseconds of rate
+    constexpr int DEFAULT_SEND_BUFFER = 0;                      // 0 = size SO_SNDBUF automatically
+    constexpr int MIN_SEND_BUFFER = 4096;
+    constexpr int MAX_SEND_BUFFER = 256 * 1024 * 1024;
+    constexpr int AUTO_SEND_BUFFER_MIN = 256 * 1024;            // bounds of the automatic SO_SNDBUF size
+    constexpr int AUTO_SEND_BUFFER_MAX = 16 * 1024 * 1024;
+    constexpr int AUTO_SEND_BUFFER_MS = 100;                    // miliseconds of the rate held by the socket buffer
+
+    // Columnar output
+    constexpr int DEFAULT_ROW_GROUP_SIZE = 65536;   // rows per Arrow record batch
+    constexpr int MIN_ROW_GROUP_SIZE = 1;
+    constexpr int MAX_ROW_GROUP_SIZE = 16 * 1024 * 1024;
+
+    // Metrics
+    constexpr uint32_t METRICS_SAMPLE_MASK = 63;        // stage latencies are measured on every 64th packet
+    constexpr int DEFAULT_STATS_INTERVAL = 0;           // seconds, 0 = no periodic stats line
+    constexpr int MIN_STATS_INTERVAL = 1;
+    constexpr int MAX_STATS_INTERVAL = 86400;
+    constexpr int DEFAULT_PROMETHEUS_PORT = 0;          // 0 = Prometheus endpoint disabled
+    constexpr int METRICS_POLL_MS = 100;                // wake up period of the metrics reporter
+
+    // Time index
+    constexpr uint32_t DEFAULT_INDEX_INTERVAL = 10000;      // packets per index block
+    constexpr int MIN_INDEX_INTERVAL = 1;
+    constexpr int MAX_INDEX_INTERVAL = 100000000;
+    constexpr const char* INDEX_SUFFIX = ".p2ni";           // index file is <pcap><suffix>
+    constexpr size_t INDEX_SCAN_BUFFER_SIZE = 1024 * 1024;  // stdio buffer of the header scan
+
+    // TCP termination
+    constexpr int DEFAULT_FIN_LINGER_MS = 2000;         // flow stays after FIN in both directions for the last ACK
+    constexpr int MIN_FIN_LINGER_MS = 0;
+    constexpr int MAX_FIN_LINGER_MS = 60000;
+
+    // Disk-backed flow table
+    constexpr int DEFAULT_HOT_FLOWS = 1000000;          // flows kept in memory, colder ones go to the spill file
+    constexpr int MIN_HOT_FLOWS = 1000;
+    constexpr int MAX_HOT_FLOWS = 100000000;
+    constexpr size_t SPILL_INITIAL_SLOTS = 65536;       // flows the spill file holds at first, doubled when full
+    constexpr size_t SPILL_RELEASE_INTERVAL = 4096;     // slots read or written between releases of the resident pages
+
+    // Duplicate packet suppression
+    constexpr int DEFAULT_DEDUP_WINDOW_MS = 50;         // copies of a mirror port arrive within this time
+    constexpr int MIN_DEDUP_WINDOW_MS = 1;
+    constexpr int MAX_DEDUP_WINDOW_MS = 60000;
+    constexpr size_t DEDUP_BUCKETS = 32768;             // 8 packets of 64 bytes per bucket, 2 MiB in total
+
+    // Top talker and distinct host sketches
+    constexpr int DEFAULT_SKETCH_INTERVAL = 60;         // seconds of capture time, 0 = whole capture
+    constexpr int MIN_SKETCH_INTERVAL = 0;
+    constexpr int MAX_SKETCH_INTERVAL = 86400;
+    constexpr size_t SKETCH_CAPACITY = 256;             // Space-Saving counters, error below total / capacity
+    constexpr int DEFAULT_TOP_K = 10;
+    constexpr int MIN_TOP_K = 1;
+    constexpr int MAX_TOP_K = static_cast<int>(SKETCH_CAPACITY);
+    constexpr unsigned HLL_PRECISION = 14;              // 16 KiB of registers, standard error 0.8 %
+
+    // Rollup of expired flows
+    constexpr int DEFAULT_ROLLUP_INTERVAL = 60;         // seconds of capture time per rollup bin
+    constexpr int MIN_ROLLUP_INTERVAL = 1;
+    constexpr int MAX_ROLLUP_INTERVAL = 86400;
+
+    // Parallel processing of one pcap file
+    constexpr int DEFAULT_THREADS = 1;
+    constexpr int MIN_THREADS = 1;
+    constexpr int MAX_THREADS = 256;
+    constexpr uint64_t MIN_CHUNK_SIZE = 1024 * 1024;        // bytes of the file per thread at least
+    constexpr size_t CHUNK_READ_BUFFER_SIZE = 4 * 1024 * 1024;  // stdio buffer of one range
+    constexpr int RESYNC_RECORDS = 4;                       // consecutive plausible records marking a record boundary
+    constexpr size_t RESYNC_WINDOW_SIZE = 64 * 1024;        // bytes searched for a boundary per read
+    constexpr int64_t RESYNC_MAX_SKEW_US = 1000000;         // timestamps may go back this much within the chain
+
+    // Compressed captures
+    constexpr size_t DECOMPRESS_BLOCK_SIZE = 4 * 1024 * 1024;  // decompressed bytes handed to the reader at once
+    constexpr size_t DECOMPRESS_BLOCKS = 2;                     // reader parses one block while the next is filled
+    constexpr size_t DECOMPRESS_INPUT_SIZE = 1024 * 1024;       // compressed bytes read at once
+
+    /**
+     * @brief Backend reading uncompressed capture files.
+     */
+    enum class InputReader : uint8_t {
+        LIBPCAP = 0,
+        URING = 1      // io_uring read-ahead, records parsed in place
+    };
+
+    // io_uring input
+    constexpr InputReader DEFAULT_INPUT_READER = InputReader::LIBPCAP;
+    constexpr size_t URING_BUFFER_SIZE = 4 * 1024 * 1024;   // bytes of one read
+    constexpr unsigned URING_BUFFERS = 4;                   // reads in flight while the reader parses
+    constexpr size_t URING_ALIGNMENT = 4096;                // O_DIRECT buffer, offset and length alignment
+
     // Processing constraints
     constexpr size_t MAX_CACHED_FLOWS = MAX_FLOWS_PER_PACKET;
     constexpr size_t ETHERNET_HEADER_SIZE = 14;
@@ -47,6 +193,28 @@ namespace Config {
     #else
         constexpr bool ENABLE_DEBUG_LOGGING = false;
     #endif
+
+    // Lowest log level compiled in, 0 debug to 3 error (override with -DP2NPROBE_LOG_LEVEL=n)
+    #ifdef P2NPROBE_LOG_LEVEL
+        constexpr int MIN_LOG_LEVEL = P2NPROBE_LOG_LEVEL;
+    #else
+        constexpr int MIN_LOG_LEVEL = ENABLE_DEBUG_LOGGING ? 0 : 1;
+    #endif
+    constexpr size_t LOG_RING_SIZE = 1024;              // queued messages, power of two
+    constexpr size_t LOG_MESSAGE_SIZE = 256;            // longer messages are truncated
+    constexpr uint32_t LOG_RATE_BURST = 10;             // messages of one call site per window
+    constexpr uint64_t LOG_RATE_WINDOW_MS = 1000;
+    constexpr int LOG_WRITER_IDLE_MS = 50;              // writer wake up period when idle
+
+    // Hot path tracing (cmake -DP2NPROBE_TRACE=ON or make TRACE=1)
+    #ifdef P2NPROBE_TRACE
+        constexpr bool ENABLE_TRACING = true;
+    #else
+        constexpr bool ENABLE_TRACING = false;
+    #endif
+    constexpr uint64_t TRACE_BATCH_SIZE = 1024;         // packets in one batch
+    constexpr uint64_t TRACE_SAMPLE_BATCHES = 64;       // every 64th batch is stored as trace events
+    constexpr size_t TRACE_MAX_EVENTS = 1 << 20;        // trace events kept per thread
 }
 
 #endif // CONFIG_H
@@ -0,0 +1,32 @@
+////////////////////////////////////////////////////
+// File: DatagramSink.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef DATAGRAM_SINK_H
+#define DATAGRAM_SINK_H
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Interface for destinations of encoded export datagrams.
+ * Defines methods that must be implemented by all sinks:
+ *  - send: Delivers one finished datagram
+ *  - path_mtu: Largest datagram (including IP and UDP headers) the sink should receive
+ *  - flush: Pushes out any buffered data, called when the export ends
+ *  - set_capture_time: Capture time of the export, sinks that pace the export use it
+ */
+class DatagramSink {
+public:
+    virtual ~DatagramSink() = default;
+
+    virtual void send(const uint8_t* buffer, size_t buffer_size) = 0;
+    virtual int path_mtu() const = 0;
+    virtual void flush() {}
+    virtual void set_capture_time(uint32_t capture_ms) { (void)capture_ms; }
+};
+
+#endif // DATAGRAM_SINK_H
@@ -0,0 +1,92 @@
+////////////////////////////////////////////////////
+// File: Decompressor.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef DECOMPRESSOR_H
+#define DECOMPRESSOR_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BlockSource.h"
+
+/**
+ * @brief Streaming decompression of a compressed capture on a helper thread.
+ *
+ * The helper thread decompresses into a ring of large blocks while the reader parses the
+ * previous block in place, so decompression overlaps the aggregation and no temporary file
+ * is written.
+ */
+class Decompressor : public BlockSource {
+public:
+    enum class Codec {
+        NONE,
+        GZIP,
+        ZSTD,
+        XZ
+    };
+
+    static Codec detect(const std::string& path);
+    static bool codec_supported(Codec codec);
+    static const char* codec_name(Codec codec);
+
+    Decompressor(const std::string& path, Codec codec);
+    ~Decompressor() override;
+
+    Decompressor(const Decompressor&) = delete;
+    Decompressor& operator=(const Decompressor&) = delete;
+
+    bool start() override;
+    bool failed() const override;
+    std::string error() const override;
+
+protected:
+    bool next_block(const uint8_t*& data, size_t& size) override;
+
+private:
+    struct Block {
+        std::unique_ptr<uint8_t[]> data;
+        size_t size = 0;
+    };
+
+    std::string path;
+    Codec codec;
+    FILE* file = nullptr;
+    std::thread worker;
+
+    // Blocks [released, filled) are decompressed, the consumer holds block released while reading it
+    std::vector<Block> blocks;
+    uint64_t filled = 0;
+    uint64_t released = 0;
+    bool finished = false;
+    bool stopping = false;
+    std::string error_message;
+    mutable std::mutex mutex;
+    std::condition_variable condition;
+
+    bool holding = false;           // Reader holds block released
+
+    // Producer side
+    Block* output_block = nullptr;
+
+    void run();
+    bool fail(const std::string& message);
+    uint8_t* output(size_t& space);
+    void produced(size_t size);
+    void publish();
+
+    bool inflate_gzip();
+    bool decompress_zstd();
+    bool decompress_xz();
+};
+
+#endif // DECOMPRESSOR_H
@@ -0,0 +1,44 @@
+////////////////////////////////////////////////////
+// File: Dedup.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Drops the second copy of a packet seen within a time window, for SPAN and mirror
+ * ports that deliver packets twice.
+ *
+ * Packets are compared by a 64 bit fingerprint of the header fields a mirrored copy keeps
+ * (see PcapReader::fingerprint). The table has a fixed size: BUCKET_WAYS slots of one cache
+ * line per bucket, a slot holds the upper 32 bits of the fingerprint and the capture time of
+ * the first copy. A new packet takes an empty or expired slot of its bucket, otherwise the
+ * oldest one, so a window holding more packets than the table only misses duplicates.
+ */
+class PacketDedup {
+public:
+    PacketDedup(size_t buckets, uint32_t window_ms);
+
+    bool duplicate(uint64_t fingerprint, uint32_t timestamp_ms);
+
+private:
+    static constexpr size_t BUCKET_WAYS = 8;
+
+    struct alignas(64) Bucket {
+        uint32_t tags[BUCKET_WAYS];     // Upper half of the fingerprint, 0 for an empty slot
+        uint32_t times[BUCKET_WAYS];    // Capture time of the first copy in miliseconds
+    };
+
+    std::vector<Bucket> table;
+    size_t mask;
+    uint32_t window_ms;
+};
+
+#endif // DEDUP_H
@@ -12,6 +12,8 @@
 #include <cstdlib>
 #include <iostream>
 
+#include "Logger.h"
+
 /**
  * @brief Error codes that can be returned by the program.
  */
@@ -22,6 +24,7 @@ enum class ErrorCode {
     FILE_OPEN_ERROR = 3,        // Error while opening file
     READING_PACKET_ERROR = 4,   // Error while reading packet
     INVALID_PACKET = 5,         // Invalid packet
+    FILE_WRITE_ERROR = 6,       // Error while writing output file
 };
 
 /**
@@ -29,6 +32,7 @@ enum class ErrorCode {
  * @param code Error code
  */
 inline void ExitWith(ErrorCode code) {
+    Logger::flush(); // Queued log lines are written before the exit message
     if (code != ErrorCode::SUCCESS) {
         std::cerr << "Program terminated with: " << static_cast<int>(code) << "\n";
     }
@@ -10,38 +10,34 @@
 #define EXPORTER_H
 
 #include <vector>
-#include <iostream>
-#include <cstring> 
-#include <arpa/inet.h>
-#include <sys/socket.h>
-#include <sys/types.h>
-#include <unistd.h> 
+#include <memory>
+#include <cstdint>
 
 #include "Flow.h"
-
-constexpr uint16_t VERSION_5 = 5;
+#include "ArgParser.h"
 
 /**
- * @brief Class for establishing connection with collector, exporting flows to collector and formating flows.
+ * @brief Interface for exporter classes.
+ * Defines methods that must be implemented by all exporters:
+ *  - export_flows: Encodes and sends the expired flows
+ *  - max_flows_per_export: How many flows the Probe should batch before calling export_flows
+ *  - flush: Called after the last export, pushes out anything still buffered
+ *  - sequence / set_sequence: Sequence number of the export header, carried over by checkpoints
+ *  - exports_biflows: Whether one record carries both directions of a biflow, otherwise the
+ *    Probe passes the reverse direction as a separate flow
  */
 class Exporter {
 public:
-    Exporter(const std::string& collector_ip, int collector_port);
-    ~Exporter();
-
-    void export_flows(const std::vector<Flow>& flows, uint32_t time_start, uint32_t time_end);
-
-private:
-    int create_socket();
-    void close_socket();
-
-    void send(uint8_t* buffer, size_t buffer_size);
-    void format_header(uint8_t* buffer, uint16_t flow_count, uint32_t time_start, uint32_t time_end);
-    void format_record(NetFlowV5record record, uint8_t* buffer, size_t &offset, uint32_t time_start);
-    
-    uint32_t flow_sequence; // Number of flows exported
-    int sock;
-    struct sockaddr_in server_addr;
+    virtual ~Exporter() = default;
+
+    virtual void export_flows(const std::vector<Flow>& flows, uint32_t time_start, uint32_t time_end) = 0;
+    virtual size_t max_flows_per_export() const = 0;
+    virtual void flush() {}
+    virtual uint32_t sequence() const { return 0; }
+    virtual void set_sequence(uint32_t) {}
+    virtual bool exports_biflows() const { return false; }
+
+    static std::unique_ptr<Exporter> create(const ArgParser& programArguments);
 };
 
 #endif // EXPORTER_H
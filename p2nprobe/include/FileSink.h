@@ -0,0 +1,71 @@
+////////////////////////////////////////////////////
+// File: FileSink.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef FILE_SINK_H
+#define FILE_SINK_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "Config.h"
+#include "DatagramSink.h"
+
+/**
+ * @brief Sink writing export datagrams into a file instead of sending them to a collector.
+ *
+ * Without compression the datagrams are written back to back exactly as they would be sent,
+ * which is self delimiting for NetFlow v5 (count field) and IPFIX (length field).
+ *
+ * With compression the file uses a block container:
+ *  - File header (16 bytes): magic "P2NF", uint16 version (1), uint8 compression, uint8 reserved,
+ *    uint32 block size, uint32 reserved
+ *  - Blocks: uint32 uncompressed size, uint32 stored size, stored bytes.
+ *    Stored size equal to the uncompressed size means the block is stored without compression.
+ *  - Decompressed blocks form one stream of datagrams, each prefixed by its uint16 length.
+ * All integers are in network byte order.
+ *
+ * Output is collected into a large buffer and written in few big write() calls,
+ * optionally with O_DIRECT to bypass the page cache.
+ */
+class FileSink : public DatagramSink {
+public:
+    FileSink(const std::string& path, Config::Compression compression, bool direct_io);
+    ~FileSink() override;
+
+    FileSink(const FileSink&) = delete;
+    FileSink& operator=(const FileSink&) = delete;
+
+    void send(const uint8_t* buffer, size_t buffer_size) override;
+    int path_mtu() const override;
+    void flush() override;
+
+    static bool compression_supported(Config::Compression compression);
+
+private:
+    void open_file();
+    void write_file_header();
+    void append(const uint8_t* data, size_t size);
+    void compress_block();
+    void write_out(bool final);
+
+    std::string path;
+    Config::Compression compression;
+    bool direct_io;
+    int fd;
+
+    uint8_t* write_buffer;          // Aligned buffer collecting data for write()
+    size_t write_used;
+    std::vector<uint8_t> block;     // Uncompressed block waiting for compression
+    std::vector<uint8_t> compressed;
+
+    uint64_t bytes_in;              // Datagram bytes received
+    uint64_t bytes_written;         // Bytes written to the file
+};
+
+#endif // FILE_SINK_H
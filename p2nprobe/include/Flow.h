@@ -15,6 +15,8 @@
 #include "NetFlowV5record.h"
 #include "NetFlowV5header.h"
 
+class RoutingTable;
+
 /**
  * @brief Class representing flow. Primary stores data from agregated packets and updates them.
  */
@@ -23,14 +25,53 @@ public:
     NetFlowV5Key key;
     NetFlowV5record record;
     NetFlowV5header header;
+
+    // 64-bit counters and absolute capture timestamps in milliseconds.
+    // The 32-bit dPkts/dOctets/First/Last in record are kept for NetFlow v5 export.
+    uint64_t packets;
+    uint64_t octets;
+    uint64_t first_ms;
+    uint64_t last_ms;
+
+    /**
+     * @brief Reverse direction of a biflow, packets from the destination to the source of the key.
+     * Fixed layout, the checkpoint stores it as is.
+     */
+    struct Reverse {
+        uint64_t packets;
+        uint64_t octets;
+        uint64_t first_ms;
+        uint64_t last_ms;
+        uint32_t First;
+        uint32_t Last;
+        uint8_t tcp_flags;
+        uint8_t pad[7];
+    };
+    Reverse reverse;
+
+    /**
+     * @brief TCP end of the connection seen in the flow.
+     */
+    enum class Termination : uint8_t {
+        NONE,
+        FIN,    // FIN in both directions, exported after the linger
+        RST
+    };
+    Termination termination;
+    uint32_t end_time;      // Time the terminated flow is exported at
     
-    Flow(NetFlowV5Key key, NetFlowV5record record);
+    Flow(NetFlowV5Key key, NetFlowV5record record, uint64_t timestamp_ms);
     ~Flow() = default;
     
     Flow(const Flow& other) = default;
     Flow& operator=(const Flow& other) = default;  
 
-    void update(uint8_t tcp_flags, uint32_t num_layer_3_bytes, uint32_t timestamp);
+    void update(uint8_t tcp_flags, uint32_t num_layer_3_bytes, uint64_t timestamp_ms);
+    void update_reverse(uint8_t tcp_flags, uint32_t num_layer_3_bytes, uint64_t timestamp_ms);
+    bool has_reverse() const { return reverse.packets != 0; }
+    Flow reversed(const RoutingTable* routes = nullptr) const;
+    void terminate(Termination reason, uint32_t time);
+    bool terminated(uint32_t current_time) const;
     bool active_expired(uint32_t current_time, uint32_t active_timeout) const;
     bool inactive_expired(uint32_t current_time, uint32_t inactive_timeout) const;
 
@@ -8,63 +8,63 @@
 #ifndef FLOW_MANAGER_H
 #define FLOW_MANAGER_H
 
-#include <list>
-#include <unordered_map>
+#include <memory>
 #include <vector>
 #include <string>
 #include "Flow.h"
 #include "ArgParser.h"
 #include "Exporter.h"
 #include "PcapReader.h"
-#include "NetFlowV5Key.h"
-#include "NetFlowV5record.h"
-
-// Maxed flows that can be cached is set to 30 by specification.
-// https://www.cisco.com/c/en/us/td/docs/net_mgmt/netflow_collection_engine/3-6/user/guide/format.html#wp1006108
-constexpr unsigned int MAX_CACHED_FLOWS = 30;
+#include "ParallelProcessor.h"
+#include "Probe.h"
+#include "Rollup.h"
+#include "RoutingTable.h"
+#include "Sketches.h"
 
 /**
- * @brief Main class that gets packets from the PcapReader, processes the packets, and exports them using Exporter.
+ * @brief Command line side of the probe: reads the pcap file into the Probe, which decodes, aggregates
+ * and exports the packets, and adds what only the command line tool has: sketches, rollups,
+ * checkpoints and the parallel run.
  */
 class FlowManager {
 public:
-    // List of flows for buffering them in order they were read from the pcap file.
-    using FlowList = std::list<Flow>;
-
     FlowManager(ArgParser programArguments);
     ~FlowManager();
 
-    void add_or_update_flow(NetFlowV5record new_record);
-
-    void cache_expired(uint32_t current_time);
-    void export_cached();
     void export_remaining();
     void dispose();
     int startProcessing();
+    int processParallel(ParallelProcessor& processor);
+
+    void resume(const std::string& path);
+    void save_checkpoint(const std::string& path);
+
+    uint32_t get_flow_count() const;
+    uint32_t get_flows_exported() const;
 
 private:
-    uint32_t flow_count = 0; // current number of flows
-    uint32_t flows_exported = 0; // total number of flows exported from device start
-    Exporter exporter;  // Exporter object for exporting expired flows to collector
+    uint32_t parallel_flow_count = 0; // number of flows created by the parallel run, the probe counts the others
     PcapReader reader;  // PcapReader object for reading packets from pcap file. 
 
     int active_timeout_ms; // Active timeout expires, while there are still packets flowing to the flow, but the time exceeds the set timeout
     int inactive_timeout_ms; // Inactive timeout expires, when there is too much time between reciving next packet to the flow
 
-    bool time_start_set; // Wheter the start time was already set
-    uint32_t time_start; // Time of start of the device
-    uint32_t time_end; // Last time of the divice
-
-    // Vector to store flows waiting to be exported
-    std::vector<Flow> cached_flows;
-
-    // Double linked list to store flows in the order of arrival and fast addition or removal of flows
-    FlowList flow_list;
+    Config::ExportFormat export_format; // Format stored in the checkpoint, sequence numbers differ between formats
+    std::string checkpoint_path; // Flows left at the end are saved here instead of being exported, empty to export them
+    std::string pcap_path; // Path of the pcap file for the parallel run
+    int threads; // Number of aggregation threads
+    bool biflow; // Both directions of a connection share one flow
+    std::shared_ptr<Sketches> sketches; // Top talkers and distinct hosts, null when disabled
+    std::unique_ptr<Rollup> rollup; // Second aggregation stage of the expired flows, null when disabled
+    std::vector<Flow> rolled_up; // Finished rollup bins waiting to be passed to the probe
+    std::shared_ptr<const RoutingTable> routes; // Fills the AS numbers, masks and nexthop of new flows, null when disabled
 
-    // Hash table for finding flows fast based on their key, pointing to the list entries in double linked list
-    std::unordered_map<std::string, FlowList::iterator> flow_map;
+    // Decodes, aggregates and exports the packets with the policies selected by the program arguments
+    Probe probe;
+    Exporter* exporter; // Exporter owned by the probe, for the sequence number of the checkpoint
 
-    uint32_t getCurrentTime();
+    void roll_up(const Flow& flow);
+    void export_rolled_up();
 };
 
 #endif // FLOW_MANAGER_H
@@ -0,0 +1,90 @@
+////////////////////////////////////////////////////
+// File: FlowPolicies.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef FLOW_POLICIES_H
+#define FLOW_POLICIES_H
+
+#include <list>
+#include <unordered_map>
+
+#include "Flow.h"
+#include "NetFlowV5Key.h"
+
+/**
+ * @brief Compile time policies of the aggregation core. The Probe picks the policies from its
+ * options once and runs the packet loop instantiated for them, so the key mapping and
+ * the expiry checks of every packet are resolved without runtime dispatch.
+ *
+ * A key policy defines the Key type stored in the flow table, its Hash and make(), which maps the
+ * key of a packet to the table key. BIFLOW tells whether both directions share the flow.
+ * An expiry policy defines TCP_END, whether flows also end on RST or FIN before their timeouts.
+ */
+
+/**
+ * @brief Unidirectional flows keyed by the 5-tuple of the packet.
+ */
+struct FiveTupleKey {
+    using Key = NetFlowV5Key;
+    using Hash = NetFlowV5Key::Hash;
+    static constexpr bool BIFLOW = false;
+
+    static Key make(const NetFlowV5Key& key) { return key; }
+};
+
+/**
+ * @brief Biflows, both directions of a connection map to the canonical 5-tuple.
+ */
+struct BiflowKey {
+    using Key = NetFlowV5Key;
+    using Hash = NetFlowV5Key::Hash;
+    static constexpr bool BIFLOW = true;
+
+    static Key make(const NetFlowV5Key& key) { return key.canonical(); }
+};
+
+/**
+ * @brief Flows end only by the active and inactive timeouts.
+ */
+struct TimeoutExpiry {
+    static constexpr bool TCP_END = false;
+};
+
+/**
+ * @brief Flows also end after RST or FIN in both directions.
+ */
+struct TcpEndExpiry {
+    static constexpr bool TCP_END = true;
+};
+
+/**
+ * @brief Hash table finding the flows of the flow list by the key of the policy.
+ */
+template <class KeyPolicy>
+class FlowIndex {
+public:
+    using Policy = KeyPolicy;
+    using FlowList = std::list<Flow>;
+
+    /**
+     * @brief Flow of the packet key.
+     *
+     * @return Position of the flow in the flow list, nullptr if the key has no flow
+     */
+    FlowList::iterator* find(const NetFlowV5Key& key) {
+        auto it = map.find(KeyPolicy::make(key));
+        return it == map.end() ? nullptr : &it->second;
+    }
+
+    void insert(const NetFlowV5Key& key, FlowList::iterator flow) { map[KeyPolicy::make(key)] = flow; }
+    void erase(const NetFlowV5Key& key) { map.erase(KeyPolicy::make(key)); }
+    void clear() { map.clear(); }
+
+private:
+    std::unordered_map<typename KeyPolicy::Key, FlowList::iterator, typename KeyPolicy::Hash> map;
+};
+
+#endif // FLOW_POLICIES_H
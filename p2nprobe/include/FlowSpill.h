@@ -0,0 +1,101 @@
+////////////////////////////////////////////////////
+// File: FlowSpill.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef FLOW_SPILL_H
+#define FLOW_SPILL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Flow.h"
+#include "NetFlowV5Key.h"
+
+/**
+ * @brief Cold flows of the flow table moved out of the heap into a memory mapped file, for captures
+ * with more concurrent flows than fit into memory.
+ *
+ * The file is an array of fixed size slots (the table key, the expiry deadline and the Flow as is),
+ * it is removed right after it is created and grows by doubling. In memory every flow only takes
+ * an 8 byte index entry (low half of the key hash and the slot) in an open addressing table that
+ * is at most half full, and an 8 byte entry of a min-heap of deadlines. A flow is not changed while
+ * it is in the file, so its deadline stays valid until the flow is taken out; heap entries of
+ * flows taken out earlier are skipped when they reach the top.
+ *
+ * Deadlines are compared as 32 bit times in miliseconds like the timeouts of Flow, so all
+ * deadlines have to lie within 24 days of each other.
+ *
+ * Every put and take, including the drain at the end of the input, counts the slots it touches and
+ * the whole mapping is released from the resident set after SPILL_RELEASE_INTERVAL of them, so the
+ * file adds at most that many pages to the resident set. The index and the heap stay in memory,
+ * and taking all flows out for a checkpoint brings them back into the flow list.
+ */
+class FlowSpill {
+public:
+    explicit FlowSpill(const std::string& path);
+    ~FlowSpill();
+
+    FlowSpill(const FlowSpill&) = delete;
+    FlowSpill& operator=(const FlowSpill&) = delete;
+
+    void put(const NetFlowV5Key& table_key, const Flow& flow, uint32_t deadline);
+    std::optional<Flow> take(const NetFlowV5Key& table_key);
+    std::optional<Flow> take_expired(uint32_t current_time);
+    std::optional<Flow> take_next();
+    size_t size() const { return stored; }
+    void clear();
+
+private:
+    /**
+     * @brief Start of a slot in the file, the Flow follows it.
+     */
+    struct SlotHeader {
+        NetFlowV5Key table_key;
+        uint32_t deadline;
+        uint32_t used;
+    };
+
+    /**
+     * @brief Entry of the deadline heap.
+     */
+    struct Deadline {
+        uint32_t time;
+        uint32_t slot;
+    };
+
+    std::string path;
+    int fd;
+    uint8_t* mapping;
+    size_t slot_count;
+    size_t slot_size;
+    size_t next_slot;               // Slots from here on were never used
+    std::vector<uint32_t> free_slots;
+    size_t stored;
+    size_t accesses_since_release;  // Slots read or written since the resident pages were released
+
+    std::vector<uint64_t> index;    // Low half of the key hash << 32 | slot + 1, 0 for an empty entry
+    std::vector<Deadline> deadlines; // Min-heap by time
+
+    SlotHeader* header_of(uint32_t slot) { return reinterpret_cast<SlotHeader*>(mapping + slot * slot_size); }
+    uint8_t* flow_of(uint32_t slot) { return mapping + slot * slot_size + sizeof(SlotHeader); }
+    static uint32_t hash_of(const NetFlowV5Key& table_key) { return static_cast<uint32_t>(NetFlowV5Key::Hash()(table_key)); }
+
+    std::optional<Flow> take_earliest(bool check_time, uint32_t current_time);
+    void count_access();
+    void map_slots(size_t count);
+    uint32_t allocate_slot();
+    Flow release_slot(uint32_t slot);
+    void index_insert(uint32_t hash, uint32_t slot);
+    void index_erase(size_t position);
+    void index_grow();
+    void push_deadline(uint32_t time, uint32_t slot);
+    Deadline pop_deadline();
+};
+
+#endif // FLOW_SPILL_H
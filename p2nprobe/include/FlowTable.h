@@ -0,0 +1,435 @@
+////////////////////////////////////////////////////
+// File: FlowTable.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef FLOW_TABLE_H
+#define FLOW_TABLE_H
+
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <variant>
+#include <netinet/tcp.h>
+
+#include "Flow.h"
+#include "FlowSpill.h"
+#include "FlowPolicies.h"
+#include "Metrics.h"
+#include "NetFlowV5Key.h"
+#include "NetFlowV5record.h"
+#include "ProbationTable.h"
+#include "RoutingTable.h"
+#include "Trace.h"
+
+/**
+ * @brief Expiry of the flows and the fields filled at their creation.
+ */
+struct FlowTableSettings {
+    uint32_t active_timeout_ms = 0;
+    uint32_t inactive_timeout_ms = 0;
+    uint32_t fin_linger_ms = 0;             // Time a flow stays after the second FIN, TcpEndExpiry only
+    const RoutingTable* routes = nullptr;   // Fills the routing fields of new flows, null to keep them zero
+    bool admission = false;                 // New flows wait in the probation table until their second packet
+    FlowSpill* spill = nullptr;             // Takes the coldest flows above hot_flows, null to keep all flows in memory
+    size_t hot_flows = 0;
+};
+
+/**
+ * @brief Aggregation core: the flows of decoded packets and their expiry, without reading or exporting.
+ *
+ * Flows are kept in a list in the order of their creation, the index of the key policy finds them
+ * by key. Expired flows are passed to a sink given by the caller, the sink is a template parameter
+ * so the packet loop is compiled together with it. Used through the Probe by the command line tool and the library.
+ *
+ * With admission, the first packet of a flow goes into the probation table instead and the flow is
+ * moved into the list by its second packet. Flows that never get one are passed to the sink from the
+ * probation table as one packet flows, so the exported flows are the same, only their order differs.
+ * With TcpEndExpiry packets with FIN or RST create full flows at once.
+ *
+ * With a spill file the list is kept in the order of use instead, and the least recently used flows
+ * above hot_flows are moved into the file. A packet of such a flow pages it back into the list, flows
+ * of the file expire by their deadlines without being read.
+ */
+template <class KeyPolicy, class Expiry>
+class FlowTable {
+public:
+    using FlowList = std::list<Flow>;
+
+    explicit FlowTable(const FlowTableSettings& settings) : settings(settings) {}
+
+    bool add(NetFlowV5record record, uint64_t timestamp_ms);
+    template <class Sink>
+    void expire(uint32_t current_time, Sink&& sink);
+    template <class Sink>
+    void expire_all(Sink&& sink);
+
+    FlowList& flows();
+    size_t size() const { return flow_list.size() + probation.size() + (settings.spill != nullptr ? settings.spill->size() : 0); }
+    void reindex();
+    void clear();
+
+private:
+    FlowTableSettings settings;
+
+    // Double linked list to store flows in the order of arrival and fast addition or removal of flows
+    FlowList flow_list;
+
+    // Hash table for finding flows fast based on their key, pointing to the list entries in double linked list
+    FlowIndex<KeyPolicy> flow_map;
+
+    // Flows of a single packet, empty without admission
+    ProbationTable<KeyPolicy> probation;
+
+    Flow& promote(const typename ProbationTable<KeyPolicy>::Entry& entry);
+    Flow* page_in(const NetFlowV5Key& key);
+    void spill_cold();
+    uint32_t deadline_of(const Flow& flow) const;
+    void count_expiry(const Flow& flow, uint32_t current_time) const;
+    void check_termination(Flow& flow, const NetFlowV5Key& key, uint8_t tcp_flags, uint32_t time);
+};
+
+// Flow table of the policies selected at runtime, the Probe visits it once per run or batch
+using AnyFlowTable = std::variant<FlowTable<FiveTupleKey, TimeoutExpiry>, FlowTable<FiveTupleKey, TcpEndExpiry>,
+                                  FlowTable<BiflowKey, TimeoutExpiry>, FlowTable<BiflowKey, TcpEndExpiry>>;
+
+AnyFlowTable make_flow_table(bool biflow, bool tcp_end, const FlowTableSettings& settings);
+
+/**
+ * @brief Tries to find a flow by comparing their keys, if the flow is found, updates it.
+ * If not, new flow is created.
+ *
+ * @param record Processed packet from pcap file into a NetFlowV5record struct.
+ * @param timestamp_ms Absolute capture timestamp of the packet in miliseconds.
+ *
+ * @return true if a new flow was created
+ */
+template <class KeyPolicy, class Expiry>
+bool FlowTable<KeyPolicy, Expiry>::add(NetFlowV5record record, uint64_t timestamp_ms) {
+    // Key for comparing the flows.
+    NetFlowV5Key key(record);
+    FlowList::iterator* found;
+    {
+        TRACE_SCOPE(LOOKUP);
+        found = flow_map.find(key); // Get the pointer to the flow by searching in hash map
+    }
+    Flow* existing = nullptr;
+    if (found != nullptr) {
+        existing = &**found; // found points to the entry in the list
+        if (settings.spill != nullptr) {
+            flow_list.splice(flow_list.end(), flow_list, *found); // Coldest flow stays at the front
+        }
+    }
+    else if (settings.spill != nullptr) {
+        existing = page_in(key);
+    }
+    if (existing == nullptr && settings.admission) {
+        typename ProbationTable<KeyPolicy>::Entry first;
+        if (probation.take(key, first)) {
+            existing = &promote(first); // Second packet of the flow
+        }
+        else if ((!Expiry::TCP_END || (record.tcp_flags & (TH_FIN | TH_RST)) == 0) && record.dPkts != 0) {
+            Metrics::add(Metrics::Counter::FLOWS_CREATED);
+            record.First = record.Last;
+            if (settings.routes != nullptr) {
+                settings.routes->fill(record);
+            }
+            probation.insert(record, timestamp_ms);
+            return true;
+        }
+    }
+    if (existing != nullptr) {
+        // Flow exists, update the existing flow in the list. Biflows keep the direction of their first packet.
+        Flow& flow = *existing;
+        if (KeyPolicy::BIFLOW && !(flow.key == key)) {
+            flow.update_reverse(record.tcp_flags, record.dOctets, timestamp_ms);
+        }
+        else {
+            flow.update(record.tcp_flags, record.dOctets, timestamp_ms);
+        }
+        if constexpr (Expiry::TCP_END) {
+            check_termination(flow, key, record.tcp_flags, record.Last);
+        }
+        if (settings.spill != nullptr) {
+            spill_cold();
+        }
+        return false;
+    }
+
+    // New flow, add it to the list and map
+    Metrics::add(Metrics::Counter::FLOWS_CREATED);
+    record.First = record.Last;
+    if (settings.routes != nullptr) {
+        settings.routes->fill(record); // Looked up once per flow, later packets only update the counters
+    }
+    flow_list.push_back(Flow(key, record, timestamp_ms));
+    FlowList::iterator list_it = --flow_list.end();
+    flow_map.insert(key, list_it);
+    if constexpr (Expiry::TCP_END) {
+        check_termination(*list_it, key, record.tcp_flags, record.Last);
+    }
+    if (settings.spill != nullptr) {
+        spill_cold();
+    }
+    return true;
+}
+
+/**
+ * @brief Moves a flow of the probation table into the flow list.
+ *
+ * @param entry First packet of the flow
+ *
+ * @return The flow in the list
+ */
+template <class KeyPolicy, class Expiry>
+Flow& FlowTable<KeyPolicy, Expiry>::promote(const typename ProbationTable<KeyPolicy>::Entry& entry) {
+    Metrics::add(Metrics::Counter::FLOWS_PROMOTED);
+    NetFlowV5Key key(entry.record);
+    flow_list.push_back(Flow(key, entry.record, entry.timestamp_ms));
+    FlowList::iterator list_it = --flow_list.end();
+    flow_map.insert(key, list_it);
+    return *list_it;
+}
+
+/**
+ * @brief Moves the flow of the key from the spill file back into the list, as the most recently used one.
+ *
+ * @param key Key of the packet
+ *
+ * @return The flow in the list, nullptr if the key has no flow in the file
+ */
+template <class KeyPolicy, class Expiry>
+Flow* FlowTable<KeyPolicy, Expiry>::page_in(const NetFlowV5Key& key) {
+    std::optional<Flow> spilled = settings.spill->take(KeyPolicy::make(key));
+    if (!spilled) {
+        return nullptr;
+    }
+    Metrics::add(Metrics::Counter::FLOWS_PAGED_IN);
+    flow_list.push_back(*spilled);
+    FlowList::iterator list_it = --flow_list.end();
+    flow_map.insert(list_it->key, list_it);
+    return &*list_it;
+}
+
+/**
+ * @brief Moves the least recently used flows into the spill file until the list holds hot_flows flows.
+ */
+template <class KeyPolicy, class Expiry>
+void FlowTable<KeyPolicy, Expiry>::spill_cold() {
+    while (flow_list.size() > settings.hot_flows) {
+        const Flow& flow = flow_list.front();
+        settings.spill->put(KeyPolicy::make(flow.key), flow, deadline_of(flow));
+        flow_map.erase(flow.key);
+        flow_list.pop_front();
+        Metrics::add(Metrics::Counter::FLOWS_SPILLED);
+    }
+}
+
+/**
+ * @brief Earliest time the flow expires at without further packets: the active timeout, the inactive
+ * timeout of the later direction or the end of a terminated flow. Compared like in Flow, with wrap around.
+ *
+ * @param flow Flow to check
+ */
+template <class KeyPolicy, class Expiry>
+uint32_t FlowTable<KeyPolicy, Expiry>::deadline_of(const Flow& flow) const {
+    uint32_t deadline = flow.record.First + settings.active_timeout_ms;
+    uint32_t last = flow.record.Last;
+    if (flow.reverse.packets != 0 && static_cast<int32_t>(flow.reverse.Last - last) > 0) {
+        last = flow.reverse.Last;
+    }
+    if (static_cast<int32_t>(last + settings.inactive_timeout_ms - deadline) < 0) {
+        deadline = last + settings.inactive_timeout_ms;
+    }
+    if (Expiry::TCP_END && flow.termination != Flow::Termination::NONE && static_cast<int32_t>(flow.end_time - deadline) < 0) {
+        deadline = flow.end_time;
+    }
+    return deadline;
+}
+
+/**
+ * @brief Counts the reason of the expiry of the flow.
+ *
+ * @param flow Expired flow
+ * @param current_time Time the flow expired at
+ */
+template <class KeyPolicy, class Expiry>
+void FlowTable<KeyPolicy, Expiry>::count_expiry(const Flow& flow, uint32_t current_time) const {
+    if (Expiry::TCP_END && flow.terminated(current_time)) {
+        Metrics::add(flow.termination == Flow::Termination::RST ? Metrics::Counter::FLOWS_ENDED_RST
+                                                                : Metrics::Counter::FLOWS_ENDED_FIN);
+    }
+    else {
+        Metrics::add(flow.active_expired(current_time, settings.active_timeout_ms) ? Metrics::Counter::FLOWS_EXPIRED_ACTIVE
+                                                                                   : Metrics::Counter::FLOWS_EXPIRED_INACTIVE);
+    }
+}
+
+/**
+ * @brief Marks the flow of the packet as ended when the packet closes the TCP connection.
+ * A RST ends the connection at once, FIN ends it when both directions sent one and the linger passes.
+ * Without biflows the opposite direction is a separate flow, so it is looked up and ended as well.
+ *
+ * @param flow Flow the packet was aggregated to
+ * @param key Key of the packet
+ * @param tcp_flags TCP flags of the packet
+ * @param time Timestamp of the packet
+ */
+template <class KeyPolicy, class Expiry>
+void FlowTable<KeyPolicy, Expiry>::check_termination(Flow& flow, const NetFlowV5Key& key, uint8_t tcp_flags, uint32_t time) {
+    if ((tcp_flags & (TH_FIN | TH_RST)) == 0) {
+        return;
+    }
+
+    Flow* opposite = nullptr;
+    if (!KeyPolicy::BIFLOW) {
+        FlowList::iterator* found = flow_map.find(key.reversed());
+        typename ProbationTable<KeyPolicy>::Entry first;
+        if (found != nullptr) {
+            opposite = &**found;
+        }
+        else if (settings.spill != nullptr) {
+            opposite = page_in(key.reversed());
+        }
+        if (opposite == nullptr && settings.admission && (tcp_flags & TH_RST) && probation.take(key.reversed(), first)) {
+            opposite = &promote(first); // Ended by the RST as well
+        }
+    }
+
+    if (tcp_flags & TH_RST) {
+        flow.terminate(Flow::Termination::RST, time);
+        if (opposite != nullptr) {
+            opposite->terminate(Flow::Termination::RST, time);
+        }
+        return;
+    }
+
+    bool fin_both = KeyPolicy::BIFLOW ? (flow.record.tcp_flags & TH_FIN) && (flow.reverse.tcp_flags & TH_FIN)
+                                      : opposite != nullptr && (opposite->record.tcp_flags & TH_FIN);
+    if (fin_both) {
+        flow.terminate(Flow::Termination::FIN, time + settings.fin_linger_ms);
+        if (opposite != nullptr) {
+            opposite->terminate(Flow::Termination::FIN, time + settings.fin_linger_ms);
+        }
+    }
+}
+
+/**
+ * @brief Iterates over current flows and check wheter the flows are expired. Expired flows are
+ * passed to the sink and removed.
+ * Iterating through list in cpp while removing some entries inspired from:
+ * https://stackoverflow.com/a/1604632
+ *
+ * @param current_time Time that will be the packes compared to.
+ * @param sink Called with each expired flow before it is removed
+ */
+template <class KeyPolicy, class Expiry>
+template <class Sink>
+void FlowTable<KeyPolicy, Expiry>::expire(uint32_t current_time, Sink&& sink) {
+    for (auto it = flow_list.begin(); it != flow_list.end(); ) {
+        // If flow ended by TCP or exceeds active or inactive timeout, pass it to the sink.
+        bool ended = Expiry::TCP_END && it->terminated(current_time);
+        bool active_expired = !ended && it->active_expired(current_time, settings.active_timeout_ms);
+        if (ended || active_expired || it->inactive_expired(current_time, settings.inactive_timeout_ms)) {
+            count_expiry(*it, current_time);
+            sink(*it);
+
+            flow_map.erase(it->key);
+            it = flow_list.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    // One packet flows expire after the shorter timeout, in the order they were admitted
+    while (const auto* entry = probation.front()) {
+        bool active_expired = (current_time - entry->record.First) >= settings.active_timeout_ms;
+        if (!active_expired && (current_time - entry->record.Last) < settings.inactive_timeout_ms) {
+            break;
+        }
+        Metrics::add(active_expired ? Metrics::Counter::FLOWS_EXPIRED_ACTIVE : Metrics::Counter::FLOWS_EXPIRED_INACTIVE);
+        sink(Flow(NetFlowV5Key(entry->record), entry->record, entry->timestamp_ms));
+        probation.pop_front();
+    }
+
+    // Flows of the spill file are read only when their deadline passed
+    if (settings.spill != nullptr) {
+        while (std::optional<Flow> flow = settings.spill->take_expired(current_time)) {
+            count_expiry(*flow, current_time);
+            sink(*flow);
+        }
+    }
+}
+
+/**
+ * @brief Passes all flows to the sink in the order of their creation and empties the table,
+ * used when the input ended.
+ *
+ * @param sink Called with each flow
+ */
+template <class KeyPolicy, class Expiry>
+template <class Sink>
+void FlowTable<KeyPolicy, Expiry>::expire_all(Sink&& sink) {
+    Metrics::add(Metrics::Counter::FLOWS_EXPIRED_FORCED, size());
+    for (const Flow& flow : flow_list) {
+        sink(flow);
+    }
+    probation.for_each([&sink](const typename ProbationTable<KeyPolicy>::Entry& entry) {
+        sink(Flow(NetFlowV5Key(entry.record), entry.record, entry.timestamp_ms));
+    });
+    if (settings.spill != nullptr) {
+        while (std::optional<Flow> flow = settings.spill->take_next()) {
+            sink(*flow);
+        }
+    }
+    clear();
+}
+
+/**
+ * @brief Flows of the table in the list, for the checkpoint and the parallel run. Flows of the
+ * probation table and the spill file are moved into the list first.
+ */
+template <class KeyPolicy, class Expiry>
+typename FlowTable<KeyPolicy, Expiry>::FlowList& FlowTable<KeyPolicy, Expiry>::flows() {
+    while (const auto* entry = probation.front()) {
+        flow_list.push_back(Flow(NetFlowV5Key(entry->record), entry->record, entry->timestamp_ms));
+        flow_map.insert(flow_list.back().key, --flow_list.end());
+        probation.pop_front();
+    }
+    if (settings.spill != nullptr) {
+        while (std::optional<Flow> flow = settings.spill->take_next()) {
+            flow_list.push_back(*flow);
+            flow_map.insert(flow_list.back().key, --flow_list.end());
+        }
+    }
+    return flow_list;
+}
+
+/**
+ * @brief Rebuilds the hash table after flows were put into the list directly (checkpoint, parallel run).
+ */
+template <class KeyPolicy, class Expiry>
+void FlowTable<KeyPolicy, Expiry>::reindex() {
+    flow_map.clear();
+    for (auto it = flow_list.begin(); it != flow_list.end(); ++it) {
+        flow_map.insert(it->key, it);
+    }
+}
+
+/**
+ * @brief Removes all flows.
+ */
+template <class KeyPolicy, class Expiry>
+void FlowTable<KeyPolicy, Expiry>::clear() {
+    flow_map.clear();
+    flow_list.clear();
+    probation.clear();
+    if (settings.spill != nullptr) {
+        settings.spill->clear();
+    }
+}
+
+#endif // FLOW_TABLE_H
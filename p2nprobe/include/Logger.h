@@ -8,14 +8,24 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
-#include <iostream>
-#include <iomanip>
-#include <chrono>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
 #include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
 #include "Config.h"
 
 /**
- * @brief Simple logging utility for debugging and monitoring
+ * @brief Asynchronous logging utility for debugging and monitoring
+ *
+ * Messages are formatted on the stack of the calling thread and pushed into a lock-free
+ * ring buffer, a background thread adds the timestamp and writes them out. When the ring
+ * is full the message is dropped and counted instead of blocking the caller.
+ * Levels below Config::MIN_LOG_LEVEL are removed at compile time and every LOG_* call site
+ * is limited to Config::LOG_RATE_BURST messages per Config::LOG_RATE_WINDOW_MS.
  */
 class Logger {
 public:
@@ -26,12 +36,122 @@ public:
         ERROR = 3
     };
 
+    /**
+     * @brief Whether the level is compiled in.
+     */
+    static constexpr bool enabled(Level level) {
+        return static_cast<int>(level) >= Config::MIN_LOG_LEVEL;
+    }
+
+    /**
+     * @brief Message limit of one call site. Constant initialized, so a static instance has no guard.
+     */
+    class RateLimit {
+    public:
+        constexpr RateLimit() = default;
+
+        /**
+         * @brief Counts the message against the current window.
+         *
+         * @param now_ms Current time in miliseconds
+         * @param suppressed Set to the number of messages suppressed since the last allowed one
+         *
+         * @return true if the message should be logged
+         */
+        bool allow(uint64_t now_ms, uint32_t& suppressed) {
+            uint64_t start = window_start_ms.load(std::memory_order_relaxed);
+            if (now_ms - start >= Config::LOG_RATE_WINDOW_MS &&
+                window_start_ms.compare_exchange_strong(start, now_ms, std::memory_order_relaxed)) {
+                count.store(0, std::memory_order_relaxed);
+            }
+            if (count.fetch_add(1, std::memory_order_relaxed) < Config::LOG_RATE_BURST) {
+                suppressed = dropped.exchange(0, std::memory_order_relaxed);
+                return true;
+            }
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+    private:
+        std::atomic<uint64_t> window_start_ms{0};
+        std::atomic<uint32_t> count{0};
+        std::atomic<uint32_t> dropped{0};
+    };
+
+    /**
+     * @brief Fixed size message buffer, longer messages are truncated.
+     */
+    class Line {
+    public:
+        template<typename T>
+        void append(const T& value) {
+            if constexpr (std::is_same_v<T, bool>) {
+                append_text(value ? "true" : "false");
+            }
+            else if constexpr (std::is_same_v<T, char>) {
+                append_text(std::string_view(&value, 1));
+            }
+            else if constexpr (std::is_integral_v<T>) {
+                char digits[24];
+                auto result = std::to_chars(digits, digits + sizeof(digits), value);
+                append_text(std::string_view(digits, result.ptr - digits));
+            }
+            else if constexpr (std::is_floating_point_v<T>) {
+                char digits[32];
+                int length = std::snprintf(digits, sizeof(digits), "%g", static_cast<double>(value));
+                append_text(std::string_view(digits, length > 0 ? length : 0));
+            }
+            else if constexpr (std::is_enum_v<T>) {
+                append(static_cast<std::underlying_type_t<T>>(value));
+            }
+            else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+                append_text(std::string_view(value));
+            }
+            else {
+                // Rare types without a fast path go through a stream
+                std::ostringstream oss;
+                oss << value;
+                append_text(oss.str());
+            }
+        }
+
+        void append_text(std::string_view text) {
+            size_t space = Config::LOG_MESSAGE_SIZE - length;
+            size_t count = text.size() < space ? text.size() : space;
+            text.copy(buffer + length, count);
+            length += count;
+        }
+
+        const char* data() const { return buffer; }
+        size_t size() const { return length; }
+
+    private:
+        char buffer[Config::LOG_MESSAGE_SIZE];
+        size_t length = 0;
+    };
+
+    /**
+     * @brief Formats the message and queues it for the writer thread.
+     */
+    template<typename... Args>
+    static void write(Level level, RateLimit& limit, Args&&... args) {
+        uint64_t now_ns = clock_ns();
+        uint32_t suppressed = 0;
+        if (!limit.allow(now_ns / 1000000, suppressed)) {
+            return;
+        }
+
+        Line line;
+        (line.append(args), ...);
+        submit(level, now_ns, suppressed, line);
+    }
+
     /**
      * @brief Log a debug message (only in debug builds)
      */
     template<typename... Args>
     static void debug(Args&&... args) {
-        if constexpr (Config::ENABLE_DEBUG_LOGGING) {
+        if constexpr (enabled(Level::DEBUG_LEVEL)) {
             log(Level::DEBUG_LEVEL, std::forward<Args>(args)...);
         }
     }
@@ -41,7 +161,9 @@ public:
      */
     template<typename... Args>
     static void info(Args&&... args) {
-        log(Level::INFO, std::forward<Args>(args)...);
+        if constexpr (enabled(Level::INFO)) {
+            log(Level::INFO, std::forward<Args>(args)...);
+        }
     }
 
     /**
@@ -49,7 +171,9 @@ public:
      */
     template<typename... Args>
     static void warning(Args&&... args) {
-        log(Level::WARNING, std::forward<Args>(args)...);
+        if constexpr (enabled(Level::WARNING)) {
+            log(Level::WARNING, std::forward<Args>(args)...);
+        }
     }
 
     /**
@@ -57,50 +181,40 @@ public:
      */
     template<typename... Args>
     static void error(Args&&... args) {
-        log(Level::ERROR, std::forward<Args>(args)...);
+        if constexpr (enabled(Level::ERROR)) {
+            log(Level::ERROR, std::forward<Args>(args)...);
+        }
     }
 
+    static void flush();
+
 private:
     /**
-     * @brief Internal logging function
+     * @brief Log without rate limit, used by the direct calls of the level methods
      */
     template<typename... Args>
     static void log(Level level, Args&&... args) {
-        auto now = std::chrono::system_clock::now();
-        auto time_t = std::chrono::system_clock::to_time_t(now);
-        auto tm = *std::localtime(&time_t);
-
-        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-            now.time_since_epoch()) % 1000;
-
-        std::ostream& stream = (level >= Level::WARNING) ? std::cerr : std::cout;
-
-        stream << "[" << std::put_time(&tm, "%Y-%m-%d %H:%M:%S")
-               << "." << std::setfill('0') << std::setw(3) << ms.count()
-               << "] [" << levelToString(level) << "] ";
-
-        ((stream << std::forward<Args>(args)), ...);
-        stream << std::endl;
+        Line line;
+        (line.append(args), ...);
+        submit(level, clock_ns(), 0, line);
     }
 
-    /**
-     * @brief Convert log level to string
-     */
-    static const char* levelToString(Level level) {
-        switch (level) {
-            case Level::DEBUG_LEVEL: return "DEBUG";
-            case Level::INFO:        return "INFO ";
-            case Level::WARNING:     return "WARN ";
-            case Level::ERROR:       return "ERROR";
-            default:                return "UNKNOWN";
-        }
-    }
+    static uint64_t clock_ns();
+    static void submit(Level level, uint64_t time_ns, uint32_t suppressed, const Line& line);
 };
 
-// Convenience macros for cleaner code
-#define LOG_DEBUG(...) Logger::debug(__VA_ARGS__)
-#define LOG_INFO(...) Logger::info(__VA_ARGS__)
-#define LOG_WARNING(...) Logger::warning(__VA_ARGS__)
-#define LOG_ERROR(...) Logger::error(__VA_ARGS__)
+// Convenience macros for cleaner code, every call site has its own rate limit
+#define LOG_AT(level, ...) \
+    do { \
+        if constexpr (Logger::enabled(level)) { \
+            static Logger::RateLimit log_rate_limit; \
+            Logger::write(level, log_rate_limit, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_DEBUG(...) LOG_AT(Logger::Level::DEBUG_LEVEL, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(Logger::Level::INFO, __VA_ARGS__)
+#define LOG_WARNING(...) LOG_AT(Logger::Level::WARNING, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(Logger::Level::ERROR, __VA_ARGS__)
 
 #endif // LOGGER_H
@@ -0,0 +1,167 @@
+////////////////////////////////////////////////////
+// File: Metrics.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Registry of the program counters and per stage latency histograms.
+ *
+ * Every thread writes into its own block, so updates are plain relaxed loads and stores
+ * without locked instructions. Readers (stats line, SIGUSR1 dump, Prometheus endpoint)
+ * sum the blocks of all threads. Blocks live until the program exits, so counters of
+ * finished threads are kept.
+ *
+ * Histograms are log-linear like HdrHistogram: every power of two is split into
+ * HISTOGRAM_SUB_BUCKETS linear buckets, so the relative error of a percentile is below 1/16.
+ */
+class Metrics {
+public:
+    enum class Counter : size_t {
+        PACKETS_READ,
+        PACKETS_DECODED,
+        REJECTED_NOT_TCP,
+        REJECTED_TRUNCATED,
+        REJECTED_BAD_IP_HEADER,
+        PACKETS_DUPLICATE,
+        DEDUP_EVICTIONS,
+        FLOWS_CREATED,
+        FLOWS_PROMOTED,
+        FLOWS_SPILLED,
+        FLOWS_PAGED_IN,
+        FLOWS_EXPIRED_ACTIVE,
+        FLOWS_EXPIRED_INACTIVE,
+        FLOWS_EXPIRED_FORCED,
+        FLOWS_ENDED_FIN,
+        FLOWS_ENDED_RST,
+        FLOWS_EXPORTED,
+        DATAGRAMS_SENT,
+        SEND_ERRORS,
+        EXPORT_THROTTLES,
+        EXPORT_THROTTLED_US,
+        SHM_RING_FULL,
+        DATAGRAMS_SPOOLED,
+        DATAGRAMS_REPLAYED,
+        SPOOL_OVERFLOWS,
+        COUNT
+    };
+
+    enum class Stage : size_t {
+        READ,
+        DECODE,
+        AGGREGATE,
+        EXPIRE,
+        EXPORT,
+        COUNT
+    };
+
+    static constexpr size_t COUNTER_COUNT = static_cast<size_t>(Counter::COUNT);
+    static constexpr size_t STAGE_COUNT = static_cast<size_t>(Stage::COUNT);
+    static constexpr size_t HISTOGRAM_SUB_BUCKET_BITS = 4;
+    static constexpr size_t HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BUCKET_BITS;
+    static constexpr size_t HISTOGRAM_BUCKETS = (64 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS;
+
+    /**
+     * @brief Latency summary of one stage in nanoseconds.
+     */
+    struct LatencySummary {
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t p50 = 0;
+        uint64_t p90 = 0;
+        uint64_t p99 = 0;
+        uint64_t p999 = 0;
+        uint64_t max = 0;
+    };
+
+    /**
+     * @brief Values of all counters and histograms summed over the threads.
+     */
+    struct Snapshot {
+        std::array<uint64_t, COUNTER_COUNT> counters{};
+        std::array<LatencySummary, STAGE_COUNT> latencies{};
+    };
+
+    /**
+     * @brief Adds to a counter of the calling thread.
+     */
+    static void add(Counter counter, uint64_t value = 1) {
+        std::atomic<uint64_t>& slot = local().counters[static_cast<size_t>(counter)];
+        slot.store(slot.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    static void record(Stage stage, uint64_t nanoseconds);
+
+    static Snapshot snapshot();
+    static std::string to_json(const Snapshot& snapshot);
+    static std::string to_prometheus(const Snapshot& snapshot);
+
+    static const char* counter_name(Counter counter);
+    static const char* stage_name(Stage stage);
+
+private:
+    struct Histogram {
+        std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> buckets{};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> max{0};
+    };
+
+    struct ThreadBlock {
+        std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters{};
+        std::array<Histogram, STAGE_COUNT> histograms;
+    };
+
+    static ThreadBlock& local() {
+        thread_local ThreadBlock* block = register_thread();
+        return *block;
+    }
+
+    static ThreadBlock* register_thread();
+    static std::vector<std::unique_ptr<ThreadBlock>>& all_blocks();
+    static size_t bucket_index(uint64_t value);
+    static uint64_t bucket_value(size_t index);
+};
+
+/**
+ * @brief Measures the time of one stage and records it to its histogram.
+ * When not enabled no clock is read, so sampled timing costs nothing for the other packets.
+ */
+class StageTimer {
+public:
+    StageTimer(Metrics::Stage stage, bool enabled)
+        : stage(stage), enabled(enabled) {
+        if (enabled) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~StageTimer() {
+        if (enabled) {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            Metrics::record(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    Metrics::Stage stage;
+    bool enabled;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,59 @@
+////////////////////////////////////////////////////
+// File: MetricsReporter.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef METRICS_REPORTER_H
+#define METRICS_REPORTER_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Background thread publishing the values of the Metrics registry.
+ *
+ *  - Prints a JSON stats line to the standard output every stats interval
+ *  - Prints the JSON line whenever SIGUSR1 is received
+ *  - Serves the Prometheus text format on 127.0.0.1 when a port is set
+ *  - Prints the report lines published by the processing (sketches) before each stats line
+ *    and when stopped, so the packet thread never writes them itself
+ *
+ * SIGUSR1 is received through signalfd, so it has to be blocked in all threads,
+ * call block_signals() before any other thread is started.
+ */
+class MetricsReporter {
+public:
+    MetricsReporter(int stats_interval, int prometheus_port);
+    ~MetricsReporter();
+
+    MetricsReporter(const MetricsReporter&) = delete;
+    MetricsReporter& operator=(const MetricsReporter&) = delete;
+
+    static void block_signals();
+    static void publish(std::string line);
+
+    void stop();
+
+private:
+    static std::mutex reports_mutex;
+    static std::vector<std::string> reports;    // Published lines not printed yet
+
+    int stats_interval_ms;
+    int signal_fd = -1;
+    int listen_fd = -1;
+    std::atomic<bool> running{true};
+    std::thread worker;
+
+    void open_listener(int port);
+    void run();
+    void serve_client();
+    void print_stats();
+    void print_reports();
+};
+
+#endif // METRICS_REPORTER_H
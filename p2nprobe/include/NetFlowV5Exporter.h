@@ -0,0 +1,44 @@
+////////////////////////////////////////////////////
+// File: NetFlowV5Exporter.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+
+#ifndef NETFLOW_V5_EXPORTER_H
+#define NETFLOW_V5_EXPORTER_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "Exporter.h"
+#include "DatagramSink.h"
+#include "Flow.h"
+
+constexpr uint16_t VERSION_5 = 5;
+
+/**
+ * @brief Class for exporting flows to collector in NetFlow v5 format and formating flows.
+ */
+class NetFlowV5Exporter : public Exporter {
+public:
+    explicit NetFlowV5Exporter(std::unique_ptr<DatagramSink> sink);
+    ~NetFlowV5Exporter() override = default;
+
+    void export_flows(const std::vector<Flow>& flows, uint32_t time_start, uint32_t time_end) override;
+    size_t max_flows_per_export() const override;
+    void flush() override;
+    uint32_t sequence() const override;
+    void set_sequence(uint32_t value) override;
+
+private:
+    void format_header(uint8_t* buffer, uint16_t flow_count, uint32_t time_start, uint32_t time_end);
+    void format_record(NetFlowV5record record, uint8_t* buffer, size_t &offset, uint32_t time_start);
+    
+    uint32_t flow_sequence; // Number of flows exported
+    std::unique_ptr<DatagramSink> sink; // Collector or file receiving the datagrams
+};
+
+#endif // NETFLOW_V5_EXPORTER_H
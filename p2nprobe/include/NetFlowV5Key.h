@@ -8,9 +8,9 @@
 #ifndef NETFLOW_V5_FLOW_KEY_H
 #define NETFLOW_V5_FLOW_KEY_H
 
-#include <string>
+#include <cstddef>
+#include <cstdint>
 
-#include "FlowKey.h"
 #include "NetFlowV5record.h"
 
 
@@ -26,20 +26,47 @@
  * 3. Protocol
  * 4. Source port
  * 5. Destination port
+ *
+ * Plain value type, comparison and hashing are defined here so they are inlined into the packet loop.
  */
-class NetFlowV5Key : public FlowKey {
+class NetFlowV5Key {
     public:                         // coresponding parts on wiki
-        uint32_t src_ip;         // 2. 
+        uint32_t src_ip;         // 2.
         uint32_t  dst_ip;         // 3.
-        uint8_t protocol;           // 4. 
+        uint8_t protocol;           // 4.
         uint16_t src_port;          // 5.
         uint16_t dst_port;          // 6.
 
-        NetFlowV5Key(NetFlowV5record record);
+        NetFlowV5Key(const NetFlowV5record& record)
+            : src_ip(record.srcaddr),
+            dst_ip(record.dstaddr),
+            protocol(record.prot),
+            src_port(record.srcport),
+            dst_port(record.dstport) {}
+
+        // Key of both directions of a connection, the lower endpoint (address, port) is the source
+        NetFlowV5Key canonical() const;
+        // Key of the opposite direction
+        NetFlowV5Key reversed() const;
 
         // Comparison operator for comparing keys in case of colision
-        bool operator==(const FlowKey& other) const override;
-        std::string concatToString() const override; // Concat key parts to one string so that it can be used as key in hash table
+        bool operator==(const NetFlowV5Key& other) const {
+            return src_ip == other.src_ip && dst_ip == other.dst_ip && src_port == other.src_port &&
+                   dst_port == other.dst_port && protocol == other.protocol;
+        }
+
+        /**
+         * @brief Hash for the flow tables, the key is packed into one word and mixed.
+         */
+        struct Hash {
+            size_t operator()(const NetFlowV5Key& key) const {
+                uint64_t ports = (static_cast<uint64_t>(key.src_port) << 24) | (static_cast<uint64_t>(key.dst_port) << 8) | key.protocol;
+                uint64_t hash = ((static_cast<uint64_t>(key.src_ip) << 32) | key.dst_ip) ^ (ports * 0x9e3779b97f4a7c15ULL);
+                hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+                return static_cast<size_t>(hash ^ (hash >> 31));
+            }
+        };
 };
 
-#endif // NETFLOW_V5_FLOW_KEY_H
\ No newline at end of file
+#endif // NETFLOW_V5_FLOW_KEY_H
@@ -0,0 +1,67 @@
+////////////////////////////////////////////////////
+// File: Pacer.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef PACER_H
+#define PACER_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Limits the export rate so the collector is not flooded with datagrams.
+ *
+ * Two independent mechanisms:
+ *  - Token bucket limiting datagrams per second or bits per second, applied to every datagram
+ *  - Capture time pacing, export follows the timestamps of the capture multiplied by a speed factor
+ *
+ * Time spent sleeping in either of them is counted, also in the export_throttles and
+ * export_throttled_us metrics.
+ */
+class Pacer {
+public:
+    /**
+     * @brief Unit of the token bucket rate.
+     */
+    enum class RateUnit {
+        NONE,               // No rate limit
+        DATAGRAMS,          // Datagrams per second
+        BITS                // Bits per second
+    };
+
+    Pacer(RateUnit unit, double rate, double replay_speed);
+
+    void set_max_datagram_size(size_t max_datagram_size);
+    void acquire(size_t datagram_size);
+    void sync_capture_time(uint32_t capture_ms);
+
+    bool enabled() const;
+    double bytes_per_second() const;
+    uint64_t throttled_count() const;
+    std::chrono::nanoseconds throttled_time() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void throttle(Clock::time_point until);
+
+    RateUnit unit;
+    double rate;                    // Tokens per second
+    double burst;                   // Bucket capacity in tokens
+    double tokens;
+    Clock::time_point last_refill;
+
+    double replay_speed;            // 0 = do not follow capture time
+    bool capture_anchor_set;
+    uint32_t capture_anchor_ms;     // Capture time of the first export
+    Clock::time_point wall_anchor;  // Wall time of the first export
+
+    uint64_t throttles;
+    std::chrono::nanoseconds throttled;
+};
+
+#endif // PACER_H
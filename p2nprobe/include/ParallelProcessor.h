@@ -0,0 +1,112 @@
+////////////////////////////////////////////////////
+// File: ParallelProcessor.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef PARALLEL_PROCESSOR_H
+#define PARALLEL_PROCESSOR_H
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Flow.h"
+#include "PcapFormat.h"
+
+/**
+ * @brief Aggregates one classic pcap file on several threads, with the same flows as the sequential run.
+ *
+ * The file is split into byte ranges, each range starts at the first offset where several consecutive
+ * plausible record headers follow. Every thread aggregates its range with an empty flow table, the
+ * ranges are then merged in file order. Flows still open at the end of a range are carried into the
+ * next one: if the next range has packets of the same key before the carried flow would have expired,
+ * the key's packets up to its first inactive expiry are replayed on the carried flow, which gives the
+ * splits the sequential run would make. Later flows of the key are not affected by the earlier packets.
+ *
+ * Timestamps of the file have to be non-decreasing, like for the sequential run the expiry is driven
+ * by the timestamp of each read packet.
+ */
+class ParallelProcessor {
+public:
+    // Receives the flows in the order they are finished, active is true for the active timeout
+    using FlowSink = std::function<void(const Flow& flow, bool active)>;
+
+    ParallelProcessor(const std::string& pcap_path, int threads, uint32_t active_timeout_ms,
+                      uint32_t inactive_timeout_ms);
+
+    bool split();
+    size_t chunk_count() const { return boundaries.empty() ? 0 : boundaries.size() - 1; }
+    int run(std::list<Flow>& carried, const FlowSink& sink);
+
+private:
+    // Check time of a packet that is the first of its range, the last packet of the previous range is used
+    static constexpr uint64_t CHECK_PREVIOUS_RANGE = UINT64_MAX;
+
+    /**
+     * @brief Packet of a key kept for the replay on a carried flow.
+     */
+    struct HeadPacket {
+        uint64_t timestamp_ms;
+        uint64_t check_ms;      // Timestamp of the packet read before it, flows were last checked then
+        uint32_t octets;
+        uint8_t tcp_flags;
+    };
+
+    /**
+     * @brief Key seen within the inactive timeout from the start of the range, only these keys can
+     * continue a carried flow. Head packets are the packets before the key's first inactive expiry.
+     */
+    struct KeyState {
+        NetFlowV5record record;     // Record of the first packet, for creating flows during the replay
+        bool head_done = false;     // A flow of the key expired by the inactive timeout in this range
+        uint64_t head_end_ms = 0;   // Time of that expiry
+        std::vector<HeadPacket> packets;
+    };
+
+    struct ChunkFlow {
+        Flow flow;
+        bool head;                  // Created from head packets, replaced by the replay when the key is carried
+        bool active;                // Expired by the active timeout
+    };
+
+    struct Chunk {
+        uint64_t begin = 0;
+        uint64_t end = 0;
+        bool failed = false;
+        bool has_packets = false;
+        uint64_t first_ms = 0;
+        uint64_t last_ms = 0;
+        std::vector<uint64_t> check_times;  // Packet times of the range that exceed all before them
+        std::vector<ChunkFlow> expired;
+        std::vector<ChunkFlow> open;    // In the order of arrival
+        std::unordered_map<NetFlowV5Key, KeyState, NetFlowV5Key::Hash> keys;
+    };
+
+    std::string pcap_path;
+    int threads;
+    uint32_t active_timeout_ms;
+    uint32_t inactive_timeout_ms;
+
+    PcapFormat::FileInfo info;
+    int64_t reference_us = 0;           // Timestamp of the first packet, bounds the timestamps accepted when resynchronising
+    std::vector<uint64_t> boundaries;   // Range i is [boundaries[i], boundaries[i + 1])
+
+    uint64_t previous_last_ms = 0;      // Last packet of the previous merged range
+    bool has_previous = false;
+
+    bool is_boundary(int fd, uint64_t offset, uint64_t file_size) const;
+    uint64_t find_boundary(int fd, uint64_t offset, uint64_t file_size) const;
+
+    void aggregate(Chunk& chunk) const;
+    void merge(Chunk& chunk, std::list<Flow>& carried, const FlowSink& sink);
+    bool replay(Flow& flow, const KeyState& state, const Chunk& chunk, const FlowSink& sink) const;
+    bool expired(const Flow& flow, uint32_t current_time, bool& active) const;
+    bool active_at_expiry(const Flow& flow, const Chunk& chunk, uint64_t check_ms) const;
+};
+
+#endif // PARALLEL_PROCESSOR_H
@@ -0,0 +1,95 @@
+////////////////////////////////////////////////////
+// File: PcapFormat.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef PCAP_FORMAT_H
+#define PCAP_FORMAT_H
+
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief Layout of classic pcap files, for the parts of the program that read the file without libpcap.
+ */
+namespace PcapFormat {
+    // Magic numbers of classic pcap files, as read in host byte order
+    constexpr uint32_t MAGIC_US = 0xa1b2c3d4;
+    constexpr uint32_t MAGIC_NS = 0xa1b23c4d;
+    constexpr size_t FILE_HEADER_SIZE = 24;
+    constexpr size_t RECORD_HEADER_SIZE = 16;
+    constexpr uint32_t MAX_PACKET_LENGTH = 262144;  // largest snapshot length libpcap accepts
+
+    /**
+     * @brief Properties of the file taken from its file header.
+     */
+    struct FileInfo {
+        bool swapped = false;       // File was written with the other byte order
+        bool nanoseconds = false;   // Subsecond part of timestamps is in nanoseconds
+        uint32_t snaplen = 0;
+    };
+
+    /**
+     * @brief Record header with the timestamp converted to microseconds.
+     */
+    struct Record {
+        int64_t timestamp_us = 0;
+        uint32_t caplen = 0;
+        uint32_t len = 0;
+        uint32_t subsecond = 0;     // as stored in the file, for validation
+    };
+
+    inline uint32_t read32(const uint8_t* data, bool swapped) {
+        uint32_t value;
+        memcpy(&value, data, sizeof(value));
+        return swapped ? __builtin_bswap32(value) : value;
+    }
+
+    /**
+     * @brief Parses the file header.
+     *
+     * @return false if the data is not a classic pcap file header (e.g. pcapng)
+     */
+    inline bool parse_file_header(const uint8_t* data, FileInfo& info) {
+        uint32_t magic = read32(data, false);
+        uint32_t swapped_magic = __builtin_bswap32(magic);
+        if (magic == MAGIC_US || magic == MAGIC_NS) {
+            info.swapped = false;
+            info.nanoseconds = magic == MAGIC_NS;
+        }
+        else if (swapped_magic == MAGIC_US || swapped_magic == MAGIC_NS) {
+            info.swapped = true;
+            info.nanoseconds = swapped_magic == MAGIC_NS;
+        }
+        else {
+            return false;
+        }
+        info.snaplen = read32(data + 16, info.swapped);
+        return true;
+    }
+
+    inline Record parse_record_header(const uint8_t* data, const FileInfo& info) {
+        Record record;
+        uint32_t seconds = read32(data, info.swapped);
+        record.subsecond = read32(data + 4, info.swapped);
+        record.caplen = read32(data + 8, info.swapped);
+        record.len = read32(data + 12, info.swapped);
+        uint32_t microseconds = info.nanoseconds ? record.subsecond / 1000 : record.subsecond;
+        record.timestamp_us = static_cast<int64_t>(seconds) * 1000000 + microseconds;
+        return record;
+    }
+
+    /**
+     * @brief Checks whether the record header can be a real one, used to find record boundaries
+     * when reading starts in the middle of the file.
+     */
+    inline bool plausible(const Record& record, const FileInfo& info) {
+        uint32_t snaplen = info.snaplen == 0 || info.snaplen > MAX_PACKET_LENGTH ? MAX_PACKET_LENGTH : info.snaplen;
+        return record.caplen <= snaplen && record.caplen <= record.len && record.len <= MAX_PACKET_LENGTH &&
+               record.subsecond < (info.nanoseconds ? 1000000000u : 1000000u);
+    }
+}
+
+#endif // PCAP_FORMAT_H
@@ -8,28 +8,54 @@
 #ifndef PCAP_READER_H
 #define PCAP_READER_H
 
+#include "Config.h"  // before pcap.h, its PCAP_ERRBUF_SIZE macro collides with the Config constant
 #include <pcap.h>
+#include <memory>
 #include <string>
+#include <cstdint>
+#include "BlockSource.h"
+#include "Decompressor.h"
 #include "NetFlowV5record.h"
+#include "PcapFormat.h"
+#include "TimeIndex.h"
 
 /**
  * @brief Class for reading and processing packets from pcap file.
  */
 class PcapReader {
 public:
-    PcapReader(std::string pcapFile);
+    PcapReader(std::string pcapFile, Config::InputReader inputReader = Config::DEFAULT_INPUT_READER,
+               bool directRead = false);
     ~PcapReader();
 
     bool open();
     void close();
+    void select_range(int64_t from_us, int64_t to_us);
+    int next(struct pcap_pkthdr** header, const u_char** packet);
 
     bool processPacket(const struct pcap_pkthdr* header, const u_char* packet, NetFlowV5record& record);
+    static uint64_t fingerprint(const u_char* packet);
     pcap_t* handle = nullptr;
 
 private:
     std::string _pcapFile; // Name of the processed pcap file
+    Config::InputReader _inputReader; // Backend for uncompressed files
+    bool _directRead; // O_DIRECT reads with the io_uring backend
     char _errbuf[PCAP_ERRBUF_SIZE]; // Error buffer in case error occurs while processing packets
 
+    bool _rangeActive = false; // Only packets in [_fromUs, _toUs) are returned by next
+    bool _rangeEmpty = false; // No packet of the file is in the range
+    int64_t _fromUs = 0;
+    int64_t _toUs = 0;
+    TimeIndex::Range _range; // Part of the file holding the range
+
+    std::unique_ptr<BlockSource> _stream; // Compressed captures and io_uring reads are parsed here instead of libpcap
+    PcapFormat::FileInfo _streamInfo;
+    struct pcap_pkthdr _streamHeader;
+
+    bool openStream(std::unique_ptr<BlockSource> source, std::string& reason);
+    int readPacket(struct pcap_pkthdr** header, const u_char** packet);
+    int readStreamPacket(struct pcap_pkthdr** header, const u_char** packet);
     bool isTcpPacket(const u_char* packet);
 };
 
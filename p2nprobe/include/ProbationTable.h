@@ -0,0 +1,213 @@
+////////////////////////////////////////////////////
+// File: ProbationTable.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef PROBATION_TABLE_H
+#define PROBATION_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "NetFlowV5Key.h"
+#include "NetFlowV5record.h"
+
+/**
+ * @brief Flows of a single packet waiting for their second packet, kept without a Flow entry,
+ * list node and map node of the flow table.
+ *
+ * Entries are the record of the first packet in a queue in the order of admission. The index is
+ * an open addressing table with linear probing that holds the sequence number of the entry, so an
+ * entry takes the record, its timestamp and two to four 8 byte index slots. An entry taken out by
+ * its second packet is only marked (dPkts 0) and dropped once it reaches the front of the queue.
+ *
+ * A single packet flow expires after the shorter of the timeouts since its packet, so with
+ * non-decreasing timestamps the entries expire in the order of the queue and only its front is checked.
+ */
+template <class KeyPolicy>
+class ProbationTable {
+public:
+    /**
+     * @brief First packet of a flow, with First equal to Last.
+     */
+    struct Entry {
+        NetFlowV5record record;
+        uint64_t timestamp_ms;
+    };
+
+    bool take(const NetFlowV5Key& key, Entry& entry);
+    void insert(const NetFlowV5record& record, uint64_t timestamp_ms);
+    const Entry* front();
+    void pop_front();
+    template <class Fn>
+    void for_each(Fn&& fn) const;
+    size_t size() const { return live; }
+    void clear();
+
+private:
+    static constexpr size_t MIN_SLOTS = 64;
+
+    std::deque<Entry> entries;      // In the order of admission, taken entries stay until they reach the front
+    uint64_t front_seq = 0;         // Sequence number of the front entry
+    std::vector<uint64_t> slots;    // Sequence number + 1 of an entry, 0 for an empty slot; at most half full
+    size_t live = 0;                // Entries not taken
+
+    static typename KeyPolicy::Key key_of(const Entry& entry) { return KeyPolicy::make(NetFlowV5Key(entry.record)); }
+    size_t home_of(const typename KeyPolicy::Key& key) const { return typename KeyPolicy::Hash()(key) & (slots.size() - 1); }
+    Entry& entry_of(uint64_t slot) { return entries[slot - 1 - front_seq]; }
+    void place(uint64_t seq);
+    void erase_slot(size_t index);
+    void grow();
+};
+
+/**
+ * @brief Removes the entry of the key, used when the second packet of the flow arrives.
+ *
+ * @param key Key of the packet
+ * @param entry Set to the entry of the key when it was found
+ *
+ * @return true if the key had an entry
+ */
+template <class KeyPolicy>
+bool ProbationTable<KeyPolicy>::take(const NetFlowV5Key& key, Entry& entry) {
+    if (live == 0) {
+        return false;
+    }
+    typename KeyPolicy::Key table_key = KeyPolicy::make(key);
+    size_t mask = slots.size() - 1;
+    for (size_t index = home_of(table_key); slots[index] != 0; index = (index + 1) & mask) {
+        Entry& candidate = entry_of(slots[index]);
+        if (key_of(candidate) == table_key) {
+            entry = candidate;
+            candidate.record.dPkts = 0;
+            erase_slot(index);
+            live--;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Adds the first packet of a flow at the back of the queue.
+ *
+ * @param record Record of the packet, First already set
+ * @param timestamp_ms Capture timestamp of the packet in miliseconds
+ */
+template <class KeyPolicy>
+void ProbationTable<KeyPolicy>::insert(const NetFlowV5record& record, uint64_t timestamp_ms) {
+    if ((live + 1) * 2 > slots.size()) {
+        grow();
+    }
+    uint64_t seq = front_seq + entries.size();
+    entries.push_back({record, timestamp_ms});
+    place(seq);
+    live++;
+}
+
+/**
+ * @brief Oldest entry not taken yet, the taken entries before it are dropped.
+ *
+ * @return The entry, nullptr if the table is empty
+ */
+template <class KeyPolicy>
+const typename ProbationTable<KeyPolicy>::Entry* ProbationTable<KeyPolicy>::front() {
+    while (!entries.empty() && entries.front().record.dPkts == 0) {
+        entries.pop_front();
+        front_seq++;
+    }
+    return entries.empty() ? nullptr : &entries.front();
+}
+
+/**
+ * @brief Removes the entry returned by front.
+ */
+template <class KeyPolicy>
+void ProbationTable<KeyPolicy>::pop_front() {
+    size_t mask = slots.size() - 1;
+    size_t index = home_of(key_of(entries.front()));
+    while (slots[index] != front_seq + 1) {
+        index = (index + 1) & mask;
+    }
+    erase_slot(index);
+    entries.pop_front();
+    front_seq++;
+    live--;
+}
+
+/**
+ * @brief Calls the function with every entry not taken, in the order of admission.
+ */
+template <class KeyPolicy>
+template <class Fn>
+void ProbationTable<KeyPolicy>::for_each(Fn&& fn) const {
+    for (const Entry& entry : entries) {
+        if (entry.record.dPkts != 0) {
+            fn(entry);
+        }
+    }
+}
+
+/**
+ * @brief Removes all entries and frees the index.
+ */
+template <class KeyPolicy>
+void ProbationTable<KeyPolicy>::clear() {
+    entries.clear();
+    slots.clear();
+    front_seq = 0;
+    live = 0;
+}
+
+/**
+ * @brief Puts the sequence number of an entry into the first free slot from its home slot.
+ */
+template <class KeyPolicy>
+void ProbationTable<KeyPolicy>::place(uint64_t seq) {
+    size_t mask = slots.size() - 1;
+    size_t index = home_of(key_of(entries[seq - front_seq]));
+    while (slots[index] != 0) {
+        index = (index + 1) & mask;
+    }
+    slots[index] = seq + 1;
+}
+
+/**
+ * @brief Empties a slot and shifts the following slots of the probe sequence back into the gap,
+ * so lookups do not need deleted markers.
+ *
+ * @param index Slot to empty
+ */
+template <class KeyPolicy>
+void ProbationTable<KeyPolicy>::erase_slot(size_t index) {
+    size_t mask = slots.size() - 1;
+    size_t hole = index;
+    for (size_t next = (index + 1) & mask; slots[next] != 0; next = (next + 1) & mask) {
+        // The entry may move into the hole if the hole lies between its home slot and its slot
+        size_t home = home_of(key_of(entry_of(slots[next])));
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            slots[hole] = slots[next];
+            hole = next;
+        }
+    }
+    slots[hole] = 0;
+}
+
+/**
+ * @brief Doubles the index and places the entries not taken again.
+ */
+template <class KeyPolicy>
+void ProbationTable<KeyPolicy>::grow() {
+    slots.assign(slots.empty() ? MIN_SLOTS : slots.size() * 2, 0);
+    for (size_t offset = 0; offset < entries.size(); offset++) {
+        if (entries[offset].record.dPkts != 0) {
+            place(front_seq + offset);
+        }
+    }
+}
+
+#endif // PROBATION_TABLE_H
@@ -0,0 +1,131 @@
+////////////////////////////////////////////////////
+// File: Probe.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef PROBE_H
+#define PROBE_H
+
+#include "Config.h"  // before pcap.h, its PCAP_ERRBUF_SIZE macro collides with the Config constant
+#include <pcap.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "Dedup.h"
+#include "Exporter.h"
+#include "Flow.h"
+#include "FlowSpill.h"
+#include "FlowTable.h"
+#include "NetFlowV5record.h"
+#include "PcapReader.h"
+#include "RoutingTable.h"
+#include "Sketches.h"
+
+/**
+ * @brief Aggregation options of the Probe, the defaults match the command line tool.
+ */
+struct ProbeOptions {
+    uint32_t active_timeout_ms = Config::DEFAULT_ACTIVE_TIMEOUT * 1000;
+    uint32_t inactive_timeout_ms = Config::DEFAULT_INACTIVE_TIMEOUT * 1000;
+    bool biflow = false;            // Both directions of a connection share one flow
+    bool tcp_end = false;           // Flows also end after RST or FIN in both directions
+    uint32_t fin_linger_ms = Config::DEFAULT_FIN_LINGER_MS;
+    bool admission = false;         // Flows of a single packet wait in a compact table until their second packet
+    uint32_t dedup_window_ms = 0;   // Copies of a packet seen again within this time are dropped, 0 disables
+    std::shared_ptr<const RoutingTable> routes;    // Fills AS numbers, masks and nexthop, optional
+    std::shared_ptr<FlowSpill> spill;               // Takes the coldest flows above hot_flows, optional
+    size_t hot_flows = Config::DEFAULT_HOT_FLOWS;
+    std::shared_ptr<Sketches> sketches;             // Gets every aggregated packet, optional
+    bool export_expired = true;     // Expired flows go to the exporter, false when the callback picks what is exported
+};
+
+/**
+ * @brief Entry point of the libp2nprobe library: decodes pushed packets, aggregates them into flows
+ * and hands out the expired flows, without reading a file or sending anything by itself.
+ *
+ * Expired flows go to the callback and to the exporter when they are set, otherwise they are queued
+ * for next_flow. Expiry is driven by the timestamps of the pushed packets. The command line tool is
+ * a probe fed by add_from, so both export the same records for the same capture. A probe is not
+ * thread safe, use one per thread.
+ */
+class Probe {
+public:
+    using Options = ProbeOptions;
+
+    /**
+     * @brief Captured packet of a batch, as returned by pcap_next_ex.
+     */
+    struct Packet {
+        const struct pcap_pkthdr* header;
+        const u_char* data;
+    };
+
+    using FlowCallback = std::function<void(const Flow& flow)>;
+
+    explicit Probe(const Options& options = Options());
+    ~Probe();
+
+    void set_callback(FlowCallback callback);
+    void set_exporter(std::unique_ptr<Exporter> exporter);
+
+    bool add_packet(const struct pcap_pkthdr* header, const u_char* packet);
+    size_t add_packets(const Packet* packets, size_t count);
+    void add_record(const NetFlowV5record& record, uint64_t timestamp_ms);
+    int add_from(PcapReader& reader);
+    void add_expired(const Flow& flow);
+    void export_flow(const Flow& flow);
+
+    std::optional<Flow> next_flow();
+    void finish();
+    void expire_all();
+    void flush();
+
+    std::list<Flow>& flows();
+    void reindex();
+    void start_clock();
+    void set_times(uint32_t start, uint32_t end);
+    uint32_t start_time() const { return time_start; }
+    uint32_t end_time() const { return time_end; }
+
+    uint64_t flows_created() const { return created; }
+    uint64_t flows_expired() const { return expired; }
+    uint64_t flows_exported() const { return exported; }
+    size_t open_flows() const;
+
+private:
+    Options options;
+    AnyFlowTable table;
+    PcapReader decoder;     // Only decodes packets, libpcap does not open a file
+    std::unique_ptr<PacketDedup> dedup;     // Null when the duplicate suppression is disabled
+
+    FlowCallback callback;
+    std::unique_ptr<Exporter> exporter;
+    std::vector<Flow> export_batch;     // Flows waiting for a full batch of the exporter
+    std::deque<Flow> pending;           // Flows waiting for next_flow, without callback and exporter
+
+    bool time_start_set = false;
+    uint32_t time_start = 0;            // Wall clock time of the first aggregated packet, the exported uptime counts from it
+    uint32_t time_end = 0;              // Capture time of the last aggregated packet
+    uint64_t created = 0;
+    uint64_t expired = 0;
+    uint64_t exported = 0;
+    uint64_t packet_index = 0;          // Stage latencies are measured on every METRICS_SAMPLE_MASK + 1st packet
+
+    bool sample() { return (packet_index++ & Config::METRICS_SAMPLE_MASK) == 0; }
+    template <class Table>
+    bool decode_into(Table& flows, const struct pcap_pkthdr* header, const u_char* packet, bool sampled);
+    template <class Table>
+    void aggregate_into(Table& flows, const NetFlowV5record& record, uint64_t timestamp_ms);
+    void deliver(const Flow& flow);
+    void export_batched();
+};
+
+#endif // PROBE_H
@@ -0,0 +1,88 @@
+////////////////////////////////////////////////////
+// File: Rollup.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Flow.h"
+
+/**
+ * @brief Second aggregation stage, sums the expired flows by a coarser key per time interval.
+ *
+ * The key is a subset of source and destination prefixes, protocol, ports and AS numbers.
+ * Flows are binned by the time of their last packet. The bin is exported when a flow of a later
+ * bin arrives, flows of already exported bins are added to the open one. Rollups are exported as
+ * flows, the prefix lengths are stored in the masks and fields outside of the key are zero.
+ */
+class Rollup {
+public:
+    /**
+     * @brief Fields of the rollup key.
+     */
+    struct Spec {
+        int src_prefix = -1;    // Prefix length of the source address, -1 when not in the key
+        int dst_prefix = -1;
+        bool protocol = false;
+        bool src_port = false;
+        bool dst_port = false;
+        bool src_as = false;
+        bool dst_as = false;
+    };
+
+    static bool parse_spec(const std::string& text, Spec& spec, std::string& error);
+
+    Rollup(const Spec& spec, uint32_t interval_ms);
+
+    void add(const Flow& flow, std::vector<Flow>& output);
+    void flush(std::vector<Flow>& output);
+
+    uint64_t flows_in() const { return flows_added; }
+    uint64_t rollups_out() const { return rollups_exported; }
+
+private:
+    struct Key {
+        uint32_t src;
+        uint32_t dst;
+        uint16_t src_port;
+        uint16_t dst_port;
+        uint16_t src_as;
+        uint16_t dst_as;
+        uint8_t protocol;
+
+        bool operator==(const Key& other) const {
+            return src == other.src && dst == other.dst && src_port == other.src_port &&
+                   dst_port == other.dst_port && src_as == other.src_as && dst_as == other.dst_as &&
+                   protocol == other.protocol;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    Spec spec;
+    uint32_t interval_ms;
+    uint32_t src_netmask;
+    uint32_t dst_netmask;
+
+    bool open = false;
+    uint64_t bin = 0;               // Index of the open bin, last_ms / interval_ms
+    std::unordered_map<Key, Flow, KeyHash> table;
+
+    uint64_t flows_added = 0;
+    uint64_t rollups_exported = 0;
+
+    Key make_key(const NetFlowV5record& record) const;
+};
+
+#endif // ROLLUP_H
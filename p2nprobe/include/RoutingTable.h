@@ -0,0 +1,64 @@
+////////////////////////////////////////////////////
+// File: RoutingTable.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef ROUTING_TABLE_H
+#define ROUTING_TABLE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "NetFlowV5record.h"
+
+/**
+ * @brief IPv4 routing table for filling the routing fields of the records, built once at startup.
+ *
+ * Longest prefix match uses the DIR-24-8 layout (Gupta et al.): the first table is indexed by the
+ * top 24 bits of the address, entries of prefixes longer than /24 point to a group of 256 entries
+ * indexed by the last byte. A lookup takes at most two memory accesses.
+ *
+ * File format, one route per line, '#' starts a comment:
+ *   <prefix>/<length> <nexthop> <origin AS>
+ * for example "192.0.2.0/24 198.51.100.1 64500". Nexthop may be "-" when unknown.
+ */
+class RoutingTable {
+public:
+    /**
+     * @brief Routing information of one prefix.
+     */
+    struct Route {
+        uint32_t nexthop = 0;
+        uint16_t as = 0;
+        uint8_t length = 0;     // Prefix length, the mask of the record
+    };
+
+    bool load(const std::string& path);
+
+    const Route* lookup(uint32_t address) const;
+    void fill(NetFlowV5record& record) const;
+
+    size_t route_count() const { return routes.size() - 1; }
+
+private:
+    static constexpr uint32_t GROUP_FLAG = 0x80000000u;    // Entry points to a group of 256 entries
+    static constexpr size_t GROUP_SIZE = 256;
+
+    // Entries are indexes into routes, routes[0] means no route
+    std::vector<Route> routes;
+    std::vector<uint32_t> tbl24;     // 2^24 entries, 64 MiB
+    std::vector<uint32_t> tbl8;
+
+    struct Prefix {
+        uint32_t address;
+        uint8_t length;
+        uint32_t route;
+    };
+
+    void insert(const Prefix& prefix);
+};
+
+#endif // ROUTING_TABLE_H
@@ -0,0 +1,136 @@
+////////////////////////////////////////////////////
+// File: ShmRing.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include "DatagramSink.h"
+
+/**
+ * @brief Single producer single consumer ring of export datagrams in POSIX shared memory
+ * (/dev/shm/<name>), handing the datagrams to a collector on the same host without the kernel
+ * network stack. The ring is lossless: a full ring blocks the producer until the reader catches up.
+ *
+ * Layout of the segment, integers in host byte order:
+ *  - Header, HEADER_SIZE bytes (see Header): fields of the producer and of the reader are on
+ *    separate cache lines, magic is stored last once the segment is initialised.
+ *  - Data area of capacity bytes (power of two) starting at HEADER_SIZE. write_pos and read_pos
+ *    are byte positions that only grow, their offset in the data area is position & (capacity - 1).
+ *  - Records: uint32 length of the datagram, uint32 reserved, the datagram, padding to RECORD_ALIGNMENT.
+ *    A record never wraps, a length of WRAP_MARKER means the rest of the data area is unused
+ *    and the next record starts at offset 0.
+ *
+ * Neither side makes a system call while the ring is neither empty nor full. A side that has
+ * to wait sets its waiting flag and sleeps on a futex word of the segment (data_seq for the
+ * reader, space_seq for the producer); the other side bumps the word and wakes it only
+ * when the flag is set.
+ *
+ * The producer removes a stale segment of the same name and creates a new one, the reader
+ * removes the segment after it read everything of a closed ring.
+ */
+namespace ShmRing {
+    constexpr uint32_t MAGIC = 0x524E3250;          // "P2NR" in little endian
+    constexpr uint32_t VERSION = 1;
+    constexpr size_t HEADER_SIZE = 4096;
+    constexpr size_t RECORD_HEADER_SIZE = 8;
+    constexpr size_t RECORD_ALIGNMENT = 8;
+    constexpr uint32_t WRAP_MARKER = 0xFFFFFFFF;
+
+    /**
+     * @brief Header at the start of the segment.
+     */
+    struct Header {
+        std::atomic<uint32_t> magic;            // MAGIC once the segment is ready
+        uint32_t version;
+        uint64_t capacity;                      // Bytes of the data area, power of two
+        uint32_t header_size;                   // Offset of the data area
+        uint32_t reserved;
+
+        // Written by the producer
+        alignas(64) std::atomic<uint64_t> write_pos;    // End of the published records
+        std::atomic<uint32_t> data_seq;                 // Futex word the reader sleeps on
+        std::atomic<uint32_t> reader_waiting;           // Reader sleeps, wake it after publishing
+        std::atomic<uint32_t> closed;                   // No more records will be published
+
+        // Written by the reader
+        alignas(64) std::atomic<uint64_t> read_pos;     // End of the consumed records
+        std::atomic<uint32_t> space_seq;                // Futex word the producer sleeps on
+        std::atomic<uint32_t> writer_waiting;           // Producer sleeps, wake it after consuming
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "Ring positions have to be lock free");
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Futex words have to be plain 32 bit integers");
+    static_assert(sizeof(Header) <= HEADER_SIZE, "Header does not fit");
+
+    std::string segment_name(const std::string& name);
+}
+
+/**
+ * @brief Producer side of the ring, export datagrams are written straight into the shared memory.
+ */
+class ShmRingSink : public DatagramSink {
+public:
+    ShmRingSink(const std::string& name, size_t capacity);
+    ~ShmRingSink() override;
+
+    ShmRingSink(const ShmRingSink&) = delete;
+    ShmRingSink& operator=(const ShmRingSink&) = delete;
+
+    void send(const uint8_t* buffer, size_t buffer_size) override;
+    int path_mtu() const override;
+    void flush() override;
+
+private:
+    void wait_for_space(size_t needed);
+    void publish();
+
+    std::string name;
+    size_t capacity;
+    size_t mapping_size;
+    ShmRing::Header* header;
+    uint8_t* data;
+
+    uint64_t write_pos;         // Producer copy of the shared position, published after each record
+    uint64_t read_pos_cache;    // Last read position seen, the shared one is read only when the ring looks full
+    bool waited;                // A full ring was already reported
+};
+
+/**
+ * @brief Reader side of the ring, returns the datagrams in place without copying them.
+ * Used by examples/shm_reader.cpp, collectors can link it from the library.
+ */
+class ShmRingReader {
+public:
+    ShmRingReader();
+    ~ShmRingReader();
+
+    ShmRingReader(const ShmRingReader&) = delete;
+    ShmRingReader& operator=(const ShmRingReader&) = delete;
+
+    bool attach(const std::string& name, int timeout_ms);
+    bool next(const uint8_t*& datagram, size_t& size);
+    void unlink();
+
+    uint64_t capacity() const { return header != nullptr ? header->capacity : 0; }
+
+private:
+    std::string name;
+    size_t mapping_size;
+    uint64_t segment_device;    // Identity of the mapped segment, unlink() keeps a newer one
+    uint64_t segment_inode;
+    ShmRing::Header* header;
+    uint8_t* data;
+    uint64_t read_pos;          // Start of the record returned last, released by the next call
+    size_t pending;             // Size of that record including padding
+};
+
+#endif // SHM_RING_H
@@ -0,0 +1,110 @@
+////////////////////////////////////////////////////
+// File: Sketches.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef SKETCHES_H
+#define SKETCHES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "NetFlowV5record.h"
+
+/**
+ * @brief Weighted Space-Saving heavy hitter sketch (Metwally et al.).
+ *
+ * Keeps at most capacity counters in a min-heap. A key that is not tracked takes over the
+ * smallest counter, its count is overestimated by at most that counter's value, which is kept
+ * as the error. Every key heavier than total / capacity is guaranteed to be tracked.
+ */
+class SpaceSaving {
+public:
+    struct Entry {
+        uint64_t key;
+        uint64_t count;
+        uint64_t error;     // Upper bound of the overestimation of count
+    };
+
+    explicit SpaceSaving(size_t capacity);
+
+    void add(uint64_t key, uint64_t weight);
+    std::vector<Entry> top(size_t k) const;
+    void clear();
+
+private:
+    size_t capacity;
+    std::vector<Entry> heap;                        // Min-heap by count
+    std::unordered_map<uint64_t, size_t> positions; // Key to its index in heap
+
+    void swap_entries(size_t a, size_t b);
+    void sift_up(size_t index);
+    void sift_down(size_t index);
+};
+
+/**
+ * @brief HyperLogLog distinct counter (Flajolet et al.) with the linear counting correction
+ * for small cardinalities. Uses 2^precision one byte registers, the standard error is
+ * 1.04 / sqrt(2^precision).
+ */
+class HyperLogLog {
+public:
+    explicit HyperLogLog(unsigned precision);
+
+    void add(uint64_t hash);
+    uint64_t estimate() const;
+    void clear();
+
+private:
+    unsigned precision;
+    std::vector<uint8_t> registers;
+};
+
+/**
+ * @brief Top talkers and distinct host counts computed from the decoded packets, with memory
+ * independent of the number of flows.
+ *
+ * Packets are summed per capture time interval, top-K by bytes and by packets for source
+ * addresses, destination addresses and destination ports, and distinct source and destination
+ * addresses. Every finished interval is published as one JSON line to the MetricsReporter, which
+ * prints it with the next stats line (--stats-interval, SIGUSR1) or at the end of the run.
+ */
+class Sketches {
+public:
+    Sketches(uint32_t interval_ms, size_t top_k);
+
+    void add(const NetFlowV5record& record, uint64_t timestamp_ms);
+    void finish();
+
+private:
+    enum Dimension {
+        SOURCE,
+        DESTINATION,
+        PORT,
+        DIMENSION_COUNT
+    };
+
+    uint32_t interval_ms;   // 0 for one interval over the whole capture
+    size_t top_k;
+    bool started = false;
+    uint64_t interval_start_ms = 0;
+    uint64_t last_ms = 0;
+    uint64_t packets = 0;
+    uint64_t octets = 0;
+
+    std::vector<SpaceSaving> by_octets;     // Indexed by Dimension
+    std::vector<SpaceSaving> by_packets;
+    HyperLogLog sources;
+    HyperLogLog destinations;
+
+    void start_interval(uint64_t timestamp_ms);
+    void report();
+    std::string format_top(const SpaceSaving& sketch, Dimension dimension) const;
+};
+
+#endif // SKETCHES_H
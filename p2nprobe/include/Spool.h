@@ -0,0 +1,102 @@
+////////////////////////////////////////////////////
+// File: Spool.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Pacer.h"
+
+/**
+ * @brief Location, size cap and replay rate of the spool.
+ */
+struct SpoolSettings {
+    std::string path;       // Empty disables the spool
+    size_t size = 0;        // Bytes of the data area
+    double rate = 0;        // Replayed datagrams per second
+};
+
+/**
+ * @brief Append-only spool of export datagrams the collector did not get, kept in a memory mapped file.
+ *
+ * Layout of the file, integers in host byte order:
+ *  - Header (HEADER_SIZE bytes): magic "P2NS", uint16 version, uint16 reserved, uint32 reserved,
+ *    uint64 capacity, uint64 head (first datagram not yet replayed), uint64 tail (end of the data)
+ *  - Data area of capacity bytes: datagrams appended as uint32 length and the datagram.
+ *
+ * While the spool holds datagrams, all new datagrams are appended too, so the collector receives
+ * them in order. A drainer thread replays them at a bounded rate. A replayed datagram is removed
+ * once no ICMP error came back for Config::SPOOL_CONFIRM_MS, an error rewinds the replay to the
+ * first datagram not removed yet and the collector is probed again after Config::SPOOL_RETRY_MS.
+ * Datagrams may therefore reach the collector twice, never zero times while the spool has room.
+ * When everything was replayed the spool starts again at offset 0. Datagrams left at exit stay
+ * in the file and are replayed first by the next run.
+ */
+class Spool {
+public:
+    using Transmit = std::function<bool(const uint8_t* buffer, size_t buffer_size)>;
+    using Reachable = std::function<bool()>;
+
+    Spool(const SpoolSettings& settings, Transmit transmit, Reachable reachable);
+    ~Spool();
+
+    Spool(const Spool&) = delete;
+    Spool& operator=(const Spool&) = delete;
+
+    bool offer(const uint8_t* buffer, size_t buffer_size);
+    void append(const uint8_t* buffer, size_t buffer_size);
+    bool active() const { return spooling.load(std::memory_order_acquire); }
+    void wait_drained(std::chrono::milliseconds timeout);
+
+private:
+    static constexpr size_t HEADER_SIZE = 4096;
+    static constexpr size_t RECORD_HEADER_SIZE = 4;
+
+    void open_file();
+    void store_positions();
+    bool append_locked(const uint8_t* buffer, size_t buffer_size);
+    void drain();
+    void commit_confirmed(std::chrono::steady_clock::time_point now);
+    void rewind();
+
+    std::string path;
+    size_t capacity;
+    Transmit transmit;
+    Reachable reachable;
+    Pacer pacer;
+
+    uint8_t* mapping;
+    size_t mapping_size;
+    uint8_t* data;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::atomic<bool> spooling;     // Holds datagrams, new datagrams have to be appended
+    uint64_t head;
+    uint64_t tail;
+    uint64_t replay_pos;            // Next datagram the drainer sends
+    bool collector_down;
+    bool stopping;
+    bool overflow_reported;
+
+    // Replayed datagrams waiting for the confirmation: send time and the end of the datagram
+    std::deque<std::pair<std::chrono::steady_clock::time_point, uint64_t>> in_flight;
+
+    std::thread drainer;
+};
+
+#endif // SPOOL_H
@@ -0,0 +1,69 @@
+////////////////////////////////////////////////////
+// File: TemplateExporter.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+
+#ifndef TEMPLATE_EXPORTER_H
+#define TEMPLATE_EXPORTER_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "Config.h"
+#include "Exporter.h"
+#include "DatagramSink.h"
+#include "Flow.h"
+
+constexpr uint16_t VERSION_9 = 9;
+constexpr uint16_t VERSION_IPFIX = 10;
+
+/**
+ * @brief Class for exporting flows in template based formats, NetFlow v9 (RFC 3954) and IPFIX (RFC 7011).
+ *
+ * Records carry 64-bit packet and octet counters. IPFIX records carry absolute millisecond timestamps,
+ * v9 records FIRST_SWITCHED/LAST_SWITCHED relative to SysUptime like NetFlow v5.
+ * Datagrams are filled with as many records as fit into the path MTU towards the collector
+ * and the template is resent every template_refresh datagrams, so a restarted collector can decode again.
+ * Records are encoded directly into one reused datagram buffer.
+ * In biflow mode IPFIX records carry the reverse direction in the RFC 5103 reverse information elements.
+ */
+class TemplateExporter : public Exporter {
+public:
+    TemplateExporter(std::unique_ptr<DatagramSink> sink, Config::ExportFormat format, int mtu, int template_refresh,
+                     bool biflow = false);
+    ~TemplateExporter() override = default;
+
+    void export_flows(const std::vector<Flow>& flows, uint32_t time_start, uint32_t time_end) override;
+    size_t max_flows_per_export() const override;
+    void flush() override;
+    uint32_t sequence() const override;
+    void set_sequence(uint32_t value) override;
+    bool exports_biflows() const override;
+
+private:
+    size_t header_size() const;
+    size_t template_set_size() const;
+    size_t record_size() const;
+    bool template_due() const;
+
+    void format_header(size_t length, uint16_t record_count, uint32_t time_start, uint32_t time_end);
+    void format_template_set(size_t& offset);
+    void format_record(const Flow& flow, size_t& offset, uint32_t time_start);
+
+    Config::ExportFormat format;
+    bool biflow;                    // Records carry both directions, IPFIX only
+    uint16_t template_id;
+    std::unique_ptr<DatagramSink> sink; // Collector or file receiving the datagrams
+    std::vector<uint8_t> buffer;    // Datagram being encoded, reused for every export
+    size_t max_datagram_size;       // Path MTU without IP and UDP headers
+    uint32_t template_refresh;      // Datagrams between template resends
+    uint32_t datagrams_since_template;
+    bool template_sent;
+    uint32_t sequence_number;       // v9: datagrams sent, IPFIX: data records sent
+};
+
+#endif // TEMPLATE_EXPORTER_H
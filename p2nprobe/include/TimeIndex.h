@@ -0,0 +1,76 @@
+////////////////////////////////////////////////////
+// File: TimeIndex.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef TIME_INDEX_H
+#define TIME_INDEX_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "PcapFormat.h"
+
+/**
+ * @brief Sidecar index of a classic pcap file for processing only a time range of it.
+ *
+ * The file is split into blocks of a fixed number of packets, for every block the index stores
+ * its file offset and the lowest and highest timestamp, so the range can be found even when
+ * the timestamps are not perfectly ordered.
+ *
+ * Index file (<pcap>.p2ni), integers in host byte order:
+ *  - Header (40 bytes): magic "P2NI", uint16 version (1), uint16 reserved, uint32 packets per block,
+ *    uint64 size and uint64 modification time (ns) of the pcap file, uint64 block count
+ *  - Blocks (24 bytes): uint64 offset, int64 lowest and int64 highest timestamp in microseconds
+ */
+class TimeIndex {
+public:
+    /**
+     * @brief Byte range of the pcap file holding the packets of the time range.
+     */
+    struct Range {
+        uint64_t start = 0;             // Offset of the first record to read
+        uint64_t end = UINT64_MAX;      // Offset where reading stops
+        bool exact_end = false;         // End comes from the index, otherwise reading stops at the first later packet
+    };
+
+    static bool build(const std::string& pcap_path, uint32_t block_packets);
+    static bool find_range(const std::string& pcap_path, int64_t from_us, int64_t to_us, Range& range);
+    static std::string sidecar_path(const std::string& pcap_path);
+
+private:
+    struct Block {
+        uint64_t offset;
+        int64_t min_us;
+        int64_t max_us;
+    };
+
+    /**
+     * @brief Reads only the record headers of a classic pcap file, packet data is skipped.
+     */
+    class Scanner {
+    public:
+        explicit Scanner(const std::string& path);
+        ~Scanner();
+
+        Scanner(const Scanner&) = delete;
+        Scanner& operator=(const Scanner&) = delete;
+
+        bool valid() const { return file != nullptr; }
+        bool next(uint64_t& offset, int64_t& timestamp_us);
+
+    private:
+        FILE* file = nullptr;
+        std::vector<char> buffer;
+        PcapFormat::FileInfo info;
+    };
+
+    static bool load(const std::string& pcap_path, std::vector<Block>& blocks);
+    static bool pcap_identity(const std::string& pcap_path, uint64_t& size, uint64_t& mtime_ns);
+};
+
+#endif // TIME_INDEX_H
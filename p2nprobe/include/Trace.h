@@ -0,0 +1,147 @@
+////////////////////////////////////////////////////
+// File: Trace.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+#include "Config.h"
+
+/**
+ * @brief Cycle counting of the hot path stages, compiled only when Config::ENABLE_TRACING is set.
+ *
+ * Every TRACE_SCOPE adds the cycles spent in the scope and one call to the stage totals
+ * of the calling thread. Scopes inside sampled batches of packets are also stored as
+ * Chrome trace events (chrome://tracing, Perfetto) when a trace file is set.
+ * Scopes are inclusive, nested stages are counted in both stages.
+ */
+class Trace {
+public:
+    enum class Stage : size_t {
+        READ,
+        DECODE,
+        LOOKUP,
+        EXPIRY,
+        EXPORT,
+        COUNT
+    };
+
+    static constexpr size_t STAGE_COUNT = static_cast<size_t>(Stage::COUNT);
+
+    /**
+     * @brief Reads the time stamp counter, nanoseconds of the steady clock on other architectures.
+     */
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    /**
+     * @brief Marks the start of the next packet, every Config::TRACE_SAMPLE_BATCHES-th batch is sampled.
+     */
+    static void next_packet() {
+        ThreadTotals& totals = local();
+        totals.sampled = events_enabled &&
+            (totals.packets++ / Config::TRACE_BATCH_SIZE) % Config::TRACE_SAMPLE_BATCHES == 0;
+    }
+
+    /**
+     * @brief Adds one call of the stage to the totals of the calling thread.
+     */
+    static void add(Stage stage, uint64_t start, uint64_t end) {
+        ThreadTotals& totals = local();
+        size_t index = static_cast<size_t>(stage);
+        totals.cycles[index] += end - start;
+        totals.calls[index]++;
+        if (totals.sampled && totals.events.size() < Config::TRACE_MAX_EVENTS) {
+            totals.events.push_back({stage, start, end});
+        }
+    }
+
+    static void set_output(const std::string& path);
+    static void report();
+
+private:
+    struct Event {
+        Stage stage;
+        uint64_t start;
+        uint64_t end;
+    };
+
+    struct ThreadTotals {
+        std::array<uint64_t, STAGE_COUNT> cycles{};
+        std::array<uint64_t, STAGE_COUNT> calls{};
+        uint64_t packets = 0;
+        bool sampled = false;
+        uint32_t thread_id = 0;
+        std::vector<Event> events;
+    };
+
+    static bool events_enabled;
+
+    static ThreadTotals& local() {
+        thread_local ThreadTotals* totals = register_thread();
+        return *totals;
+    }
+
+    static ThreadTotals* register_thread();
+    static std::vector<std::unique_ptr<ThreadTotals>>& all_threads();
+    static const char* stage_name(Stage stage);
+    static void write_events(double cycles_per_us);
+};
+
+/**
+ * @brief Adds the duration of the enclosing scope to the stage. Without Config::ENABLE_TRACING
+ * the constructor and destructor are empty, so the scope costs nothing.
+ */
+class TraceScope {
+public:
+    explicit TraceScope(Trace::Stage stage)
+        : stage(stage) {
+        if constexpr (Config::ENABLE_TRACING) {
+            start = Trace::now();
+        }
+    }
+
+    ~TraceScope() {
+        if constexpr (Config::ENABLE_TRACING) {
+            Trace::add(stage, start, Trace::now());
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    Trace::Stage stage;
+    uint64_t start = 0;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+// Convenience macros for the hot path
+#define TRACE_SCOPE(stage) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(Trace::Stage::stage)
+#define TRACE_PACKET() do { if constexpr (Config::ENABLE_TRACING) { Trace::next_packet(); } } while (0)
+
+#endif // TRACE_H
@@ -0,0 +1,59 @@
+////////////////////////////////////////////////////
+// File: UdpSender.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef UDP_SENDER_H
+#define UDP_SENDER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <netinet/in.h>
+
+#include "DatagramSink.h"
+#include "Pacer.h"
+#include "Spool.h"
+
+/**
+ * @brief UDP transport shared by all exporters. Resolves the collector address and sends finished datagrams.
+ * Sending can be paced by a token bucket or by the capture time, so the collector is not flooded.
+ * With a spool, datagrams the collector did not get are kept on disk and replayed (see Spool).
+ */
+class UdpSender : public DatagramSink {
+public:
+    UdpSender(const std::string& collector_ip, int collector_port, const Pacer& pacer, int send_buffer,
+              const SpoolSettings& spool_settings = SpoolSettings());
+    ~UdpSender() override;
+
+    UdpSender(const UdpSender&) = delete;
+    UdpSender& operator=(const UdpSender&) = delete;
+
+    void send(const uint8_t* buffer, size_t buffer_size) override;
+    int path_mtu() const override;
+    void set_capture_time(uint32_t capture_ms) override;
+    void flush() override;
+
+private:
+    int create_socket();
+    void close_socket();
+    void size_send_buffer(int send_buffer);
+    bool transmit(const uint8_t* buffer, size_t buffer_size);
+    bool collector_reachable();
+    void spool_refused();
+
+    int sock;
+    struct sockaddr_in server_addr;
+    Pacer pacer;
+
+    std::unique_ptr<Spool> spool;
+    // Copies of the last datagrams sent directly, ICMP errors quote only their start
+    std::vector<std::vector<uint8_t>> recent;
+    uint64_t recent_count;
+};
+
+#endif // UDP_SENDER_H
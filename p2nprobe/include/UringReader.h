@@ -0,0 +1,92 @@
+////////////////////////////////////////////////////
+// File: UringReader.h
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#ifndef URING_READER_H
+#define URING_READER_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+
+#include "BlockSource.h"
+
+/**
+ * @brief Reads the capture file with io_uring, several large aligned reads are in flight while
+ * the reader parses the oldest completed buffer in place.
+ *
+ * The ring is set up with the raw system calls, no liburing is needed. With direct reads the
+ * file is opened with O_DIRECT, file systems that do not support it are read through the page cache.
+ */
+class UringReader : public BlockSource {
+public:
+    UringReader(const std::string& path, bool direct);
+    ~UringReader() override;
+
+    UringReader(const UringReader&) = delete;
+    UringReader& operator=(const UringReader&) = delete;
+
+    bool start() override;
+    bool failed() const override;
+    std::string error() const override;
+
+protected:
+    bool next_block(const uint8_t*& data, size_t& size) override;
+
+private:
+    /**
+     * @brief Buffer of one read, holds the file chunk at offset.
+     */
+    struct Buffer {
+        uint8_t* data = nullptr;
+        struct iovec iov;
+        uint64_t offset = 0;    // Offset of the chunk in the file
+        size_t expected = 0;    // Chunk size, smaller only for the last chunk
+        size_t filled = 0;      // Bytes read so far, short reads are continued
+        bool pending = false;   // Read is submitted and not completed
+    };
+
+    std::string path;
+    bool direct;
+    int fd = -1;
+    uint64_t file_size = 0;
+    std::string error_message;
+
+    int ring_fd = -1;
+    void* sq_ring = nullptr;
+    void* cq_ring = nullptr;
+    size_t sq_ring_size = 0;
+    size_t cq_ring_size = 0;
+    struct io_uring_sqe* sqes = nullptr;
+    size_t sqes_size = 0;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    struct io_uring_cqe* cqes = nullptr;
+
+    std::vector<Buffer> buffers;
+    uint64_t next_chunk = 0;        // Chunk of the next read
+    uint64_t current_chunk = 0;     // Chunk the reader parses
+    bool holding = false;
+    uint64_t bytes_read = 0;
+    std::chrono::steady_clock::time_point start_time;
+
+    bool setup_ring();
+    bool submit(unsigned index);
+    bool reap(bool block);
+    bool wait(unsigned index);
+    bool schedule(unsigned index);
+    bool fail(const std::string& message);
+    void report();
+};
+
+#endif // URING_READER_H
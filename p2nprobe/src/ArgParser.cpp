@@ -9,6 +9,9 @@
 #include <iostream>
 #include <sstream>
 #include <cstdlib>
+#include <cmath>
+#include <ctime>
+#include <limits>
 #include <filesystem>
 #include <fstream>
 
@@ -16,6 +19,7 @@
 #include "ErrorCodes.h"
 #include "Config.h"
 #include "Logger.h"
+#include "FileSink.h"
 
 // Maximum and minimum possible port number
 const unsigned int PORT_MIN = Config::MIN_PORT;
@@ -32,6 +36,9 @@ DESCRIPTION:
 
 USAGE:
     ./p2nprobe <host>:<port> <pcap_file_path> [OPTIONS]
+    ./p2nprobe <pcap_file_path> --output <file> [OPTIONS]
+    ./p2nprobe <pcap_file_path> --shm <name> [OPTIONS]
+    ./p2nprobe <pcap_file_path> --build-index [--index-interval <n>]
 
 ARGUMENTS:
     <host>:<port>            Address of the NetFlow collector in format host:port
@@ -44,12 +51,91 @@ OPTIONS:
                             Range: )" + std::to_string(Config::MIN_TIMEOUT) + R"(-)" + std::to_string(Config::MAX_TIMEOUT) + R"( seconds
     -i <inactive_timeout>    Inactive timeout in seconds (default: )" + std::to_string(Config::DEFAULT_INACTIVE_TIMEOUT) + R"()
                             Range: )" + std::to_string(Config::MIN_TIMEOUT) + R"(-)" + std::to_string(Config::MAX_TIMEOUT) + R"( seconds
+    --format <format>        Export format: v5, v9, ipfix or arrow (default: v5)
+                            arrow writes Apache Arrow IPC stream and requires --output
+    --mtu <bytes>            MTU of the path to the collector for v9/IPFIX datagrams
+                            (default: queried from the route to the collector)
+                            Range: )" + std::to_string(Config::MIN_EXPORT_MTU) + R"(-)" + std::to_string(Config::MAX_EXPORT_MTU) + R"( bytes
+    --template-refresh <n>   Resend v9/IPFIX template every n datagrams (default: )" + std::to_string(Config::DEFAULT_TEMPLATE_REFRESH) + R"()
+    --output <file>          Write the export datagrams to a file instead of the collector
+    --compress <codec>       Block compression of the output file: none, zlib, lz4 or zstd (default: none)
+    --direct-io              Write the output file with O_DIRECT
+    --shm <name>             Hand the export datagrams to a local collector through the shared memory
+                            ring /dev/shm/<name>; lossless, waits for the reader when the ring is full
+    --shm-size <MiB>         Size of the shared memory ring, power of two (default: )" + std::to_string(Config::DEFAULT_SHM_RING_SIZE) + R"()
+    --row-group <rows>       Rows per Arrow record batch (default: )" + std::to_string(Config::DEFAULT_ROW_GROUP_SIZE) + R"()
+    --rate <n><unit>         Limit export rate, unit is dps (datagrams/s), bps, kbps, mbps or gbps
+                            Examples: 500dps, 20mbps (default: unlimited)
+    --replay-speed <x|max>   Export at x times the speed of the capture timestamps (default: max)
+    --sndbuf <bytes>         Size of the socket send buffer (default: sized automatically)
+    --spool <file>           Keep datagrams the collector refused in file and replay them once it is back
+    --spool-size <MiB>       Size cap of the spool file (default: )" + std::to_string(Config::DEFAULT_SPOOL_SIZE) + R"()
+    --spool-rate <dps>       Replay rate of the spooled datagrams (default: )" + std::to_string(Config::DEFAULT_SPOOL_RATE) + R"()
+    --stats-interval <sec>   Print a JSON line with counters and stage latencies every sec seconds
+                            (SIGUSR1 prints it at any time)
+    --prometheus <port>      Serve metrics in Prometheus text format on 127.0.0.1:port
+    --trace <file>           Write Chrome trace events of sampled packet batches to file
+                            (requires a build with tracing: make TRACE=1)
+    --checkpoint <file>      Save the flows left at the end to file instead of exporting them
+    --resume <file>          Continue with the flows and export state saved by --checkpoint
+    --from <time>            Process only packets at or after time
+    --to <time>              Process only packets before time
+                            Time is unix seconds (1728900000.5) or UTC YYYY-MM-DDTHH:MM:SS
+                            Compressed captures, --reader uring and pcapng cannot seek,
+                            they are read whole and filtered by time
+    --build-index            Write the time index of the PCAP file used by --from/--to and exit
+    --index-interval <n>     Packets per time index entry (default: )" + std::to_string(Config::DEFAULT_INDEX_INTERVAL) + R"()
+    --threads <n>            Aggregate a classic pcap file on n threads (default: )" + std::to_string(Config::DEFAULT_THREADS) + R"()
+                            Flows are the same as with one thread, cannot be combined with --from/--to
+    --reader libpcap|uring   Backend reading uncompressed captures (default: libpcap)
+                            uring keeps several large reads in flight, falls back to libpcap when unavailable
+    --direct-read            Read the capture with O_DIRECT, bypassing the page cache (requires --reader uring)
+    --biflow                 Aggregate both directions of a connection into one flow; exported as one
+                            record with reverse fields for ipfix, as two records for the other formats
+    --tcp-end                Export TCP flows after RST, or after FIN in both directions and the linger
+    --fin-linger <ms>        Time a flow stays after the second FIN (default: )" + std::to_string(Config::DEFAULT_FIN_LINGER_MS) + R"()
+    --flow-spill <file>      Move the least recently used flows above --hot-flows into a memory mapped file
+    --hot-flows <n>          Flows kept in memory with --flow-spill (default: )" + std::to_string(Config::DEFAULT_HOT_FLOWS) + R"()
+    --admission              Keep flows of a single packet in a compact probation table until their second packet
+    --dedup                  Drop copies of a packet seen again within the window (SPAN and mirror ports)
+    --dedup-window <ms>      Longest time between two copies of a packet (default: )" + std::to_string(Config::DEFAULT_DEDUP_WINDOW_MS) + R"()
+    --sketches               Print top talkers and distinct host counts as JSON lines to the standard output,
+                            with the stats lines (--stats-interval, SIGUSR1) and at the end
+    --sketch-interval <sec>  Capture time per sketch report, 0 for the whole capture (default: )" + std::to_string(Config::DEFAULT_SKETCH_INTERVAL) + R"()
+    --top-k <n>              Heaviest keys reported per sketch (default: )" + std::to_string(Config::DEFAULT_TOP_K) + R"()
+    --rollup <fields>        Also export expired flows summed by a coarser key, comma separated fields
+                            src[/N], dst[/N], proto, sport, dport, srcas, dstas
+    --rollup-interval <sec>  Capture time per rollup bin (default: )" + std::to_string(Config::DEFAULT_ROLLUP_INTERVAL) + R"()
+    --rollup-only            Export only the rollups, not the flows
+    --routes <file>          Fill AS numbers, masks and nexthop from a routing table file,
+                            one "<prefix>/<length> <nexthop> <AS>" route per line,
+                            the lookup table takes 64 MiB however few routes there are
     -h                       Display this help message and exit
 
 EXAMPLES:
     ./p2nprobe localhost:9995 capture.pcap
     ./p2nprobe 192.168.1.100:2055 traffic.pcap -a 30 -i 15
     ./p2nprobe netflow-collector.example.com:9995 network_dump.pcap -a 120 -i 60
+    ./p2nprobe localhost:4739 traffic.pcap --format ipfix --mtu 9000
+    ./p2nprobe traffic.pcap --output flows.nf5 --compress zstd
+    ./p2nprobe traffic.pcap --output flows.arrows --format arrow
+    ./p2nprobe traffic.pcap --shm p2nprobe --format ipfix
+    ./p2nprobe localhost:9995 traffic.pcap --replay-speed 10 --rate 1000dps
+    ./p2nprobe localhost:9995 traffic.pcap --stats-interval 5 --prometheus 9100
+    ./p2nprobe localhost:9995 traffic.pcap --spool /var/spool/p2nprobe.spool --spool-rate 5000
+    ./p2nprobe localhost:9995 part2.pcap --resume flows.ckpt --checkpoint flows.ckpt
+    ./p2nprobe huge.pcap --build-index
+    ./p2nprobe localhost:9995 huge.pcap --from 2024-10-14T12:00:00 --to 2024-10-14T13:00:00
+    ./p2nprobe localhost:9995 huge.pcap --threads 8
+    ./p2nprobe localhost:9995 huge.pcap --reader uring --direct-read
+    ./p2nprobe localhost:4739 traffic.pcap --format ipfix --biflow
+    ./p2nprobe localhost:9995 traffic.pcap --tcp-end --fin-linger 500
+    ./p2nprobe localhost:9995 mirror.pcap --dedup --dedup-window 10
+    ./p2nprobe localhost:9995 scan.pcap --admission
+    ./p2nprobe localhost:9995 incident.pcap --flow-spill /var/tmp/flows.spill --hot-flows 200000
+    ./p2nprobe localhost:9995 traffic.pcap --sketches --sketch-interval 10 --top-k 5
+    ./p2nprobe localhost:9995 traffic.pcap --rollup src/24,dst/24,proto,dport --rollup-only
+    ./p2nprobe localhost:9995 traffic.pcap --routes routes.txt --rollup srcas,dstas
 )";
 
 
@@ -66,7 +152,50 @@ ArgParser::ArgParser(int argc, char* argv[])
     collectorPort(0),
     pcapFilePath(""),
     activeTimeout(Config::DEFAULT_ACTIVE_TIMEOUT),
-    inactiveTimeout(Config::DEFAULT_INACTIVE_TIMEOUT) {
+    inactiveTimeout(Config::DEFAULT_INACTIVE_TIMEOUT),
+    exportFormat(Config::DEFAULT_EXPORT_FORMAT),
+    exportMtu(Config::DEFAULT_EXPORT_MTU),
+    templateRefresh(Config::DEFAULT_TEMPLATE_REFRESH),
+    outputPath(""),
+    compression(Config::Compression::NONE),
+    directIo(false),
+    rowGroupSize(Config::DEFAULT_ROW_GROUP_SIZE),
+    rateUnit(Pacer::RateUnit::NONE),
+    rate(0),
+    replaySpeed(0),
+    sendBuffer(Config::DEFAULT_SEND_BUFFER),
+    statsInterval(Config::DEFAULT_STATS_INTERVAL),
+    prometheusPort(Config::DEFAULT_PROMETHEUS_PORT),
+    tracePath(""),
+    checkpointPath(""),
+    resumePath(""),
+    fromTime(std::numeric_limits<int64_t>::min()),
+    toTime(std::numeric_limits<int64_t>::max()),
+    buildIndex(false),
+    indexInterval(Config::DEFAULT_INDEX_INTERVAL),
+    threads(Config::DEFAULT_THREADS),
+    inputReader(Config::DEFAULT_INPUT_READER),
+    directRead(false),
+    biflow(false),
+    tcpEnd(false),
+    finLinger(Config::DEFAULT_FIN_LINGER_MS),
+    flowSpillPath(""),
+    hotFlows(Config::DEFAULT_HOT_FLOWS),
+    admission(false),
+    dedup(false),
+    dedupWindow(Config::DEFAULT_DEDUP_WINDOW_MS),
+    sketches(false),
+    sketchInterval(Config::DEFAULT_SKETCH_INTERVAL),
+    topK(Config::DEFAULT_TOP_K),
+    rollup(false),
+    rollupInterval(Config::DEFAULT_ROLLUP_INTERVAL),
+    rollupOnly(false),
+    routesPath(""),
+    shmName(""),
+    shmSize(Config::DEFAULT_SHM_RING_SIZE),
+    spoolPath(""),
+    spoolSize(Config::DEFAULT_SPOOL_SIZE),
+    spoolRate(Config::DEFAULT_SPOOL_RATE) {
 
     LOG_DEBUG("Parsing command line arguments");
     parseArgs(argc, argv);
@@ -187,6 +316,252 @@ void ArgParser::validatePcapFile(const std::string& filePath) {
     LOG_DEBUG("PCAP file validated: ", filePath);
 }
 
+/**
+ * @brief Parses the integer value of an option and checks its range.
+ * Moves the index to the value, exits the program if the value is missing or invalid.
+ *
+ * @param argc Number of command line arguments
+ * @param argv Array of command line arguments
+ * @param i Index of the option, set to the index of its value
+ * @param optionName Name of the option for error messages
+ * @param minValue Minimum allowed value
+ * @param maxValue Maximum allowed value
+ *
+ * @return Parsed value
+ */
+int ArgParser::parseIntOption(int argc, char* argv[], int& i, const std::string& optionName, int minValue, int maxValue) {
+    if (++i >= argc) {
+        std::cerr << "Error: " << optionName << " option requires a value.\n";
+        printUsage();
+        ExitWith(ErrorCode::INVALID_ARGS);
+    }
+
+    int value = 0;
+    try {
+        size_t parsed = 0;
+        value = std::stoi(argv[i], &parsed);
+        if (parsed != std::string(argv[i]).size()) {
+            throw std::invalid_argument(argv[i]);
+        }
+    }
+    catch (const std::exception& e) {
+        LOG_ERROR("Invalid ", optionName, " value: ", argv[i]);
+        std::cerr << "Error: Invalid " << optionName << " value '" << argv[i] << "'.\n";
+        printUsage();
+        ExitWith(ErrorCode::INVALID_ARGS);
+    }
+
+    if (value < minValue || value > maxValue) {
+        LOG_ERROR(optionName, " value out of range: ", value);
+        std::cerr << "Error: " << optionName << " must be between " << minValue
+                  << " and " << maxValue << ". Got: " << value << "\n";
+        printUsage();
+        ExitWith(ErrorCode::INVALID_ARGS);
+    }
+
+    LOG_DEBUG(optionName, " set to: ", value);
+    return value;
+}
+
+/**
+ * @brief Parses the export format name.
+ *
+ * @param format One of v5, v9 or ipfix
+ */
+void ArgParser::parseExportFormat(const std::string& format) {
+    if (format == "v5" || format == "5") {
+        exportFormat = Config::ExportFormat::NETFLOW_V5;
+    }
+    else if (format == "v9" || format == "9") {
+        exportFormat = Config::ExportFormat::NETFLOW_V9;
+    }
+    else if (format == "ipfix" || format == "10") {
+        exportFormat = Config::ExportFormat::IPFIX;
+    }
+    else if (format == "arrow") {
+        exportFormat = Config::ExportFormat::ARROW;
+    }
+    else {
+        LOG_ERROR("Invalid export format: ", format);
+        std::cerr << "Error: Unknown export format '" << format << "'. Use v5, v9, ipfix or arrow.\n";
+        printUsage();
+        ExitWith(ErrorCode::INVALID_ARGS);
+    }
+    LOG_DEBUG("Export format set to: ", format);
+}
+
+/**
+ * @brief Parses the compression name of the output file and checks it was compiled in.
+ *
+ * @param name One of none, zlib, lz4 or zstd
+ */
+void ArgParser::parseCompression(const std::string& name) {
+    if (name == "none") {
+        compression = Config::Compression::NONE;
+    }
+    else if (name == "zlib") {
+        compression = Config::Compression::ZLIB;
+    }
+    else if (name == "lz4") {
+        compression = Config::Compression::LZ4;
+    }
+    else if (name == "zstd") {
+        compression = Config::Compression::ZSTD;
+    }
+    else {
+        LOG_ERROR("Invalid compression: ", name);
+        std::cerr << "Error: Unknown compression '" << name << "'. Use none, zlib, lz4 or zstd.\n";
+        printUsage();
+        ExitWith(ErrorCode::INVALID_ARGS);
+    }
+
+    if (!FileSink::compression_supported(compression)) {
+        std::cerr << "Error: Compression '" << name << "' is not available in this build.\n";
+        ExitWith(ErrorCode::INVALID_ARGS);
+    }
+    LOG_DEBUG("Output compression set to: ", name);
+}
+
+/**
+ * @brief Parses the backend reading uncompressed captures.
+ *
+ * @param name Name of the backend, libpcap or uring
+ */
+void ArgParser::parseInputReader(const std::string& name) {
+    if (name == "libpcap") {
+        inputReader = Config::InputReader::LIBPCAP;
+    }
+    else if (name == "uring") {
+        inputReader = Config::InputReader::URING;
+    }
+    else {
+        LOG_ERROR("Invalid input reader: ", name);
+        std::cerr << "Error: Unknown reader '" << name << "'. Use libpcap or uring.\n";
+        printUsage();
+        ExitWith(ErrorCode::INVALID_ARGS);
+    }
+    LOG_DEBUG("Input reader set to: ", name);
+}
+
+/**
+ * @brief Parses the export rate limit, number followed by its unit.
+ *
+ * @param value Rate such as 500dps or 20mbps
+ */
+void ArgParser::parseRate(const std::string& value) {
+    double number = 0;
+    size_t parsed = 0;
+    try {
+        number = std::stod(value, &parsed);
+    }
+    catch (const std::exception& e) {
+        parsed = 0;
+    }
+
+    std::string unit = value.substr(parsed);
+    double multiplier = 0;
+    if (unit == "dps") {
+        rateUnit = Pacer::RateUnit::DATAGRAMS;
+        multiplier = 1;
+    }
+    else if (unit == "bps") {
+        multiplier = 1;
+    }
+    else if (unit == "kbps") {
+        multiplier = 1e3;
+    }
+    else if (unit == "mbps") {
+        multiplier = 1e6;
+    }
+    else if (unit == "gbps") {
+        multiplier = 1e9;
+    }
+
+    if (parsed == 0 || multiplier == 0 || number <= 0) {
+        LOG_ERROR("Invalid rate: ", value);
+        std::cerr << "Error: Invalid rate '" << value << "'. Use e.g. 500dps or 20mbps.\n";
+        printUsage();
+        ExitWith(ErrorCode::INVALID_ARGS);
+    }
+
+    if (rateUnit != Pacer::RateUnit::DATAGRAMS) {
+        rateUnit = Pacer::RateUnit::BITS;
+    }
+    rate = number * multiplier;
+    LOG_DEBUG("Export rate set to: ", rate, rateUnit == Pacer::RateUnit::DATAGRAMS ? " datagrams/s" : " bits/s");
+}
+
+/**
+ * @brief Parses the replay speed, multiple of the capture speed or max for no pacing.
+ *
+ * @param value Speed such as 1, 10 or max
+ */
+void ArgParser::parseReplaySpeed(const std::string& value) {
+    if (value == "max") {
+        replaySpeed = 0;
+        return;
+    }
+
+    size_t parsed = 0;
+    try {
+        replaySpeed = std::stod(value, &parsed);
+    }
+    catch (const std::exception& e) {
+        parsed = 0;
+    }
+
+    if (parsed != value.size() || replaySpeed <= 0) {
+        LOG_ERROR("Invalid replay speed: ", value);
+        std::cerr << "Error: Invalid replay speed '" << value << "'. Use a positive number or max.\n";
+        printUsage();
+        ExitWith(ErrorCode::INVALID_ARGS);
+    }
+    LOG_DEBUG("Replay speed set to: ", replaySpeed);
+}
+
+/**
+ * @brief Parses the boundary of the processed time range.
+ *
+ * @param value Unix time in seconds with optional fraction, or UTC time in format YYYY-MM-DDTHH:MM:SS
+ * @param optionName Name of the option for the error message
+ *
+ * @return Time in microseconds since the epoch
+ */
+int64_t ArgParser::parseTime(const std::string& value, const std::string& optionName) {
+    size_t parsed = 0;
+    double seconds = 0;
+    try {
+        seconds = std::stod(value, &parsed);
+    }
+    catch (const std::exception& e) {
+        parsed = 0;
+    }
+    if (parsed == value.size()) {
+        // inf, nan and values past the microseconds of int64 cannot be converted
+        if (!std::isfinite(seconds) || seconds < 0 ||
+            seconds >= static_cast<double>(std::numeric_limits<int64_t>::max()) / 1000000) {
+            LOG_ERROR(optionName, " time out of range: ", value);
+            std::cerr << "Error: " << optionName << " time '" << value << "' is out of range.\n";
+            printUsage();
+            ExitWith(ErrorCode::INVALID_ARGS);
+        }
+        return static_cast<int64_t>(seconds * 1000000);
+    }
+
+    struct tm tm = {};
+    const char* end = strptime(value.c_str(), "%Y-%m-%dT%H:%M:%S", &tm);
+    if (end != nullptr && (*end == '\0' || (end[0] == 'Z' && end[1] == '\0'))) {
+        return static_cast<int64_t>(timegm(&tm)) * 1000000;
+    }
+
+    LOG_ERROR("Invalid ", optionName, " time: ", value);
+    std::cerr << "Error: Invalid " << optionName << " time '" << value
+              << "'. Use unix seconds or YYYY-MM-DDTHH:MM:SS (UTC).\n";
+    printUsage();
+    ExitWith(ErrorCode::INVALID_ARGS);
+    return 0;
+}
+
 /**
  * @brief Parses the command line arguments by iterating through them and trying to parse them.
  * If the argument is not valid, the program exits with an error message.
@@ -263,6 +638,248 @@ void ArgParser::parseArgs(int argc, char* argv[]) {
                 ExitWith(ErrorCode::INVALID_ARGS);
             }
         }
+        // Export format
+        else if (arg == "--format") {
+            if (++i >= argc) {
+                std::cerr << "Error: --format option requires a value.\n";
+                printUsage();
+                ExitWith(ErrorCode::INVALID_ARGS);
+            }
+            parseExportFormat(argv[i]);
+        }
+        // Path MTU for template based export
+        else if (arg == "--mtu") {
+            exportMtu = parseIntOption(argc, argv, i, "--mtu", Config::MIN_EXPORT_MTU, Config::MAX_EXPORT_MTU);
+        }
+        // Template resend interval
+        else if (arg == "--template-refresh") {
+            templateRefresh = parseIntOption(argc, argv, i, "--template-refresh",
+                                             Config::MIN_TEMPLATE_REFRESH, Config::MAX_TEMPLATE_REFRESH);
+        }
+        // Output file instead of collector
+        else if (arg == "--output") {
+            if (++i >= argc || argv[i][0] == '\0') {
+                std::cerr << "Error: --output option requires a file path.\n";
+                printUsage();
+                ExitWith(ErrorCode::INVALID_ARGS);
+            }
+            outputPath = argv[i];
+            LOG_DEBUG("Output file set to: ", outputPath);
+        }
+        // Compression of the output file
+        else if (arg == "--compress") {
+            if (++i >= argc) {
+                std::cerr << "Error: --compress option requires a value.\n";
+                printUsage();
+                ExitWith(ErrorCode::INVALID_ARGS);
+            }
+            parseCompression(argv[i]);
+        }
+        else if (arg == "--direct-io") {
+            directIo = true;
+        }
+        // Rows per Arrow record batch
+        else if (arg == "--row-group") {
+            rowGroupSize = parseIntOption(argc, argv, i, "--row-group",
+                                          Config::MIN_ROW_GROUP_SIZE, Config::MAX_ROW_GROUP_SIZE);
+        }
+        // Export pacing
+        else if (arg == "--rate") {
+            if (++i >= argc) {
+                std::cerr << "Error: --rate option requires a value.\n";
+                printUsage();
+                ExitWith(ErrorCode::INVALID_ARGS);
+            }
+            parseRate(argv[i]);
+        }
+        else if (arg == "--replay-speed") {
+            if (++i >= argc) {
+                std::cerr << "Error: --replay-speed option requires a value.\n";
+                printUsage();
+                ExitWith(ErrorCode::INVALID_ARGS);
+            }
+            parseReplaySpeed(argv[i]);
+        }
+        else if (arg == "--sndbuf") {
+            sendBuffer = parseIntOption(argc, argv, i, "--sndbuf", Config::MIN_SEND_BUFFER, Config::MAX_SEND_BUFFER);
+        }
+        // Metrics
+        else if (arg == "--stats-interval") {
+            statsInterval = parseIntOption(argc, argv, i, "--stats-interval",
+                                           Config::MIN_STATS_INTERVAL, Config::MAX_STATS_INTERVAL);
+        }
+        else if (arg == "--prometheus") {
+            prometheusPort = parseIntOption(argc, argv, i, "--prometheus", Config::MIN_PORT, Config::MAX_PORT);
+        }
+        else if (arg == "--trace") {
+            if (++i >= argc) {
+                std::cerr << "Error: --trace option requires a value.\n";
+                printUsage();
+                ExitWith(ErrorCode::INVALID_ARGS);
+            }
+            if (!Config::ENABLE_TRACING) {
+                std::cerr << "Error: --trace requires a build with tracing enabled (make TRACE=1).\n";
+                ExitWith(ErrorCode::INVALID_ARGS);
+            }
+            tracePath = argv[i];
+            LOG_DEBUG("Trace file set to: ", tracePath);
+        }
+        // Flow table checkpoint
+        else if (arg == "--checkpoint" || arg == "--resume") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " option requires a value.\n";
+                printUsage();
+                ExitWith(ErrorCode::INVALID_ARGS);
+            }
+            (arg == "--checkpoint" ? checkpointPath : resumePath) = argv[i];
+            LOG_DEBUG(arg, " file set to: ", argv[i]);
+        }
+        // Time range
+        else if (arg == "--from" || arg == "--to") {
+            if (++i >= argc) {
+                std::cerr << "Error: " << arg << " option requires a value.\n";
+                printUsage();
+                ExitWith(ErrorCode::INVALID_ARGS);
+            }
+            (arg == "--from" ? fromTime : toTime) = parseTime(argv[i], arg);
+            LOG_DEBUG(arg, " set to: ", argv[i]);
+        }
+        else if (arg == "--build-index") {
+            buildIndex = true;
+        }
+        else if (arg == "--index-interval") {
+            indexInterval = parseIntOption(argc, argv, i, "--index-interval",
+                                           Config::MIN_INDEX_INTERVAL, Config::MAX_INDEX_INTERVAL);
+        }
+        else if (arg == "--threads") {
+            threads = parseIntOption(argc, argv, i, "--threads", Config::MIN_THREADS, Config::MAX_THREADS);
+        }
+        // Input backend
+        else if (arg == "--reader") {
+            if (++i >= argc) {
+                std::cerr << "Error: --reader option requires a value.\n";
+                printUsage();
+                ExitWith(ErrorCode::INVALID_ARGS);
+            }
+            parseInputReader(argv[i]);
+        }
+        else if (arg == "--direct-read") {
+            directRead = true;
+        }
+        // Bidirectional aggregation
+        else if (arg == "--biflow") {
+            biflow = true;
+        }
+        // TCP termination
+        else if (arg == "--tcp-end") {
+            tcpEnd = true;
+        }
+        else if (arg == "--fin-linger") {
+            finLinger = parseIntOption(argc, argv, i, "--fin-linger", Config::MIN_FIN_LINGER_MS, Config::MAX_FIN_LINGER_MS);
+        }
+        // Disk-backed flow table
+        else if (arg == "--flow-spill") {
+            if (++i >= argc) {
+                std::cerr << "Error: --flow-spill option requires a file path.\n";
+                printUsage();
+                ExitWith(ErrorCode::INVALID_ARGS);
+            }
+            flowSpillPath = argv[i];
+            LOG_DEBUG("Flow spill file set to: ", flowSpillPath);
+        }
+        else if (arg == "--hot-flows") {
+            hotFlows = parseIntOption(argc, argv, i, "--hot-flows", Config::MIN_HOT_FLOWS, Config::MAX_HOT_FLOWS);
+        }
+        // Flow admission
+        else if (arg == "--admission") {
+            admission = true;
+        }
+        // Duplicate packet suppression
+        else if (arg == "--dedup") {
+            dedup = true;
+        }
+        else if (arg == "--dedup-window") {
+            dedupWindow = parseIntOption(argc, argv, i, "--dedup-window", Config::MIN_DEDUP_WINDOW_MS, Config::MAX_DEDUP_WINDOW_MS);
+        }
+        // Sketches
+        else if (arg == "--sketches") {
+            sketches = true;
+        }
+        else if (arg == "--sketch-interval") {
+            sketchInterval = parseIntOption(argc, argv, i, "--sketch-interval",
+                                            Config::MIN_SKETCH_INTERVAL, Config::MAX_SKETCH_INTERVAL);
+        }
+        else if (arg == "--top-k") {
+            topK = parseIntOption(argc, argv, i, "--top-k", Config::MIN_TOP_K, Config::MAX_TOP_K);
+        }
+        // Rollup
+        else if (arg == "--rollup") {
+            if (++i >= argc) {
+                std::cerr << "Error: --rollup option requires a value.\n";
+                printUsage();
+                ExitWith(ErrorCode::INVALID_ARGS);
+            }
+            std::string error;
+            if (!Rollup::parse_spec(argv[i], rollupSpec, error)) {
+                LOG_ERROR("Invalid rollup key: ", argv[i]);
+                std::cerr << "Error: Invalid --rollup key: " << error << ".\n";
+                printUsage();
+                ExitWith(ErrorCode::INVALID_ARGS);
+            }
+            rollup = true;
+            LOG_DEBUG("Rollup key set to: ", argv[i]);
+        }
+        else if (arg == "--rollup-interval") {
+            rollupInterval = parseIntOption(argc, argv, i, "--rollup-interval",
+                                            Config::MIN_ROLLUP_INTERVAL, Config::MAX_ROLLUP_INTERVAL);
+        }
+        else if (arg == "--rollup-only") {
+            rollupOnly = true;
+        }
+        // Routing table
+        else if (arg == "--routes") {
+            if (++i >= argc) {
+                std::cerr << "Error: --routes option requires a value.\n";
+                printUsage();
+                ExitWith(ErrorCode::INVALID_ARGS);
+            }
+            routesPath = argv[i];
+            LOG_DEBUG("Routing table file set to: ", routesPath);
+        }
+        // Shared memory ring instead of collector
+        else if (arg == "--shm") {
+            if (++i >= argc || argv[i][0] == '\0' || std::string(argv[i]).find('/', 1) != std::string::npos) {
+                std::cerr << "Error: --shm option requires a name without slashes.\n";
+                printUsage();
+                ExitWith(ErrorCode::INVALID_ARGS);
+            }
+            shmName = argv[i];
+            LOG_DEBUG("Shared memory ring set to: ", shmName);
+        }
+        else if (arg == "--shm-size") {
+            shmSize = parseIntOption(argc, argv, i, "--shm-size", Config::MIN_SHM_RING_SIZE, Config::MAX_SHM_RING_SIZE);
+            if ((shmSize & (shmSize - 1)) != 0) {
+                std::cerr << "Error: --shm-size has to be a power of two.\n";
+                printUsage();
+                ExitWith(ErrorCode::INVALID_ARGS);
+            }
+        }
+        // Spool of refused datagrams
+        else if (arg == "--spool") {
+            if (++i >= argc || argv[i][0] == '\0') {
+                std::cerr << "Error: --spool option requires a file path.\n";
+                printUsage();
+                ExitWith(ErrorCode::INVALID_ARGS);
+            }
+            spoolPath = argv[i];
+            LOG_DEBUG("Spool file set to: ", spoolPath);
+        }
+        else if (arg == "--spool-size") {
+            spoolSize = parseIntOption(argc, argv, i, "--spool-size", Config::MIN_SPOOL_SIZE, Config::MAX_SPOOL_SIZE);
+        }
+        else if (arg == "--spool-rate") {
+            spoolRate = parseIntOption(argc, argv, i, "--spool-rate", Config::MIN_SPOOL_RATE, Config::MAX_SPOOL_RATE);
+        }
         // Path to PCAP file
         else if (!pcapSetFlag && !arg.empty() && arg[0] != '-') {
             pcapFilePath = arg;
@@ -278,15 +895,97 @@ void ArgParser::parseArgs(int argc, char* argv[]) {
         }
     }
 
-    // Check if the mandatory arguments were set
-    if (collectorHost.empty() || pcapFilePath.empty()) {
-        std::cerr << "Error: host:port and PCAP file path are mandatory.\n";
+    // Building the index only reads the PCAP file
+    if (buildIndex) {
+        if (pcapFilePath.empty() || !collectorHost.empty() || !outputPath.empty() || !shmName.empty()) {
+            std::cerr << "Error: --build-index takes only the PCAP file path.\n";
+            printUsage();
+            ExitWith(ErrorCode::INVALID_ARGS);
+        }
+        return;
+    }
+
+    if (fromTime >= toTime) {
+        std::cerr << "Error: --from has to be before --to.\n";
+        printUsage();
+        ExitWith(ErrorCode::INVALID_ARGS);
+    }
+
+    if (rollupOnly && !rollup) {
+        std::cerr << "Error: --rollup-only requires --rollup.\n";
+        printUsage();
+        ExitWith(ErrorCode::INVALID_ARGS);
+    }
+
+    if (directRead && inputReader != Config::InputReader::URING) {
+        std::cerr << "Error: --direct-read requires --reader uring.\n";
+        printUsage();
+        ExitWith(ErrorCode::INVALID_ARGS);
+    }
+
+    // Ranges of the parallel run are split by file size, not by time
+    if (threads > 1 && hasTimeRange()) {
+        std::cerr << "Error: --threads cannot be combined with --from/--to.\n";
+        printUsage();
+        ExitWith(ErrorCode::INVALID_ARGS);
+    }
+
+    // Ranges are merged by unidirectional keys and timeouts only, copies of a packet may be in two ranges
+    if (threads > 1 && (biflow || tcpEnd || sketches || dedup || admission || !flowSpillPath.empty())) {
+        std::cerr << "Error: --threads cannot be combined with --biflow, --tcp-end, --sketches, --dedup, --admission or --flow-spill.\n";
+        printUsage();
+        ExitWith(ErrorCode::INVALID_ARGS);
+    }
+
+    // Check if the mandatory arguments were set, collector is not needed when writing to a file or ring
+    if ((collectorHost.empty() && outputPath.empty() && shmName.empty()) || pcapFilePath.empty()) {
+        std::cerr << "Error: host:port (or --output or --shm) and PCAP file path are mandatory.\n";
+        printUsage();
+        ExitWith(ErrorCode::INVALID_ARGS);
+    }
+
+    if (!outputPath.empty() && !collectorHost.empty()) {
+        std::cerr << "Error: --output cannot be combined with a collector address.\n";
+        printUsage();
+        ExitWith(ErrorCode::INVALID_ARGS);
+    }
+
+    if (!shmName.empty() && (!collectorHost.empty() || !outputPath.empty())) {
+        std::cerr << "Error: --shm cannot be combined with a collector address or --output.\n";
+        printUsage();
+        ExitWith(ErrorCode::INVALID_ARGS);
+    }
+
+    if (!spoolPath.empty() && collectorHost.empty()) {
+        std::cerr << "Error: --spool requires a collector address.\n";
+        printUsage();
+        ExitWith(ErrorCode::INVALID_ARGS);
+    }
+
+    if (outputPath.empty() && (compression != Config::Compression::NONE || directIo)) {
+        std::cerr << "Error: --compress and --direct-io require --output.\n";
+        printUsage();
+        ExitWith(ErrorCode::INVALID_ARGS);
+    }
+
+    // NetFlow v9 header has no length, raw v9 datagrams could not be split when reading the file back
+    if (!outputPath.empty() && compression == Config::Compression::NONE &&
+        exportFormat == Config::ExportFormat::NETFLOW_V9) {
+        std::cerr << "Error: Uncompressed output file supports v5 and ipfix formats only.\n";
+        printUsage();
+        ExitWith(ErrorCode::INVALID_ARGS);
+    }
+
+    // Arrow stream is a file format, its messages are larger than the framing of compressed blocks allows
+    if (exportFormat == Config::ExportFormat::ARROW &&
+        (outputPath.empty() || compression != Config::Compression::NONE)) {
+        std::cerr << "Error: arrow format requires --output and cannot be combined with --compress.\n";
         printUsage();
         ExitWith(ErrorCode::INVALID_ARGS);
     }
 
     // Check valid range of port number
-    if (collectorPort < PORT_MIN || collectorPort > PORT_MAX) {
+    if (outputPath.empty() && shmName.empty() && (collectorPort < PORT_MIN || collectorPort > PORT_MAX)) {
         std::cerr << "Error: Port number out of range (" << PORT_MIN << "-" << PORT_MAX << ").\n";
         printUsage();
         ExitWith(ErrorCode::INVALID_ARGS);
@@ -317,7 +1016,17 @@ void ArgParser::printHelp() const {
  * @return void
  */
 void ArgParser::printUsage() const {
-    std::cerr << "Usage: ./p2nprobe <host>:<port> <pcap_file_path> [-a <active_timeout> -i <inactive_timeout>]\n";
+    std::cerr << "Usage: ./p2nprobe <host>:<port>|--output <file>|--shm <name> <pcap_file_path> [-a <active_timeout> -i <inactive_timeout>]"
+                 " [--format v5|v9|ipfix|arrow] [--mtu <bytes>] [--template-refresh <n>]"
+                 " [--compress none|zlib|lz4|zstd] [--direct-io] [--shm-size <MiB>] [--row-group <rows>]"
+                 " [--rate <n><unit>] [--replay-speed <x|max>] [--sndbuf <bytes>]"
+                 " [--spool <file>] [--spool-size <MiB>] [--spool-rate <dps>]"
+                 " [--stats-interval <sec>] [--prometheus <port>] [--trace <file>]"
+                 " [--checkpoint <file>] [--resume <file>] [--from <time>] [--to <time>]"
+                 " [--build-index] [--index-interval <n>] [--threads <n>]"
+                 " [--reader libpcap|uring] [--direct-read] [--biflow]"
+                 " [--tcp-end] [--fin-linger <ms>] [--flow-spill <file>] [--hot-flows <n>] [--admission] [--dedup] [--dedup-window <ms>] [--sketches] [--sketch-interval <sec>] [--top-k <n>]"
+                 " [--rollup <fields>] [--rollup-interval <sec>] [--rollup-only] [--routes <file>]\n";
 }
 
 /**
@@ -364,3 +1073,408 @@ int ArgParser::getActiveTimeout() const {
 int ArgParser::getInactiveTimeout() const {
     return inactiveTimeout;
 }
+
+/**
+ * @brief Getter method for the export format if set, otherwise NetFlow v5.
+ *
+ * @return Config::ExportFormat Export format
+ */
+Config::ExportFormat ArgParser::getExportFormat() const {
+    return exportFormat;
+}
+
+/**
+ * @brief Getter method for the export MTU, 0 when it should be queried from the kernel.
+ *
+ * @return int Export MTU in bytes
+ */
+int ArgParser::getExportMtu() const {
+    return exportMtu;
+}
+
+/**
+ * @brief Getter method for the number of datagrams between template resends.
+ *
+ * @return int Template refresh interval
+ */
+int ArgParser::getTemplateRefresh() const {
+    return templateRefresh;
+}
+
+/**
+ * @brief Getter method for the output file path, empty when flows are sent to the collector.
+ *
+ * @return const std::string& Output file path
+ */
+const std::string& ArgParser::getOutputPath() const {
+    return outputPath;
+}
+
+/**
+ * @brief Getter method for the compression of the output file.
+ *
+ * @return Config::Compression Output file compression
+ */
+Config::Compression ArgParser::getCompression() const {
+    return compression;
+}
+
+/**
+ * @brief Getter method for writing the output file with O_DIRECT.
+ *
+ * @return bool true if O_DIRECT should be used
+ */
+bool ArgParser::getDirectIo() const {
+    return directIo;
+}
+
+/**
+ * @brief Getter method for the number of rows in one Arrow record batch.
+ *
+ * @return int Row group size
+ */
+int ArgParser::getRowGroupSize() const {
+    return rowGroupSize;
+}
+
+/**
+ * @brief Getter method for the unit of the export rate limit.
+ *
+ * @return Pacer::RateUnit Unit of the rate, NONE when the rate is not limited
+ */
+Pacer::RateUnit ArgParser::getRateUnit() const {
+    return rateUnit;
+}
+
+/**
+ * @brief Getter method for the export rate limit in datagrams or bits per second.
+ *
+ * @return double Export rate
+ */
+double ArgParser::getRate() const {
+    return rate;
+}
+
+/**
+ * @brief Getter method for the replay speed, 0 when export is not paced by the capture time.
+ *
+ * @return double Replay speed
+ */
+double ArgParser::getReplaySpeed() const {
+    return replaySpeed;
+}
+
+/**
+ * @brief Getter method for the socket send buffer size, 0 for the automatic size.
+ *
+ * @return int Send buffer size in bytes
+ */
+int ArgParser::getSendBuffer() const {
+    return sendBuffer;
+}
+
+/**
+ * @brief Getter method for the interval of the periodic stats line, 0 when disabled.
+ *
+ * @return int Stats interval in seconds
+ */
+int ArgParser::getStatsInterval() const {
+    return statsInterval;
+}
+
+/**
+ * @brief Getter method for the port of the Prometheus endpoint, 0 when disabled.
+ *
+ * @return int Prometheus port
+ */
+int ArgParser::getPrometheusPort() const {
+    return prometheusPort;
+}
+
+/**
+ * @brief Getter method for the Chrome trace file, empty when no trace is written.
+ *
+ * @return const std::string& Trace file path
+ */
+const std::string& ArgParser::getTracePath() const {
+    return tracePath;
+}
+
+/**
+ * @brief Getter method for the checkpoint file the remaining flows are saved to, empty when they are exported.
+ *
+ * @return const std::string& Checkpoint file path
+ */
+const std::string& ArgParser::getCheckpointPath() const {
+    return checkpointPath;
+}
+
+/**
+ * @brief Getter method for the checkpoint file loaded at the start, empty to start without flows.
+ *
+ * @return const std::string& Resume file path
+ */
+const std::string& ArgParser::getResumePath() const {
+    return resumePath;
+}
+
+/**
+ * @brief Whether only a time range of the PCAP file is processed.
+ *
+ * @return bool true if --from or --to was set
+ */
+bool ArgParser::hasTimeRange() const {
+    return fromTime != std::numeric_limits<int64_t>::min() || toTime != std::numeric_limits<int64_t>::max();
+}
+
+/**
+ * @brief Getter method for the start of the processed time range.
+ *
+ * @return int64_t Start time in microseconds since the epoch
+ */
+int64_t ArgParser::getFromTime() const {
+    return fromTime;
+}
+
+/**
+ * @brief Getter method for the end of the processed time range.
+ *
+ * @return int64_t End time in microseconds since the epoch
+ */
+int64_t ArgParser::getToTime() const {
+    return toTime;
+}
+
+/**
+ * @brief Getter method for the index building mode.
+ *
+ * @return bool true if only the time index should be built
+ */
+bool ArgParser::getBuildIndex() const {
+    return buildIndex;
+}
+
+/**
+ * @brief Getter method for the number of packets per time index entry.
+ *
+ * @return uint32_t Index interval
+ */
+uint32_t ArgParser::getIndexInterval() const {
+    return indexInterval;
+}
+
+/**
+ * @brief Getter method for the number of aggregation threads.
+ *
+ * @return int Number of threads
+ */
+int ArgParser::getThreads() const {
+    return threads;
+}
+
+/**
+ * @brief Getter method for the backend reading uncompressed captures.
+ *
+ * @return Config::InputReader Input backend
+ */
+Config::InputReader ArgParser::getInputReader() const {
+    return inputReader;
+}
+
+/**
+ * @brief Getter method for the O_DIRECT reading of the capture.
+ *
+ * @return bool true if the capture is read with O_DIRECT
+ */
+bool ArgParser::getDirectRead() const {
+    return directRead;
+}
+
+/**
+ * @brief Getter method for the bidirectional aggregation.
+ *
+ * @return bool true if both directions of a connection share one flow
+ */
+bool ArgParser::getBiflow() const {
+    return biflow;
+}
+
+/**
+ * @brief Getter method for the TCP termination of flows.
+ *
+ * @return bool true if flows are exported after RST or FIN in both directions
+ */
+bool ArgParser::getTcpEnd() const {
+    return tcpEnd;
+}
+
+/**
+ * @brief Getter method for the time a flow stays after FIN in both directions.
+ *
+ * @return int Linger in milliseconds
+ */
+int ArgParser::getFinLinger() const {
+    return finLinger;
+}
+
+/**
+ * @brief Getter method for the spill file of the cold flows.
+ *
+ * @return const std::string& Path of the file, empty to keep all flows in memory
+ */
+const std::string& ArgParser::getFlowSpillPath() const {
+    return flowSpillPath;
+}
+
+/**
+ * @brief Getter method for the number of flows kept in memory with the spill file.
+ *
+ * @return int Number of flows
+ */
+int ArgParser::getHotFlows() const {
+    return hotFlows;
+}
+
+/**
+ * @brief Getter method for the flow admission.
+ *
+ * @return bool true if flows of a single packet are kept in the probation table
+ */
+bool ArgParser::getAdmission() const {
+    return admission;
+}
+
+/**
+ * @brief Getter method for the duplicate packet suppression.
+ *
+ * @return bool true if copies of a packet seen within the window are dropped
+ */
+bool ArgParser::getDedup() const {
+    return dedup;
+}
+
+/**
+ * @brief Getter method for the longest time between two copies of a packet.
+ *
+ * @return int Window in miliseconds
+ */
+int ArgParser::getDedupWindow() const {
+    return dedupWindow;
+}
+
+/**
+ * @brief Getter method for the top talker and distinct host sketches.
+ *
+ * @return bool true if the sketches are computed and printed
+ */
+bool ArgParser::getSketches() const {
+    return sketches;
+}
+
+/**
+ * @brief Getter method for the capture time covered by one sketch report.
+ *
+ * @return int Interval in seconds, 0 for the whole capture
+ */
+int ArgParser::getSketchInterval() const {
+    return sketchInterval;
+}
+
+/**
+ * @brief Getter method for the number of heaviest keys reported per sketch.
+ *
+ * @return int Number of keys
+ */
+int ArgParser::getTopK() const {
+    return topK;
+}
+
+/**
+ * @brief Getter method for the rollup of expired flows.
+ *
+ * @return bool true if rollups are exported
+ */
+bool ArgParser::getRollup() const {
+    return rollup;
+}
+
+/**
+ * @brief Getter method for the key of the rollups.
+ *
+ * @return const Rollup::Spec& Fields of the rollup key
+ */
+const Rollup::Spec& ArgParser::getRollupSpec() const {
+    return rollupSpec;
+}
+
+/**
+ * @brief Getter method for the capture time of one rollup bin.
+ *
+ * @return int Interval in seconds
+ */
+int ArgParser::getRollupInterval() const {
+    return rollupInterval;
+}
+
+/**
+ * @brief Getter method for exporting only the rollups.
+ *
+ * @return bool true if the flows themselves are not exported
+ */
+bool ArgParser::getRollupOnly() const {
+    return rollupOnly;
+}
+
+/**
+ * @brief Getter method for the routing table file.
+ *
+ * @return const std::string& Routing table file path, empty when the routing fields are not filled
+ */
+const std::string& ArgParser::getRoutesPath() const {
+    return routesPath;
+}
+
+/**
+ * @brief Getter method for the name of the shared memory ring, empty when it is not used.
+ *
+ * @return const std::string& Name of the ring
+ */
+const std::string& ArgParser::getShmName() const {
+    return shmName;
+}
+
+/**
+ * @brief Getter method for the size of the shared memory ring.
+ *
+ * @return size_t Size of the data area in bytes
+ */
+size_t ArgParser::getShmSize() const {
+    return static_cast<size_t>(shmSize) << 20;
+}
+
+/**
+ * @brief Getter method for the spool file, empty when refused datagrams are not spooled.
+ *
+ * @return const std::string& Spool file path
+ */
+const std::string& ArgParser::getSpoolPath() const {
+    return spoolPath;
+}
+
+/**
+ * @brief Getter method for the size cap of the spool file.
+ *
+ * @return size_t Size of the data area in bytes
+ */
+size_t ArgParser::getSpoolSize() const {
+    return static_cast<size_t>(spoolSize) << 20;
+}
+
+/**
+ * @brief Getter method for the replay rate of the spool.
+ *
+ * @return double Datagrams per second
+ */
+double ArgParser::getSpoolRate() const {
+    return spoolRate;
+}
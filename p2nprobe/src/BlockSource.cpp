@@ -0,0 +1,52 @@
+////////////////////////////////////////////////////
+// File: BlockSource.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <algorithm>
+
+#include "BlockSource.h"
+
+/**
+ * @brief Returns the next size bytes of the data. The data points into the block when it is
+ * contiguous there, otherwise it is copied. It stays valid until the next call.
+ *
+ * @param size Number of bytes to read
+ * @param data Set to the read bytes
+ *
+ * @return Number of bytes read, less than size only at the end of the data
+ */
+size_t BlockSource::read(size_t size, const uint8_t*& data) {
+    auto advance = [this]() {
+        if (!ended && !next_block(block, block_size)) {
+            ended = true;
+            block = nullptr;
+            block_size = 0;
+        }
+        position = 0;
+        return !ended;
+    };
+
+    if (position == block_size && !advance()) {
+        return 0;
+    }
+    if (position + size <= block_size) {
+        data = block + position;
+        position += size;
+        return size;
+    }
+
+    scratch.clear();
+    while (scratch.size() < size) {
+        if (position == block_size && !advance()) {
+            break;
+        }
+        size_t length = std::min(size - scratch.size(), block_size - position);
+        scratch.insert(scratch.end(), block + position, block + position + length);
+        position += length;
+    }
+    data = scratch.data();
+    return scratch.size();
+}
@@ -0,0 +1,155 @@
+////////////////////////////////////////////////////
+// File: Checkpoint.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Checkpoint.h"
+#include "NetFlowV5Key.h"
+
+namespace {
+    constexpr char CHECKPOINT_MAGIC[4] = {'P', '2', 'N', 'C'};
+    constexpr uint16_t CHECKPOINT_VERSION = 1;
+    constexpr uint16_t CHECKPOINT_BYTE_ORDER = 0x0102;
+    constexpr uint8_t FLAG_BIFLOW = 0x01;
+}
+
+/**
+ * @brief Writes the flows and the export state. The file is written under a temporary name
+ * and renamed, so an interrupted run never leaves a truncated checkpoint behind.
+ *
+ * @param path Path of the checkpoint file
+ * @param state Export state to store
+ * @param flows Flows that have not expired yet
+ *
+ * @return true if the checkpoint was written
+ */
+bool Checkpoint::save(const std::string& path, const State& state, const std::list<Flow>& flows) {
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.byte_order = CHECKPOINT_BYTE_ORDER;
+    header.format = static_cast<uint8_t>(state.format);
+    header.flags = state.biflow ? FLAG_BIFLOW : 0;
+    header.flow_count = static_cast<uint32_t>(flows.size());
+    header.sequence = state.sequence;
+    header.time_start = state.time_start;
+    header.time_end = state.time_end;
+
+    std::vector<Record> records;
+    std::vector<Flow::Reverse> reverse;
+    records.reserve(flows.size());
+    for (const Flow& flow : flows) {
+        records.push_back({flow.record, flow.packets, flow.octets, flow.first_ms, flow.last_ms});
+        if (state.biflow) {
+            reverse.push_back(flow.reverse);
+        }
+    }
+
+    std::string temporary = path + ".tmp";
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(Record));
+    out.write(reinterpret_cast<const char*>(reverse.data()), reverse.size() * sizeof(Flow::Reverse));
+    out.close();
+
+    if (!out || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::cerr << "Error: Cannot write checkpoint file: " << path << std::endl;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Maps the checkpoint file and appends its flows to the flow list.
+ *
+ * @param path Path of the checkpoint file
+ * @param state Export state, format has to be set to the format of the current run
+ * @param flows List the stored flows are appended to
+ *
+ * @return false if the file cannot be read, is damaged or was written for another export format
+ */
+bool Checkpoint::load(const std::string& path, State& state, std::list<Flow>& flows) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Error: Cannot open checkpoint file " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        std::cerr << "Error: Checkpoint file is too short: " << path << std::endl;
+        close(fd);
+        return false;
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Error: Cannot map checkpoint file " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    const Header* header = static_cast<const Header*>(mapping);
+    const char* error = nullptr;
+    size_t record_size = sizeof(Record) + (state.biflow ? sizeof(Flow::Reverse) : 0);
+    if (memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0 || header->version != CHECKPOINT_VERSION) {
+        error = "not a checkpoint file";
+    }
+    else if (header->byte_order != CHECKPOINT_BYTE_ORDER) {
+        error = "written on a machine with different byte order";
+    }
+    else if (header->format != static_cast<uint8_t>(state.format)) {
+        error = "written with a different export format";
+    }
+    else if (((header->flags & FLAG_BIFLOW) != 0) != state.biflow) {
+        error = state.biflow ? "written without --biflow" : "written with --biflow";
+    }
+    else if (size != sizeof(Header) + static_cast<size_t>(header->flow_count) * record_size) {
+        error = "size does not match the flow count";
+    }
+
+    if (error != nullptr) {
+        std::cerr << "Error: Invalid checkpoint file " << path << ": " << error << std::endl;
+        munmap(mapping, size);
+        return false;
+    }
+
+    // Header is 32 bytes and the mapping is page aligned, so the records are aligned as well
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    const Record* records = reinterpret_cast<const Record*>(header + 1);
+    const Flow::Reverse* reverse = reinterpret_cast<const Flow::Reverse*>(records + header->flow_count);
+    for (uint32_t i = 0; i < header->flow_count; i++) {
+        const Record& stored = records[i];
+        Flow flow(NetFlowV5Key(stored.record), stored.record, stored.first_ms);
+        flow.packets = stored.packets;
+        flow.octets = stored.octets;
+        flow.last_ms = stored.last_ms;
+        if (state.biflow) {
+            flow.reverse = reverse[i];
+        }
+        flows.push_back(flow);
+    }
+
+    state.sequence = header->sequence;
+    state.time_start = header->time_start;
+    state.time_end = header->time_end;
+
+    munmap(mapping, size);
+    return true;
+}
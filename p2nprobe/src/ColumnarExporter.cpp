@@ -0,0 +1,423 @@
+////////////////////////////////////////////////////
+// File: ColumnarExporter.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "ColumnarExporter.h"
+#include "Logger.h"
+
+// Arrow IPC format described at:
+// https://arrow.apache.org/docs/format/Columnar.html#serialization-and-interprocess-communication-ipc
+namespace {
+    constexpr uint32_t CONTINUATION_MARKER = 0xFFFFFFFF;
+    constexpr uint16_t METADATA_VERSION_V5 = 4;
+    constexpr uint8_t HEADER_SCHEMA = 1;
+    constexpr uint8_t HEADER_RECORD_BATCH = 3;
+    constexpr uint8_t TYPE_INT = 2;
+    constexpr uint8_t TYPE_TIMESTAMP = 10;
+    constexpr uint16_t TIME_UNIT_MILLISECOND = 1;
+    constexpr size_t COLUMN_COUNT = 10;
+    constexpr size_t EXPORT_BATCH = 1024;   // Flows batched by the Probe before export_flows
+
+    /**
+     * @brief Description of one column of the schema.
+     */
+    struct Column {
+        const char* name;
+        uint8_t type;       // TYPE_INT or TYPE_TIMESTAMP
+        uint8_t bit_width;
+        bool is_signed;
+    };
+
+    // Order of the columns must match ColumnarExporter::write_record_batch
+    constexpr Column COLUMNS[COLUMN_COUNT] = {
+        {"src_addr", TYPE_INT, 32, false},
+        {"dst_addr", TYPE_INT, 32, false},
+        {"src_port", TYPE_INT, 16, false},
+        {"dst_port", TYPE_INT, 16, false},
+        {"protocol", TYPE_INT, 8, false},
+        {"tcp_flags", TYPE_INT, 8, false},
+        {"packets", TYPE_INT, 64, false},
+        {"bytes", TYPE_INT, 64, false},
+        {"first", TYPE_TIMESTAMP, 64, true},
+        {"last", TYPE_TIMESTAMP, 64, true},
+    };
+
+    inline size_t pad8(size_t size) {
+        return (size + 7) & ~static_cast<size_t>(7);
+    }
+
+    /**
+     * @brief Minimal FlatBuffers writer for the Arrow metadata.
+     * Objects are written front to back, parent before its children. Offset fields are
+     * patched once the child is written, so every offset points forward as FlatBuffers require.
+     * Each vtable is placed right before its table.
+     */
+    class FlatBufferWriter {
+    public:
+        struct Scalar {
+            uint16_t id;
+            uint8_t size;
+            uint64_t value;
+        };
+
+        FlatBufferWriter() {
+            buffer.resize(4); // Offset of the root table
+        }
+
+        /**
+         * @brief Writes a table. Positions of the offset fields are stored to slots in the order of offset_ids.
+         */
+        size_t table(const std::vector<Scalar>& scalars, const std::vector<uint16_t>& offset_ids,
+                     std::vector<size_t>& slots) {
+            uint16_t field_count = 0;
+            for (const auto& scalar : scalars) {
+                field_count = std::max<uint16_t>(field_count, scalar.id + 1);
+            }
+            for (uint16_t id : offset_ids) {
+                field_count = std::max<uint16_t>(field_count, id + 1);
+            }
+
+            // Lay out the fields from the largest, each naturally aligned, after the vtable offset
+            std::vector<uint16_t> field_offsets(field_count, 0);
+            size_t table_size = 4;
+            for (uint8_t size : {8, 4, 2, 1}) {
+                for (const auto& scalar : scalars) {
+                    if (scalar.size == size) {
+                        table_size = (table_size + size - 1) & ~static_cast<size_t>(size - 1);
+                        field_offsets[scalar.id] = static_cast<uint16_t>(table_size);
+                        table_size += size;
+                    }
+                }
+                if (size == 4) {
+                    for (uint16_t id : offset_ids) {
+                        field_offsets[id] = static_cast<uint16_t>(table_size);
+                        table_size += 4;
+                    }
+                }
+            }
+
+            align(2);
+            size_t vtable = buffer.size();
+            put<uint16_t>(static_cast<uint16_t>(4 + 2 * field_count));
+            put<uint16_t>(static_cast<uint16_t>(table_size));
+            for (uint16_t offset : field_offsets) {
+                put<uint16_t>(offset);
+            }
+
+            align(8);
+            size_t table = buffer.size();
+            buffer.resize(table + table_size, 0);
+            set<int32_t>(table, static_cast<int32_t>(table - vtable));
+            for (const auto& scalar : scalars) {
+                memcpy(buffer.data() + table + field_offsets[scalar.id], &scalar.value, scalar.size);
+            }
+            slots.clear();
+            for (uint16_t id : offset_ids) {
+                slots.push_back(table + field_offsets[id]);
+            }
+            return table;
+        }
+
+        size_t string(const std::string& value) {
+            align(4);
+            size_t position = buffer.size();
+            put<uint32_t>(static_cast<uint32_t>(value.size()));
+            buffer.insert(buffer.end(), value.begin(), value.end());
+            buffer.push_back(0);
+            return position;
+        }
+
+        /**
+         * @brief Writes a vector of offsets, the elements are patched later through slots.
+         */
+        size_t offset_vector(size_t count, std::vector<size_t>& slots) {
+            align(4);
+            size_t position = buffer.size();
+            put<uint32_t>(static_cast<uint32_t>(count));
+            slots.clear();
+            for (size_t i = 0; i < count; i++) {
+                slots.push_back(buffer.size());
+                put<uint32_t>(0);
+            }
+            return position;
+        }
+
+        /**
+         * @brief Writes a vector of structs made of 64-bit words, elements are 8 byte aligned.
+         */
+        size_t struct_vector(size_t count, const std::vector<int64_t>& words) {
+            align(4);
+            if ((buffer.size() + 4) % 8 != 0) {
+                put<uint32_t>(0);
+            }
+            size_t position = buffer.size();
+            put<uint32_t>(static_cast<uint32_t>(count));
+            for (int64_t word : words) {
+                put<int64_t>(word);
+            }
+            return position;
+        }
+
+        void patch(size_t slot, size_t target) {
+            set<uint32_t>(slot, static_cast<uint32_t>(target - slot));
+        }
+
+        void set_root(size_t table) {
+            patch(0, table);
+        }
+
+        std::vector<uint8_t>& data() {
+            align(8);
+            return buffer;
+        }
+
+    private:
+        template<typename T>
+        void put(T value) {
+            size_t position = buffer.size();
+            buffer.resize(position + sizeof(T));
+            memcpy(buffer.data() + position, &value, sizeof(T));
+        }
+
+        template<typename T>
+        void set(size_t position, T value) {
+            memcpy(buffer.data() + position, &value, sizeof(T));
+        }
+
+        void align(size_t alignment) {
+            buffer.resize((buffer.size() + alignment - 1) & ~(alignment - 1), 0);
+        }
+
+        std::vector<uint8_t> buffer;
+    };
+
+    /**
+     * @brief Copies one column into the message body and records its buffers.
+     */
+    template<typename T>
+    void append_column(std::vector<uint8_t>& body, std::vector<int64_t>& buffers, const std::vector<T>& column) {
+        size_t offset = body.size();
+        size_t length = column.size() * sizeof(T);
+
+        buffers.push_back(static_cast<int64_t>(offset));    // Validity bitmap, omitted as there are no nulls
+        buffers.push_back(0);
+        buffers.push_back(static_cast<int64_t>(offset));    // Values
+        buffers.push_back(static_cast<int64_t>(length));
+
+        body.resize(offset + pad8(length), 0);
+        if (length > 0) {
+            memcpy(body.data() + offset, column.data(), length);
+        }
+    }
+}
+
+/**
+ * @brief Constructor of the class. Reserves the column vectors and writes the schema message.
+ *
+ * @param sink Output file
+ * @param row_group_size Number of rows in one record batch
+ */
+ColumnarExporter::ColumnarExporter(std::unique_ptr<DatagramSink> sink, size_t row_group_size)
+    : sink(std::move(sink)),
+    row_group_size(row_group_size),
+    finished(false)
+{
+    src_addr.reserve(row_group_size);
+    dst_addr.reserve(row_group_size);
+    src_port.reserve(row_group_size);
+    dst_port.reserve(row_group_size);
+    protocol.reserve(row_group_size);
+    tcp_flags.reserve(row_group_size);
+    packets.reserve(row_group_size);
+    bytes.reserve(row_group_size);
+    first.reserve(row_group_size);
+    last.reserve(row_group_size);
+
+    write_schema();
+}
+
+/**
+ * @brief Destructor. Writes the last batch and the end of stream marker.
+ */
+ColumnarExporter::~ColumnarExporter() {
+    flush();
+}
+
+/**
+ * @brief Flows are appended to the columns directly, the Probe only needs a small batch.
+ *
+ * @return Number of flows the Probe should batch before exporting.
+ */
+size_t ColumnarExporter::max_flows_per_export() const {
+    return EXPORT_BATCH;
+}
+
+/**
+ * @brief Appends the flows to the column vectors, full row groups are written as record batches.
+ *
+ * @param flows Vector of flows to be exported
+ * @param time_start Not used, timestamps are absolute
+ * @param time_end Not used, timestamps are absolute
+ */
+void ColumnarExporter::export_flows(const std::vector<Flow>& flows, uint32_t time_start, uint32_t time_end) {
+    (void)time_start;
+    (void)time_end;
+
+    for (const auto& flow : flows) {
+        src_addr.push_back(flow.record.srcaddr);
+        dst_addr.push_back(flow.record.dstaddr);
+        src_port.push_back(flow.record.srcport);
+        dst_port.push_back(flow.record.dstport);
+        protocol.push_back(flow.record.prot);
+        tcp_flags.push_back(flow.record.tcp_flags);
+        packets.push_back(flow.packets);
+        bytes.push_back(flow.octets);
+        first.push_back(static_cast<int64_t>(flow.first_ms));
+        last.push_back(static_cast<int64_t>(flow.last_ms));
+
+        if (src_addr.size() >= row_group_size) {
+            write_record_batch();
+        }
+    }
+}
+
+/**
+ * @brief Writes the remaining rows and the end of stream marker, then flushes the file.
+ */
+void ColumnarExporter::flush() {
+    if (finished) {
+        return;
+    }
+    finished = true;
+
+    if (!src_addr.empty()) {
+        write_record_batch();
+    }
+
+    const uint32_t end_of_stream[2] = {CONTINUATION_MARKER, 0};
+    sink->send(reinterpret_cast<const uint8_t*>(end_of_stream), sizeof(end_of_stream));
+    sink->flush();
+}
+
+/**
+ * @brief Writes the schema message describing the columns.
+ */
+void ColumnarExporter::write_schema() {
+    FlatBufferWriter fb;
+    std::vector<size_t> slots;
+
+    size_t message = fb.table({{0, 2, METADATA_VERSION_V5}, {1, 1, HEADER_SCHEMA}, {3, 8, 0}}, {2}, slots);
+    fb.set_root(message);
+    size_t header_slot = slots[0];
+
+    size_t schema = fb.table({}, {1}, slots); // Endianness defaults to little endian
+    fb.patch(header_slot, schema);
+    size_t fields_slot = slots[0];
+
+    std::vector<size_t> field_slots;
+    size_t fields = fb.offset_vector(COLUMN_COUNT, field_slots);
+    fb.patch(fields_slot, fields);
+
+    for (size_t i = 0; i < COLUMN_COUNT; i++) {
+        const Column& column = COLUMNS[i];
+
+        // name (0), nullable (1), type_type (2), type (3), children (5)
+        size_t field = fb.table({{1, 1, 0}, {2, 1, column.type}}, {0, 3, 5}, slots);
+        fb.patch(field_slots[i], field);
+        std::vector<size_t> field_children = slots;
+
+        fb.patch(field_children[0], fb.string(column.name));
+
+        std::vector<size_t> type_slots;
+        size_t type;
+        if (column.type == TYPE_TIMESTAMP) {
+            type = fb.table({{0, 2, TIME_UNIT_MILLISECOND}}, {1}, type_slots);
+            fb.patch(type_slots[0], fb.string("UTC"));
+        }
+        else {
+            type = fb.table({{0, 4, column.bit_width}, {1, 1, column.is_signed}}, {}, type_slots);
+        }
+        fb.patch(field_children[1], type);
+
+        std::vector<size_t> no_children;
+        fb.patch(field_children[2], fb.offset_vector(0, no_children));
+    }
+
+    write_message(fb.data());
+}
+
+/**
+ * @brief Writes the collected rows as one record batch and clears the columns, keeping their capacity.
+ */
+void ColumnarExporter::write_record_batch() {
+    size_t rows = src_addr.size();
+    std::vector<int64_t> buffers;
+    buffers.reserve(COLUMN_COUNT * 4);
+
+    body.clear();
+    append_column(body, buffers, src_addr);
+    append_column(body, buffers, dst_addr);
+    append_column(body, buffers, src_port);
+    append_column(body, buffers, dst_port);
+    append_column(body, buffers, protocol);
+    append_column(body, buffers, tcp_flags);
+    append_column(body, buffers, packets);
+    append_column(body, buffers, bytes);
+    append_column(body, buffers, first);
+    append_column(body, buffers, last);
+
+    std::vector<int64_t> nodes;
+    for (size_t i = 0; i < COLUMN_COUNT; i++) {
+        nodes.push_back(static_cast<int64_t>(rows)); // length
+        nodes.push_back(0);                          // null count
+    }
+
+    FlatBufferWriter fb;
+    std::vector<size_t> slots;
+    size_t message = fb.table({{0, 2, METADATA_VERSION_V5}, {1, 1, HEADER_RECORD_BATCH}, {3, 8, body.size()}},
+                              {2}, slots);
+    fb.set_root(message);
+    size_t header_slot = slots[0];
+
+    size_t batch = fb.table({{0, 8, rows}}, {1, 2}, slots);
+    fb.patch(header_slot, batch);
+    std::vector<size_t> batch_slots = slots;
+    fb.patch(batch_slots[0], fb.struct_vector(COLUMN_COUNT, nodes));
+    fb.patch(batch_slots[1], fb.struct_vector(COLUMN_COUNT * 2, buffers));
+
+    write_message(fb.data());
+    if (!body.empty()) {
+        sink->send(body.data(), body.size());
+    }
+
+    LOG_DEBUG("Columnar export wrote record batch with ", rows, " rows");
+
+    src_addr.clear();
+    dst_addr.clear();
+    src_port.clear();
+    dst_port.clear();
+    protocol.clear();
+    tcp_flags.clear();
+    packets.clear();
+    bytes.clear();
+    first.clear();
+    last.clear();
+}
+
+/**
+ * @brief Writes the encapsulated message prefix and metadata, body is written by the caller.
+ *
+ * @param metadata FlatBuffers Message padded to 8 bytes
+ */
+void ColumnarExporter::write_message(const std::vector<uint8_t>& metadata) {
+    uint32_t prefix[2] = {CONTINUATION_MARKER, static_cast<uint32_t>(metadata.size())};
+    sink->send(reinterpret_cast<const uint8_t*>(prefix), sizeof(prefix));
+    sink->send(metadata.data(), metadata.size());
+}
@@ -0,0 +1,433 @@
+////////////////////////////////////////////////////
+// File: Decompressor.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <cstring>
+#include <cerrno>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+
+#include "Decompressor.h"
+#include "Config.h"
+#include "Logger.h"
+
+namespace {
+    constexpr uint8_t GZIP_MAGIC[] = {0x1f, 0x8b};
+    constexpr uint8_t ZSTD_MAGIC[] = {0x28, 0xb5, 0x2f, 0xfd};
+    constexpr uint8_t XZ_MAGIC[] = {0xfd, '7', 'z', 'X', 'Z', 0x00};
+}
+
+/**
+ * @brief Detects the compression of the file by its magic bytes.
+ *
+ * @param path Path of the capture
+ *
+ * @return Codec of the file, NONE for uncompressed files or when the file cannot be read
+ */
+Decompressor::Codec Decompressor::detect(const std::string& path) {
+    uint8_t magic[sizeof(XZ_MAGIC)] = {};
+    FILE* probe = fopen(path.c_str(), "rb");
+    if (probe == nullptr) {
+        return Codec::NONE;
+    }
+    size_t length = fread(magic, 1, sizeof(magic), probe);
+    fclose(probe);
+
+    if (length >= sizeof(GZIP_MAGIC) && memcmp(magic, GZIP_MAGIC, sizeof(GZIP_MAGIC)) == 0) {
+        return Codec::GZIP;
+    }
+    if (length >= sizeof(ZSTD_MAGIC) && memcmp(magic, ZSTD_MAGIC, sizeof(ZSTD_MAGIC)) == 0) {
+        return Codec::ZSTD;
+    }
+    if (length >= sizeof(XZ_MAGIC) && memcmp(magic, XZ_MAGIC, sizeof(XZ_MAGIC)) == 0) {
+        return Codec::XZ;
+    }
+    return Codec::NONE;
+}
+
+/**
+ * @brief Checks whether the codec was compiled in.
+ *
+ * @return true if captures compressed with the codec can be read
+ */
+bool Decompressor::codec_supported(Codec codec) {
+    switch (codec) {
+        case Codec::NONE:
+            return true;
+        case Codec::GZIP:
+#ifdef HAVE_ZLIB
+            return true;
+#else
+            return false;
+#endif
+        case Codec::ZSTD:
+#ifdef HAVE_ZSTD
+            return true;
+#else
+            return false;
+#endif
+        case Codec::XZ:
+#ifdef HAVE_LZMA
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+/**
+ * @brief Name of the codec for messages.
+ */
+const char* Decompressor::codec_name(Codec codec) {
+    switch (codec) {
+        case Codec::GZIP: return "gzip";
+        case Codec::ZSTD: return "zstd";
+        case Codec::XZ:   return "xz";
+        default:          return "none";
+    }
+}
+
+/**
+ * @brief Constructor of the decompressor, the file is opened by start.
+ *
+ * @param path Path of the compressed capture
+ * @param codec Compression of the file
+ */
+Decompressor::Decompressor(const std::string& path, Codec codec)
+    : path(path), codec(codec) {}
+
+/**
+ * @brief Destructor. Stops the helper thread and closes the file.
+ */
+Decompressor::~Decompressor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+    if (file != nullptr) {
+        fclose(file);
+    }
+}
+
+/**
+ * @brief Opens the file and starts the helper thread.
+ *
+ * @return false if the file cannot be opened or the codec is not compiled in
+ */
+bool Decompressor::start() {
+    if (!codec_supported(codec)) {
+        return fail(std::string(codec_name(codec)) + " compressed captures are not supported in this build");
+    }
+    file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return fail(std::string("cannot open file: ") + strerror(errno));
+    }
+
+    blocks.resize(Config::DECOMPRESS_BLOCKS);
+    for (Block& block : blocks) {
+        block.data = std::make_unique<uint8_t[]>(Config::DECOMPRESS_BLOCK_SIZE);
+    }
+    worker = std::thread(&Decompressor::run, this);
+    LOG_INFO("Decompressing ", path, " (", codec_name(codec), ") on a helper thread");
+    return true;
+}
+
+/**
+ * @brief Body of the helper thread.
+ */
+void Decompressor::run() {
+    switch (codec) {
+        case Codec::GZIP: inflate_gzip(); break;
+        case Codec::ZSTD: decompress_zstd(); break;
+        case Codec::XZ:   decompress_xz(); break;
+        default:          break;
+    }
+    // Data decompressed before an error is still read, like the packets before a truncated record
+    publish();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    finished = true;
+    condition.notify_all();
+}
+
+/**
+ * @brief Stores the error of the helper thread, the reader reports it when the data runs out.
+ *
+ * @return false, to be returned by the codec loop
+ */
+bool Decompressor::fail(const std::string& message) {
+    std::lock_guard<std::mutex> lock(mutex);
+    error_message = message;
+    return false;
+}
+
+/**
+ * @brief Whether the decompression stopped on an error.
+ */
+bool Decompressor::failed() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return !error_message.empty();
+}
+
+/**
+ * @brief Error of the decompression.
+ */
+std::string Decompressor::error() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return error_message;
+}
+
+/**
+ * @brief Hands the current block back to the helper thread and waits for the next one.
+ */
+bool Decompressor::next_block(const uint8_t*& data, size_t& size) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (holding) {
+        released++;
+        holding = false;
+        condition.notify_all();
+    }
+    condition.wait(lock, [this] { return filled > released || finished; });
+    if (filled == released) {
+        return false;
+    }
+    Block& block = blocks[released % blocks.size()];
+    data = block.data.get();
+    size = block.size;
+    holding = true;
+    return true;
+}
+
+/**
+ * @brief Free space of the block being filled, waits until the reader releases a block.
+ *
+ * @param space Set to the number of free bytes
+ *
+ * @return Start of the free space, nullptr when the decompressor is being destroyed
+ */
+uint8_t* Decompressor::output(size_t& space) {
+    if (output_block == nullptr) {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this] { return stopping || filled - released < blocks.size(); });
+        if (stopping) {
+            return nullptr;
+        }
+        output_block = &blocks[filled % blocks.size()];
+        output_block->size = 0;
+    }
+    space = Config::DECOMPRESS_BLOCK_SIZE - output_block->size;
+    return output_block->data.get() + output_block->size;
+}
+
+/**
+ * @brief Accounts the decompressed bytes, a full block is passed to the reader.
+ */
+void Decompressor::produced(size_t size) {
+    output_block->size += size;
+    if (output_block->size == Config::DECOMPRESS_BLOCK_SIZE) {
+        publish();
+    }
+}
+
+/**
+ * @brief Passes the block being filled to the reader.
+ */
+void Decompressor::publish() {
+    if (output_block == nullptr || output_block->size == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    filled++;
+    output_block = nullptr;
+    condition.notify_all();
+}
+
+/**
+ * @brief Decompresses gzip data, also several concatenated gzip members.
+ *
+ * @return false on a read error or corrupted or truncated data
+ */
+bool Decompressor::inflate_gzip() {
+#ifdef HAVE_ZLIB
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, 15 + 32) != Z_OK) { // 15 + 32 = largest window, gzip header detected
+        return fail("cannot initialize zlib");
+    }
+
+    std::vector<uint8_t> input(Config::DECOMPRESS_INPUT_SIZE);
+    bool ok = true;
+    bool member_end = false;
+    bool output_full = false; // zlib may hold more output for the consumed input
+    while (true) {
+        if (stream.avail_in == 0 && !output_full) {
+            size_t length = fread(input.data(), 1, input.size(), file);
+            if (length == 0) {
+                if (ferror(file)) {
+                    ok = fail("read error");
+                }
+                else if (!member_end) {
+                    ok = fail("unexpected end of compressed data");
+                }
+                break;
+            }
+            stream.next_in = input.data();
+            stream.avail_in = static_cast<uInt>(length);
+        }
+        if (member_end && stream.avail_in > 0) { // Next gzip member, e.g. files joined with cat
+            inflateReset(&stream);
+            member_end = false;
+        }
+
+        size_t space;
+        uint8_t* out = output(space);
+        if (out == nullptr) {
+            break;
+        }
+        stream.next_out = out;
+        stream.avail_out = static_cast<uInt>(space);
+        int result = inflate(&stream, Z_NO_FLUSH);
+        produced(space - stream.avail_out);
+        output_full = stream.avail_out == 0;
+
+        if (result == Z_STREAM_END) {
+            member_end = true;
+        }
+        else if (result != Z_OK && result != Z_BUF_ERROR) {
+            ok = fail(std::string("corrupted data: ") + (stream.msg != nullptr ? stream.msg : "zlib error"));
+            break;
+        }
+    }
+    inflateEnd(&stream);
+    return ok;
+#else
+    return fail("gzip support is not compiled in");
+#endif
+}
+
+/**
+ * @brief Decompresses zstd data, also several concatenated frames.
+ *
+ * @return false on a read error or corrupted or truncated data
+ */
+bool Decompressor::decompress_zstd() {
+#ifdef HAVE_ZSTD
+    ZSTD_DCtx* context = ZSTD_createDCtx();
+    if (context == nullptr) {
+        return fail("cannot initialize zstd");
+    }
+
+    std::vector<uint8_t> input(Config::DECOMPRESS_INPUT_SIZE);
+    ZSTD_inBuffer in = {input.data(), 0, 0};
+    bool ok = true;
+    size_t remaining = 0;     // 0 when the last frame is complete
+    bool output_full = false;
+    while (true) {
+        if (in.pos == in.size && !output_full) {
+            size_t length = fread(input.data(), 1, input.size(), file);
+            if (length == 0) {
+                if (ferror(file)) {
+                    ok = fail("read error");
+                }
+                else if (remaining != 0) {
+                    ok = fail("unexpected end of compressed data");
+                }
+                break;
+            }
+            in.size = length;
+            in.pos = 0;
+        }
+
+        size_t space;
+        uint8_t* out = output(space);
+        if (out == nullptr) {
+            break;
+        }
+        ZSTD_outBuffer buffer = {out, space, 0};
+        remaining = ZSTD_decompressStream(context, &buffer, &in);
+        produced(buffer.pos);
+        output_full = buffer.pos == space;
+
+        if (ZSTD_isError(remaining)) {
+            ok = fail(std::string("corrupted data: ") + ZSTD_getErrorName(remaining));
+            break;
+        }
+    }
+    ZSTD_freeDCtx(context);
+    return ok;
+#else
+    return fail("zstd support is not compiled in");
+#endif
+}
+
+/**
+ * @brief Decompresses xz data, also several concatenated streams.
+ *
+ * @return false on a read error or corrupted or truncated data
+ */
+bool Decompressor::decompress_xz() {
+#ifdef HAVE_LZMA
+    lzma_stream stream = LZMA_STREAM_INIT;
+    if (lzma_stream_decoder(&stream, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+        return fail("cannot initialize liblzma");
+    }
+
+    std::vector<uint8_t> input(Config::DECOMPRESS_INPUT_SIZE);
+    lzma_action action = LZMA_RUN;
+    bool ok = true;
+    bool output_full = false;
+    while (true) {
+        if (stream.avail_in == 0 && action == LZMA_RUN && !output_full) {
+            size_t length = fread(input.data(), 1, input.size(), file);
+            if (ferror(file)) {
+                ok = fail("read error");
+                break;
+            }
+            if (length == 0) {
+                action = LZMA_FINISH; // Concatenated decoder needs it to end the last stream
+            }
+            stream.next_in = input.data();
+            stream.avail_in = length;
+        }
+
+        size_t space;
+        uint8_t* out = output(space);
+        if (out == nullptr) {
+            break;
+        }
+        stream.next_out = out;
+        stream.avail_out = space;
+        lzma_ret result = lzma_code(&stream, action);
+        produced(space - stream.avail_out);
+        output_full = stream.avail_out == 0;
+
+        if (result == LZMA_STREAM_END) {
+            break;
+        }
+        if (result != LZMA_OK) {
+            ok = fail(result == LZMA_BUF_ERROR ? "unexpected end of compressed data" : "corrupted data");
+            break;
+        }
+    }
+    lzma_end(&stream);
+    return ok;
+#else
+    return fail("xz support is not compiled in");
+#endif
+}
@@ -0,0 +1,61 @@
+////////////////////////////////////////////////////
+// File: Dedup.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include "Dedup.h"
+#include "Metrics.h"
+
+/**
+ * @brief Constructor of the table, the whole table is allocated here.
+ *
+ * @param buckets Number of buckets, power of two
+ * @param window_ms Longest time between two copies of a packet
+ */
+PacketDedup::PacketDedup(size_t buckets, uint32_t window_ms)
+    : table(buckets, Bucket{}),
+    mask(buckets - 1),
+    window_ms(window_ms) {}
+
+/**
+ * @brief Looks the packet up and remembers it if it was not seen within the window.
+ *
+ * @param fingerprint Fingerprint of the packet headers
+ * @param timestamp_ms Capture time of the packet in miliseconds
+ *
+ * @return true if the packet is a copy of a packet seen within the window
+ */
+bool PacketDedup::duplicate(uint64_t fingerprint, uint32_t timestamp_ms) {
+    Bucket& bucket = table[fingerprint & mask];
+    uint32_t tag = static_cast<uint32_t>(fingerprint >> 32);
+    tag |= (tag == 0); // 0 marks an empty slot
+
+    size_t victim = 0;
+    uint32_t victim_age = 0;
+    for (size_t way = 0; way < BUCKET_WAYS; way++) {
+        // Copies may be slightly out of order, the age is taken in both directions
+        int32_t delta = static_cast<int32_t>(timestamp_ms - bucket.times[way]);
+        uint32_t age = delta < 0 ? static_cast<uint32_t>(-static_cast<int64_t>(delta)) : static_cast<uint32_t>(delta);
+        bool live = bucket.tags[way] != 0 && age <= window_ms;
+        if (live && bucket.tags[way] == tag) {
+            Metrics::add(Metrics::Counter::PACKETS_DUPLICATE);
+            return true;
+        }
+
+        // Empty and expired slots are taken first, then the oldest one
+        uint32_t rank = live ? age : UINT32_MAX;
+        if (way == 0 || rank > victim_age) {
+            victim = way;
+            victim_age = rank;
+        }
+    }
+
+    if (victim_age != UINT32_MAX) {
+        Metrics::add(Metrics::Counter::DEDUP_EVICTIONS);
+    }
+    bucket.tags[victim] = tag;
+    bucket.times[victim] = timestamp_ms;
+    return false;
+}
@@ -0,0 +1,344 @@
+////////////////////////////////////////////////////
+// File: FileSink.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "FileSink.h"
+#include "ErrorCodes.h"
+#include "Logger.h"
+#include "Metrics.h"
+
+namespace {
+    constexpr char FILE_MAGIC[4] = {'P', '2', 'N', 'F'};
+    constexpr uint16_t FILE_VERSION = 1;
+    constexpr size_t FILE_HEADER_SIZE = 16;
+    constexpr size_t BLOCK_HEADER_SIZE = 8;
+
+    inline void put_u16(uint8_t* buffer, uint16_t value) {
+        value = htons(value);
+        memcpy(buffer, &value, sizeof(value));
+    }
+
+    inline void put_u32(uint8_t* buffer, uint32_t value) {
+        value = htonl(value);
+        memcpy(buffer, &value, sizeof(value));
+    }
+}
+
+/**
+ * @brief Constructor of the class. Opens the output file and allocates the write buffer.
+ *
+ * @param path Path of the output file, truncated if it exists
+ * @param compression Block compression, Config::Compression::NONE for raw datagrams
+ * @param direct_io Open the file with O_DIRECT
+ */
+FileSink::FileSink(const std::string& path, Config::Compression compression, bool direct_io)
+    : path(path),
+    compression(compression),
+    direct_io(direct_io),
+    fd(-1),
+    write_buffer(nullptr),
+    write_used(0),
+    bytes_in(0),
+    bytes_written(0)
+{
+    void* memory = nullptr;
+    if (posix_memalign(&memory, Config::FILE_SINK_ALIGNMENT, Config::FILE_SINK_BUFFER_SIZE) != 0) {
+        std::cerr << "Error: Cannot allocate output buffer." << std::endl;
+        ExitWith(ErrorCode::INTERNAL_ERROR);
+    }
+    write_buffer = static_cast<uint8_t*>(memory);
+
+    open_file();
+
+    if (compression != Config::Compression::NONE) {
+        block.reserve(Config::FILE_SINK_BLOCK_SIZE);
+        write_file_header();
+    }
+}
+
+/**
+ * @brief Destructor. Writes out buffered data and closes the file.
+ */
+FileSink::~FileSink() {
+    flush();
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(write_buffer);
+    LOG_DEBUG("File sink wrote ", bytes_written, " bytes for ", bytes_in, " bytes of datagrams to ", path);
+}
+
+/**
+ * @brief Checks wheter the compression library was available at build time.
+ *
+ * @param compression Requested compression
+ *
+ * @return true if the compression can be used, false otherwise.
+ */
+bool FileSink::compression_supported(Config::Compression compression) {
+    switch (compression) {
+        case Config::Compression::NONE:
+            return true;
+        case Config::Compression::ZLIB:
+#ifdef HAVE_ZLIB
+            return true;
+#else
+            return false;
+#endif
+        case Config::Compression::LZ4:
+#ifdef HAVE_LZ4
+            return true;
+#else
+            return false;
+#endif
+        case Config::Compression::ZSTD:
+#ifdef HAVE_ZSTD
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+/**
+ * @brief Opens the output file. O_DIRECT is not supported by every file system,
+ * in that case the file is opened for normal buffered writes.
+ */
+void FileSink::open_file() {
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    if (direct_io) {
+        fd = open(path.c_str(), flags | O_DIRECT, 0644);
+        if (fd < 0 && errno == EINVAL) {
+            LOG_WARNING("O_DIRECT not supported for ", path, ", using buffered writes");
+            direct_io = false;
+        }
+    }
+    if (fd < 0) {
+        fd = open(path.c_str(), flags, 0644);
+    }
+    if (fd < 0) {
+        std::cerr << "Error: Cannot open output file '" << path << "': " << strerror(errno) << std::endl;
+        ExitWith(ErrorCode::FILE_OPEN_ERROR);
+    }
+}
+
+/**
+ * @brief Sets the header of the block container.
+ */
+void FileSink::write_file_header() {
+    uint8_t header[FILE_HEADER_SIZE] = {};
+    memcpy(header, FILE_MAGIC, sizeof(FILE_MAGIC));
+    put_u16(header + 4, FILE_VERSION);
+    header[6] = static_cast<uint8_t>(compression);
+    put_u32(header + 8, static_cast<uint32_t>(Config::FILE_SINK_BLOCK_SIZE));
+    append(header, sizeof(header));
+}
+
+/**
+ * @brief Files have no MTU, datagrams can be as large as UDP allows.
+ *
+ * @return Maximum export MTU.
+ */
+int FileSink::path_mtu() const {
+    return Config::MAX_EXPORT_MTU;
+}
+
+/**
+ * @brief Stores one datagram. Raw datagrams go to the write buffer,
+ * otherwise the datagram is framed with its length and added to the current block.
+ *
+ * @param buffer Datagram to store
+ * @param buffer_size Size of the datagram
+ */
+void FileSink::send(const uint8_t* buffer, size_t buffer_size) {
+    if (buffer_size == 0) {
+        return;
+    }
+    bytes_in += buffer_size;
+    Metrics::add(Metrics::Counter::DATAGRAMS_SENT);
+
+    if (compression == Config::Compression::NONE) {
+        append(buffer, buffer_size);
+        return;
+    }
+
+    uint8_t length[2];
+    put_u16(length, static_cast<uint16_t>(buffer_size));
+    block.insert(block.end(), length, length + sizeof(length));
+    block.insert(block.end(), buffer, buffer + buffer_size);
+
+    if (block.size() >= Config::FILE_SINK_BLOCK_SIZE) {
+        compress_block();
+    }
+}
+
+/**
+ * @brief Copies data into the write buffer, writing the buffer out whenever it fills up.
+ *
+ * @param data Data to copy
+ * @param size Size of the data
+ */
+void FileSink::append(const uint8_t* data, size_t size) {
+    while (size > 0) {
+        size_t chunk = std::min(size, Config::FILE_SINK_BUFFER_SIZE - write_used);
+        memcpy(write_buffer + write_used, data, chunk);
+        write_used += chunk;
+        data += chunk;
+        size -= chunk;
+
+        if (write_used == Config::FILE_SINK_BUFFER_SIZE) {
+            write_out(false);
+        }
+    }
+}
+
+/**
+ * @brief Compresses the current block and appends it with its block header to the write buffer.
+ */
+void FileSink::compress_block() {
+    if (block.empty()) {
+        return;
+    }
+
+    size_t bound = block.size();
+#ifdef HAVE_ZLIB
+    if (compression == Config::Compression::ZLIB) {
+        bound = compressBound(block.size());
+    }
+#endif
+#ifdef HAVE_LZ4
+    if (compression == Config::Compression::LZ4) {
+        bound = LZ4_compressBound(static_cast<int>(block.size()));
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (compression == Config::Compression::ZSTD) {
+        bound = ZSTD_compressBound(block.size());
+    }
+#endif
+    compressed.resize(bound);
+
+    size_t stored = 0; // 0 = compression failed, block is stored as it is
+    switch (compression) {
+#ifdef HAVE_ZLIB
+        case Config::Compression::ZLIB: {
+            uLongf length = compressed.size();
+            if (compress2(compressed.data(), &length, block.data(), block.size(), Z_BEST_SPEED) == Z_OK) {
+                stored = length;
+            }
+            break;
+        }
+#endif
+#ifdef HAVE_LZ4
+        case Config::Compression::LZ4: {
+            int length = LZ4_compress_default(reinterpret_cast<const char*>(block.data()),
+                                              reinterpret_cast<char*>(compressed.data()),
+                                              static_cast<int>(block.size()), static_cast<int>(compressed.size()));
+            if (length > 0) {
+                stored = static_cast<size_t>(length);
+            }
+            break;
+        }
+#endif
+#ifdef HAVE_ZSTD
+        case Config::Compression::ZSTD: {
+            size_t length = ZSTD_compress(compressed.data(), compressed.size(), block.data(), block.size(), 1);
+            if (!ZSTD_isError(length)) {
+                stored = length;
+            }
+            break;
+        }
+#endif
+        default:
+            break;
+    }
+
+    uint8_t header[BLOCK_HEADER_SIZE];
+    put_u32(header, static_cast<uint32_t>(block.size()));
+    if (stored == 0 || stored >= block.size()) {
+        // Incompressible block, store it as it is
+        put_u32(header + 4, static_cast<uint32_t>(block.size()));
+        append(header, sizeof(header));
+        append(block.data(), block.size());
+    }
+    else {
+        put_u32(header + 4, static_cast<uint32_t>(stored));
+        append(header, sizeof(header));
+        append(compressed.data(), stored);
+    }
+
+    block.clear();
+}
+
+/**
+ * @brief Writes the write buffer to the file.
+ * With O_DIRECT only whole aligned chunks can be written, the rest stays in the buffer
+ * until the final write, which is done after switching O_DIRECT off.
+ *
+ * @param final Write everything, the file is being closed
+ */
+void FileSink::write_out(bool final) {
+    size_t length = write_used;
+    if (direct_io) {
+        if (final) {
+            int flags = fcntl(fd, F_GETFL);
+            fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+            direct_io = false;
+        }
+        else {
+            length -= length % Config::FILE_SINK_ALIGNMENT;
+        }
+    }
+
+    size_t written = 0;
+    while (written < length) {
+        ssize_t result = write(fd, write_buffer + written, length - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Error: Cannot write output file '" << path << "': " << strerror(errno) << std::endl;
+            ExitWith(ErrorCode::FILE_WRITE_ERROR);
+        }
+        written += static_cast<size_t>(result);
+    }
+    bytes_written += written;
+
+    // Keep the unaligned rest at the start of the buffer
+    memmove(write_buffer, write_buffer + length, write_used - length);
+    write_used -= length;
+}
+
+/**
+ * @brief Compresses the pending block and writes all buffered data to the file.
+ */
+void FileSink::flush() {
+    if (fd < 0) {
+        return;
+    }
+    compress_block();
+    write_out(true);
+}
@@ -6,18 +6,28 @@
 ////////////////////////////////////////////////////
 
 #include <iostream>
+#include <utility>
 
 #include "NetFlowV5Key.h"
 #include "Flow.h"
+#include "RoutingTable.h"
 
 /**
  * @brief Constructor of the flow.
  *
  * @param key Unqiue key for identifying the flow
  * @param record Record for holding agregated data from packets
+ * @param timestamp_ms Absolute capture timestamp of the first packet in miliseconds
  */
-Flow::Flow(NetFlowV5Key key, NetFlowV5record record)
-    : key(key), record(record) {}
+Flow::Flow(NetFlowV5Key key, NetFlowV5record record, uint64_t timestamp_ms)
+    : key(key), record(record),
+    packets(record.dPkts),
+    octets(record.dOctets),
+    first_ms(timestamp_ms),
+    last_ms(timestamp_ms),
+    reverse(),
+    termination(Termination::NONE),
+    end_time(0) {}
 
 /**
  * @brief Updates the flow. Called on flow when new packet is aggregated to the flow.
@@ -25,16 +35,99 @@ Flow::Flow(NetFlowV5Key key, NetFlowV5record record)
  *
  * @param tcp_flags TCP flags from aggregated packet
  * @param num_layer_3_bytes Number of bytes in the packet
- * @param timestamp Timestamp of the packet
+ * @param timestamp_ms Absolute timestamp of the packet in miliseconds
  *
  * @return void
  */
-void Flow::update(uint8_t tcp_flags, uint32_t num_layer_3_bytes, uint32_t timestamp) {
+void Flow::update(uint8_t tcp_flags, uint32_t num_layer_3_bytes, uint64_t timestamp_ms) {
     record.dPkts += 1;
     record.tcp_flags |= tcp_flags;
     record.dOctets += num_layer_3_bytes;
-    record.Last = timestamp;
+    record.Last = static_cast<uint32_t>(timestamp_ms);
 
+    packets += 1;
+    octets += num_layer_3_bytes;
+    last_ms = timestamp_ms;
+}
+
+/**
+ * @brief Updates the reverse direction of a biflow with a packet sent from the destination to the source.
+ *
+ * @param tcp_flags TCP flags from aggregated packet
+ * @param num_layer_3_bytes Number of bytes in the packet
+ * @param timestamp_ms Absolute timestamp of the packet in miliseconds
+ *
+ * @return void
+ */
+void Flow::update_reverse(uint8_t tcp_flags, uint32_t num_layer_3_bytes, uint64_t timestamp_ms) {
+    if (reverse.packets == 0) {
+        reverse.first_ms = timestamp_ms;
+        reverse.First = static_cast<uint32_t>(timestamp_ms);
+    }
+    reverse.packets += 1;
+    reverse.octets += num_layer_3_bytes;
+    reverse.tcp_flags |= tcp_flags;
+    reverse.last_ms = timestamp_ms;
+    reverse.Last = static_cast<uint32_t>(timestamp_ms);
+}
+
+/**
+ * @brief Unidirectional flow of the reverse direction, for formats that cannot carry biflows.
+ * With a routing table the nexthop is looked up again, the reverse direction is routed towards
+ * the source of the flow.
+ *
+ * @param routes Routing table the flow was filled from, null without --routes
+ *
+ * @return Flow with swapped endpoints and the reverse counters
+ */
+Flow Flow::reversed(const RoutingTable* routes) const {
+    Flow flow(*this);
+    NetFlowV5record& swapped = flow.record;
+    std::swap(swapped.srcaddr, swapped.dstaddr);
+    std::swap(swapped.srcport, swapped.dstport);
+    std::swap(swapped.input, swapped.output);
+    std::swap(swapped.src_as, swapped.dst_as);
+    std::swap(swapped.src_mask, swapped.dst_mask);
+    swapped.dPkts = static_cast<uint32_t>(reverse.packets);
+    swapped.dOctets = static_cast<uint32_t>(reverse.octets);
+    swapped.First = reverse.First;
+    swapped.Last = reverse.Last;
+    swapped.tcp_flags = reverse.tcp_flags;
+
+    flow.key = NetFlowV5Key(swapped);
+    flow.packets = reverse.packets;
+    flow.octets = reverse.octets;
+    flow.first_ms = reverse.first_ms;
+    flow.last_ms = reverse.last_ms;
+    flow.reverse = Reverse();
+    if (routes != nullptr) {
+        swapped.nexthop = 0;
+        routes->fill(swapped);
+    }
+    return flow;
+}
+
+/**
+ * @brief Marks the flow as ended by TCP. A RST overrides the linger of an earlier FIN,
+ * retransmitted FINs do not extend it.
+ *
+ * @param reason FIN in both directions or RST
+ * @param time Time the flow should be exported at
+ */
+void Flow::terminate(Termination reason, uint32_t time) {
+    if (termination == Termination::NONE || (reason == Termination::RST && termination != Termination::RST)) {
+        termination = reason;
+        end_time = time;
+    }
+}
+
+/**
+ * @brief Checks wheter the TCP connection of the flow ended and its linger passed.
+ *
+ * @return true if the flow should be exported, false otherwise
+ */
+bool Flow::terminated(uint32_t current_time) const {
+    return termination != Termination::NONE && static_cast<int32_t>(current_time - end_time) >= 0;
 }
 
 /**
@@ -47,10 +140,13 @@ bool Flow::active_expired(uint32_t current_time, uint32_t active_timeout) const
     }
 
 /**
- * @brief Checks wheter the flow has exceeded inactive timeout
+ * @brief Checks wheter the flow has exceeded inactive timeout, packets of both directions of a biflow count.
  *
  * @return true if is expired, false otherwise
  */
 bool Flow::inactive_expired(uint32_t current_time, uint32_t inactive_timeout) const {
+        if (reverse.packets != 0 && (current_time - reverse.Last) < inactive_timeout) {
+            return false;
+        }
         return (current_time - record.Last) >= inactive_timeout;
     }
\ No newline at end of file
@@ -8,15 +8,58 @@
 
 #include <string>
 #include <iostream>
-#include <netinet/ip.h>
-#include <netinet/tcp.h>
-#include <arpa/inet.h>
-#include <iostream>
-#include <sys/time.h> 
-#include <cstring>
+#include <algorithm>
 
 #include "FlowManager.h"
 #include "ErrorCodes.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "Checkpoint.h"
+#include "Logger.h"
+
+namespace {
+    // Routing table of the --routes option, null without it
+    std::shared_ptr<const RoutingTable> load_routes(const std::string& path) {
+        if (path.empty()) {
+            return nullptr;
+        }
+        auto routes = std::make_shared<RoutingTable>();
+        if (!routes->load(path)) {
+            ExitWith(ErrorCode::FILE_OPEN_ERROR);
+        }
+        return routes;
+    }
+
+    // Sketches of the --sketches option, null without it
+    std::shared_ptr<Sketches> make_sketches(const ArgParser& programArguments) {
+        if (!programArguments.getSketches()) {
+            return nullptr;
+        }
+        return std::make_shared<Sketches>(static_cast<uint32_t>(programArguments.getSketchInterval()) * 1000,
+                                          static_cast<size_t>(programArguments.getTopK()));
+    }
+
+    // Aggregation options of the probe selected by the program arguments
+    ProbeOptions probe_options(const ArgParser& programArguments, std::shared_ptr<const RoutingTable> routes,
+                               std::shared_ptr<Sketches> sketches) {
+        ProbeOptions options;
+        options.active_timeout_ms = static_cast<uint32_t>(programArguments.getActiveTimeout()) * 1000;
+        options.inactive_timeout_ms = static_cast<uint32_t>(programArguments.getInactiveTimeout()) * 1000;
+        options.biflow = programArguments.getBiflow();
+        options.tcp_end = programArguments.getTcpEnd();
+        options.fin_linger_ms = static_cast<uint32_t>(programArguments.getFinLinger());
+        options.admission = programArguments.getAdmission();
+        options.dedup_window_ms = programArguments.getDedup() ? static_cast<uint32_t>(programArguments.getDedupWindow()) : 0;
+        options.routes = std::move(routes);
+        if (!programArguments.getFlowSpillPath().empty()) {
+            options.spill = std::make_shared<FlowSpill>(programArguments.getFlowSpillPath());
+        }
+        options.hot_flows = static_cast<size_t>(programArguments.getHotFlows());
+        options.sketches = std::move(sketches);
+        options.export_expired = !programArguments.getRollupOnly(); // Only the rollups are exported
+        return options;
+    }
+}
 
 /**
  * @brief Constructor for the class. Loads program arguments, initializes reader and tries to open the pcap file.
@@ -24,20 +67,83 @@
  * @param programArguments Program arguments set by user.
  */
 FlowManager::FlowManager(ArgParser programArguments)
-    : flow_count(0),
-    flows_exported(0),
-    exporter(programArguments.getHost(), programArguments.getPort()),
-    reader(programArguments.getPCAPFilePath()),
+    : parallel_flow_count(0),
+    reader(programArguments.getPCAPFilePath(), programArguments.getInputReader(), programArguments.getDirectRead()),
     active_timeout_ms(programArguments.getActiveTimeout() * 1000),
     inactive_timeout_ms(programArguments.getInactiveTimeout() * 1000),
-    time_start_set(false),
-    time_start(0),
-    time_end(0)
+    export_format(programArguments.getExportFormat()),
+    checkpoint_path(programArguments.getCheckpointPath()),
+    pcap_path(programArguments.getPCAPFilePath()),
+    threads(programArguments.getThreads()),
+    biflow(programArguments.getBiflow()),
+    sketches(make_sketches(programArguments)),
+    routes(load_routes(programArguments.getRoutesPath())),
+    probe(probe_options(programArguments, routes, sketches)),
+    exporter(nullptr)
 {
+    std::unique_ptr<Exporter> created = Exporter::create(programArguments);
+    exporter = created.get();
+    probe.set_exporter(std::move(created));
+
+    if (programArguments.getRollup()) {
+        rollup = std::make_unique<Rollup>(programArguments.getRollupSpec(),
+                                          static_cast<uint32_t>(programArguments.getRollupInterval()) * 1000);
+        probe.set_callback([this](const Flow& flow) { roll_up(flow); });
+    }
+
     if (!reader.open()) {
         dispose();
         ExitWith(ErrorCode::FILE_OPEN_ERROR);
     }
+
+    if (programArguments.hasTimeRange()) {
+        reader.select_range(programArguments.getFromTime(), programArguments.getToTime());
+    }
+
+    if (!programArguments.getResumePath().empty()) {
+        resume(programArguments.getResumePath());
+    }
+}
+
+/**
+ * @brief Restores the flows and export state saved by the previous run.
+ *
+ * @param path Path of the checkpoint file
+ */
+void FlowManager::resume(const std::string& path) {
+    Checkpoint::State state;
+    state.format = export_format;
+    state.biflow = biflow;
+    if (!Checkpoint::load(path, state, probe.flows())) {
+        dispose();
+        ExitWith(ErrorCode::FILE_OPEN_ERROR);
+    }
+
+    probe.reindex();
+    exporter->set_sequence(state.sequence);
+    probe.set_times(state.time_start, state.time_end);
+
+    LOG_INFO("Resumed ", probe.flows().size(), " flows from checkpoint ", path);
+}
+
+/**
+ * @brief Saves the flows that have not expired and the export state for the next run.
+ *
+ * @param path Path of the checkpoint file
+ */
+void FlowManager::save_checkpoint(const std::string& path) {
+    Checkpoint::State state;
+    state.format = export_format;
+    state.biflow = biflow;
+    state.sequence = exporter->sequence();
+    state.time_start = probe.start_time();
+    state.time_end = probe.end_time();
+    if (!Checkpoint::save(path, state, probe.flows())) {
+        dispose();
+        ExitWith(ErrorCode::FILE_WRITE_ERROR);
+    }
+
+    LOG_INFO("Saved ", probe.flows().size(), " flows to checkpoint ", path);
 }
 
 /**
@@ -48,77 +154,59 @@ FlowManager::~FlowManager() {
 }
 
 /**
- * @brief Cleans up resources and frees memmory.
+ * @brief Cleans up resources, the flows are freed with the probe.
  */
 void FlowManager::dispose() {
-    flow_map.clear();
-    cached_flows.clear();
     reader.close();
 }
 
 /**
- * @brief Get current time in miliseconds.
+ * @brief Adds an expired flow to its rollup, both directions of a biflow separately. Finished rollup
+ * bins are exported before the flow itself.
  *
- * @return Current time in miliseconds.
+ * @param flow Expired flow
  */
-uint32_t FlowManager::getCurrentTime() {
-    struct timeval tv;
-    gettimeofday(&tv, nullptr);
-    uint32_t duration = (tv.tv_sec * 1000LL) + (tv.tv_usec / 1000);
-    return duration;
+void FlowManager::roll_up(const Flow& flow) {
+    rollup->add(flow, rolled_up);
+    if (flow.has_reverse()) {
+        rollup->add(flow.reversed(routes.get()), rolled_up);
+    }
+    export_rolled_up();
 }
 
 /**
- * @brief Tries to find a flow by comparing their keys, if the flow is found, updates it.
- * If not, new flow is created.
- *
- * @param new_record Processed packet from pcap file into a NetFlowV5record struct.
- *
- * @return void
+ * @brief Passes the finished rollup bins to the exporter of the probe.
  */
-void FlowManager::add_or_update_flow(NetFlowV5record new_record) {
-    if (!time_start_set) { // Set the start time of the device
-            time_start = getCurrentTime();
-            time_start_set = true;
-    }
-    time_end = new_record.Last; // Update the end time with current timestamp
-
-    // Key for comparing the flows.
-    NetFlowV5Key key(new_record);
-    std::string concat_key = key.concatToString();
-
-    auto it = flow_map.find(concat_key); // Get the pointer to the flow by searching in hash map
-    if (it != flow_map.end() && concat_key == it->first) {
-        // Flow exists, update the existing flow in the list
-        it->second->update(new_record.tcp_flags, new_record.dOctets, new_record.Last); // it->seconds points to the entry in the list
-    }
-    else {
-        // New flow, add it to the list and map
-        flow_count++;
-        new_record.First = new_record.Last;
-        flow_list.push_back(Flow(key, new_record));  
-        FlowList::iterator list_it = --flow_list.end();  
-        flow_map[concat_key] = list_it;  
+void FlowManager::export_rolled_up() {
+    for (const Flow& bin : rolled_up) {
+        probe.export_flow(bin);
     }
+    rolled_up.clear();
 }
 
 /**
- * @brief Exports flow that have not expired, but the pcap file ended, so they should be all sent to the collector
+ * @brief Exports flow that have not expired, but the pcap file ended, so they should be all sent to the collector.
+ * With a checkpoint file the flows are saved for the next run instead.
  */
 void FlowManager::export_remaining() {
-    if (flow_list.empty()) {
+    if (!checkpoint_path.empty()) {
+        if (rollup) {
+            rollup->flush(rolled_up); // The open bin is not carried over
+            export_rolled_up();
+        }
+        probe.flush();  // Flows that already expired are not carried over
+        save_checkpoint(checkpoint_path);
         return;
     }
 
-    // Export all flows by aggregating them into buffers of size of maximum of 30 flows. 
-    for (const auto& flow : flow_list) {
-        cached_flows.push_back(flow); 
-        if (cached_flows.size() == MAX_CACHED_FLOWS) {
-            export_cached(); // Export 30 at once
-        }
+    // Export all flows in batches of the size accepted by the exporter (30 flows for v5).
+    probe.expire_all();
+    if (rollup) {
+        rollup->flush(rolled_up);
+        export_rolled_up();
+        LOG_INFO("Rolled up ", rollup->flows_in(), " flows into ", rollup->rollups_out(), " records");
     }
-
-    export_cached();  // Export remaining
+    probe.flush();  // Export remaining
 }
 
 /**
@@ -127,67 +215,82 @@ void FlowManager::export_remaining() {
  * @return -1 if error occurs while reading packets, -2 when the reader reaches end of the pcap file.
  */
 int FlowManager::startProcessing() {
-    struct pcap_pkthdr* header;
-    const u_char* packet;
-    int result;
-
-    // Result is -1 if error occured while reading packet, -2 when it reaches the end of pcap file.
-    while ((result = pcap_next_ex(reader.handle, &header, &packet)) > 0) {
-        NetFlowV5record record;
-        bool packetProcessed = reader.processPacket(header, packet, record);
-        if (packetProcessed) {
-            add_or_update_flow(record);
+    if (threads > 1) {
+        ParallelProcessor processor(pcap_path, threads, active_timeout_ms, inactive_timeout_ms);
+        if (!processor.split()) {
+            LOG_WARNING("Only uncompressed classic pcap files can be processed on several threads, using one thread");
         }
-
-        uint32_t timestamp_ms = header->ts.tv_sec * 1000 + header->ts.tv_usec / 1000; // convert to miliseconds
-
-        // Cache expired flows into buffer
-        cache_expired(timestamp_ms);
-        if (cached_flows.size() == MAX_CACHED_FLOWS) {
-            export_cached(); // Buffer is full -> export it
+        else if (processor.chunk_count() > 1) {
+            return processParallel(processor);
         }
     }
 
+    // Result is -1 if error occured while reading packet, -2 when it reaches the end of pcap file.
+    int result = probe.add_from(reader);
+    if (sketches) {
+        sketches->finish();
+    }
     return result;
 }
 
 /**
- * @brief Iterates over current flows and check wheter the flows are expired. Expired flows are cached.
- * Iterating through list in cpp while removing some entries inspired from:
- * https://stackoverflow.com/a/1604632
+ * @brief Processes the pcap file on several threads. Finished flows are passed to the probe as
+ * expired flows, flows open at the end stay in its flow list for export_remaining.
  *
- * @param current_time Time that will be the packes compared to.
+ * @param processor Processor with the file already split into ranges
+ *
+ * @return -1 if error occurs while reading packets, -2 when the whole file was processed.
  */
-void FlowManager::cache_expired(uint32_t current_time) {
-    for (auto it = flow_list.begin(); it != flow_list.end(); ) {
-        // If flow exceeds active or inactive timeout, cache it.
-        if (it->active_expired(current_time, active_timeout_ms) ||
-            it->inactive_expired(current_time, inactive_timeout_ms)) {
-            // Cache the flow
-            cached_flows.push_back(*it);
-
-            flow_map.erase(it->key.concatToString());
-            it = flow_list.erase(it);       
-
-            if (cached_flows.size() == MAX_CACHED_FLOWS) { // Buffer is full
-                export_cached(); // -> export it, clear the buffer
-            }
+int FlowManager::processParallel(ParallelProcessor& processor) {
+    LOG_INFO("Processing ", pcap_path, " in ", processor.chunk_count(), " ranges");
+    probe.start_clock();
+
+    // Resumed flows are carried into the first range, every other flow was created by this run
+    std::list<Flow>& flows = probe.flows();
+    size_t resumed = flows.size();
+    size_t finished = 0;
+    int result = processor.run(flows, [this, &finished](const Flow& flow, bool active) {
+        Metrics::add(active ? Metrics::Counter::FLOWS_EXPIRED_ACTIVE : Metrics::Counter::FLOWS_EXPIRED_INACTIVE);
+        finished++;
+        if (routes) {
+            Flow routed = flow;
+            routes->fill(routed.record);
+            probe.add_expired(routed);
         }
         else {
-            ++it;
+            probe.add_expired(flow);
+        }
+    });
+
+    probe.reindex();
+    uint32_t time_end = probe.end_time();
+    for (Flow& flow : flows) {
+        time_end = std::max(time_end, flow.record.Last);
+        if (routes) {
+            routes->fill(flow.record);
         }
     }
+    probe.set_times(probe.start_time(), time_end);
+    uint32_t created = static_cast<uint32_t>(finished + flows.size() - resumed);
+    parallel_flow_count += created;
+    Metrics::add(Metrics::Counter::FLOWS_CREATED, created);
+    return result;
 }
 
 /**
- * @brief Export flows with the Exporter object and updates number of flows exported.
+ * @brief Get number of flows created since the start of processing.
+ *
+ * @return Number of created flows.
  */
-void FlowManager::export_cached() {
-    if (cached_flows.empty()) {
-        return;
-    }
-    flows_exported += cached_flows.size();
+uint32_t FlowManager::get_flow_count() const {
+    return static_cast<uint32_t>(probe.flows_created()) + parallel_flow_count;
+}
 
-    exporter.export_flows(cached_flows, time_start, time_end);
-    cached_flows.clear();
-}   
\ No newline at end of file
+/**
+ * @brief Get number of flows passed to the exporter.
+ *
+ * @return Number of exported flows.
+ */
+uint32_t FlowManager::get_flows_exported() const {
+    return static_cast<uint32_t>(probe.flows_exported());
+}
@@ -0,0 +1,295 @@
+////////////////////////////////////////////////////
+// File: FlowSpill.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "FlowSpill.h"
+#include "Config.h"
+#include "ErrorCodes.h"
+#include "Logger.h"
+
+static_assert(std::is_trivially_copyable<Flow>::value, "Flows are copied into the spill file as they are");
+
+namespace {
+    // Min-heap order of the deadlines, times are compared like the timeouts of Flow
+    inline bool later(uint32_t a, uint32_t b) {
+        return static_cast<int32_t>(a - b) > 0;
+    }
+}
+
+/**
+ * @brief Constructor of the class. Creates the spill file and removes its name at once,
+ * the space is freed when the file is closed.
+ *
+ * @param path Path of the spill file
+ */
+FlowSpill::FlowSpill(const std::string& path)
+    : path(path),
+    fd(-1),
+    mapping(nullptr),
+    slot_count(0),
+    slot_size((sizeof(SlotHeader) + sizeof(Flow) + 63) / 64 * 64),
+    next_slot(0),
+    stored(0),
+    accesses_since_release(0)
+{
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        std::cerr << "Error: Cannot create spill file '" << path << "': " << strerror(errno) << std::endl;
+        ExitWith(ErrorCode::FILE_OPEN_ERROR);
+    }
+    unlink(path.c_str());
+    map_slots(Config::SPILL_INITIAL_SLOTS);
+}
+
+/**
+ * @brief Destructor. Unmaps and closes the file.
+ */
+FlowSpill::~FlowSpill() {
+    if (mapping != nullptr) {
+        munmap(mapping, slot_count * slot_size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+/**
+ * @brief Moves a flow into the file.
+ *
+ * @param table_key Key of the flow in the flow table
+ * @param flow Flow to store
+ * @param deadline Time the flow expires at if no packet comes
+ */
+void FlowSpill::put(const NetFlowV5Key& table_key, const Flow& flow, uint32_t deadline) {
+    uint32_t slot = allocate_slot();
+    SlotHeader header{table_key, deadline, 1};
+    memcpy(header_of(slot), &header, sizeof(header));
+    memcpy(flow_of(slot), &flow, sizeof(Flow));
+
+    if ((stored + 1) * 2 > index.size()) {
+        index_grow();
+    }
+    index_insert(hash_of(table_key), slot);
+    push_deadline(deadline, slot);
+    stored++;
+    count_access();
+}
+
+/**
+ * @brief Takes the flow of the key out of the file, used when a packet of a cold flow arrives.
+ *
+ * @param table_key Key of the flow in the flow table
+ *
+ * @return The flow, empty if the key has no flow in the file
+ */
+std::optional<Flow> FlowSpill::take(const NetFlowV5Key& table_key) {
+    if (stored == 0) {
+        return std::nullopt;
+    }
+    uint32_t hash = hash_of(table_key);
+    size_t mask = index.size() - 1;
+    for (size_t position = hash & mask; index[position] != 0; position = (position + 1) & mask) {
+        if (static_cast<uint32_t>(index[position] >> 32) != hash) {
+            continue;
+        }
+        uint32_t slot = static_cast<uint32_t>(index[position]) - 1;
+        count_access();
+        if (header_of(slot)->table_key == table_key) {
+            index_erase(position);
+            return release_slot(slot);
+        }
+    }
+    return std::nullopt;
+}
+
+/**
+ * @brief Takes out the flow with the earliest deadline if it has passed.
+ *
+ * @param current_time Time of the current packet
+ *
+ * @return The expired flow, empty if no flow of the file has expired
+ */
+std::optional<Flow> FlowSpill::take_expired(uint32_t current_time) {
+    return take_earliest(true, current_time);
+}
+
+/**
+ * @brief Takes out the flow with the earliest deadline, used to empty the file at the end of the input.
+ *
+ * @return The flow, empty if the file holds no flow
+ */
+std::optional<Flow> FlowSpill::take_next() {
+    return take_earliest(false, 0);
+}
+
+/**
+ * @brief Takes out the flow at the top of the deadline heap, heap entries of flows taken out
+ * before are dropped on the way.
+ *
+ * @param check_time Only a flow whose deadline has passed is taken
+ * @param current_time Time of the current packet
+ */
+std::optional<Flow> FlowSpill::take_earliest(bool check_time, uint32_t current_time) {
+    while (!deadlines.empty() && !(check_time && later(deadlines.front().time, current_time))) {
+        Deadline top = pop_deadline();
+        count_access();
+        SlotHeader* header = header_of(top.slot);
+        if (header->used == 0 || header->deadline != top.time) {
+            continue; // The flow was taken out before
+        }
+        uint32_t hash = hash_of(header->table_key);
+        size_t mask = index.size() - 1;
+        size_t position = hash & mask;
+        while (index[position] != ((static_cast<uint64_t>(hash) << 32) | (top.slot + 1))) {
+            position = (position + 1) & mask;
+        }
+        index_erase(position);
+        return release_slot(top.slot);
+    }
+    return std::nullopt;
+}
+
+/**
+ * @brief Removes all flows, the file keeps its size.
+ */
+void FlowSpill::clear() {
+    next_slot = 0;
+    free_slots.clear();
+    stored = 0;
+    index.clear();
+    deadlines.clear();
+}
+
+/**
+ * @brief Counts a slot read or written through the mapping. Every access may bring another page
+ * into the resident set, so all pages of the mapping are released after SPILL_RELEASE_INTERVAL
+ * accesses; the kernel keeps them in the page cache and they are read back from it when needed.
+ */
+void FlowSpill::count_access() {
+    if (++accesses_since_release >= Config::SPILL_RELEASE_INTERVAL) {
+        madvise(mapping, next_slot * slot_size, MADV_DONTNEED);
+        accesses_since_release = 0;
+    }
+}
+
+/**
+ * @brief Sizes the file for count slots and maps it.
+ */
+void FlowSpill::map_slots(size_t count) {
+    if (ftruncate(fd, static_cast<off_t>(count * slot_size)) != 0) {
+        std::cerr << "Error: Cannot grow spill file '" << path << "': " << strerror(errno) << std::endl;
+        ExitWith(ErrorCode::FILE_WRITE_ERROR);
+    }
+    void* memory = mapping == nullptr
+        ? mmap(nullptr, count * slot_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+        : mremap(mapping, slot_count * slot_size, count * slot_size, MREMAP_MAYMOVE);
+    if (memory == MAP_FAILED) {
+        std::cerr << "Error: Cannot map spill file '" << path << "': " << strerror(errno) << std::endl;
+        ExitWith(ErrorCode::FILE_WRITE_ERROR);
+    }
+    mapping = static_cast<uint8_t*>(memory);
+    slot_count = count;
+    LOG_DEBUG("Spill file ", path, " holds ", slot_count, " slots");
+}
+
+/**
+ * @brief Free slot for a new flow, the file is doubled when all slots are used.
+ */
+uint32_t FlowSpill::allocate_slot() {
+    if (!free_slots.empty()) {
+        uint32_t slot = free_slots.back();
+        free_slots.pop_back();
+        return slot;
+    }
+    if (next_slot == slot_count) {
+        map_slots(slot_count * 2);
+    }
+    return static_cast<uint32_t>(next_slot++);
+}
+
+/**
+ * @brief Copies the flow out of the slot and frees the slot.
+ */
+Flow FlowSpill::release_slot(uint32_t slot) {
+    SlotHeader* header = header_of(slot);
+    Flow flow(header->table_key, NetFlowV5record(), 0);
+    memcpy(&flow, flow_of(slot), sizeof(Flow));
+    header->used = 0;
+    free_slots.push_back(slot);
+    stored--;
+    return flow;
+}
+
+/**
+ * @brief Puts the slot into the first free index entry from the home entry of its hash.
+ */
+void FlowSpill::index_insert(uint32_t hash, uint32_t slot) {
+    size_t mask = index.size() - 1;
+    size_t position = hash & mask;
+    while (index[position] != 0) {
+        position = (position + 1) & mask;
+    }
+    index[position] = (static_cast<uint64_t>(hash) << 32) | (slot + 1);
+}
+
+/**
+ * @brief Empties an index entry and shifts the following entries of the probe sequence back into the gap.
+ */
+void FlowSpill::index_erase(size_t position) {
+    size_t mask = index.size() - 1;
+    size_t hole = position;
+    for (size_t next = (position + 1) & mask; index[next] != 0; next = (next + 1) & mask) {
+        size_t home = static_cast<uint32_t>(index[next] >> 32) & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            index[hole] = index[next];
+            hole = next;
+        }
+    }
+    index[hole] = 0;
+}
+
+/**
+ * @brief Doubles the index, the entries are placed again by their stored hash.
+ */
+void FlowSpill::index_grow() {
+    std::vector<uint64_t> old;
+    old.swap(index);
+    index.assign(old.empty() ? Config::SPILL_INITIAL_SLOTS : old.size() * 2, 0);
+    for (uint64_t entry : old) {
+        if (entry != 0) {
+            index_insert(static_cast<uint32_t>(entry >> 32), static_cast<uint32_t>(entry) - 1);
+        }
+    }
+}
+
+/**
+ * @brief Adds a deadline to the heap.
+ */
+void FlowSpill::push_deadline(uint32_t time, uint32_t slot) {
+    deadlines.push_back({time, slot});
+    std::push_heap(deadlines.begin(), deadlines.end(),
+                   [](const Deadline& a, const Deadline& b) { return later(a.time, b.time); });
+}
+
+/**
+ * @brief Removes the earliest deadline from the heap.
+ */
+FlowSpill::Deadline FlowSpill::pop_deadline() {
+    std::pop_heap(deadlines.begin(), deadlines.end(),
+                  [](const Deadline& a, const Deadline& b) { return later(a.time, b.time); });
+    Deadline top = deadlines.back();
+    deadlines.pop_back();
+    return top;
+}
@@ -0,0 +1,28 @@
+////////////////////////////////////////////////////
+// File: FlowTable.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include "FlowTable.h"
+
+/**
+ * @brief Creates the flow table of the policies selected by the options.
+ *
+ * @param biflow Both directions of a connection share one flow
+ * @param tcp_end Flows also end after RST or FIN in both directions
+ * @param settings Timeouts and routing table of the flows
+ */
+AnyFlowTable make_flow_table(bool biflow, bool tcp_end, const FlowTableSettings& settings) {
+    if (biflow) {
+        if (tcp_end) {
+            return FlowTable<BiflowKey, TcpEndExpiry>(settings);
+        }
+        return FlowTable<BiflowKey, TimeoutExpiry>(settings);
+    }
+    if (tcp_end) {
+        return FlowTable<FiveTupleKey, TcpEndExpiry>(settings);
+    }
+    return FlowTable<FiveTupleKey, TimeoutExpiry>(settings);
+}
@@ -0,0 +1,283 @@
+////////////////////////////////////////////////////
+// File: Logger.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "Logger.h"
+
+namespace {
+    /**
+     * @brief One queued message. The sequence number tells whether the slot is free or filled
+     * for the current round of the ring (bounded MPMC queue by Dmitry Vyukov).
+     */
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        Logger::Level level = Logger::Level::INFO;
+        uint64_t time_ns = 0;
+        uint32_t suppressed = 0;
+        uint16_t length = 0;
+        char text[Config::LOG_MESSAGE_SIZE];
+    };
+
+    // Cleared when the backend is destroyed at exit, later messages are written synchronously
+    std::atomic<bool> backend_alive{false};
+
+    static_assert((Config::LOG_RING_SIZE & (Config::LOG_RING_SIZE - 1)) == 0, "Log ring size must be a power of two");
+
+    const char* levelToString(Logger::Level level) {
+        switch (level) {
+            case Logger::Level::DEBUG_LEVEL: return "DEBUG";
+            case Logger::Level::INFO:        return "INFO ";
+            case Logger::Level::WARNING:     return "WARN ";
+            case Logger::Level::ERROR:       return "ERROR";
+            default:                         return "UNKNOWN";
+        }
+    }
+
+    /**
+     * @brief Ring buffer and the writer thread. Producers never block, the writer sleeps
+     * when the ring is empty and is woken by the next message.
+     */
+    class Backend {
+    public:
+        Backend()
+            : slots(std::make_unique<Slot[]>(Config::LOG_RING_SIZE)) {
+            for (size_t i = 0; i < Config::LOG_RING_SIZE; i++) {
+                slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+            writer = std::thread(&Backend::run, this);
+            backend_alive.store(true);
+        }
+
+        ~Backend() {
+            backend_alive.store(false);
+            running.store(false);
+            wake();
+            writer.join();
+        }
+
+        /**
+         * @brief Copies the message into a free slot.
+         *
+         * @return false if the ring is full
+         */
+        bool push(Logger::Level level, uint64_t time_ns, uint32_t suppressed, const Logger::Line& line) {
+            uint64_t position = tail.load(std::memory_order_relaxed);
+            Slot* slot;
+            while (true) {
+                slot = &slots[position & (Config::LOG_RING_SIZE - 1)];
+                uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+                int64_t difference = static_cast<int64_t>(sequence - position);
+                if (difference == 0) {
+                    if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                }
+                else if (difference < 0) {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                else {
+                    position = tail.load(std::memory_order_relaxed);
+                }
+            }
+
+            slot->level = level;
+            slot->time_ns = time_ns;
+            slot->suppressed = suppressed;
+            slot->length = static_cast<uint16_t>(line.size());
+            std::memcpy(slot->text, line.data(), line.size());
+            slot->sequence.store(position + 1, std::memory_order_release);
+
+            if (sleeping.load(std::memory_order_relaxed)) {
+                wake();
+            }
+            return true;
+        }
+
+        /**
+         * @brief Waits until all messages queued before the call are written.
+         */
+        void flush() {
+            uint64_t target = tail.load(std::memory_order_acquire);
+            while (written.load(std::memory_order_acquire) < target) {
+                wake();
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+
+    private:
+        std::unique_ptr<Slot[]> slots;
+        std::atomic<uint64_t> tail{0};      // next position for producers
+        uint64_t head = 0;                  // next position for the writer
+        std::atomic<uint64_t> written{0};   // messages already written out
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> running{true};
+        std::atomic<bool> sleeping{false};
+
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::thread writer;
+
+        // Formatted date and time of the last second, localtime runs once per second
+        time_t cached_second = -1;
+        char cached_time[32] = {};
+
+        // Notified without the mutex so producers never wait for the writer,
+        // a lost wake up only delays the message by the idle period
+        void wake() {
+            condition.notify_one();
+        }
+
+        /**
+         * @brief Loop of the writer thread. Drains the ring, then sleeps until woken or the idle period passes.
+         */
+        void run() {
+            while (true) {
+                bool stopping = !running.load();
+                drain();
+                if (stopping) {
+                    break;
+                }
+
+                std::unique_lock<std::mutex> lock(mutex);
+                sleeping.store(true);
+                if (!has_message() && running.load()) {
+                    condition.wait_for(lock, std::chrono::milliseconds(Config::LOG_WRITER_IDLE_MS));
+                }
+                sleeping.store(false);
+            }
+        }
+
+        bool has_message() const {
+            const Slot& slot = slots[head & (Config::LOG_RING_SIZE - 1)];
+            return slot.sequence.load(std::memory_order_acquire) == head + 1;
+        }
+
+        /**
+         * @brief Writes all filled slots, standard output and error are flushed once per drain.
+         */
+        void drain() {
+            bool wrote_out = false;
+            bool wrote_err = false;
+
+            uint64_t lost = dropped.exchange(0, std::memory_order_relaxed);
+            if (lost > 0) {
+                Logger::Line line;
+                line.append(lost);
+                line.append_text(" log messages dropped, ring buffer full");
+                write_line(stderr, Logger::Level::WARNING, line.data(), line.size(), 0, now_ns());
+                wrote_err = true;
+            }
+
+            while (has_message()) {
+                Slot& slot = slots[head & (Config::LOG_RING_SIZE - 1)];
+                FILE* stream = slot.level >= Logger::Level::WARNING ? stderr : stdout;
+                write_line(stream, slot.level, slot.text, slot.length, slot.suppressed, slot.time_ns);
+                (stream == stderr ? wrote_err : wrote_out) = true;
+
+                slot.sequence.store(head + Config::LOG_RING_SIZE, std::memory_order_release);
+                head++;
+                written.store(head, std::memory_order_release);
+            }
+
+            if (wrote_out) {
+                std::fflush(stdout);
+            }
+            if (wrote_err) {
+                std::fflush(stderr);
+            }
+        }
+
+        static uint64_t now_ns() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+
+        /**
+         * @brief Writes one line with the cached timestamp, level and the suppressed count.
+         */
+        void write_line(FILE* stream, Logger::Level level, const char* text, size_t length, uint32_t suppressed,
+                        uint64_t time_ns) {
+            time_t second = static_cast<time_t>(time_ns / 1000000000);
+            if (second != cached_second) {
+                struct tm tm;
+                localtime_r(&second, &tm);
+                strftime(cached_time, sizeof(cached_time), "%Y-%m-%d %H:%M:%S", &tm);
+                cached_second = second;
+            }
+
+            unsigned ms = static_cast<unsigned>((time_ns / 1000000) % 1000);
+            std::fprintf(stream, "[%s.%03u] [%s] ", cached_time, ms, levelToString(level));
+            std::fwrite(text, 1, length, stream);
+            if (suppressed > 0) {
+                std::fprintf(stream, " (%u similar messages suppressed)", suppressed);
+            }
+            std::fputc('\n', stream);
+        }
+    };
+
+    /**
+     * @brief Backend created by the first message, destroyed (and drained) by the static destructors at exit.
+     */
+    Backend& backend() {
+        static Backend instance;
+        return instance;
+    }
+}
+
+/**
+ * @brief Current wall clock time for the message timestamp.
+ *
+ * @return Nanoseconds since the epoch
+ */
+uint64_t Logger::clock_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Queues the formatted message for the writer thread.
+ *
+ * @param level Level of the message
+ * @param time_ns Timestamp of the message
+ * @param suppressed Number of messages of the same call site suppressed before this one
+ * @param line Formatted message
+ */
+void Logger::submit(Level level, uint64_t time_ns, uint32_t suppressed, const Line& line) {
+    static Backend& instance = backend();
+
+    if (backend_alive.load(std::memory_order_relaxed)) {
+        instance.push(level, time_ns, suppressed, line);
+        // Errors are usually followed by a message on stderr and the exit, they are written first
+        if (level == Level::ERROR) {
+            instance.flush();
+        }
+        return;
+    }
+
+    // Program is exiting and the writer thread is gone
+    FILE* stream = level >= Level::WARNING ? stderr : stdout;
+    std::fprintf(stream, "[%s] ", levelToString(level));
+    std::fwrite(line.data(), 1, line.size(), stream);
+    std::fputc('\n', stream);
+}
+
+/**
+ * @brief Waits until all queued messages are written.
+ */
+void Logger::flush() {
+    if (backend_alive.load()) {
+        backend().flush();
+    }
+}
@@ -0,0 +1,255 @@
+////////////////////////////////////////////////////
+// File: Metrics.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include "Metrics.h"
+
+namespace {
+    // Guards the registry of thread blocks
+    std::mutex blocks_mutex;
+
+    constexpr double PERCENTILES[] = {0.5, 0.9, 0.99, 0.999};
+}
+
+/**
+ * @brief Allocates the block of the calling thread and adds it to the registry.
+ *
+ * @return Block of the calling thread.
+ */
+Metrics::ThreadBlock* Metrics::register_thread() {
+    std::lock_guard<std::mutex> lock(blocks_mutex);
+    all_blocks().push_back(std::make_unique<ThreadBlock>());
+    return all_blocks().back().get();
+}
+
+/**
+ * @brief Blocks of all threads. Never destroyed, threads may update metrics during program exit.
+ *
+ * @return Registry of the thread blocks.
+ */
+std::vector<std::unique_ptr<Metrics::ThreadBlock>>& Metrics::all_blocks() {
+    static auto* blocks = new std::vector<std::unique_ptr<ThreadBlock>>();
+    return *blocks;
+}
+
+/**
+ * @brief Index of the histogram bucket of the value.
+ * Values below HISTOGRAM_SUB_BUCKETS have their own bucket, larger values
+ * are bucketed by the position of the highest bit and the next HISTOGRAM_SUB_BUCKET_BITS bits.
+ *
+ * @param value Measured value
+ *
+ * @return Index of the bucket
+ */
+size_t Metrics::bucket_index(uint64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return static_cast<size_t>(value);
+    }
+    size_t msb = 63 - __builtin_clzll(value);
+    size_t shift = msb - HISTOGRAM_SUB_BUCKET_BITS;
+    size_t sub_bucket = (value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return (msb - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS + sub_bucket;
+}
+
+/**
+ * @brief Representative value of the bucket, middle of its range.
+ *
+ * @param index Index of the bucket
+ *
+ * @return Value in the middle of the bucket
+ */
+uint64_t Metrics::bucket_value(size_t index) {
+    if (index < HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+    size_t msb = index / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKET_BITS - 1;
+    size_t shift = msb - HISTOGRAM_SUB_BUCKET_BITS;
+    uint64_t sub_bucket = index % HISTOGRAM_SUB_BUCKETS;
+    uint64_t lower = (1ULL << msb) + (sub_bucket << shift);
+    return lower + ((1ULL << shift) >> 1);
+}
+
+/**
+ * @brief Records one latency measurement of the stage for the calling thread.
+ *
+ * @param stage Measured stage
+ * @param nanoseconds Duration of the stage
+ */
+void Metrics::record(Stage stage, uint64_t nanoseconds) {
+    Histogram& histogram = local().histograms[static_cast<size_t>(stage)];
+
+    std::atomic<uint64_t>& bucket = histogram.buckets[bucket_index(nanoseconds)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    histogram.sum.store(histogram.sum.load(std::memory_order_relaxed) + nanoseconds, std::memory_order_relaxed);
+    if (nanoseconds > histogram.max.load(std::memory_order_relaxed)) {
+        histogram.max.store(nanoseconds, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Sums counters and histograms of all threads.
+ *
+ * @return Current values of all metrics.
+ */
+Metrics::Snapshot Metrics::snapshot() {
+    Snapshot result;
+    std::vector<std::array<uint64_t, HISTOGRAM_BUCKETS>> merged(STAGE_COUNT);
+    for (auto& buckets : merged) {
+        buckets.fill(0);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(blocks_mutex);
+        for (const auto& block : all_blocks()) {
+            for (size_t i = 0; i < COUNTER_COUNT; i++) {
+                result.counters[i] += block->counters[i].load(std::memory_order_relaxed);
+            }
+            for (size_t stage = 0; stage < STAGE_COUNT; stage++) {
+                const Histogram& histogram = block->histograms[stage];
+                LatencySummary& summary = result.latencies[stage];
+                for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+                    uint64_t count = histogram.buckets[b].load(std::memory_order_relaxed);
+                    merged[stage][b] += count;
+                    summary.count += count;
+                }
+                summary.sum += histogram.sum.load(std::memory_order_relaxed);
+                summary.max = std::max(summary.max, histogram.max.load(std::memory_order_relaxed));
+            }
+        }
+    }
+
+    for (size_t stage = 0; stage < STAGE_COUNT; stage++) {
+        LatencySummary& summary = result.latencies[stage];
+        uint64_t* targets[] = {&summary.p50, &summary.p90, &summary.p99, &summary.p999};
+        uint64_t cumulative = 0;
+        size_t next = 0;
+        for (size_t b = 0; b < HISTOGRAM_BUCKETS && next < 4; b++) {
+            cumulative += merged[stage][b];
+            while (next < 4 && summary.count > 0 && cumulative >= PERCENTILES[next] * summary.count) {
+                *targets[next++] = std::min(bucket_value(b), summary.max);
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Name of the counter used in the JSON and Prometheus output.
+ */
+const char* Metrics::counter_name(Counter counter) {
+    switch (counter) {
+        case Counter::PACKETS_READ:             return "packets_read";
+        case Counter::PACKETS_DECODED:          return "packets_decoded";
+        case Counter::REJECTED_NOT_TCP:         return "packets_rejected_not_tcp";
+        case Counter::REJECTED_TRUNCATED:       return "packets_rejected_truncated";
+        case Counter::REJECTED_BAD_IP_HEADER:   return "packets_rejected_bad_ip_header";
+        case Counter::PACKETS_DUPLICATE:        return "packets_duplicate";
+        case Counter::DEDUP_EVICTIONS:          return "dedup_evictions";
+        case Counter::FLOWS_CREATED:            return "flows_created";
+        case Counter::FLOWS_PROMOTED:           return "flows_promoted";
+        case Counter::FLOWS_SPILLED:            return "flows_spilled";
+        case Counter::FLOWS_PAGED_IN:           return "flows_paged_in";
+        case Counter::FLOWS_EXPIRED_ACTIVE:     return "flows_expired_active";
+        case Counter::FLOWS_EXPIRED_INACTIVE:   return "flows_expired_inactive";
+        case Counter::FLOWS_EXPIRED_FORCED:     return "flows_expired_forced";
+        case Counter::FLOWS_ENDED_FIN:          return "flows_ended_fin";
+        case Counter::FLOWS_ENDED_RST:          return "flows_ended_rst";
+        case Counter::FLOWS_EXPORTED:           return "flows_exported";
+        case Counter::DATAGRAMS_SENT:           return "datagrams_sent";
+        case Counter::SEND_ERRORS:              return "send_errors";
+        case Counter::EXPORT_THROTTLES:         return "export_throttles";
+        case Counter::EXPORT_THROTTLED_US:      return "export_throttled_us";
+        case Counter::SHM_RING_FULL:            return "shm_ring_full_waits";
+        case Counter::DATAGRAMS_SPOOLED:        return "datagrams_spooled";
+        case Counter::DATAGRAMS_REPLAYED:       return "datagrams_replayed";
+        case Counter::SPOOL_OVERFLOWS:          return "spool_overflows";
+        default:                                return "unknown";
+    }
+}
+
+/**
+ * @brief Name of the stage used in the JSON and Prometheus output.
+ */
+const char* Metrics::stage_name(Stage stage) {
+    switch (stage) {
+        case Stage::READ:       return "read";
+        case Stage::DECODE:     return "decode";
+        case Stage::AGGREGATE:  return "aggregate";
+        case Stage::EXPIRE:     return "expire";
+        case Stage::EXPORT:     return "export";
+        default:                return "unknown";
+    }
+}
+
+/**
+ * @brief Formats the snapshot as one line of JSON.
+ *
+ * @param snapshot Values to format
+ *
+ * @return JSON object without trailing newline
+ */
+std::string Metrics::to_json(const Snapshot& snapshot) {
+    std::ostringstream oss;
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    oss << "{\"timestamp_ms\":" << std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        oss << ",\"" << counter_name(static_cast<Counter>(i)) << "\":" << snapshot.counters[i];
+    }
+
+    oss << ",\"latency_ns\":{";
+    for (size_t stage = 0; stage < STAGE_COUNT; stage++) {
+        const LatencySummary& summary = snapshot.latencies[stage];
+        oss << (stage == 0 ? "" : ",") << "\"" << stage_name(static_cast<Stage>(stage)) << "\":{"
+            << "\"count\":" << summary.count
+            << ",\"mean\":" << (summary.count ? summary.sum / summary.count : 0)
+            << ",\"p50\":" << summary.p50
+            << ",\"p90\":" << summary.p90
+            << ",\"p99\":" << summary.p99
+            << ",\"p999\":" << summary.p999
+            << ",\"max\":" << summary.max << "}";
+    }
+    oss << "}}";
+    return oss.str();
+}
+
+/**
+ * @brief Formats the snapshot in the Prometheus text exposition format.
+ * Latencies are exported as summaries in seconds.
+ *
+ * @param snapshot Values to format
+ *
+ * @return Text of the exposition
+ */
+std::string Metrics::to_prometheus(const Snapshot& snapshot) {
+    std::ostringstream oss;
+    for (size_t i = 0; i < COUNTER_COUNT; i++) {
+        const char* name = counter_name(static_cast<Counter>(i));
+        oss << "# TYPE p2nprobe_" << name << "_total counter\n"
+            << "p2nprobe_" << name << "_total " << snapshot.counters[i] << "\n";
+    }
+
+    oss << "# TYPE p2nprobe_stage_latency_seconds summary\n";
+    for (size_t stage = 0; stage < STAGE_COUNT; stage++) {
+        const LatencySummary& summary = snapshot.latencies[stage];
+        const char* name = stage_name(static_cast<Stage>(stage));
+        const std::pair<const char*, uint64_t> quantiles[] = {
+            {"0.5", summary.p50}, {"0.9", summary.p90}, {"0.99", summary.p99}, {"0.999", summary.p999}
+        };
+        for (const auto& quantile : quantiles) {
+            oss << "p2nprobe_stage_latency_seconds{stage=\"" << name << "\",quantile=\"" << quantile.first << "\"} "
+                << quantile.second / 1e9 << "\n";
+        }
+        oss << "p2nprobe_stage_latency_seconds_sum{stage=\"" << name << "\"} " << summary.sum / 1e9 << "\n"
+            << "p2nprobe_stage_latency_seconds_count{stage=\"" << name << "\"} " << summary.count << "\n";
+    }
+    return oss.str();
+}
@@ -0,0 +1,234 @@
+////////////////////////////////////////////////////
+// File: MetricsReporter.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "MetricsReporter.h"
+#include "Metrics.h"
+#include "Config.h"
+#include "Logger.h"
+
+std::mutex MetricsReporter::reports_mutex;
+std::vector<std::string> MetricsReporter::reports;
+
+/**
+ * @brief Blocks SIGUSR1 in the calling thread. Threads started afterwards inherit the mask,
+ * so the signal is only delivered through the signalfd of the reporter.
+ */
+void MetricsReporter::block_signals() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+}
+
+/**
+ * @brief Constructor of the class. Opens the signalfd and the Prometheus listener and starts the thread.
+ *
+ * @param stats_interval Seconds between stats lines, 0 to print them only on SIGUSR1
+ * @param prometheus_port Port of the Prometheus endpoint, 0 to disable it
+ */
+MetricsReporter::MetricsReporter(int stats_interval, int prometheus_port)
+    : stats_interval_ms(stats_interval * 1000) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        LOG_WARNING("Cannot receive SIGUSR1: ", strerror(errno));
+    }
+
+    if (prometheus_port > 0) {
+        open_listener(prometheus_port);
+    }
+
+    worker = std::thread(&MetricsReporter::run, this);
+}
+
+/**
+ * @brief Destructor. Stops the thread if stop was not called.
+ */
+MetricsReporter::~MetricsReporter() {
+    stop();
+}
+
+/**
+ * @brief Queues a report line, printed by the reporter with the next stats line or when it stops.
+ *
+ * @param line JSON line without the trailing newline
+ */
+void MetricsReporter::publish(std::string line) {
+    std::lock_guard<std::mutex> lock(reports_mutex);
+    reports.push_back(std::move(line));
+}
+
+/**
+ * @brief Stops the thread and closes the endpoints. Prints the reports left and the final stats line
+ * when periodic stats are enabled, call it before the final summary so they do not follow it.
+ */
+void MetricsReporter::stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+    print_reports();
+    if (stats_interval_ms > 0) {
+        print_stats();
+    }
+    if (signal_fd >= 0) {
+        close(signal_fd);
+        signal_fd = -1;
+    }
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        listen_fd = -1;
+    }
+}
+
+/**
+ * @brief Opens the listening socket of the Prometheus endpoint. Bound to the loopback only,
+ * failure only disables the endpoint.
+ *
+ * @param port Port to listen on
+ */
+void MetricsReporter::open_listener(int port) {
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        LOG_WARNING("Cannot create Prometheus socket: ", strerror(errno));
+        return;
+    }
+
+    int reuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listen_fd, 16) < 0) {
+        LOG_WARNING("Cannot listen on 127.0.0.1:", port, " for Prometheus: ", strerror(errno));
+        close(listen_fd);
+        listen_fd = -1;
+    }
+}
+
+/**
+ * @brief Loop of the reporter thread. Waits for SIGUSR1, a Prometheus client or the next stats interval.
+ */
+void MetricsReporter::run() {
+    auto next_stats = std::chrono::steady_clock::now() + std::chrono::milliseconds(stats_interval_ms);
+
+    while (running) {
+        struct pollfd fds[2];
+        nfds_t count = 0;
+        if (signal_fd >= 0) {
+            fds[count++] = {signal_fd, POLLIN, 0};
+        }
+        if (listen_fd >= 0) {
+            fds[count++] = {listen_fd, POLLIN, 0};
+        }
+
+        if (poll(fds, count, Config::METRICS_POLL_MS) > 0) {
+            for (nfds_t i = 0; i < count; i++) {
+                if (!(fds[i].revents & POLLIN)) {
+                    continue;
+                }
+                if (fds[i].fd == signal_fd) {
+                    struct signalfd_siginfo info;
+                    while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {}
+                    print_reports();
+                    print_stats();
+                }
+                else {
+                    serve_client();
+                }
+            }
+        }
+
+        if (stats_interval_ms > 0 && std::chrono::steady_clock::now() >= next_stats) {
+            print_reports();
+            print_stats();
+            next_stats += std::chrono::milliseconds(stats_interval_ms);
+        }
+    }
+}
+
+/**
+ * @brief Accepts one Prometheus client and answers with the current metrics.
+ * The request itself is not parsed, every path returns the metrics.
+ */
+void MetricsReporter::serve_client() {
+    int client = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client < 0) {
+        return;
+    }
+
+    // Read the request so the client does not see a reset, it is short enough for one read
+    struct pollfd pfd = {client, POLLIN, 0};
+    if (poll(&pfd, 1, Config::METRICS_POLL_MS) > 0) {
+        char request[1024];
+        (void)!read(client, request, sizeof(request));
+    }
+
+    std::string body = Metrics::to_prometheus(Metrics::snapshot());
+    std::string response = "HTTP/1.0 200 OK\r\n"
+                           "Content-Type: text/plain; version=0.0.4\r\n"
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                           "Connection: close\r\n\r\n" + body;
+
+    size_t written = 0;
+    while (written < response.size()) {
+        ssize_t n = send(client, response.data() + written, response.size() - written, MSG_NOSIGNAL);
+        if (n <= 0) {
+            break;
+        }
+        written += static_cast<size_t>(n);
+    }
+    close(client);
+}
+
+/**
+ * @brief Prints the JSON stats line to the standard output.
+ */
+void MetricsReporter::print_stats() {
+    std::string line = Metrics::to_json(Metrics::snapshot()) + "\n";
+    std::cout << line << std::flush;
+}
+
+/**
+ * @brief Prints the published report lines in the order they were published.
+ */
+void MetricsReporter::print_reports() {
+    std::vector<std::string> pending;
+    {
+        std::lock_guard<std::mutex> lock(reports_mutex);
+        pending.swap(reports);
+    }
+    if (pending.empty()) {
+        return;
+    }
+
+    std::string lines;
+    for (const std::string& line : pending) {
+        lines += line + "\n";
+    }
+    std::cout << lines << std::flush;
+}
@@ -0,0 +1,158 @@
+////////////////////////////////////////////////////
+// File: NetFlowV5Exporter.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <arpa/inet.h>
+
+#include "NetFlowV5Exporter.h"
+#include "Config.h"
+
+
+/**
+ * @brief Constructor of the class.
+ *
+ * @param sink Destination of the encoded datagrams
+ */
+NetFlowV5Exporter::NetFlowV5Exporter(std::unique_ptr<DatagramSink> sink)
+    : flow_sequence(0),
+    sink(std::move(sink)) {}
+
+/**
+ * @brief NetFlow v5 datagram can carry at most 30 records by specification.
+ * https://www.cisco.com/c/en/us/td/docs/net_mgmt/netflow_collection_engine/3-6/user/guide/format.html#wp1006108
+ *
+ * @return Maximum number of flows in one export.
+ */
+size_t NetFlowV5Exporter::max_flows_per_export() const {
+    return Config::MAX_FLOWS_PER_PACKET;
+}
+
+/**
+ * @brief Pushes out datagrams buffered by the sink.
+ */
+void NetFlowV5Exporter::flush() {
+    sink->flush();
+}
+
+/**
+ * @brief Number of flows exported so far, sent as flow_sequence of the next header.
+ *
+ * @return Flow sequence
+ */
+uint32_t NetFlowV5Exporter::sequence() const {
+    return flow_sequence;
+}
+
+/**
+ * @brief Continues the flow sequence of a previous run.
+ *
+ * @param value Flow sequence
+ */
+void NetFlowV5Exporter::set_sequence(uint32_t value) {
+    flow_sequence = value;
+}
+
+/**
+ * @brief Exports all cached flows in the flows vector.
+ * Flows are split into datagrams of at most 30 records.
+ *
+ * @param flows Vector of flows to be exported
+ * @param time_start Start time of the flow
+ * @param time_end End time of the flow
+ *
+ * @return void
+ */
+void NetFlowV5Exporter::export_flows(const std::vector<Flow>& flows, uint32_t time_start, uint32_t time_end) {
+    uint8_t buffer[Config::NETFLOW_HEADER_SIZE + Config::NETFLOW_RECORD_SIZE * Config::MAX_FLOWS_PER_PACKET];
+
+    sink->set_capture_time(time_end);
+
+    for (size_t first = 0; first < flows.size(); first += Config::MAX_FLOWS_PER_PACKET) {
+        // Datagram has one header and can have 1-30 flows
+        uint16_t flow_count = std::min<size_t>(flows.size() - first, Config::MAX_FLOWS_PER_PACKET);
+        size_t datagram_size = sizeof(NetFlowV5header) + sizeof(NetFlowV5record) * flow_count;
+
+        format_header(buffer, flow_count, time_start, time_end);
+
+        // Update the number of exported flows
+        flow_sequence += flow_count;
+
+        size_t offset = sizeof(NetFlowV5header);
+        for (size_t i = first; i < first + flow_count; i++) {
+            format_record(flows[i].record, buffer, offset, time_start);
+        }
+
+        sink->send(buffer, datagram_size);
+    }
+}
+
+/**
+ * @brief Sets header in the buffer for Netflow v5 protocol.
+ *
+ * @param buffer Buffer for setting the data
+ * @param flow_count Number of flows exported
+ * @param time_start Start time of the flow needed for calculating uptime of the device
+ * @param time_end End time of the flow needed for calculating uptime of the device
+*/
+void NetFlowV5Exporter::format_header(uint8_t* buffer, uint16_t flow_count, uint32_t time_start, uint32_t time_end) {
+    NetFlowV5header header;
+    header.version = htons(VERSION_5);
+    header.count = htons(flow_count); 
+    header.SysUptime = htonl(time_end - time_start);  // Calculate the uptime of the device
+    struct timespec ts;
+    if (clock_gettime(CLOCK_REALTIME, &ts) == 0) { // Get current time 
+        header.unix_secs = htonl(ts.tv_sec);
+        header.unix_nsecs = htonl(ts.tv_nsec);
+    }
+    else { // Defaults to 0 in case of error
+        header.unix_secs = htonl(0); 
+        header.unix_nsecs = htonl(0);
+    }
+    header.flow_sequence = htonl(flow_sequence);
+    header.engine_type = 0;
+    header.engine_id = 0; 
+    header.sampling_interval = 0; 
+
+    // set the data to buffer
+    memcpy(buffer, &header, sizeof(NetFlowV5header));
+}
+
+/**
+ * @brief Sets record in the buffer for Netflow v5 protocol.
+ *
+ * @param record Record to set the buffer with
+ * @param buffer Buffer for setting the data
+ * @param offset for calculating where should be the data placed and not overwrting previous records
+ * @param time_start Start time of the flow needed for calculating uptime of the device
+*/
+void NetFlowV5Exporter::format_record(NetFlowV5record record, uint8_t* buffer, size_t& offset, uint32_t time_start) {
+
+    record.srcaddr = htonl(record.srcaddr);
+    record.dstaddr = htonl(record.dstaddr);
+    record.nexthop = htonl(record.nexthop);
+    record.input = 0;
+    record.output = 0;
+    record.dPkts = htonl(record.dPkts);
+    record.dOctets = htonl(record.dOctets);
+    record.First = htonl(record.First - time_start);
+    record.Last = htonl(record.Last - time_start);
+    record.srcport = htons(record.srcport);
+    record.dstport = htons(record.dstport);
+    record.tcp_flags = record.tcp_flags;
+    record.prot = record.prot;
+    record.tos = 0;
+    record.src_as = htons(record.src_as);
+    record.dst_as = htons(record.dst_as);
+
+    memcpy(buffer + offset, &record, sizeof(NetFlowV5record));
+    // update the offset in the buffer after adding the record
+    offset += sizeof(NetFlowV5record);
+}
+
+
@@ -5,67 +5,35 @@
 // Date: 14.10.2024
 ////////////////////////////////////////////////////
 
-#include <functional>
-#include <sstream>
-#include <arpa/inet.h>
-
 #include "NetFlowV5Key.h"
-/**
- * @brief Constructor for NetFlowV5Key. NetFlowV5Key is constructed from data in NetFlowV5record.
- * 
- */
-NetFlowV5Key::NetFlowV5Key(NetFlowV5record record) {
-    src_ip = record.srcaddr;
-    dst_ip = record.dstaddr;     
-    protocol = record.prot;    
-    src_port = record.srcport;      
-    dst_port = record.dstport;   
-}
 
 /**
- * @brief Concatenates key parts to one string so that it can be used as key in hash table.
- * 
- * @return std::string 
+ * @brief Canonical key shared by both directions of a connection, used for biflow aggregation.
+ * Endpoints are ordered by address and then by port, the lower one becomes the source.
+ *
+ * @return Key with the lower endpoint first
  */
-std::string NetFlowV5Key::concatToString() const {
-    char src_ip_str[INET_ADDRSTRLEN];
-    char dst_ip_str[INET_ADDRSTRLEN];
-
-    struct in_addr src_addr, dst_addr;
-    // Convert IP addresses to network byte order
-    src_addr.s_addr = htonl(src_ip);
-    dst_addr.s_addr = htonl(dst_ip);
-
-    // Convert IP addresses to string
-    inet_ntop(AF_INET, &src_addr, src_ip_str, INET_ADDRSTRLEN);
-    inet_ntop(AF_INET, &dst_addr, dst_ip_str, INET_ADDRSTRLEN);
-
-    std::ostringstream oss;
-    oss << src_ip_str << ":"
-        << dst_ip_str << ":"
-        << src_port << ":"
-        << dst_port << ":"
-        << static_cast<int>(protocol);
-    return oss.str();
+NetFlowV5Key NetFlowV5Key::canonical() const {
+    NetFlowV5Key key(*this);
+    if (dst_ip < src_ip || (dst_ip == src_ip && dst_port < src_port)) {
+        key.src_ip = dst_ip;
+        key.dst_ip = src_ip;
+        key.src_port = dst_port;
+        key.dst_port = src_port;
+    }
+    return key;
 }
 
 /**
- * @brief Comparison operator for comparing keys in case of colision.
- * 
- * @param other 
- * @return true if keys are equal,
- * @return false otherwise
+ * @brief Key of the packets sent in the opposite direction.
+ *
+ * @return Key with swapped endpoints
  */
-bool NetFlowV5Key::operator==(const FlowKey& other) const {
-    const NetFlowV5Key* otherKey = dynamic_cast<const NetFlowV5Key*>(&other);
-
-    if (otherKey == nullptr) {
-        return false;
-    }
-
-    return (src_ip == otherKey->src_ip &&
-            dst_ip == otherKey->dst_ip &&
-            src_port == otherKey->src_port &&
-            dst_port == otherKey->dst_port &&
-            protocol == otherKey->protocol);
-}
\ No newline at end of file
+NetFlowV5Key NetFlowV5Key::reversed() const {
+    NetFlowV5Key key(*this);
+    key.src_ip = dst_ip;
+    key.dst_ip = src_ip;
+    key.src_port = dst_port;
+    key.dst_port = src_port;
+    return key;
+}
@@ -0,0 +1,162 @@
+////////////////////////////////////////////////////
+// File: Pacer.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <thread>
+
+#include "Pacer.h"
+#include "Config.h"
+#include "Metrics.h"
+
+/**
+ * @brief Constructor of the class. The bucket starts full.
+ *
+ * @param unit Unit of the rate, RateUnit::NONE disables the token bucket
+ * @param rate Datagrams or bits per second
+ * @param replay_speed Multiple of the capture speed to export at, 0 disables capture time pacing
+ */
+Pacer::Pacer(RateUnit unit, double rate, double replay_speed)
+    : unit(rate > 0 ? unit : RateUnit::NONE),
+    rate(rate),
+    burst(0),
+    tokens(0),
+    last_refill(Clock::now()),
+    replay_speed(replay_speed),
+    capture_anchor_set(false),
+    capture_anchor_ms(0),
+    throttles(0),
+    throttled(0)
+{
+    // Allow short bursts, but at least one datagram, until the sink sets its datagram size
+    burst = rate * Config::PACER_BURST_MS / 1000.0;
+    if (this->unit == RateUnit::BITS) {
+        burst = std::max(burst, static_cast<double>(Config::MIN_EXPORT_MTU - Config::IP_UDP_HEADER_SIZE) * 8);
+    }
+    else {
+        burst = std::max(burst, 1.0);
+    }
+    tokens = burst;
+}
+
+/**
+ * @brief Sizes the bucket of a bits rate to hold at least one datagram of the path MTU, so a datagram
+ * passes without waiting after an idle period but a low rate does not send seconds of traffic at once.
+ * Larger datagrams still pass, they wait for the tokens they are missing.
+ *
+ * @param max_datagram_size Largest datagram the sink sends, in bytes
+ */
+void Pacer::set_max_datagram_size(size_t max_datagram_size) {
+    if (unit != RateUnit::BITS) {
+        return;
+    }
+    burst = std::max(rate * Config::PACER_BURST_MS / 1000.0, static_cast<double>(max_datagram_size) * 8);
+    tokens = std::min(tokens, burst);
+}
+
+/**
+ * @brief Checks wheter any of the limits is active.
+ */
+bool Pacer::enabled() const {
+    return unit != RateUnit::NONE || replay_speed > 0;
+}
+
+/**
+ * @brief Rate limit converted to bytes per second, used for sizing the socket buffer.
+ *
+ * @return Bytes per second, 0 when the bits rate is not limited.
+ */
+double Pacer::bytes_per_second() const {
+    return unit == RateUnit::BITS ? rate / 8 : 0;
+}
+
+/**
+ * @brief Waits until the bucket holds enough tokens for the datagram and takes them.
+ *
+ * @param datagram_size Size of the datagram in bytes
+ */
+void Pacer::acquire(size_t datagram_size) {
+    if (unit == RateUnit::NONE) {
+        return;
+    }
+
+    double cost = unit == RateUnit::BITS ? datagram_size * 8.0 : 1.0;
+
+    Clock::time_point now = Clock::now();
+    std::chrono::duration<double> elapsed = now - last_refill;
+    tokens = std::min(burst, tokens + elapsed.count() * rate);
+    last_refill = now;
+
+    if (tokens < cost) {
+        // Sleep exactly for the missing tokens, they are refilled by then
+        std::chrono::duration<double> missing((cost - tokens) / rate);
+        throttle(now + std::chrono::duration_cast<Clock::duration>(missing));
+        last_refill = Clock::now();
+        tokens = cost;
+    }
+    tokens -= cost;
+}
+
+/**
+ * @brief Waits until the wall time catches up with the capture time scaled by the replay speed.
+ * The first call only sets the anchor both times are measured from.
+ *
+ * @param capture_ms Capture timestamp in miliseconds of the packet that triggered the export
+ */
+void Pacer::sync_capture_time(uint32_t capture_ms) {
+    if (replay_speed <= 0) {
+        return;
+    }
+
+    if (!capture_anchor_set) {
+        capture_anchor_set = true;
+        capture_anchor_ms = capture_ms;
+        wall_anchor = Clock::now();
+        return;
+    }
+
+    // Unsigned difference handles the 32-bit wrap of the miliseconds timestamp
+    uint32_t capture_elapsed_ms = capture_ms - capture_anchor_ms;
+    if (capture_elapsed_ms > UINT32_MAX / 2) {
+        return; // Capture time went backwards, nothing to wait for
+    }
+
+    std::chrono::duration<double, std::milli> wall_elapsed(capture_elapsed_ms / replay_speed);
+    Clock::time_point target = wall_anchor + std::chrono::duration_cast<Clock::duration>(wall_elapsed);
+    if (target > Clock::now()) {
+        throttle(target);
+    }
+}
+
+/**
+ * @brief Sleeps until the given time and counts the time spent.
+ *
+ * @param until Time point to sleep to
+ */
+void Pacer::throttle(Clock::time_point until) {
+    Clock::time_point start = Clock::now();
+    std::this_thread::sleep_until(until);
+    std::chrono::nanoseconds slept = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+    throttled += slept;
+    throttles++;
+    Metrics::add(Metrics::Counter::EXPORT_THROTTLES);
+    Metrics::add(Metrics::Counter::EXPORT_THROTTLED_US,
+                 static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(slept).count()));
+}
+
+/**
+ * @brief Number of times export had to wait.
+ */
+uint64_t Pacer::throttled_count() const {
+    return throttles;
+}
+
+/**
+ * @brief Total time export spent waiting.
+ */
+std::chrono::nanoseconds Pacer::throttled_time() const {
+    return throttled;
+}
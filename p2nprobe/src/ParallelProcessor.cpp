@@ -0,0 +1,431 @@
+////////////////////////////////////////////////////
+// File: ParallelProcessor.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <unordered_set>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ParallelProcessor.h"
+#include "Config.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "PcapReader.h"
+
+/**
+ * @brief Constructor of the processor.
+ *
+ * @param pcap_path Path of the classic pcap file
+ * @param threads Maximal number of ranges processed at once
+ * @param active_timeout_ms Active timeout in miliseconds
+ * @param inactive_timeout_ms Inactive timeout in miliseconds
+ */
+ParallelProcessor::ParallelProcessor(const std::string& pcap_path, int threads, uint32_t active_timeout_ms,
+                                     uint32_t inactive_timeout_ms)
+    : pcap_path(pcap_path),
+    threads(threads),
+    active_timeout_ms(active_timeout_ms),
+    inactive_timeout_ms(inactive_timeout_ms) {}
+
+/**
+ * @brief Checks the timeouts of the flow the same way FlowManager::cache_expired does.
+ *
+ * @param flow Checked flow
+ * @param current_time Time of the check
+ * @param active Set to true if the active timeout expired
+ *
+ * @return true if the flow expired
+ */
+bool ParallelProcessor::expired(const Flow& flow, uint32_t current_time, bool& active) const {
+    active = flow.active_expired(current_time, active_timeout_ms);
+    return active || flow.inactive_expired(current_time, inactive_timeout_ms);
+}
+
+/**
+ * @brief Reason of the expiry of a flow that was found expired later than the check that expired it
+ * in the sequential run. That check is the first packet of the range reaching one of the timeouts,
+ * the active timeout wins when both expired by then as in FlowTable::expire.
+ *
+ * @param flow Expired flow
+ * @param chunk Range whose packets checked the flow
+ * @param check_ms Time of the check that found the flow expired
+ *
+ * @return true for the active timeout
+ */
+bool ParallelProcessor::active_at_expiry(const Flow& flow, const Chunk& chunk, uint64_t check_ms) const {
+    // Timeouts are checked on differences of 32 bit times, which wrap before the last packet
+    auto checked = std::lower_bound(chunk.check_times.begin(), chunk.check_times.end(), flow.last_ms);
+    auto first_expired = std::partition_point(checked, chunk.check_times.end(), [this, &flow](uint64_t time) {
+        bool active;
+        return !expired(flow, static_cast<uint32_t>(time), active);
+    });
+    uint64_t expiry_ms = first_expired != chunk.check_times.end() ? std::min(*first_expired, check_ms) : check_ms;
+    return flow.active_expired(static_cast<uint32_t>(expiry_ms), active_timeout_ms);
+}
+
+/**
+ * @brief Checks whether a chain of plausible records starts at the offset.
+ *
+ * @return true if Config::RESYNC_RECORDS plausible records follow or the chain ends exactly at the end of the file
+ */
+bool ParallelProcessor::is_boundary(int fd, uint64_t offset, uint64_t file_size) const {
+    int64_t previous_us = reference_us;
+    for (int i = 0; i < Config::RESYNC_RECORDS; i++) {
+        if (offset == file_size) {
+            return true;
+        }
+
+        uint8_t data[PcapFormat::RECORD_HEADER_SIZE];
+        if (pread(fd, data, sizeof(data), static_cast<off_t>(offset)) != static_cast<ssize_t>(sizeof(data))) {
+            return false;
+        }
+        PcapFormat::Record record = PcapFormat::parse_record_header(data, info);
+        if (!PcapFormat::plausible(record, info) || record.timestamp_us + Config::RESYNC_MAX_SKEW_US < previous_us) {
+            return false;
+        }
+
+        previous_us = record.timestamp_us;
+        offset += PcapFormat::RECORD_HEADER_SIZE + record.caplen;
+        if (offset > file_size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Finds the first record boundary at or after the offset.
+ *
+ * @return Offset of the record, or the size of the file when there is none
+ */
+uint64_t ParallelProcessor::find_boundary(int fd, uint64_t offset, uint64_t file_size) const {
+    std::vector<uint8_t> window(Config::RESYNC_WINDOW_SIZE);
+    while (offset < file_size) {
+        ssize_t size = pread(fd, window.data(), window.size(), static_cast<off_t>(offset));
+        if (size < static_cast<ssize_t>(PcapFormat::RECORD_HEADER_SIZE)) {
+            break;
+        }
+
+        size_t last = static_cast<size_t>(size) - PcapFormat::RECORD_HEADER_SIZE;
+        for (size_t i = 0; i <= last; i++) {
+            PcapFormat::Record record = PcapFormat::parse_record_header(window.data() + i, info);
+            if (PcapFormat::plausible(record, info) && is_boundary(fd, offset + i, file_size)) {
+                return offset + i;
+            }
+        }
+        offset += last + 1;
+    }
+    return file_size;
+}
+
+/**
+ * @brief Reads the file header and splits the file into ranges starting at record boundaries.
+ *
+ * @return false if the file is not a classic pcap file
+ */
+bool ParallelProcessor::split() {
+    int fd = open(pcap_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    uint8_t header[PcapFormat::FILE_HEADER_SIZE + PcapFormat::RECORD_HEADER_SIZE];
+    ssize_t size = pread(fd, header, sizeof(header), 0);
+    if (fstat(fd, &st) != 0 || size < static_cast<ssize_t>(PcapFormat::FILE_HEADER_SIZE) ||
+        !PcapFormat::parse_file_header(header, info)) {
+        close(fd);
+        return false;
+    }
+    if (size == static_cast<ssize_t>(sizeof(header))) {
+        reference_us = PcapFormat::parse_record_header(header + PcapFormat::FILE_HEADER_SIZE, info).timestamp_us;
+    }
+
+    uint64_t file_size = static_cast<uint64_t>(st.st_size);
+    uint64_t data_size = file_size - PcapFormat::FILE_HEADER_SIZE;
+    uint64_t count = std::min<uint64_t>(threads, std::max<uint64_t>(1, data_size / Config::MIN_CHUNK_SIZE));
+
+    boundaries.clear();
+    boundaries.push_back(PcapFormat::FILE_HEADER_SIZE);
+    for (uint64_t i = 1; i < count; i++) {
+        uint64_t offset = std::max(PcapFormat::FILE_HEADER_SIZE + data_size * i / count, boundaries.back());
+        boundaries.push_back(find_boundary(fd, offset, file_size));
+    }
+    boundaries.push_back(file_size);
+    close(fd);
+
+    for (size_t i = 0; i < chunk_count(); i++) {
+        LOG_DEBUG("Range ", i, ": offsets ", boundaries[i], " - ", boundaries[i + 1]);
+    }
+    return true;
+}
+
+/**
+ * @brief Aggregates the packets of one range into its own flow table, runs on a worker thread.
+ * Expiry follows Probe::add_from, flows are checked after every read packet.
+ *
+ * @param chunk Range to process, receives the expired and open flows
+ */
+void ParallelProcessor::aggregate(Chunk& chunk) const {
+    FILE* file = fopen(pcap_path.c_str(), "rb");
+    if (file == nullptr) {
+        chunk.failed = true;
+        return;
+    }
+    std::vector<char> buffer(Config::CHUNK_READ_BUFFER_SIZE);
+    setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+    if (fseeko(file, static_cast<off_t>(chunk.begin), SEEK_SET) != 0) {
+        fclose(file);
+        chunk.failed = true;
+        return;
+    }
+
+    using ChunkList = std::list<ChunkFlow>;
+    ChunkList flows;
+    std::unordered_map<NetFlowV5Key, ChunkList::iterator, NetFlowV5Key::Hash> flow_map;
+
+    PcapReader decoder(pcap_path); // Only decodes packets, libpcap does not open the file
+    std::vector<u_char> packet(PcapFormat::MAX_PACKET_LENGTH);
+    uint64_t offset = chunk.begin;
+    uint64_t previous_ms = CHECK_PREVIOUS_RANGE;
+    uint64_t packet_index = 0;
+    bool key_window = true; // New keys can still continue a flow carried from the previous range
+
+    while (offset < chunk.end) {
+        uint8_t data[PcapFormat::RECORD_HEADER_SIZE];
+        PcapFormat::Record record;
+        {
+            StageTimer timer(Metrics::Stage::READ, (packet_index & Config::METRICS_SAMPLE_MASK) == 0);
+            if (fread(data, 1, sizeof(data), file) != sizeof(data)) {
+                chunk.failed = true;
+                break;
+            }
+            record = PcapFormat::parse_record_header(data, info);
+            if (record.caplen > PcapFormat::MAX_PACKET_LENGTH ||
+                fread(packet.data(), 1, record.caplen, file) != record.caplen) {
+                chunk.failed = true;
+                break;
+            }
+        }
+        offset += PcapFormat::RECORD_HEADER_SIZE + record.caplen;
+        bool sampled = (packet_index++ & Config::METRICS_SAMPLE_MASK) == 0;
+        Metrics::add(Metrics::Counter::PACKETS_READ);
+
+        uint64_t timestamp_ms = static_cast<uint64_t>(record.timestamp_us) / 1000;
+        if (!chunk.has_packets) {
+            chunk.has_packets = true;
+            chunk.first_ms = timestamp_ms;
+        }
+        if (chunk.check_times.empty() || timestamp_ms > chunk.check_times.back()) {
+            chunk.check_times.push_back(timestamp_ms);
+        }
+        // A carried flow of a key that first appears after this has expired by its inactive timeout
+        if (previous_ms != CHECK_PREVIOUS_RANGE && previous_ms >= chunk.first_ms + inactive_timeout_ms) {
+            key_window = false;
+        }
+
+        struct pcap_pkthdr header;
+        header.ts.tv_sec = static_cast<time_t>(record.timestamp_us / 1000000);
+        header.ts.tv_usec = static_cast<suseconds_t>(record.timestamp_us % 1000000);
+        header.caplen = record.caplen;
+        header.len = record.len;
+
+        NetFlowV5record flow_record;
+        bool processed;
+        {
+            StageTimer timer(Metrics::Stage::DECODE, sampled);
+            processed = decoder.processPacket(&header, packet.data(), flow_record);
+        }
+        if (processed) {
+            Metrics::add(Metrics::Counter::PACKETS_DECODED);
+            StageTimer timer(Metrics::Stage::AGGREGATE, sampled);
+
+            NetFlowV5Key key(flow_record);
+            auto state = chunk.keys.find(key);
+            if (state == chunk.keys.end() && key_window) {
+                KeyState key_state;
+                key_state.record = flow_record;
+                state = chunk.keys.emplace(key, std::move(key_state)).first;
+            }
+            bool head = state != chunk.keys.end() && !state->second.head_done;
+            if (head) {
+                state->second.packets.push_back({timestamp_ms, previous_ms, flow_record.dOctets, flow_record.tcp_flags});
+            }
+
+            auto it = flow_map.find(key);
+            if (it != flow_map.end()) {
+                it->second->flow.update(flow_record.tcp_flags, flow_record.dOctets, timestamp_ms);
+            }
+            else {
+                flow_record.First = flow_record.Last;
+                flows.push_back({Flow(key, flow_record, timestamp_ms), head, false});
+                flow_map[key] = --flows.end();
+            }
+        }
+
+        {
+            StageTimer timer(Metrics::Stage::EXPIRE, sampled);
+            uint32_t current_time = static_cast<uint32_t>(timestamp_ms);
+            for (auto it = flows.begin(); it != flows.end(); ) {
+                bool active;
+                if (!expired(it->flow, current_time, active)) {
+                    ++it;
+                    continue;
+                }
+
+                // The inactive timeout ends the flow whatever its first packet was, later flows of the key are final
+                if (it->head && it->flow.inactive_expired(current_time, inactive_timeout_ms)) {
+                    KeyState& state = chunk.keys.at(it->flow.key);
+                    state.head_done = true;
+                    state.head_end_ms = timestamp_ms;
+                }
+                it->active = active;
+                chunk.expired.push_back(*it);
+                flow_map.erase(it->flow.key);
+                it = flows.erase(it);
+            }
+        }
+        previous_ms = timestamp_ms;
+    }
+
+    chunk.last_ms = previous_ms;
+    chunk.open.assign(flows.begin(), flows.end());
+    fclose(file);
+}
+
+/**
+ * @brief Applies the head packets of a key to the flow carried from the previous ranges.
+ *
+ * @param flow Carried flow, replaced by the key's last flow
+ * @param state Head packets of the key in the range
+ * @param chunk Range of the head packets
+ * @param sink Receives the finished flows
+ *
+ * @return true if the flow is still open at the end of the range
+ */
+bool ParallelProcessor::replay(Flow& flow, const KeyState& state, const Chunk& chunk, const FlowSink& sink) const {
+    bool open = true;
+    bool active;
+    for (const HeadPacket& packet : state.packets) {
+        // Flows resumed from a checkpoint were not checked before the first packet
+        bool checked = packet.check_ms != CHECK_PREVIOUS_RANGE || has_previous;
+        uint64_t check_ms = packet.check_ms == CHECK_PREVIOUS_RANGE ? previous_last_ms : packet.check_ms;
+        if (checked && expired(flow, static_cast<uint32_t>(check_ms), active)) {
+            sink(flow, active_at_expiry(flow, chunk, check_ms));
+            open = false;
+        }
+
+        if (open) {
+            flow.update(packet.tcp_flags, packet.octets, packet.timestamp_ms);
+            continue;
+        }
+        NetFlowV5record record = state.record;
+        record.dPkts = 1;
+        record.dOctets = packet.octets;
+        record.tcp_flags = packet.tcp_flags;
+        record.First = record.Last = static_cast<uint32_t>(packet.timestamp_ms);
+        flow = Flow(NetFlowV5Key(record), record, packet.timestamp_ms);
+        open = true;
+    }
+
+    // The range's flow with the same last packet expired by the inactive timeout, so does this one
+    if (state.head_done) {
+        sink(flow, flow.active_expired(static_cast<uint32_t>(state.head_end_ms), active_timeout_ms));
+        return false;
+    }
+    if (expired(flow, static_cast<uint32_t>(chunk.last_ms), active)) {
+        sink(flow, active_at_expiry(flow, chunk, chunk.last_ms));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Merges the results of the next range with the flows carried from the previous ones.
+ *
+ * @param chunk Processed range
+ * @param carried Flows open at the end of the previous range, open flows at the end of this range on return
+ * @param sink Receives the finished flows
+ */
+void ParallelProcessor::merge(Chunk& chunk, std::list<Flow>& carried, const FlowSink& sink) {
+    if (!chunk.has_packets) {
+        return;
+    }
+
+    uint32_t last_time = static_cast<uint32_t>(chunk.last_ms);
+    std::unordered_set<NetFlowV5Key, NetFlowV5Key::Hash> replayed;
+    for (auto it = carried.begin(); it != carried.end(); ) {
+        auto state = chunk.keys.find(it->key);
+        bool active;
+        if (state != chunk.keys.end()) {
+            replayed.insert(it->key);
+            it = replay(*it, state->second, chunk, sink) ? std::next(it) : carried.erase(it);
+        }
+        else if (expired(*it, last_time, active)) {
+            sink(*it, active_at_expiry(*it, chunk, chunk.last_ms));
+            it = carried.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    // Flows of the head packets of replayed keys were computed without the carried flow
+    auto replaced = [&replayed](const ChunkFlow& chunk_flow) {
+        return chunk_flow.head && !replayed.empty() && replayed.count(chunk_flow.flow.key) > 0;
+    };
+    for (const ChunkFlow& chunk_flow : chunk.expired) {
+        if (!replaced(chunk_flow)) {
+            sink(chunk_flow.flow, chunk_flow.active);
+        }
+    }
+    for (const ChunkFlow& chunk_flow : chunk.open) {
+        if (!replaced(chunk_flow)) {
+            carried.push_back(chunk_flow.flow);
+        }
+    }
+
+    previous_last_ms = chunk.last_ms;
+    has_previous = true;
+}
+
+/**
+ * @brief Processes all ranges on their own threads and merges them in file order.
+ * A range is merged as soon as it and all ranges before it are done.
+ *
+ * @param carried Flows open before the first packet (resumed from a checkpoint), open flows at the end on return
+ * @param sink Receives the finished flows
+ *
+ * @return -1 if a range could not be read, -2 when the whole file was processed
+ */
+int ParallelProcessor::run(std::list<Flow>& carried, const FlowSink& sink) {
+    std::vector<Chunk> chunks(chunk_count());
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        chunks[i].begin = boundaries[i];
+        chunks[i].end = boundaries[i + 1];
+        workers.emplace_back(&ParallelProcessor::aggregate, this, std::ref(chunks[i]));
+    }
+
+    int result = -2;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        workers[i].join();
+        if (result == -2) {
+            // Like the sequential run, packets read before the error are still aggregated
+            merge(chunks[i], carried, sink);
+            if (chunks[i].failed) {
+                LOG_ERROR("Failed to read range ", i, " of ", pcap_path, " at offsets ", chunks[i].begin, " - ", chunks[i].end);
+                result = -1;
+            }
+        }
+        chunks[i] = Chunk(); // Results are merged, free them
+    }
+    return result;
+}
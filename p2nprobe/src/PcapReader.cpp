@@ -12,18 +12,25 @@
 #include <sys/time.h> 
 #include <cstring>
 
+#include "Logger.h"  // before pcap.h, its PCAP_ERRBUF_SIZE macro collides with the Config constant
 #include "PcapReader.h"
+#include "UringReader.h"
 #include "ErrorCodes.h"
 #include "NetFlowV5Key.h"
 #include "NetFlowV5record.h"
+#include "Metrics.h"
 
 const unsigned int ETHERNET_HEADER_SIZE = 14;
 
 /**
  * @brief Constructor for the PcapReader class. Initializes the err buffer and pcap file name.
+ *
+ * @param pcapFile Path of the capture
+ * @param inputReader Backend reading uncompressed captures
+ * @param directRead Read with O_DIRECT when the io_uring backend is used
  */
-PcapReader::PcapReader(std::string pcapFile)
-    : _pcapFile(pcapFile) {
+PcapReader::PcapReader(std::string pcapFile, Config::InputReader inputReader, bool directRead)
+    : _pcapFile(pcapFile), _inputReader(inputReader), _directRead(directRead) {
     _errbuf[0] = '\0';
 }
 
@@ -36,10 +43,30 @@ PcapReader::~PcapReader() {
 
 /**
  * @brief Initializes handle for processing packets by opening the pcap file.
+ * Compressed files are recognised by their magic bytes and decompressed on the fly. With the io_uring
+ * backend the records are parsed here, files it cannot read (pcapng, io_uring unavailable) are read by libpcap.
  *
  * @return false if error occured while opening the file, true otherwise.
  */
 bool PcapReader::open() {
+    std::string reason;
+    Decompressor::Codec codec = Decompressor::detect(_pcapFile);
+    if (codec != Decompressor::Codec::NONE) {
+        if (!openStream(std::make_unique<Decompressor>(_pcapFile, codec), reason)) {
+            std::cerr << "Error: Cannot open file: " << _pcapFile << " (" << Decompressor::codec_name(codec)
+                      << " compressed): " << reason << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    if (_inputReader == Config::InputReader::URING) {
+        if (openStream(std::make_unique<UringReader>(_pcapFile, _directRead), reason)) {
+            return true;
+        }
+        LOG_WARNING("Cannot read ", _pcapFile, " with io_uring (", reason, "), using libpcap");
+    }
+
     handle = pcap_open_offline(_pcapFile.c_str(), _errbuf);
     if (handle == NULL) {
         std::cerr << "Error: Cannot open file: " << _errbuf << std::endl;
@@ -48,6 +75,31 @@ bool PcapReader::open() {
     return true;
 }
 
+/**
+ * @brief Starts the block source and reads the pcap file header from it.
+ * libpcap cannot read from the source, so the classic pcap records are parsed here.
+ *
+ * @param source Decompressor or io_uring reader of the file
+ * @param reason Filled with the reason when the source cannot be used
+ *
+ * @return false if the source cannot be started or does not hold a classic pcap file.
+ */
+bool PcapReader::openStream(std::unique_ptr<BlockSource> source, std::string& reason) {
+    if (!source->start()) {
+        reason = source->error();
+        return false;
+    }
+
+    const uint8_t* data;
+    if (source->read(PcapFormat::FILE_HEADER_SIZE, data) != PcapFormat::FILE_HEADER_SIZE ||
+        !PcapFormat::parse_file_header(data, _streamInfo)) {
+        reason = source->failed() ? source->error() : "not a classic pcap file";
+        return false;
+    }
+    _stream = std::move(source);
+    return true;
+}
+
 /**
  * @brief Closes the handle and sets the handle to nullptr.
  *
@@ -58,8 +110,127 @@ void PcapReader::close() {
         pcap_close(handle);
         handle = nullptr;
     }
+    _stream.reset();
+}
+
+
+/**
+ * @brief Restricts reading to packets with timestamps in [from_us, to_us).
+ * Seeks to the first block of the range found by the time index, or by scanning the record headers
+ * when there is no index. Files that cannot be scanned (pcapng) are read whole and filtered.
+ *
+ * @param from_us Start of the range in microseconds
+ * @param to_us End of the range in microseconds
+ */
+void PcapReader::select_range(int64_t from_us, int64_t to_us) {
+    _rangeActive = true;
+    _fromUs = from_us;
+    _toUs = to_us;
+
+    FILE* file = handle != nullptr ? pcap_file(handle) : nullptr;
+    if (file == nullptr || !TimeIndex::find_range(_pcapFile, from_us, to_us, _range)) {
+        LOG_WARNING("Cannot seek in ", _pcapFile, ", filtering the whole file by time");
+        _range = TimeIndex::Range();
+        return;
+    }
+
+    if (_range.start == UINT64_MAX) {
+        _rangeEmpty = true;
+        return;
+    }
+    if (fseeko(file, static_cast<off_t>(_range.start), SEEK_SET) != 0) {
+        std::cerr << "Error: Cannot seek in file: " << _pcapFile << std::endl;
+        close();
+        ExitWith(ErrorCode::READING_PACKET_ERROR);
+    }
+}
+
+/**
+ * @brief Reads the next packet, skipping packets outside of the selected time range.
+ *
+ * @param header Header of the read packet
+ * @param packet Data of the read packet
+ *
+ * @return Same as pcap_next_ex, -2 also when the end of the time range is reached.
+ */
+int PcapReader::next(struct pcap_pkthdr** header, const u_char** packet) {
+    if (!_rangeActive) {
+        return readPacket(header, packet);
+    }
+    if (_rangeEmpty) {
+        return -2;
+    }
+
+    while (true) {
+        if (_range.end != UINT64_MAX && static_cast<uint64_t>(ftello(pcap_file(handle))) >= _range.end) {
+            return -2;
+        }
+
+        int result = readPacket(header, packet);
+        if (result <= 0) {
+            return result;
+        }
+
+        int64_t timestamp_us = (*header)->ts.tv_sec * 1000000LL + (*header)->ts.tv_usec;
+        if (timestamp_us >= _toUs) {
+            if (!_range.exact_end) { // Without the index the file is assumed to be ordered by time
+                return -2;
+            }
+            continue;
+        }
+        if (timestamp_us >= _fromUs) {
+            return result;
+        }
+    }
+}
+
+/**
+ * @brief Reads the next packet from libpcap or from the block source.
+ *
+ * @return Same as pcap_next_ex.
+ */
+int PcapReader::readPacket(struct pcap_pkthdr** header, const u_char** packet) {
+    if (_stream) {
+        return readStreamPacket(header, packet);
+    }
+    return pcap_next_ex(handle, header, packet);
 }
 
+/**
+ * @brief Parses the next record of the block source (decompressor or io_uring reader), the packet data is not copied
+ * unless it spans two blocks.
+ *
+ * @return 1 if the packet was read, -2 at the end of the stream, -1 on truncated or corrupted data.
+ */
+int PcapReader::readStreamPacket(struct pcap_pkthdr** header, const u_char** packet) {
+    const uint8_t* data;
+    size_t length = _stream->read(PcapFormat::RECORD_HEADER_SIZE, data);
+    if (length == 0 && !_stream->failed()) {
+        return -2;
+    }
+    if (length != PcapFormat::RECORD_HEADER_SIZE) {
+        LOG_ERROR("Truncated record header in ", _pcapFile, _stream->failed() ? ": " + _stream->error() : "");
+        return -1;
+    }
+
+    PcapFormat::Record record = PcapFormat::parse_record_header(data, _streamInfo);
+    if (record.caplen > PcapFormat::MAX_PACKET_LENGTH) {
+        LOG_ERROR("Invalid record length ", record.caplen, " in ", _pcapFile);
+        return -1;
+    }
+    if (_stream->read(record.caplen, data) != record.caplen) {
+        LOG_ERROR("Truncated packet in ", _pcapFile, _stream->failed() ? ": " + _stream->error() : "");
+        return -1;
+    }
+
+    _streamHeader.ts.tv_sec = static_cast<time_t>(record.timestamp_us / 1000000);
+    _streamHeader.ts.tv_usec = static_cast<suseconds_t>(record.timestamp_us % 1000000);
+    _streamHeader.caplen = record.caplen;
+    _streamHeader.len = record.len;
+    *header = &_streamHeader;
+    *packet = data;
+    return 1;
+}
 
 /**
  * @brief Checks wheter the packet processed is TCP packet.
@@ -82,7 +253,13 @@ bool PcapReader::isTcpPacket(const u_char* packet) {
  * @return true if packet was processed without issues, false otherwise.
  */
 bool PcapReader::processPacket(const struct pcap_pkthdr* header, const u_char* packet, NetFlowV5record& record) {
+    if (header->caplen < ETHERNET_HEADER_SIZE + sizeof(struct ip)) { // IP header was not captured
+        Metrics::add(Metrics::Counter::REJECTED_TRUNCATED);
+        return false;
+    }
+
     if (!isTcpPacket(packet)) { // Process only TCP packets
+        Metrics::add(Metrics::Counter::REJECTED_NOT_TCP);
         return false;
     }
 
@@ -97,7 +274,13 @@ bool PcapReader::processPacket(const struct pcap_pkthdr* header, const u_char* p
 
     unsigned int ipHeaderLength = ipHeader->ip_hl * 4; // Length of IP header
     if (ipHeaderLength < 20) { // IPv4 packet headers have to be at least 20 bytes long
-        std::cerr << "Error: Invalid IP header length: " << ipHeaderLength << " bytes." << std::endl;
+        Metrics::add(Metrics::Counter::REJECTED_BAD_IP_HEADER);
+        LOG_WARNING("Invalid IP header length: ", ipHeaderLength, " bytes");
+        return false;
+    }
+
+    if (header->caplen < ETHERNET_HEADER_SIZE + ipHeaderLength + sizeof(struct tcphdr)) { // TCP header was not captured
+        Metrics::add(Metrics::Counter::REJECTED_TRUNCATED);
         return false;
     }
 
@@ -128,6 +311,37 @@ bool PcapReader::processPacket(const struct pcap_pkthdr* header, const u_char* p
     return true;
 }
 
+/**
+ * @brief Fingerprint of a packet accepted by processPacket, for the duplicate suppression.
+ * Only fields a mirrored copy keeps are used: addresses, ports, IP id and total length, TCP
+ * sequence and acknowledgment numbers and the TCP checksum. TTL and the IP checksum are left
+ * out, a copy taken after a router differs in them.
+ *
+ * @param packet Captured bytes starting with the Ethernet header
+ *
+ * @return 64 bit hash of the fields
+ */
+uint64_t PcapReader::fingerprint(const u_char* packet) {
+    const struct ip* ipHeader = reinterpret_cast<const struct ip*>(packet + ETHERNET_HEADER_SIZE);
+    const struct tcphdr* tcpHeader = reinterpret_cast<const struct tcphdr*>(packet + ETHERNET_HEADER_SIZE + ipHeader->ip_hl * 4);
+
+    uint64_t hash = (static_cast<uint64_t>(ipHeader->ip_src.s_addr) << 32) | ipHeader->ip_dst.s_addr;
+    uint64_t fields[] = {
+        (static_cast<uint64_t>(tcpHeader->source) << 48) | (static_cast<uint64_t>(tcpHeader->dest) << 32) |
+            (static_cast<uint64_t>(ipHeader->ip_id) << 16) | ipHeader->ip_len,
+        (static_cast<uint64_t>(tcpHeader->seq) << 32) | tcpHeader->ack_seq,
+        tcpHeader->check
+    };
+    // Each field is mixed into the hash with the splitmix64 finalizer
+    for (uint64_t field : fields) {
+        hash = (hash ^ field) + 0x9e3779b97f4a7c15ULL;
+        hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+        hash ^= hash >> 31;
+    }
+    return hash;
+}
+
 
 
 
@@ -0,0 +1,334 @@
+////////////////////////////////////////////////////
+// File: Probe.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <sys/time.h>
+
+#include "Probe.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+/**
+ * @brief Constructor of the probe.
+ *
+ * @param options Timeouts, key and expiry policies of the aggregation
+ */
+Probe::Probe(const Options& options)
+    : options(options),
+    table(make_flow_table(options.biflow, options.tcp_end,
+                          {options.active_timeout_ms, options.inactive_timeout_ms, options.fin_linger_ms, options.routes.get(),
+                           options.admission, options.spill.get(), options.hot_flows})),
+    decoder("")
+{
+    if (options.dedup_window_ms > 0) {
+        dedup = std::make_unique<PacketDedup>(Config::DEDUP_BUCKETS, options.dedup_window_ms);
+    }
+}
+
+/**
+ * @brief Destructor, flows still open are dropped, call finish to get them.
+ */
+Probe::~Probe() = default;
+
+/**
+ * @brief Sets the function called with every expired flow. Biflows are passed with both directions.
+ *
+ * @param callback Function called with the flow, the flow is only valid during the call
+ */
+void Probe::set_callback(FlowCallback callback) {
+    this->callback = std::move(callback);
+}
+
+/**
+ * @brief Sets the exporter the expired flows are passed to in batches of its max_flows_per_export.
+ * Any implementation of the Exporter interface can be used, including the ones of the command line tool.
+ *
+ * @param exporter Exporter owned by the probe from now on
+ */
+void Probe::set_exporter(std::unique_ptr<Exporter> exporter) {
+    this->exporter = std::move(exporter);
+}
+
+/**
+ * @brief Decodes one packet and aggregates it, then expires the flows by its timestamp.
+ *
+ * @param header Capture header of the packet
+ * @param packet Captured bytes starting with the Ethernet header
+ *
+ * @return true if the packet was a TCP/IPv4 packet, not a dropped copy, and was aggregated
+ */
+bool Probe::add_packet(const struct pcap_pkthdr* header, const u_char* packet) {
+    return std::visit([this, header, packet](auto& flows) { return decode_into(flows, header, packet, sample()); }, table);
+}
+
+/**
+ * @brief Adds a batch of packets in their order. The policies are resolved once for the whole batch.
+ *
+ * @param packets Packets of the batch
+ * @param count Number of packets
+ *
+ * @return Number of aggregated packets
+ */
+size_t Probe::add_packets(const Packet* packets, size_t count) {
+    return std::visit([this, packets, count](auto& flows) {
+        size_t decoded = 0;
+        for (size_t i = 0; i < count; i++) {
+            decoded += decode_into(flows, packets[i].header, packets[i].data, sample());
+        }
+        return decoded;
+    }, table);
+}
+
+/**
+ * @brief Reads all packets of an opened reader and adds them, used by the command line tool.
+ * The policies are resolved once for the whole input.
+ *
+ * @param reader Reader of the input, already opened by the caller
+ *
+ * @return -1 if reading a packet failed, -2 when the reader reached the end of the input
+ */
+int Probe::add_from(PcapReader& reader) {
+    return std::visit([this, &reader](auto& flows) {
+        struct pcap_pkthdr* header;
+        const u_char* packet;
+        int result;
+        while (true) {
+            bool sampled = sample();
+            TRACE_PACKET();
+            {
+                StageTimer timer(Metrics::Stage::READ, sampled);
+                TRACE_SCOPE(READ);
+                result = reader.next(&header, &packet);
+            }
+            if (result <= 0) {
+                return result;
+            }
+            decode_into(flows, header, packet, sampled);
+        }
+    }, table);
+}
+
+/**
+ * @brief Passes a flow that expired outside of the flow table, like in the parallel run,
+ * on as an expired flow. The end time of the exports follows its last packet.
+ *
+ * @param flow Expired flow
+ */
+void Probe::add_expired(const Flow& flow) {
+    start_clock();
+    time_end = std::max(time_end, flow.record.Last);
+    deliver(flow);
+}
+
+/**
+ * @brief Puts a flow into the batch of the exporter, used by the callback for flows that did not
+ * come from the flow table (rollups). The reverse direction of a biflow is added as a separate flow
+ * when the records of the exporter cannot carry it.
+ *
+ * @param flow Flow to export
+ */
+void Probe::export_flow(const Flow& flow) {
+    export_batch.push_back(flow);
+    if (flow.has_reverse() && !exporter->exports_biflows()) {
+        export_batch.push_back(flow.reversed(options.routes.get()));
+    }
+}
+
+/**
+ * @brief Adds a packet decoded by the caller, then expires the flows by its timestamp.
+ *
+ * @param record Packet with dPkts 1, dOctets of its layer 3 length and Last of its timestamp
+ * @param timestamp_ms Capture timestamp of the packet in miliseconds
+ */
+void Probe::add_record(const NetFlowV5record& record, uint64_t timestamp_ms) {
+    std::visit([this, &record, timestamp_ms](auto& flows) {
+        aggregate_into(flows, record, timestamp_ms);
+        flows.expire(static_cast<uint32_t>(timestamp_ms), [this](const Flow& flow) { deliver(flow); });
+    }, table);
+}
+
+/**
+ * @brief Decodes the packet into a record and aggregates it, then expires the flows.
+ *
+ * @param flows Flow table of the selected policies
+ * @param header Capture header of the packet
+ * @param packet Captured bytes starting with the Ethernet header
+ *
+ * @return true if the packet was aggregated
+ */
+template <class Table>
+bool Probe::decode_into(Table& flows, const struct pcap_pkthdr* header, const u_char* packet, bool sampled) {
+    Metrics::add(Metrics::Counter::PACKETS_READ);
+    uint64_t timestamp_ms = header->ts.tv_sec * 1000ULL + header->ts.tv_usec / 1000;
+
+    NetFlowV5record record;
+    bool decoded;
+    {
+        StageTimer timer(Metrics::Stage::DECODE, sampled);
+        TRACE_SCOPE(DECODE);
+        decoded = decoder.processPacket(header, packet, record);
+        if (decoded && dedup && dedup->duplicate(PcapReader::fingerprint(packet), static_cast<uint32_t>(timestamp_ms))) {
+            decoded = false; // Copy of a mirrored packet, it still advances the time
+        }
+    }
+    if (decoded) {
+        Metrics::add(Metrics::Counter::PACKETS_DECODED);
+        StageTimer timer(Metrics::Stage::AGGREGATE, sampled);
+        if (options.sketches) {
+            options.sketches->add(record, timestamp_ms);
+        }
+        aggregate_into(flows, record, timestamp_ms);
+    }
+
+    // Every read packet advances the time, also the rejected ones
+    {
+        StageTimer timer(Metrics::Stage::EXPIRE, sampled);
+        TRACE_SCOPE(EXPIRY);
+        flows.expire(static_cast<uint32_t>(timestamp_ms), [this](const Flow& flow) { deliver(flow); });
+    }
+    return decoded;
+}
+
+/**
+ * @brief Aggregates the record and updates the times passed to the exporter.
+ *
+ * @param flows Flow table of the selected policies
+ * @param record Decoded packet
+ * @param timestamp_ms Capture timestamp of the packet in miliseconds
+ */
+template <class Table>
+void Probe::aggregate_into(Table& flows, const NetFlowV5record& record, uint64_t timestamp_ms) {
+    start_clock();
+    time_end = record.Last;
+    created += flows.add(record, timestamp_ms);
+}
+
+/**
+ * @brief Starts the uptime of the exported headers at the current wall clock time, like a device
+ * started with the capture. First and Last of the records are relative to it. Called by the first
+ * aggregated packet, later calls keep the start.
+ */
+void Probe::start_clock() {
+    if (time_start_set) {
+        return;
+    }
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    time_start = static_cast<uint32_t>(tv.tv_sec * 1000LL + tv.tv_usec / 1000);
+    time_start_set = true;
+}
+
+/**
+ * @brief Sets the start and end time of the exports, used to resume from a checkpoint.
+ *
+ * @param start Start time saved by the previous run
+ * @param end Time of the last packet of the previous run
+ */
+void Probe::set_times(uint32_t start, uint32_t end) {
+    time_start = start;
+    time_end = end;
+    time_start_set = true;
+}
+
+/**
+ * @brief Returns the next expired flow queued when neither a callback nor an exporter is set.
+ *
+ * @return The oldest queued flow, empty if no flow is queued
+ */
+std::optional<Flow> Probe::next_flow() {
+    if (pending.empty()) {
+        return std::nullopt;
+    }
+    Flow flow = pending.front();
+    pending.pop_front();
+    return flow;
+}
+
+/**
+ * @brief Expires all open flows and flushes the exporter, called at the end of the input.
+ */
+void Probe::finish() {
+    expire_all();
+    flush();
+}
+
+/**
+ * @brief Expires all open flows, full batches are exported on the way, the last one by flush.
+ */
+void Probe::expire_all() {
+    std::visit([this](auto& flows) { flows.expire_all([this](const Flow& flow) { deliver(flow); }); }, table);
+}
+
+/**
+ * @brief Exports the batched flows and flushes the exporter.
+ */
+void Probe::flush() {
+    if (exporter) {
+        export_batched();
+        exporter->flush();
+    }
+}
+
+/**
+ * @brief Open flows in the order of their creation, for the checkpoint and the parallel run.
+ * Call reindex after the list was changed.
+ */
+std::list<Flow>& Probe::flows() {
+    return std::visit([](auto& flows) -> std::list<Flow>& { return flows.flows(); }, table);
+}
+
+/**
+ * @brief Rebuilds the flow table index after flows were put into the list directly.
+ */
+void Probe::reindex() {
+    std::visit([](auto& flows) { flows.reindex(); }, table);
+}
+
+/**
+ * @brief Number of flows that have not expired yet.
+ */
+size_t Probe::open_flows() const {
+    return std::visit([](const auto& flows) { return flows.size(); }, table);
+}
+
+/**
+ * @brief Passes the expired flow to the callback and the exporter, or queues it for next_flow.
+ * Flows the callback exported go into the same batch, before the expired flow.
+ */
+void Probe::deliver(const Flow& flow) {
+    expired++;
+    if (callback) {
+        callback(flow);
+    }
+    if (exporter) {
+        if (options.export_expired) {
+            export_flow(flow);
+        }
+        if (export_batch.size() >= exporter->max_flows_per_export()) {
+            export_batched();
+        }
+    }
+    if (!callback && !exporter) {
+        pending.push_back(flow);
+    }
+}
+
+/**
+ * @brief Exports the batched flows.
+ */
+void Probe::export_batched() {
+    if (export_batch.empty()) {
+        return;
+    }
+    exported += export_batch.size();
+    Metrics::add(Metrics::Counter::FLOWS_EXPORTED, export_batch.size());
+
+    StageTimer timer(Metrics::Stage::EXPORT, true);
+    TRACE_SCOPE(EXPORT);
+    exporter->export_flows(export_batch, time_start, time_end);
+    export_batch.clear();
+}
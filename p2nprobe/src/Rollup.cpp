@@ -0,0 +1,229 @@
+////////////////////////////////////////////////////
+// File: Rollup.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <sstream>
+
+#include "Rollup.h"
+
+namespace {
+    uint32_t netmask(int prefix) {
+        if (prefix <= 0) {
+            return 0;
+        }
+        return static_cast<uint32_t>(0xFFFFFFFFULL << (32 - prefix));
+    }
+
+    // Parses the prefix length of "src/24", the whole address is kept without a length
+    bool parse_prefix(const std::string& field, size_t name_length, int& prefix) {
+        if (field.size() == name_length) {
+            prefix = 32;
+            return true;
+        }
+        if (field[name_length] != '/' || field.size() == name_length + 1 || field.size() > name_length + 3) {
+            return false;
+        }
+        prefix = 0;
+        for (size_t i = name_length + 1; i < field.size(); i++) {
+            if (field[i] < '0' || field[i] > '9') {
+                return false;
+            }
+            prefix = prefix * 10 + (field[i] - '0');
+        }
+        return prefix <= 32;
+    }
+
+    // The v5 counters of a bin saturate instead of wrapping, the 64-bit totals stay exact
+    uint32_t saturate(uint64_t value) {
+        return static_cast<uint32_t>(std::min<uint64_t>(value, UINT32_MAX));
+    }
+}
+
+/**
+ * @brief Parses the comma separated key fields: src[/N], dst[/N], proto, sport, dport, srcas, dstas.
+ *
+ * @param text Fields given by the user
+ * @param spec Filled with the parsed key
+ * @param error Filled with the description of the invalid field
+ *
+ * @return false if a field is unknown or repeated
+ */
+bool Rollup::parse_spec(const std::string& text, Spec& spec, std::string& error) {
+    spec = Spec();
+    std::istringstream stream(text);
+    std::string field;
+    bool any = false;
+    while (std::getline(stream, field, ',')) {
+        bool repeated = false;
+        if (field.compare(0, 3, "src") == 0 && field.compare(0, 5, "srcas") != 0) {
+            repeated = spec.src_prefix >= 0;
+            if (!parse_prefix(field, 3, spec.src_prefix)) {
+                error = "invalid source prefix '" + field + "'";
+                return false;
+            }
+        }
+        else if (field.compare(0, 3, "dst") == 0 && field.compare(0, 5, "dstas") != 0) {
+            repeated = spec.dst_prefix >= 0;
+            if (!parse_prefix(field, 3, spec.dst_prefix)) {
+                error = "invalid destination prefix '" + field + "'";
+                return false;
+            }
+        }
+        else if (field == "proto") {
+            repeated = spec.protocol;
+            spec.protocol = true;
+        }
+        else if (field == "sport") {
+            repeated = spec.src_port;
+            spec.src_port = true;
+        }
+        else if (field == "dport") {
+            repeated = spec.dst_port;
+            spec.dst_port = true;
+        }
+        else if (field == "srcas") {
+            repeated = spec.src_as;
+            spec.src_as = true;
+        }
+        else if (field == "dstas") {
+            repeated = spec.dst_as;
+            spec.dst_as = true;
+        }
+        else {
+            error = "unknown field '" + field + "'";
+            return false;
+        }
+        if (repeated) {
+            error = "field '" + field + "' is given twice";
+            return false;
+        }
+        any = true;
+    }
+    if (!any) {
+        error = "no key fields";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Constructor of the rollup stage.
+ *
+ * @param spec Fields of the rollup key
+ * @param interval_ms Length of one bin
+ */
+Rollup::Rollup(const Spec& spec, uint32_t interval_ms)
+    : spec(spec),
+    interval_ms(interval_ms),
+    src_netmask(netmask(spec.src_prefix)),
+    dst_netmask(netmask(spec.dst_prefix)) {}
+
+/**
+ * @brief Hash of the rollup key, fields are packed into two words and mixed.
+ */
+size_t Rollup::KeyHash::operator()(const Key& key) const {
+    uint64_t high = (static_cast<uint64_t>(key.src) << 32) | key.dst;
+    uint64_t low = (static_cast<uint64_t>(key.src_port) << 48) | (static_cast<uint64_t>(key.dst_port) << 32) |
+                   (static_cast<uint64_t>(key.src_as) << 16) | key.dst_as;
+    uint64_t hash = (high ^ (low + 0x9e3779b97f4a7c15ULL + key.protocol)) * 0xbf58476d1ce4e5b9ULL;
+    return static_cast<size_t>(hash ^ (hash >> 31));
+}
+
+/**
+ * @brief Key of the flow, fields outside of the spec are zero.
+ */
+Rollup::Key Rollup::make_key(const NetFlowV5record& record) const {
+    Key key;
+    key.src = record.srcaddr & src_netmask;
+    key.dst = record.dstaddr & dst_netmask;
+    key.src_port = spec.src_port ? record.srcport : 0;
+    key.dst_port = spec.dst_port ? record.dstport : 0;
+    key.src_as = spec.src_as ? record.src_as : 0;
+    key.dst_as = spec.dst_as ? record.dst_as : 0;
+    key.protocol = spec.protocol ? record.prot : 0;
+    return key;
+}
+
+/**
+ * @brief Adds an expired unidirectional flow to its rollup. Exports the open bin first when the
+ * flow belongs to a later one.
+ *
+ * @param flow Expired flow
+ * @param output Exported rollups are appended here
+ */
+void Rollup::add(const Flow& flow, std::vector<Flow>& output) {
+    uint64_t flow_bin = flow.last_ms / interval_ms;
+    if (!open) {
+        bin = flow_bin;
+        open = true;
+    }
+    else if (flow_bin > bin) {
+        flush(output);
+        bin = flow_bin;
+        open = true;
+    }
+    flows_added++;
+
+    Key key = make_key(flow.record);
+    auto it = table.find(key);
+    if (it == table.end()) {
+        NetFlowV5record record;
+        record.srcaddr = key.src;
+        record.dstaddr = key.dst;
+        record.srcport = key.src_port;
+        record.dstport = key.dst_port;
+        record.src_as = key.src_as;
+        record.dst_as = key.dst_as;
+        record.prot = key.protocol;
+        record.src_mask = static_cast<uint8_t>(std::max(spec.src_prefix, 0));
+        record.dst_mask = static_cast<uint8_t>(std::max(spec.dst_prefix, 0));
+        record.tcp_flags = flow.record.tcp_flags;
+        record.dPkts = saturate(flow.packets);
+        record.dOctets = saturate(flow.octets);
+        record.First = flow.record.First;
+        record.Last = flow.record.Last;
+
+        Flow rollup(NetFlowV5Key(record), record, flow.first_ms);
+        rollup.packets = flow.packets;
+        rollup.octets = flow.octets;
+        rollup.last_ms = flow.last_ms;
+        table.emplace(key, rollup);
+        return;
+    }
+
+    Flow& rollup = it->second;
+    rollup.record.tcp_flags |= flow.record.tcp_flags;
+    rollup.packets += flow.packets;
+    rollup.octets += flow.octets;
+    rollup.record.dPkts = saturate(rollup.packets);
+    rollup.record.dOctets = saturate(rollup.octets);
+    if (flow.first_ms < rollup.first_ms) {
+        rollup.first_ms = flow.first_ms;
+        rollup.record.First = flow.record.First;
+    }
+    if (flow.last_ms > rollup.last_ms) {
+        rollup.last_ms = flow.last_ms;
+        rollup.record.Last = flow.record.Last;
+    }
+}
+
+/**
+ * @brief Exports the rollups of the open bin, ordered by their first packet.
+ *
+ * @param output Exported rollups are appended here
+ */
+void Rollup::flush(std::vector<Flow>& output) {
+    size_t start = output.size();
+    for (const auto& entry : table) {
+        output.push_back(entry.second);
+    }
+    std::sort(output.begin() + static_cast<std::ptrdiff_t>(start), output.end(),
+              [](const Flow& a, const Flow& b) { return a.first_ms < b.first_ms; });
+    rollups_exported += table.size();
+    table.clear();
+    open = false;
+}
@@ -0,0 +1,157 @@
+////////////////////////////////////////////////////
+// File: RoutingTable.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <arpa/inet.h>
+
+#include "RoutingTable.h"
+#include "Logger.h"
+
+namespace {
+    bool parse_address(const std::string& text, uint32_t& address) {
+        struct in_addr addr;
+        if (inet_pton(AF_INET, text.c_str(), &addr) != 1) {
+            return false;
+        }
+        address = ntohl(addr.s_addr);
+        return true;
+    }
+
+    uint32_t netmask(uint8_t length) {
+        return length == 0 ? 0 : static_cast<uint32_t>(0xFFFFFFFFULL << (32 - length));
+    }
+}
+
+/**
+ * @brief Reads the routes from the file and builds the lookup tables.
+ *
+ * @param path Path of the routing table file
+ *
+ * @return false if the file cannot be read or a line is invalid
+ */
+bool RoutingTable::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Error: Cannot open routing table file: " << path << std::endl;
+        return false;
+    }
+
+    routes.assign(1, Route());
+    std::vector<Prefix> prefixes;
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string prefix_text, nexthop_text;
+        long as = -1;
+        if (!(fields >> prefix_text)) {
+            continue; // Empty or comment line
+        }
+
+        size_t slash = prefix_text.find('/');
+        uint32_t address = 0;
+        uint32_t nexthop = 0;
+        int length = -1;
+        if (slash != std::string::npos) {
+            // Only digits, "10.0.0.0/8abc" is not a /8
+            std::string length_text = prefix_text.substr(slash + 1);
+            if (!length_text.empty() && length_text.size() <= 2 &&
+                std::all_of(length_text.begin(), length_text.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+                length = std::stoi(length_text);
+            }
+        }
+        std::string rest;
+        bool valid = slash != std::string::npos && parse_address(prefix_text.substr(0, slash), address) &&
+                     length >= 0 && length <= 32 && (fields >> nexthop_text >> as) && as >= 0 && as <= 65535 &&
+                     (nexthop_text == "-" || parse_address(nexthop_text, nexthop)) && !(fields >> rest);
+        if (!valid) {
+            std::cerr << "Error: Invalid route on line " << line_number << " of " << path
+                      << ", expected <prefix>/<length> <nexthop> <AS>" << std::endl;
+            return false;
+        }
+
+        Route route;
+        route.nexthop = nexthop;
+        route.as = static_cast<uint16_t>(as);
+        route.length = static_cast<uint8_t>(length);
+        routes.push_back(route);
+        prefixes.push_back({address & netmask(route.length), route.length, static_cast<uint32_t>(routes.size() - 1)});
+    }
+
+    // Longer prefixes overwrite the entries of the shorter ones they are part of, a repeated prefix keeps the last route
+    std::stable_sort(prefixes.begin(), prefixes.end(),
+                     [](const Prefix& a, const Prefix& b) { return a.length < b.length; });
+    tbl24.assign(static_cast<size_t>(1) << 24, 0);
+    tbl8.clear();
+    for (const Prefix& prefix : prefixes) {
+        insert(prefix);
+    }
+
+    LOG_INFO("Loaded ", route_count(), " routes from ", path, ", ", tbl8.size() / GROUP_SIZE, " groups of /25-/32 prefixes");
+    return true;
+}
+
+/**
+ * @brief Writes the route into all entries covered by the prefix. Prefixes are inserted
+ * from the shortest, so a new group starts as a copy of the entry it replaces.
+ */
+void RoutingTable::insert(const Prefix& prefix) {
+    if (prefix.length <= 24) {
+        size_t first = prefix.address >> 8;
+        size_t count = static_cast<size_t>(1) << (24 - prefix.length);
+        std::fill(tbl24.begin() + first, tbl24.begin() + first + count, prefix.route);
+        return;
+    }
+
+    uint32_t& entry = tbl24[prefix.address >> 8];
+    if (!(entry & GROUP_FLAG)) {
+        uint32_t group = static_cast<uint32_t>(tbl8.size() / GROUP_SIZE);
+        tbl8.insert(tbl8.end(), GROUP_SIZE, entry);
+        entry = GROUP_FLAG | group;
+    }
+    size_t first = (entry & ~GROUP_FLAG) * GROUP_SIZE + (prefix.address & 0xFF);
+    size_t count = static_cast<size_t>(1) << (32 - prefix.length);
+    std::fill(tbl8.begin() + first, tbl8.begin() + first + count, prefix.route);
+}
+
+/**
+ * @brief Longest prefix match of the address.
+ *
+ * @param address Address in host byte order
+ *
+ * @return Route of the longest matching prefix, nullptr if no prefix matches
+ */
+const RoutingTable::Route* RoutingTable::lookup(uint32_t address) const {
+    uint32_t entry = tbl24[address >> 8];
+    if (entry & GROUP_FLAG) {
+        entry = tbl8[(entry & ~GROUP_FLAG) * GROUP_SIZE + (address & 0xFF)];
+    }
+    return entry == 0 ? nullptr : &routes[entry];
+}
+
+/**
+ * @brief Fills the routing fields of the record. The source prefix gives the source AS and mask,
+ * the destination prefix the destination AS, mask and nexthop.
+ *
+ * @param record Record of a new flow
+ */
+void RoutingTable::fill(NetFlowV5record& record) const {
+    if (const Route* source = lookup(record.srcaddr)) {
+        record.src_as = source->as;
+        record.src_mask = source->length;
+    }
+    if (const Route* destination = lookup(record.dstaddr)) {
+        record.dst_as = destination->as;
+        record.dst_mask = destination->length;
+        record.nexthop = destination->nexthop;
+    }
+}
@@ -0,0 +1,348 @@
+////////////////////////////////////////////////////
+// File: ShmRing.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "ShmRing.h"
+#include "Config.h"
+#include "ErrorCodes.h"
+#include "Logger.h"
+#include "Metrics.h"
+
+namespace {
+    // Shared futexes, the two sides are different processes
+    void futex_wait(std::atomic<uint32_t>& word, uint32_t expected, int timeout_ms) {
+        struct timespec timeout;
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = static_cast<long>(timeout_ms % 1000) * 1000000;
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+    }
+
+    void futex_wake(std::atomic<uint32_t>& word) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+    }
+
+    inline size_t record_size(size_t datagram_size) {
+        return (ShmRing::RECORD_HEADER_SIZE + datagram_size + ShmRing::RECORD_ALIGNMENT - 1) &
+               ~(ShmRing::RECORD_ALIGNMENT - 1);
+    }
+
+    inline void put_record_header(uint8_t* buffer, uint32_t length) {
+        uint32_t reserved = 0;
+        memcpy(buffer, &length, sizeof(length));
+        memcpy(buffer + sizeof(length), &reserved, sizeof(reserved));
+    }
+}
+
+/**
+ * @brief Name of the POSIX shared memory object, the ring name with a leading slash.
+ *
+ * @param name Ring name given by the user, the leading slash is optional
+ *
+ * @return Name for shm_open.
+ */
+std::string ShmRing::segment_name(const std::string& name) {
+    return name[0] == '/' ? name : "/" + name;
+}
+
+/**
+ * @brief Constructor of the class. Replaces a segment left by a previous run with a new empty ring.
+ *
+ * @param name Name of the ring, the segment is /dev/shm/<name>
+ * @param capacity Bytes of the data area, power of two
+ */
+ShmRingSink::ShmRingSink(const std::string& name, size_t capacity)
+    : name(ShmRing::segment_name(name)),
+    capacity(capacity),
+    mapping_size(ShmRing::HEADER_SIZE + capacity),
+    header(nullptr),
+    data(nullptr),
+    write_pos(0),
+    read_pos_cache(0),
+    waited(false)
+{
+    shm_unlink(this->name.c_str());
+    int fd = shm_open(this->name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        std::cerr << "Error: Cannot create shared memory ring '" << this->name << "': " << strerror(errno) << std::endl;
+        ExitWith(ErrorCode::FILE_OPEN_ERROR);
+    }
+    if (ftruncate(fd, static_cast<off_t>(mapping_size)) != 0) {
+        std::cerr << "Error: Cannot size shared memory ring '" << this->name << "': " << strerror(errno) << std::endl;
+        close(fd);
+        shm_unlink(this->name.c_str());
+        ExitWith(ErrorCode::FILE_OPEN_ERROR);
+    }
+    void* memory = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        std::cerr << "Error: Cannot map shared memory ring '" << this->name << "': " << strerror(errno) << std::endl;
+        shm_unlink(this->name.c_str());
+        ExitWith(ErrorCode::FILE_OPEN_ERROR);
+    }
+
+    // The new object is zero filled, so all positions, flags and futex words start at 0
+    header = static_cast<ShmRing::Header*>(memory);
+    data = static_cast<uint8_t*>(memory) + ShmRing::HEADER_SIZE;
+    header->version = ShmRing::VERSION;
+    header->capacity = capacity;
+    header->header_size = static_cast<uint32_t>(ShmRing::HEADER_SIZE);
+    header->magic.store(ShmRing::MAGIC, std::memory_order_release);
+    LOG_DEBUG("Shared memory ring ", this->name, " created with ", capacity, " bytes");
+}
+
+/**
+ * @brief Destructor. Closes the ring and unmaps it, the segment stays until the reader removes it.
+ */
+ShmRingSink::~ShmRingSink() {
+    flush();
+    munmap(header, mapping_size);
+    LOG_DEBUG("Shared memory ring ", name, " closed after ", write_pos, " bytes");
+}
+
+/**
+ * @brief Datagrams are not sent over a network, they can be as large as UDP allows.
+ *
+ * @return Maximum export MTU.
+ */
+int ShmRingSink::path_mtu() const {
+    return Config::MAX_EXPORT_MTU;
+}
+
+/**
+ * @brief Copies one datagram into the ring and publishes it to the reader.
+ * Blocks while the ring has no space for it.
+ *
+ * @param buffer Datagram to store
+ * @param buffer_size Size of the datagram
+ */
+void ShmRingSink::send(const uint8_t* buffer, size_t buffer_size) {
+    if (buffer_size == 0) {
+        return;
+    }
+
+    size_t record = record_size(buffer_size);
+    size_t offset = write_pos & (capacity - 1);
+    size_t tail = capacity - offset;
+    size_t skipped = tail < record ? tail : 0;      // Records do not wrap, the tail is skipped
+    wait_for_space(skipped + record);
+
+    if (skipped > 0) {
+        put_record_header(data + offset, ShmRing::WRAP_MARKER);
+        write_pos += skipped;
+        offset = 0;
+    }
+    put_record_header(data + offset, static_cast<uint32_t>(buffer_size));
+    memcpy(data + offset + ShmRing::RECORD_HEADER_SIZE, buffer, buffer_size);
+    write_pos += record;
+    publish();
+
+    Metrics::add(Metrics::Counter::DATAGRAMS_SENT);
+}
+
+/**
+ * @brief Waits until the reader consumed enough records for the next write.
+ * The shared read position is loaded only when the cached one says the ring is full.
+ *
+ * @param needed Bytes of the data area the next write takes
+ */
+void ShmRingSink::wait_for_space(size_t needed) {
+    if (write_pos + needed - read_pos_cache <= capacity) {
+        return;
+    }
+    read_pos_cache = header->read_pos.load(std::memory_order_acquire);
+    while (write_pos + needed - read_pos_cache > capacity) {
+        Metrics::add(Metrics::Counter::SHM_RING_FULL);
+        if (!waited) {
+            LOG_WARNING("Shared memory ring ", name, " is full, waiting for the reader");
+            waited = true;
+        }
+
+        // Flag first, then check again, so a reader consuming in between sees the flag or is seen
+        uint32_t seq = header->space_seq.load(std::memory_order_acquire);
+        header->writer_waiting.store(1, std::memory_order_seq_cst);
+        read_pos_cache = header->read_pos.load(std::memory_order_seq_cst);
+        if (write_pos + needed - read_pos_cache > capacity) {
+            futex_wait(header->space_seq, seq, Config::SHM_RING_WAIT_MS);
+            read_pos_cache = header->read_pos.load(std::memory_order_acquire);
+        }
+        header->writer_waiting.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Makes the written records visible and wakes the reader if it sleeps.
+ */
+void ShmRingSink::publish() {
+    header->write_pos.store(write_pos, std::memory_order_seq_cst);
+    if (header->reader_waiting.load(std::memory_order_seq_cst) != 0) {
+        header->data_seq.fetch_add(1, std::memory_order_release);
+        futex_wake(header->data_seq);
+    }
+}
+
+/**
+ * @brief Marks the ring closed, the reader ends after the remaining records.
+ */
+void ShmRingSink::flush() {
+    if (header->closed.load(std::memory_order_relaxed) != 0) {
+        return;
+    }
+    header->closed.store(1, std::memory_order_seq_cst);
+    header->data_seq.fetch_add(1, std::memory_order_release);
+    futex_wake(header->data_seq);
+}
+
+/**
+ * @brief Constructor of the class, attach() maps the ring.
+ */
+ShmRingReader::ShmRingReader()
+    : mapping_size(0),
+    segment_device(0),
+    segment_inode(0),
+    header(nullptr),
+    data(nullptr),
+    read_pos(0),
+    pending(0) {}
+
+/**
+ * @brief Destructor. Releases the last record and unmaps the ring.
+ */
+ShmRingReader::~ShmRingReader() {
+    if (header != nullptr) {
+        header->read_pos.store(read_pos + pending, std::memory_order_release);
+        munmap(header, mapping_size);
+    }
+}
+
+/**
+ * @brief Maps the ring of the given name, waiting until the producer created it.
+ *
+ * @param name Name of the ring, the leading slash is optional
+ * @param timeout_ms Time to wait for the producer, negative waits forever
+ *
+ * @return true if the ring is mapped, false on timeout or error
+ */
+bool ShmRingReader::attach(const std::string& name, int timeout_ms) {
+    this->name = ShmRing::segment_name(name);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    for (;;) {
+        int fd = shm_open(this->name.c_str(), O_RDWR, 0);
+        struct stat info;
+        if (fd >= 0 && fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) > ShmRing::HEADER_SIZE) {
+            void* memory = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if (memory == MAP_FAILED) {
+                return false;
+            }
+            auto* mapped = static_cast<ShmRing::Header*>(memory);
+            if (mapped->magic.load(std::memory_order_acquire) == ShmRing::MAGIC) {
+                if (mapped->version != ShmRing::VERSION ||
+                    mapped->header_size + mapped->capacity != static_cast<uint64_t>(info.st_size)) {
+                    munmap(memory, info.st_size);
+                    return false;
+                }
+                header = mapped;
+                mapping_size = info.st_size;
+                segment_device = info.st_dev;
+                segment_inode = info.st_ino;
+                data = static_cast<uint8_t*>(memory) + header->header_size;
+                read_pos = header->read_pos.load(std::memory_order_acquire);
+                return true;
+            }
+            munmap(memory, info.st_size);   // Producer is still initialising the header
+        }
+        else if (fd >= 0) {
+            close(fd);
+        }
+
+        if (timeout_ms >= 0 && std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+/**
+ * @brief Returns the next datagram, sleeping while the ring is empty. The datagram points into
+ * the ring and stays valid until the next call, which hands its space back to the producer.
+ *
+ * @param datagram Set to the start of the datagram
+ * @param size Set to the size of the datagram
+ *
+ * @return true if a datagram was returned, false once the producer closed the ring and all was read
+ */
+bool ShmRingReader::next(const uint8_t*& datagram, size_t& size) {
+    const uint64_t capacity = header->capacity;
+    if (pending > 0) {
+        read_pos += pending;
+        pending = 0;
+        header->read_pos.store(read_pos, std::memory_order_seq_cst);
+        if (header->writer_waiting.load(std::memory_order_seq_cst) != 0) {
+            header->space_seq.fetch_add(1, std::memory_order_release);
+            futex_wake(header->space_seq);
+        }
+    }
+
+    for (;;) {
+        uint64_t write_pos = header->write_pos.load(std::memory_order_acquire);
+        if (read_pos == write_pos) {
+            if (header->closed.load(std::memory_order_acquire) != 0 &&
+                header->write_pos.load(std::memory_order_acquire) == read_pos) {
+                return false;
+            }
+
+            // Flag first, then check again, so a producer publishing in between sees the flag or is seen
+            uint32_t seq = header->data_seq.load(std::memory_order_acquire);
+            header->reader_waiting.store(1, std::memory_order_seq_cst);
+            if (header->write_pos.load(std::memory_order_seq_cst) == read_pos &&
+                header->closed.load(std::memory_order_seq_cst) == 0) {
+                futex_wait(header->data_seq, seq, Config::SHM_RING_WAIT_MS);
+            }
+            header->reader_waiting.store(0, std::memory_order_relaxed);
+            continue;
+        }
+
+        size_t offset = read_pos & (capacity - 1);
+        uint32_t length;
+        memcpy(&length, data + offset, sizeof(length));
+        if (length == ShmRing::WRAP_MARKER) {
+            read_pos += capacity - offset;
+            continue;
+        }
+        datagram = data + offset + ShmRing::RECORD_HEADER_SIZE;
+        size = length;
+        pending = record_size(length);
+        return true;
+    }
+}
+
+/**
+ * @brief Removes the segment, unless the producer already replaced it with a new ring.
+ */
+void ShmRingReader::unlink() {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return;
+    }
+    struct stat info;
+    bool same = fstat(fd, &info) == 0 && info.st_dev == segment_device && info.st_ino == segment_inode;
+    close(fd);
+    if (same) {
+        shm_unlink(name.c_str());
+    }
+}
@@ -0,0 +1,295 @@
+////////////////////////////////////////////////////
+// File: Sketches.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <arpa/inet.h>
+
+#include "Sketches.h"
+#include "Config.h"
+#include "MetricsReporter.h"
+
+namespace {
+    // Finalizer of splitmix64, spreads the bits of addresses and ports over the whole hash
+    inline uint64_t mix(uint64_t value) {
+        value += 0x9e3779b97f4a7c15ULL;
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+        return value ^ (value >> 31);
+    }
+
+    const char* const DIMENSION_NAMES[] = {"src", "dst", "dst_port"};
+}
+
+/**
+ * @brief Constructor of the sketch.
+ *
+ * @param capacity Number of tracked keys
+ */
+SpaceSaving::SpaceSaving(size_t capacity)
+    : capacity(capacity) {
+    heap.reserve(capacity);
+    positions.reserve(capacity);
+}
+
+/**
+ * @brief Adds weight to the key, an untracked key replaces the smallest counter when the sketch is full.
+ *
+ * @param key Key of the item
+ * @param weight Bytes or packets of the item
+ */
+void SpaceSaving::add(uint64_t key, uint64_t weight) {
+    auto it = positions.find(key);
+    if (it != positions.end()) {
+        heap[it->second].count += weight;
+        sift_down(it->second);
+        return;
+    }
+
+    if (heap.size() < capacity) {
+        heap.push_back({key, weight, 0});
+        positions[key] = heap.size() - 1;
+        sift_up(heap.size() - 1);
+        return;
+    }
+
+    Entry& smallest = heap[0];
+    positions.erase(smallest.key);
+    smallest = {key, smallest.count + weight, smallest.count};
+    positions[key] = 0;
+    sift_down(0);
+}
+
+/**
+ * @brief Heaviest tracked keys.
+ *
+ * @param k Number of keys
+ *
+ * @return Up to k entries ordered by count, descending
+ */
+std::vector<SpaceSaving::Entry> SpaceSaving::top(size_t k) const {
+    std::vector<Entry> entries(heap);
+    k = std::min(k, entries.size());
+    std::partial_sort(entries.begin(), entries.begin() + k, entries.end(),
+                      [](const Entry& a, const Entry& b) { return a.count > b.count; });
+    entries.resize(k);
+    return entries;
+}
+
+/**
+ * @brief Forgets all keys, the memory is kept for the next interval.
+ */
+void SpaceSaving::clear() {
+    heap.clear();
+    positions.clear();
+}
+
+void SpaceSaving::swap_entries(size_t a, size_t b) {
+    std::swap(heap[a], heap[b]);
+    positions[heap[a].key] = a;
+    positions[heap[b].key] = b;
+}
+
+void SpaceSaving::sift_up(size_t index) {
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (heap[parent].count <= heap[index].count) {
+            break;
+        }
+        swap_entries(parent, index);
+        index = parent;
+    }
+}
+
+void SpaceSaving::sift_down(size_t index) {
+    while (true) {
+        size_t smallest = index;
+        size_t left = 2 * index + 1;
+        size_t right = left + 1;
+        if (left < heap.size() && heap[left].count < heap[smallest].count) {
+            smallest = left;
+        }
+        if (right < heap.size() && heap[right].count < heap[smallest].count) {
+            smallest = right;
+        }
+        if (smallest == index) {
+            break;
+        }
+        swap_entries(smallest, index);
+        index = smallest;
+    }
+}
+
+/**
+ * @brief Constructor of the counter.
+ *
+ * @param precision Number of index bits, 2^precision registers are allocated
+ */
+HyperLogLog::HyperLogLog(unsigned precision)
+    : precision(precision), registers(static_cast<size_t>(1) << precision, 0) {}
+
+/**
+ * @brief Adds a hashed item. The top bits select the register, the register keeps the
+ * longest run of leading zeros seen in the remaining bits.
+ *
+ * @param hash Well mixed 64-bit hash of the item
+ */
+void HyperLogLog::add(uint64_t hash) {
+    size_t index = static_cast<size_t>(hash >> (64 - precision));
+    uint64_t rest = hash << precision;
+    uint8_t rank = rest == 0 ? static_cast<uint8_t>(64 - precision + 1)
+                             : static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+    registers[index] = std::max(registers[index], rank);
+}
+
+/**
+ * @brief Estimated number of distinct items, linear counting is used while registers are still empty.
+ */
+uint64_t HyperLogLog::estimate() const {
+    double m = static_cast<double>(registers.size());
+    double sum = 0;
+    size_t zeros = 0;
+    for (uint8_t value : registers) {
+        sum += std::ldexp(1.0, -value);
+        zeros += value == 0;
+    }
+
+    double alpha = 0.7213 / (1.0 + 1.079 / m);
+    double estimate = alpha * m * m / sum;
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * std::log(m / static_cast<double>(zeros));
+    }
+    return static_cast<uint64_t>(std::llround(estimate));
+}
+
+/**
+ * @brief Resets all registers.
+ */
+void HyperLogLog::clear() {
+    std::fill(registers.begin(), registers.end(), 0);
+}
+
+/**
+ * @brief Constructor of the sketches, all memory is allocated here.
+ *
+ * @param interval_ms Length of the reported capture time intervals, 0 to report the whole capture once
+ * @param top_k Number of heaviest keys reported per sketch
+ */
+Sketches::Sketches(uint32_t interval_ms, size_t top_k)
+    : interval_ms(interval_ms),
+    top_k(top_k),
+    by_octets(DIMENSION_COUNT, SpaceSaving(Config::SKETCH_CAPACITY)),
+    by_packets(DIMENSION_COUNT, SpaceSaving(Config::SKETCH_CAPACITY)),
+    sources(Config::HLL_PRECISION),
+    destinations(Config::HLL_PRECISION) {}
+
+/**
+ * @brief Adds a decoded packet, reports the interval first when the packet belongs to a later one.
+ *
+ * @param record Decoded packet
+ * @param timestamp_ms Capture timestamp of the packet
+ */
+void Sketches::add(const NetFlowV5record& record, uint64_t timestamp_ms) {
+    if (!started) {
+        start_interval(timestamp_ms);
+        started = true;
+    }
+    else if (interval_ms > 0 && timestamp_ms >= interval_start_ms + interval_ms) {
+        report();
+        start_interval(timestamp_ms);
+    }
+
+    const uint64_t keys[DIMENSION_COUNT] = {record.srcaddr, record.dstaddr, record.dstport};
+    for (int dimension = 0; dimension < DIMENSION_COUNT; dimension++) {
+        by_octets[dimension].add(keys[dimension], record.dOctets);
+        by_packets[dimension].add(keys[dimension], 1);
+    }
+    sources.add(mix(record.srcaddr));
+    destinations.add(mix(record.dstaddr));
+
+    packets++;
+    octets += record.dOctets;
+    last_ms = std::max(last_ms, timestamp_ms);
+}
+
+/**
+ * @brief Reports the last interval, called at the end of the capture.
+ */
+void Sketches::finish() {
+    if (started) {
+        report();
+        started = false;
+    }
+}
+
+/**
+ * @brief Clears the sketches for the interval holding the timestamp.
+ */
+void Sketches::start_interval(uint64_t timestamp_ms) {
+    interval_start_ms = interval_ms > 0 ? timestamp_ms - timestamp_ms % interval_ms : timestamp_ms;
+    last_ms = timestamp_ms;
+    packets = 0;
+    octets = 0;
+    for (int dimension = 0; dimension < DIMENSION_COUNT; dimension++) {
+        by_octets[dimension].clear();
+        by_packets[dimension].clear();
+    }
+    sources.clear();
+    destinations.clear();
+}
+
+/**
+ * @brief Publishes the interval as one JSON line, the metrics reporter prints it.
+ */
+void Sketches::report() {
+    uint64_t end_ms = interval_ms > 0 ? interval_start_ms + interval_ms : last_ms;
+
+    std::ostringstream oss;
+    oss << "{\"sketch\":{\"start_ms\":" << interval_start_ms
+        << ",\"end_ms\":" << end_ms
+        << ",\"packets\":" << packets
+        << ",\"bytes\":" << octets
+        << ",\"distinct_src\":" << sources.estimate()
+        << ",\"distinct_dst\":" << destinations.estimate();
+    for (int dimension = 0; dimension < DIMENSION_COUNT; dimension++) {
+        Dimension current = static_cast<Dimension>(dimension);
+        oss << ",\"top_" << DIMENSION_NAMES[dimension] << "_bytes\":" << format_top(by_octets[dimension], current)
+            << ",\"top_" << DIMENSION_NAMES[dimension] << "_packets\":" << format_top(by_packets[dimension], current);
+    }
+    oss << "}}";
+    MetricsReporter::publish(oss.str());
+}
+
+/**
+ * @brief Formats the heaviest keys of one sketch as a JSON array.
+ *
+ * @param sketch Sketch to format
+ * @param dimension Dimension of its keys, addresses are printed in dotted form
+ */
+std::string Sketches::format_top(const SpaceSaving& sketch, Dimension dimension) const {
+    std::ostringstream oss;
+    oss << "[";
+    bool first = true;
+    for (const SpaceSaving::Entry& entry : sketch.top(top_k)) {
+        oss << (first ? "" : ",") << "{\"key\":\"";
+        if (dimension == PORT) {
+            oss << entry.key;
+        }
+        else {
+            char address[INET_ADDRSTRLEN];
+            struct in_addr addr;
+            addr.s_addr = htonl(static_cast<uint32_t>(entry.key));
+            inet_ntop(AF_INET, &addr, address, sizeof(address));
+            oss << address;
+        }
+        oss << "\",\"value\":" << entry.count << ",\"error\":" << entry.error << "}";
+        first = false;
+    }
+    oss << "]";
+    return oss.str();
+}
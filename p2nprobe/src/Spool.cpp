@@ -0,0 +1,315 @@
+////////////////////////////////////////////////////
+// File: Spool.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Spool.h"
+#include "Config.h"
+#include "ErrorCodes.h"
+#include "Logger.h"
+#include "Metrics.h"
+
+namespace {
+    constexpr char SPOOL_MAGIC[4] = {'P', '2', 'N', 'S'};
+    constexpr uint16_t SPOOL_VERSION = 1;
+
+    // Offsets of the header fields
+    constexpr size_t VERSION_OFFSET = 4;
+    constexpr size_t CAPACITY_OFFSET = 16;
+    constexpr size_t HEAD_OFFSET = 24;
+    constexpr size_t TAIL_OFFSET = 32;
+
+    inline uint64_t get_u64(const uint8_t* buffer) {
+        uint64_t value;
+        memcpy(&value, buffer, sizeof(value));
+        return value;
+    }
+
+    inline void put_u64(uint8_t* buffer, uint64_t value) {
+        memcpy(buffer, &value, sizeof(value));
+    }
+}
+
+/**
+ * @brief Constructor of the class. Maps the spool file and starts the drainer,
+ * datagrams left in the file by a previous run are replayed first.
+ *
+ * @param settings Path, size cap and replay rate
+ * @param transmit Sends one datagram to the collector, false when the collector refused a datagram
+ * @param reachable Checks for an error of the collector since the last datagram, false when there was one
+ */
+Spool::Spool(const SpoolSettings& settings, Transmit transmit, Reachable reachable)
+    : path(settings.path),
+    capacity(settings.size),
+    transmit(std::move(transmit)),
+    reachable(std::move(reachable)),
+    pacer(Pacer::RateUnit::DATAGRAMS, settings.rate, 0),
+    mapping(nullptr),
+    mapping_size(0),
+    data(nullptr),
+    spooling(false),
+    head(0),
+    tail(0),
+    replay_pos(0),
+    collector_down(false),
+    stopping(false),
+    overflow_reported(false)
+{
+    open_file();
+    replay_pos = head;
+    if (head < tail) {
+        LOG_INFO("Spool ", path, " holds ", tail - head, " bytes of datagrams from the previous run");
+        spooling.store(true, std::memory_order_release);
+    }
+    drainer = std::thread(&Spool::drain, this);
+}
+
+/**
+ * @brief Destructor. Stops the drainer, datagrams not replayed stay in the file.
+ */
+Spool::~Spool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    drainer.join();
+
+    if (head < tail) {
+        LOG_WARNING("Spool ", path, " keeps ", tail - head, " bytes of datagrams for the next run");
+    }
+    store_positions();
+    msync(mapping, mapping_size, MS_SYNC);
+    munmap(mapping, mapping_size);
+}
+
+/**
+ * @brief Maps the spool file. A file with datagrams keeps its capacity, otherwise it is
+ * initialised with the configured one.
+ */
+void Spool::open_file() {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        std::cerr << "Error: Cannot open spool file '" << path << "': " << strerror(errno) << std::endl;
+        ExitWith(ErrorCode::FILE_OPEN_ERROR);
+    }
+
+    // Datagrams of a previous run are kept
+    struct stat info;
+    uint8_t header[HEADER_SIZE] = {};
+    bool resume = fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) > HEADER_SIZE &&
+                  pread(fd, header, HEADER_SIZE, 0) == static_cast<ssize_t>(HEADER_SIZE) &&
+                  memcmp(header, SPOOL_MAGIC, sizeof(SPOOL_MAGIC)) == 0 &&
+                  get_u64(header + CAPACITY_OFFSET) + HEADER_SIZE == static_cast<uint64_t>(info.st_size) &&
+                  get_u64(header + HEAD_OFFSET) < get_u64(header + TAIL_OFFSET) &&
+                  get_u64(header + TAIL_OFFSET) <= get_u64(header + CAPACITY_OFFSET);
+    if (resume) {
+        if (get_u64(header + CAPACITY_OFFSET) != capacity) {
+            LOG_WARNING("Spool ", path, " holds datagrams, keeping its size of ", get_u64(header + CAPACITY_OFFSET), " bytes");
+        }
+        capacity = get_u64(header + CAPACITY_OFFSET);
+        head = get_u64(header + HEAD_OFFSET);
+        tail = get_u64(header + TAIL_OFFSET);
+    }
+    else if (ftruncate(fd, 0) != 0 || ftruncate(fd, static_cast<off_t>(HEADER_SIZE + capacity)) != 0) {
+        std::cerr << "Error: Cannot size spool file '" << path << "': " << strerror(errno) << std::endl;
+        close(fd);
+        ExitWith(ErrorCode::FILE_OPEN_ERROR);
+    }
+
+    mapping_size = HEADER_SIZE + capacity;
+    void* memory = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        std::cerr << "Error: Cannot map spool file '" << path << "': " << strerror(errno) << std::endl;
+        ExitWith(ErrorCode::FILE_OPEN_ERROR);
+    }
+    mapping = static_cast<uint8_t*>(memory);
+    data = mapping + HEADER_SIZE;
+
+    if (!resume) {
+        memcpy(mapping, SPOOL_MAGIC, sizeof(SPOOL_MAGIC));
+        memcpy(mapping + VERSION_OFFSET, &SPOOL_VERSION, sizeof(SPOOL_VERSION));
+        put_u64(mapping + CAPACITY_OFFSET, capacity);
+        store_positions();
+    }
+}
+
+/**
+ * @brief Writes head and tail into the file header, the datagrams are written before.
+ */
+void Spool::store_positions() {
+    put_u64(mapping + HEAD_OFFSET, head);
+    put_u64(mapping + TAIL_OFFSET, tail);
+}
+
+/**
+ * @brief Appends the datagram if the spool holds datagrams, so it is not sent ahead of them.
+ *
+ * @param buffer Datagram
+ * @param buffer_size Size of the datagram
+ *
+ * @return true if the datagram was taken, false if it should be sent directly
+ */
+bool Spool::offer(const uint8_t* buffer, size_t buffer_size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!spooling.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    append_locked(buffer, buffer_size);
+    return true;
+}
+
+/**
+ * @brief Appends a datagram the collector did not get and starts the replay.
+ *
+ * @param buffer Datagram
+ * @param buffer_size Size of the datagram
+ */
+void Spool::append(const uint8_t* buffer, size_t buffer_size) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!spooling.load(std::memory_order_relaxed)) {
+            LOG_WARNING("Collector unreachable, spooling datagrams to ", path);
+            collector_down = true;  // The first replay waits for the retry period
+            spooling.store(true, std::memory_order_release);
+        }
+        append_locked(buffer, buffer_size);
+    }
+    changed.notify_all();
+}
+
+/**
+ * @brief Copies the datagram behind the tail. Datagrams that do not fit are dropped.
+ *
+ * @return true if the datagram was stored
+ */
+bool Spool::append_locked(const uint8_t* buffer, size_t buffer_size) {
+    if (tail + RECORD_HEADER_SIZE + buffer_size > capacity) {
+        Metrics::add(Metrics::Counter::SPOOL_OVERFLOWS);
+        if (!overflow_reported) {
+            LOG_ERROR("Spool ", path, " is full, datagrams are dropped");
+            overflow_reported = true;
+        }
+        return false;
+    }
+
+    uint32_t length = static_cast<uint32_t>(buffer_size);
+    memcpy(data + tail, &length, sizeof(length));
+    memcpy(data + tail + RECORD_HEADER_SIZE, buffer, buffer_size);
+    tail += RECORD_HEADER_SIZE + buffer_size;
+    store_positions();
+    Metrics::add(Metrics::Counter::DATAGRAMS_SPOOLED);
+    return true;
+}
+
+/**
+ * @brief Waits until the spool is empty or the timeout passes. Used at the end of the export,
+ * so datagrams of a short outage are not left for the next run.
+ *
+ * @param timeout Longest wait
+ */
+void Spool::wait_drained(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait_for(lock, timeout, [this]() { return !spooling.load(std::memory_order_relaxed); });
+}
+
+/**
+ * @brief Removes the replayed datagrams that got no ICMP error within the confirmation time.
+ *
+ * @param now Current time
+ */
+void Spool::commit_confirmed(std::chrono::steady_clock::time_point now) {
+    if (in_flight.empty() || now - in_flight.front().first < std::chrono::milliseconds(Config::SPOOL_CONFIRM_MS)) {
+        return;
+    }
+    // The error of the last datagram is reported only by the next send or this check
+    if (!reachable()) {
+        rewind();
+        return;
+    }
+
+    uint64_t committed = 0;
+    while (!in_flight.empty() && now - in_flight.front().first >= std::chrono::milliseconds(Config::SPOOL_CONFIRM_MS)) {
+        head = in_flight.front().second;
+        in_flight.pop_front();
+        committed++;
+    }
+    if (committed > 0) {
+        store_positions();
+        Metrics::add(Metrics::Counter::DATAGRAMS_REPLAYED, committed);
+    }
+}
+
+/**
+ * @brief Collector refused a datagram, the datagrams after the last confirmed one are replayed
+ * again after the retry period.
+ */
+void Spool::rewind() {
+    collector_down = true;
+    replay_pos = head;
+    in_flight.clear();
+    changed.notify_all();
+}
+
+/**
+ * @brief Drainer thread, replays the datagrams in order at the bounded rate.
+ */
+void Spool::drain() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        if (!spooling.load(std::memory_order_relaxed)) {
+            changed.wait(lock);
+            continue;
+        }
+
+        commit_confirmed(std::chrono::steady_clock::now());
+        if (replay_pos == tail) {
+            if (head == tail) {
+                // Everything was replayed, new datagrams are sent directly again
+                LOG_INFO("Spool ", path, " replayed");
+                head = tail = replay_pos = 0;
+                store_positions();
+                spooling.store(false, std::memory_order_release);
+                overflow_reported = false;
+                changed.notify_all();
+                continue;
+            }
+            changed.wait_for(lock, std::chrono::milliseconds(Config::SPOOL_CONFIRM_MS));
+            continue;
+        }
+
+        if (collector_down) {
+            // Probe with the first datagram after the retry period
+            changed.wait_for(lock, std::chrono::milliseconds(Config::SPOOL_RETRY_MS), [this]() { return stopping; });
+            collector_down = false;
+            continue;
+        }
+
+        // Datagrams before the tail are not changed any more, they are sent without the lock
+        uint32_t length;
+        memcpy(&length, data + replay_pos, sizeof(length));
+        const uint8_t* datagram = data + replay_pos + RECORD_HEADER_SIZE;
+        lock.unlock();
+        pacer.acquire(length);
+        bool sent = transmit(datagram, length);
+        lock.lock();
+
+        if (!sent) {
+            rewind();
+            continue;
+        }
+        replay_pos += RECORD_HEADER_SIZE + length;
+        in_flight.emplace_back(std::chrono::steady_clock::now(), replay_pos);
+    }
+}
@@ -0,0 +1,407 @@
+////////////////////////////////////////////////////
+// File: TemplateExporter.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <arpa/inet.h>
+
+#include "TemplateExporter.h"
+#include "Logger.h"
+
+namespace {
+    constexpr uint16_t TEMPLATE_ID = 256;           // First ID available for data templates
+    constexpr uint16_t BIFLOW_TEMPLATE_ID = 257;
+    constexpr uint16_t V9_TEMPLATE_SET_ID = 0;
+    constexpr uint16_t IPFIX_TEMPLATE_SET_ID = 2;
+    constexpr size_t V9_HEADER_SIZE = 20;
+    constexpr size_t IPFIX_HEADER_SIZE = 16;
+    constexpr size_t SET_HEADER_SIZE = 4;
+    constexpr size_t TEMPLATE_HEADER_SIZE = 4;
+
+    /**
+     * @brief One field of the data template, type is the information element ID shared by v9 and IPFIX.
+     */
+    struct TemplateField {
+        uint16_t type;
+        uint16_t length;
+    };
+
+    // Order of the fields must match TemplateExporter::format_record
+    constexpr TemplateField IPFIX_FIELDS[] = {
+        {8, 4},     // sourceIPv4Address
+        {12, 4},    // destinationIPv4Address
+        {15, 4},    // ipNextHopIPv4Address
+        {7, 2},     // sourceTransportPort
+        {11, 2},    // destinationTransportPort
+        {4, 1},     // protocolIdentifier
+        {6, 1},     // tcpControlBits
+        {5, 1},     // ipClassOfService
+        {2, 8},     // packetDeltaCount
+        {1, 8},     // octetDeltaCount
+        {152, 8},   // flowStartMilliseconds
+        {153, 8},   // flowEndMilliseconds
+        {16, 2},    // bgpSourceAsNumber
+        {17, 2},    // bgpDestinationAsNumber
+        {9, 1},     // sourceIPv4PrefixLength
+        {13, 1},    // destinationIPv4PrefixLength
+    };
+
+    // NetFlow v9 collectors decode the SysUptime relative FIRST_SWITCHED/LAST_SWITCHED,
+    // the absolute millisecond timestamps 152/153 are IPFIX only
+    constexpr TemplateField V9_FIELDS[] = {
+        {8, 4},     // IPV4_SRC_ADDR
+        {12, 4},    // IPV4_DST_ADDR
+        {15, 4},    // IPV4_NEXT_HOP
+        {7, 2},     // L4_SRC_PORT
+        {11, 2},    // L4_DST_PORT
+        {4, 1},     // PROTOCOL
+        {6, 1},     // TCP_FLAGS
+        {5, 1},     // SRC_TOS
+        {2, 8},     // IN_PKTS
+        {1, 8},     // IN_BYTES
+        {22, 4},    // FIRST_SWITCHED
+        {21, 4},    // LAST_SWITCHED
+        {16, 2},    // SRC_AS
+        {17, 2},    // DST_AS
+        {9, 1},     // SRC_MASK
+        {13, 1},    // DST_MASK
+    };
+    static_assert(sizeof(IPFIX_FIELDS) == sizeof(V9_FIELDS), "Both templates have the same fields");
+    constexpr size_t TEMPLATE_FIELD_COUNT = sizeof(IPFIX_FIELDS) / sizeof(IPFIX_FIELDS[0]);
+
+    template <size_t N>
+    constexpr size_t fields_size(const TemplateField (&fields)[N]) {
+        size_t size = 0;
+        for (const auto& field : fields) {
+            size += field.length;
+        }
+        return size;
+    }
+    constexpr size_t IPFIX_RECORD_SIZE = fields_size(IPFIX_FIELDS);
+    constexpr size_t V9_RECORD_SIZE = fields_size(V9_FIELDS);
+
+    // RFC 5103 reverse information elements, enterprise specific with the reverse PEN, follow the fields above
+    constexpr uint16_t ENTERPRISE_BIT = 0x8000;
+    constexpr uint32_t REVERSE_PEN = 29305;
+    constexpr TemplateField REVERSE_FIELDS[] = {
+        {6, 1},     // reverseTcpControlBits
+        {2, 8},     // reversePacketDeltaCount
+        {1, 8},     // reverseOctetDeltaCount
+        {152, 8},   // reverseFlowStartMilliseconds
+        {153, 8},   // reverseFlowEndMilliseconds
+    };
+    constexpr size_t REVERSE_FIELD_COUNT = sizeof(REVERSE_FIELDS) / sizeof(REVERSE_FIELDS[0]);
+    constexpr size_t REVERSE_RECORD_SIZE = fields_size(REVERSE_FIELDS);
+
+    // Big endian writers, the buffer is not aligned so values are copied byte wise
+    inline void put_u8(uint8_t* buffer, size_t& offset, uint8_t value) {
+        buffer[offset++] = value;
+    }
+
+    inline void put_u16(uint8_t* buffer, size_t& offset, uint16_t value) {
+        value = htons(value);
+        memcpy(buffer + offset, &value, sizeof(value));
+        offset += sizeof(value);
+    }
+
+    inline void put_u32(uint8_t* buffer, size_t& offset, uint32_t value) {
+        value = htonl(value);
+        memcpy(buffer + offset, &value, sizeof(value));
+        offset += sizeof(value);
+    }
+
+    inline void put_u64(uint8_t* buffer, size_t& offset, uint64_t value) {
+        put_u32(buffer, offset, static_cast<uint32_t>(value >> 32));
+        put_u32(buffer, offset, static_cast<uint32_t>(value));
+    }
+}
+
+/**
+ * @brief Constructor of the class. Sizes the datagram buffer.
+ *
+ * @param sink Destination of the encoded datagrams
+ * @param format NetFlow v9 or IPFIX
+ * @param mtu MTU of the path to the collector, 0 to query it from the sink
+ * @param template_refresh Number of datagrams after which the template is sent again
+ * @param biflow Export both directions of a biflow in one record, NetFlow v9 has no reverse fields
+ */
+TemplateExporter::TemplateExporter(std::unique_ptr<DatagramSink> sink, Config::ExportFormat format,
+                                   int mtu, int template_refresh, bool biflow)
+    : format(format),
+    biflow(biflow && format == Config::ExportFormat::IPFIX),
+    template_id(this->biflow ? BIFLOW_TEMPLATE_ID : TEMPLATE_ID),
+    sink(std::move(sink)),
+    template_refresh(template_refresh),
+    datagrams_since_template(0),
+    template_sent(false),
+    sequence_number(0)
+{
+    if (mtu <= 0) {
+        mtu = this->sink->path_mtu();
+    }
+    max_datagram_size = static_cast<size_t>(mtu) - Config::IP_UDP_HEADER_SIZE;
+
+    // Datagram has to fit at least the header, the template and one record
+    size_t min_size = header_size() + template_set_size() + SET_HEADER_SIZE + record_size() + 3;
+    max_datagram_size = std::max(max_datagram_size, min_size);
+    buffer.resize(max_datagram_size);
+
+    LOG_DEBUG("Template export datagram size: ", max_datagram_size, " bytes, ",
+              max_flows_per_export(), " records per datagram");
+}
+
+/**
+ * @brief Number of records that fit into one datagram together with the template.
+ *
+ * @return Maximum number of flows in one datagram.
+ */
+size_t TemplateExporter::max_flows_per_export() const {
+    size_t space = max_datagram_size - header_size() - template_set_size() - SET_HEADER_SIZE - 3;
+    return std::max<size_t>(1, space / record_size());
+}
+
+/**
+ * @brief Whether the records carry both directions of a biflow.
+ */
+bool TemplateExporter::exports_biflows() const {
+    return biflow;
+}
+
+/**
+ * @brief Pushes out datagrams buffered by the sink.
+ */
+void TemplateExporter::flush() {
+    sink->flush();
+}
+
+/**
+ * @brief Sequence number of the next message, datagrams for v9, data records for IPFIX.
+ *
+ * @return Sequence number
+ */
+uint32_t TemplateExporter::sequence() const {
+    return sequence_number;
+}
+
+/**
+ * @brief Continues the sequence of a previous run.
+ *
+ * @param value Sequence number
+ */
+void TemplateExporter::set_sequence(uint32_t value) {
+    sequence_number = value;
+}
+
+/**
+ * @brief Size of the message header for the selected format.
+ */
+size_t TemplateExporter::header_size() const {
+    return format == Config::ExportFormat::IPFIX ? IPFIX_HEADER_SIZE : V9_HEADER_SIZE;
+}
+
+/**
+ * @brief Size of the whole template set including its set header.
+ */
+size_t TemplateExporter::template_set_size() const {
+    size_t size = SET_HEADER_SIZE + TEMPLATE_HEADER_SIZE + TEMPLATE_FIELD_COUNT * 4;
+    if (biflow) {
+        size += REVERSE_FIELD_COUNT * 8; // Enterprise fields carry the enterprise number
+    }
+    return size;
+}
+
+/**
+ * @brief Size of one data record.
+ */
+size_t TemplateExporter::record_size() const {
+    if (format != Config::ExportFormat::IPFIX) {
+        return V9_RECORD_SIZE;
+    }
+    return biflow ? IPFIX_RECORD_SIZE + REVERSE_RECORD_SIZE : IPFIX_RECORD_SIZE;
+}
+
+/**
+ * @brief Checks wheter the next datagram should carry the template.
+ *
+ * @return true for the first datagram and after every template_refresh datagrams.
+ */
+bool TemplateExporter::template_due() const {
+    return !template_sent || datagrams_since_template >= template_refresh;
+}
+
+/**
+ * @brief Exports all cached flows in the flows vector.
+ * Flows are packed into as few datagrams as the datagram size allows.
+ *
+ * @param flows Vector of flows to be exported
+ * @param time_start Start time of the device
+ * @param time_end Time of the last processed packet
+ *
+ * @return void
+ */
+void TemplateExporter::export_flows(const std::vector<Flow>& flows, uint32_t time_start, uint32_t time_end) {
+    uint8_t* data = buffer.data();
+    size_t next = 0;
+
+    sink->set_capture_time(time_end);
+
+    while (next < flows.size()) {
+        size_t offset = header_size();
+        uint16_t record_count = 0;
+
+        bool with_template = template_due();
+        if (with_template) {
+            format_template_set(offset);
+            record_count++; // v9 counts template records too
+        }
+
+        // Data set header is filled in after the records are written
+        size_t set_start = offset;
+        offset += SET_HEADER_SIZE;
+
+        uint16_t data_records = 0;
+        while (next < flows.size() && offset + record_size() <= max_datagram_size - 3) {
+            format_record(flows[next++], offset, time_start);
+            data_records++;
+        }
+
+        // Pad the set to 32-bit boundary
+        while ((offset - set_start) % 4 != 0) {
+            put_u8(data, offset, 0);
+        }
+
+        size_t set_offset = set_start;
+        put_u16(data, set_offset, template_id);
+        put_u16(data, set_offset, static_cast<uint16_t>(offset - set_start));
+
+        record_count += data_records;
+        format_header(offset, record_count, time_start, time_end);
+
+        if (format == Config::ExportFormat::IPFIX) {
+            sequence_number += data_records;
+        }
+        else {
+            sequence_number++;
+        }
+
+        if (with_template) {
+            template_sent = true;
+            datagrams_since_template = 0;
+        }
+        else {
+            datagrams_since_template++;
+        }
+
+        sink->send(data, offset);
+    }
+}
+
+/**
+ * @brief Sets the message header at the start of the buffer.
+ *
+ * @param length Total length of the datagram
+ * @param record_count Number of template and data records in the datagram (used by v9 only)
+ * @param time_start Start time of the device needed for calculating uptime of the device
+ * @param time_end End time needed for calculating uptime of the device
+ */
+void TemplateExporter::format_header(size_t length, uint16_t record_count, uint32_t time_start, uint32_t time_end) {
+    uint8_t* data = buffer.data();
+    size_t offset = 0;
+
+    struct timespec ts;
+    uint32_t unix_secs = 0; // Defaults to 0 in case of error
+    if (clock_gettime(CLOCK_REALTIME, &ts) == 0) {
+        unix_secs = static_cast<uint32_t>(ts.tv_sec);
+    }
+
+    if (format == Config::ExportFormat::IPFIX) {
+        put_u16(data, offset, VERSION_IPFIX);
+        put_u16(data, offset, static_cast<uint16_t>(length));
+        put_u32(data, offset, unix_secs);           // Export time
+        put_u32(data, offset, sequence_number);     // Data records sent before this message
+        put_u32(data, offset, 0);                   // Observation domain ID
+    }
+    else {
+        put_u16(data, offset, VERSION_9);
+        put_u16(data, offset, record_count);
+        put_u32(data, offset, time_end - time_start); // SysUptime
+        put_u32(data, offset, unix_secs);
+        put_u32(data, offset, sequence_number);     // Export packets sent before this one
+        put_u32(data, offset, 0);                   // Source ID
+    }
+}
+
+/**
+ * @brief Sets the template set describing the data records.
+ *
+ * @param offset Position in the buffer, moved after the template set
+ */
+void TemplateExporter::format_template_set(size_t& offset) {
+    uint8_t* data = buffer.data();
+    uint16_t set_id = format == Config::ExportFormat::IPFIX ? IPFIX_TEMPLATE_SET_ID : V9_TEMPLATE_SET_ID;
+
+    put_u16(data, offset, set_id);
+    put_u16(data, offset, static_cast<uint16_t>(template_set_size()));
+    put_u16(data, offset, template_id);
+    put_u16(data, offset, static_cast<uint16_t>(TEMPLATE_FIELD_COUNT + (biflow ? REVERSE_FIELD_COUNT : 0)));
+    for (const auto& field : format == Config::ExportFormat::IPFIX ? IPFIX_FIELDS : V9_FIELDS) {
+        put_u16(data, offset, field.type);
+        put_u16(data, offset, field.length);
+    }
+    if (biflow) {
+        for (const auto& field : REVERSE_FIELDS) {
+            put_u16(data, offset, ENTERPRISE_BIT | field.type);
+            put_u16(data, offset, field.length);
+            put_u32(data, offset, REVERSE_PEN);
+        }
+    }
+}
+
+/**
+ * @brief Sets one data record in the buffer, fields follow IPFIX_FIELDS and REVERSE_FIELDS for biflows,
+ * or V9_FIELDS.
+ *
+ * @param flow Flow to encode
+ * @param offset Position in the buffer, moved after the record
+ * @param time_start Start time of the device, v9 timestamps are relative to it like in NetFlow v5
+ */
+void TemplateExporter::format_record(const Flow& flow, size_t& offset, uint32_t time_start) {
+    uint8_t* data = buffer.data();
+    const NetFlowV5record& record = flow.record;
+
+    put_u32(data, offset, record.srcaddr);
+    put_u32(data, offset, record.dstaddr);
+    put_u32(data, offset, record.nexthop);
+    put_u16(data, offset, record.srcport);
+    put_u16(data, offset, record.dstport);
+    put_u8(data, offset, record.prot);
+    put_u8(data, offset, record.tcp_flags);
+    put_u8(data, offset, record.tos);
+    put_u64(data, offset, flow.packets);
+    put_u64(data, offset, flow.octets);
+    if (format == Config::ExportFormat::IPFIX) {
+        put_u64(data, offset, flow.first_ms);
+        put_u64(data, offset, flow.last_ms);
+    }
+    else {
+        put_u32(data, offset, static_cast<uint32_t>(flow.first_ms) - time_start);
+        put_u32(data, offset, static_cast<uint32_t>(flow.last_ms) - time_start);
+    }
+    put_u16(data, offset, record.src_as);
+    put_u16(data, offset, record.dst_as);
+    put_u8(data, offset, record.src_mask);
+    put_u8(data, offset, record.dst_mask);
+
+    if (biflow) {
+        put_u8(data, offset, flow.reverse.tcp_flags);
+        put_u64(data, offset, flow.reverse.packets);
+        put_u64(data, offset, flow.reverse.octets);
+        put_u64(data, offset, flow.reverse.first_ms);
+        put_u64(data, offset, flow.reverse.last_ms);
+    }
+}
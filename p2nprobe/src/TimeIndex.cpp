@@ -0,0 +1,241 @@
+////////////////////////////////////////////////////
+// File: TimeIndex.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+
+#include "TimeIndex.h"
+#include "Config.h"
+#include "Logger.h"
+
+namespace {
+    constexpr char INDEX_MAGIC[4] = {'P', '2', 'N', 'I'};
+    constexpr uint16_t INDEX_VERSION = 1;
+
+    struct IndexHeader {
+        char magic[4];
+        uint16_t version;
+        uint16_t reserved;
+        uint32_t block_packets;
+        uint32_t reserved2;
+        uint64_t pcap_size;
+        uint64_t pcap_mtime_ns;
+        uint64_t block_count;
+    };
+
+    static_assert(sizeof(IndexHeader) == 40, "Index header must be 40 bytes");
+}
+
+/**
+ * @brief Opens the pcap file and reads its file header.
+ * The scanner stays invalid for files that are not classic pcap (e.g. pcapng).
+ *
+ * @param path Path of the pcap file
+ */
+TimeIndex::Scanner::Scanner(const std::string& path)
+    : buffer(Config::INDEX_SCAN_BUFFER_SIZE) {
+    file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return;
+    }
+    setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+
+    uint8_t header[PcapFormat::FILE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file) == sizeof(header) && PcapFormat::parse_file_header(header, info)) {
+        return;
+    }
+
+    fclose(file);
+    file = nullptr;
+}
+
+/**
+ * @brief Destructor. Closes the file.
+ */
+TimeIndex::Scanner::~Scanner() {
+    if (file != nullptr) {
+        fclose(file);
+    }
+}
+
+/**
+ * @brief Reads the next record header and seeks over its packet data.
+ *
+ * @param offset Offset of the record in the file
+ * @param timestamp_us Timestamp of the packet in microseconds
+ *
+ * @return false at the end of the file or on a truncated record
+ */
+bool TimeIndex::Scanner::next(uint64_t& offset, int64_t& timestamp_us) {
+    offset = static_cast<uint64_t>(ftello(file));
+
+    uint8_t header[PcapFormat::RECORD_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)) {
+        return false;
+    }
+
+    PcapFormat::Record record = PcapFormat::parse_record_header(header, info);
+    timestamp_us = record.timestamp_us;
+    return fseeko(file, record.caplen, SEEK_CUR) == 0; // Skip captured packet data
+}
+
+/**
+ * @brief Path of the index belonging to the pcap file.
+ */
+std::string TimeIndex::sidecar_path(const std::string& pcap_path) {
+    return pcap_path + Config::INDEX_SUFFIX;
+}
+
+/**
+ * @brief Size and modification time of the pcap file, stored in the index to detect a stale index.
+ */
+bool TimeIndex::pcap_identity(const std::string& pcap_path, uint64_t& size, uint64_t& mtime_ns) {
+    struct stat st;
+    if (stat(pcap_path.c_str(), &st) != 0) {
+        return false;
+    }
+    size = static_cast<uint64_t>(st.st_size);
+    mtime_ns = static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000ULL + st.st_mtim.tv_nsec;
+    return true;
+}
+
+/**
+ * @brief Scans the record headers of the pcap file and writes the index next to it.
+ *
+ * @param pcap_path Path of the pcap file
+ * @param block_packets Packets per index block
+ *
+ * @return false if the file is not a classic pcap file or the index cannot be written
+ */
+bool TimeIndex::build(const std::string& pcap_path, uint32_t block_packets) {
+    Scanner scanner(pcap_path);
+    if (!scanner.valid()) {
+        std::cerr << "Error: Only classic pcap files can be indexed: " << pcap_path << std::endl;
+        return false;
+    }
+
+    std::vector<Block> blocks;
+    uint64_t offset;
+    int64_t timestamp_us;
+    uint64_t packets = 0;
+    while (scanner.next(offset, timestamp_us)) {
+        if (packets++ % block_packets == 0) {
+            blocks.push_back({offset, timestamp_us, timestamp_us});
+        }
+        Block& block = blocks.back();
+        block.min_us = std::min(block.min_us, timestamp_us);
+        block.max_us = std::max(block.max_us, timestamp_us);
+    }
+
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.block_packets = block_packets;
+    header.block_count = blocks.size();
+    if (!pcap_identity(pcap_path, header.pcap_size, header.pcap_mtime_ns)) {
+        std::cerr << "Error: Cannot stat pcap file: " << pcap_path << std::endl;
+        return false;
+    }
+
+    std::string path = sidecar_path(pcap_path);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(blocks.data()), blocks.size() * sizeof(Block));
+    out.close();
+    if (!out) {
+        std::cerr << "Error: Cannot write index file: " << path << std::endl;
+        return false;
+    }
+
+    LOG_INFO("Indexed ", packets, " packets in ", blocks.size(), " blocks to ", path);
+    return true;
+}
+
+/**
+ * @brief Reads the index of the pcap file.
+ *
+ * @return false if there is no index or it does not match the current pcap file
+ */
+bool TimeIndex::load(const std::string& pcap_path, std::vector<Block>& blocks) {
+    std::string path = sidecar_path(pcap_path);
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+
+    IndexHeader header;
+    uint64_t size = 0;
+    uint64_t mtime_ns = 0;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0 || header.version != INDEX_VERSION) {
+        LOG_WARNING("Ignoring invalid index file ", path);
+        return false;
+    }
+    if (!pcap_identity(pcap_path, size, mtime_ns) || size != header.pcap_size || mtime_ns != header.pcap_mtime_ns) {
+        LOG_WARNING("Ignoring stale index file ", path, ", rebuild it with --build-index");
+        return false;
+    }
+
+    blocks.resize(header.block_count);
+    if (!in.read(reinterpret_cast<char*>(blocks.data()), blocks.size() * sizeof(Block))) {
+        LOG_WARNING("Ignoring truncated index file ", path);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Finds the part of the pcap file with packets in [from_us, to_us).
+ * Uses the index when it exists, otherwise scans the record headers up to the first packet of the range.
+ *
+ * @param pcap_path Path of the pcap file
+ * @param from_us Start of the range in microseconds
+ * @param to_us End of the range in microseconds
+ * @param range Found byte range
+ *
+ * @return false if the file cannot be scanned (not a classic pcap), the whole file has to be read then
+ */
+bool TimeIndex::find_range(const std::string& pcap_path, int64_t from_us, int64_t to_us, Range& range) {
+    std::vector<Block> blocks;
+    if (load(pcap_path, blocks)) {
+        // First block that can hold a packet at or after the start
+        auto first = std::find_if(blocks.begin(), blocks.end(),
+                                  [from_us](const Block& block) { return block.max_us >= from_us; });
+        // First later block with all packets at or after the end
+        auto last = std::find_if(first, blocks.end(),
+                                 [to_us](const Block& block) { return block.min_us >= to_us; });
+
+        range.start = first == blocks.end() ? UINT64_MAX : first->offset;
+        range.end = last == blocks.end() ? UINT64_MAX : last->offset;
+        range.exact_end = true;
+        LOG_DEBUG("Index range: offsets ", range.start, " - ", range.end);
+        return true;
+    }
+
+    Scanner scanner(pcap_path);
+    if (!scanner.valid()) {
+        return false;
+    }
+
+    uint64_t offset;
+    int64_t timestamp_us;
+    range.start = UINT64_MAX;
+    while (scanner.next(offset, timestamp_us)) {
+        if (timestamp_us >= from_us) {
+            range.start = offset;
+            break;
+        }
+    }
+    range.end = UINT64_MAX;
+    range.exact_end = false;
+    LOG_DEBUG("Scanned range: offset ", range.start);
+    return true;
+}
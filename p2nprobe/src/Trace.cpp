@@ -0,0 +1,152 @@
+////////////////////////////////////////////////////
+// File: Trace.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+
+#include "Trace.h"
+#include "Logger.h"
+
+bool Trace::events_enabled = false;
+
+namespace {
+    // Guards the registry of thread totals
+    std::mutex threads_mutex;
+
+    // Path of the Chrome trace file, empty when events are not stored
+    std::string output_path;
+
+    // Reference points for converting ticks to time, taken at program start
+    const uint64_t start_ticks = Trace::now();
+    const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief Allocates the totals of the calling thread and adds them to the registry.
+ *
+ * @return Totals of the calling thread.
+ */
+Trace::ThreadTotals* Trace::register_thread() {
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    all_threads().push_back(std::make_unique<ThreadTotals>());
+    all_threads().back()->thread_id = static_cast<uint32_t>(all_threads().size());
+    return all_threads().back().get();
+}
+
+/**
+ * @brief Totals of all threads. Never destroyed, so they can be reported at any point of the exit.
+ *
+ * @return Registry of the thread totals.
+ */
+std::vector<std::unique_ptr<Trace::ThreadTotals>>& Trace::all_threads() {
+    static auto* threads = new std::vector<std::unique_ptr<ThreadTotals>>();
+    return *threads;
+}
+
+/**
+ * @brief Sets the file for the Chrome trace events of the sampled batches.
+ *
+ * @param path Path of the trace file, empty to disable events
+ */
+void Trace::set_output(const std::string& path) {
+    output_path = path;
+    events_enabled = !path.empty();
+}
+
+/**
+ * @brief Name of the stage in the breakdown and in the trace events.
+ */
+const char* Trace::stage_name(Stage stage) {
+    switch (stage) {
+        case Stage::READ:   return "read";
+        case Stage::DECODE: return "decode";
+        case Stage::LOOKUP: return "lookup";
+        case Stage::EXPIRY: return "expiry";
+        case Stage::EXPORT: return "export";
+        default:            return "unknown";
+    }
+}
+
+/**
+ * @brief Prints the per stage breakdown summed over all threads and writes the trace events.
+ * Does nothing when the program was built without tracing.
+ */
+void Trace::report() {
+    if constexpr (!Config::ENABLE_TRACING) {
+        return;
+    }
+
+    // Ticks per microsecond measured over the whole run, the TSC rate is not exposed by the CPU
+    auto elapsed = std::chrono::steady_clock::now() - start_time;
+    double elapsed_us = std::chrono::duration<double, std::micro>(elapsed).count();
+    double ticks_per_us = elapsed_us > 0 ? (now() - start_ticks) / elapsed_us : 1;
+
+    std::array<uint64_t, STAGE_COUNT> cycles{};
+    std::array<uint64_t, STAGE_COUNT> calls{};
+    {
+        std::lock_guard<std::mutex> lock(threads_mutex);
+        for (const auto& totals : all_threads()) {
+            for (size_t i = 0; i < STAGE_COUNT; i++) {
+                cycles[i] += totals->cycles[i];
+                calls[i] += totals->calls[i];
+            }
+        }
+    }
+
+    std::cout << "\nHot path breakdown (" << std::fixed << std::setprecision(0) << ticks_per_us
+              << " ticks/us, nested stages are inclusive):\n";
+    std::cout << "  " << std::left << std::setw(8) << "stage" << std::right
+              << std::setw(12) << "calls" << std::setw(16) << "ticks"
+              << std::setw(12) << "ticks/call" << std::setw(12) << "ms" << "\n";
+    for (size_t i = 0; i < STAGE_COUNT; i++) {
+        std::cout << "  " << std::left << std::setw(8) << stage_name(static_cast<Stage>(i)) << std::right
+                  << std::setw(12) << calls[i] << std::setw(16) << cycles[i]
+                  << std::setw(12) << (calls[i] ? cycles[i] / calls[i] : 0)
+                  << std::setw(12) << std::setprecision(1) << cycles[i] / ticks_per_us / 1000 << "\n";
+    }
+    std::cout << std::defaultfloat << std::setprecision(6);
+
+    if (events_enabled) {
+        write_events(ticks_per_us);
+    }
+}
+
+/**
+ * @brief Writes the stored events in the Chrome trace event format, complete events ("ph":"X")
+ * with timestamps in microseconds since the program start.
+ *
+ * @param ticks_per_us Measured rate of the tick counter
+ */
+void Trace::write_events(double ticks_per_us) {
+    std::ofstream out(output_path);
+    if (!out) {
+        LOG_WARNING("Cannot write trace file: ", output_path);
+        return;
+    }
+
+    out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+    bool first = true;
+    size_t count = 0;
+
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    for (const auto& totals : all_threads()) {
+        for (const Event& event : totals->events) {
+            out << (first ? "\n" : ",\n") << "{\"name\":\"" << stage_name(event.stage)
+                << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << totals->thread_id
+                << ",\"ts\":" << (event.start - start_ticks) / ticks_per_us
+                << ",\"dur\":" << (event.end - event.start) / ticks_per_us << "}";
+            first = false;
+            count++;
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+
+    LOG_INFO("Wrote ", count, " trace events to ", output_path);
+}
@@ -0,0 +1,299 @@
+////////////////////////////////////////////////////
+// File: UdpSender.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <thread>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "UdpSender.h"
+#include "Config.h"
+#include "Logger.h"
+#include "Metrics.h"
+
+/**
+ * @brief Constructor of the class. Initialize socket for connection with collector.
+ *
+ * @param collector_ip IP address of the collector
+ * @param collector_port Port of the collector
+ * @param pacer Rate limits of the export
+ * @param send_buffer Size of SO_SNDBUF in bytes, 0 to size it automatically
+ * @param spool_settings Spool of the datagrams the collector did not get, disabled with an empty path
+ */
+UdpSender::UdpSender(const std::string& collector_ip, int collector_port, const Pacer& pacer, int send_buffer,
+                     const SpoolSettings& spool_settings)
+    : pacer(pacer),
+    recent_count(0) {
+    sock = create_socket();
+    memset(&server_addr, 0, sizeof(server_addr));
+
+    // Try to resolve the host address
+    struct addrinfo hints;
+    struct addrinfo *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET; // for IPv4
+    hints.ai_socktype = SOCK_DGRAM; // UPD for Netflow
+
+    int status = getaddrinfo(collector_ip.c_str(), std::to_string(collector_port).c_str(), &hints, &result);
+    if (status != 0) {
+        std::cerr << "Error resolving host address: " << gai_strerror(status) << std::endl;
+        return;
+    }
+
+    // Set the resolved address
+    server_addr = *(reinterpret_cast<struct sockaddr_in*>(result->ai_addr));
+
+    freeaddrinfo(result); // Clean up
+
+    this->pacer.set_max_datagram_size(static_cast<size_t>(path_mtu()) - Config::IP_UDP_HEADER_SIZE);
+    size_send_buffer(send_buffer);
+
+    if (!spool_settings.path.empty()) {
+        // ICMP errors of the unconnected socket are reported by the next send and queued with
+        // the start of the refused datagram
+        int enable = 1;
+        setsockopt(sock, IPPROTO_IP, IP_RECVERR, &enable, sizeof(enable));
+        recent.resize(Config::SPOOL_RECENT_DATAGRAMS);
+        spool = std::make_unique<Spool>(spool_settings,
+            [this](const uint8_t* buffer, size_t buffer_size) { return transmit(buffer, buffer_size); },
+            [this]() { return collector_reachable(); });
+    }
+}
+
+/**
+ * @brief Destructor. Closes socket.
+ */
+UdpSender::~UdpSender() {
+    if (pacer.enabled()) {
+        LOG_INFO("Export throttled ", pacer.throttled_count(), " times for ",
+                 std::chrono::duration_cast<std::chrono::milliseconds>(pacer.throttled_time()).count(), " ms");
+    }
+    spool.reset(); // The drainer sends through the socket
+    close_socket();
+}
+
+/**
+ * @brief Method for initializing socket for connection with collector.
+ *
+ * @return Socket if was succesfully created.
+ */
+int UdpSender::create_socket() {
+    int sock_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock_fd < 0) {
+        std::cerr << "Error creating socket." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return sock_fd;
+}
+
+/**
+ * @brief Method fo closing the connection.
+ */
+void UdpSender::close_socket() {
+    if (sock >= 0) {
+        close(sock);
+        sock = -1;
+    }
+}
+
+/**
+ * @brief Sets the size of the socket send buffer. The automatic size holds
+ * Config::AUTO_SEND_BUFFER_MS of the paced rate (or the maximum when not paced), so bursts
+ * of datagrams are queued by the kernel instead of blocking the export.
+ * The kernel caps SO_SNDBUF by net.core.wmem_max, SO_SNDBUFFORCE is tried when privileged.
+ *
+ * @param send_buffer Requested size in bytes, 0 for the automatic size
+ */
+void UdpSender::size_send_buffer(int send_buffer) {
+    if (send_buffer <= 0) {
+        double bytes_per_second = pacer.bytes_per_second();
+        if (bytes_per_second > 0) {
+            send_buffer = static_cast<int>(std::min<double>(bytes_per_second * Config::AUTO_SEND_BUFFER_MS / 1000,
+                                                            Config::AUTO_SEND_BUFFER_MAX));
+        }
+        else {
+            send_buffer = Config::AUTO_SEND_BUFFER_MAX;
+        }
+        send_buffer = std::max(send_buffer, Config::AUTO_SEND_BUFFER_MIN);
+    }
+
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &send_buffer, sizeof(send_buffer));
+
+    int actual = 0;
+    socklen_t len = sizeof(actual);
+    getsockopt(sock, SOL_SOCKET, SO_SNDBUF, &actual, &len);
+    if (actual / 2 < send_buffer) { // Kernel reports the doubled value
+        if (setsockopt(sock, SOL_SOCKET, SO_SNDBUFFORCE, &send_buffer, sizeof(send_buffer)) == 0) {
+            getsockopt(sock, SOL_SOCKET, SO_SNDBUF, &actual, &len);
+        }
+    }
+    LOG_DEBUG("Socket send buffer requested ", send_buffer, " bytes, got ", actual / 2, " bytes");
+}
+
+/**
+ * @brief Passes the capture time of the export to the pacer, which may wait for the wall time to catch up.
+ *
+ * @param capture_ms Capture timestamp in miliseconds
+ */
+void UdpSender::set_capture_time(uint32_t capture_ms) {
+    pacer.sync_capture_time(capture_ms);
+}
+
+/**
+ * @brief Sends the UDP datagram stored in buffer to the collector.
+ *
+ * @param buffer Data to export
+ * @param buffer_size Size of the data
+ */
+void UdpSender::send(const uint8_t* buffer, size_t buffer_size) {
+    if (buffer_size == 0) {
+        return;
+    }
+
+    // Datagrams are not sent ahead of the spooled ones
+    if (spool && spool->offer(buffer, buffer_size)) {
+        return;
+    }
+
+    pacer.acquire(buffer_size);
+
+    ssize_t sent = sendto(sock, buffer, buffer_size, 0, (struct sockaddr*)&server_addr, sizeof(server_addr));
+    if (sent < 0) {
+        Metrics::add(Metrics::Counter::SEND_ERRORS);
+        if (spool) {
+            spool_refused();
+            spool->append(buffer, buffer_size);
+            return;
+        }
+        std::cerr << "Error occurred when sending flow. Program continues." << std::endl;
+        return;
+    }
+    if (spool) {
+        recent[recent_count++ % recent.size()].assign(buffer, buffer + buffer_size);
+    }
+    Metrics::add(Metrics::Counter::DATAGRAMS_SENT);
+}
+
+/**
+ * @brief Sends one spooled datagram, called by the drainer of the spool.
+ *
+ * @return false if the send failed, the collector refused this or an earlier datagram
+ */
+bool UdpSender::transmit(const uint8_t* buffer, size_t buffer_size) {
+    ssize_t sent = sendto(sock, buffer, buffer_size, 0, (struct sockaddr*)&server_addr, sizeof(server_addr));
+    if (sent < 0) {
+        collector_reachable(); // Clears the queued errors, the spool replays the datagrams itself
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Takes the pending error of the socket and empties the error queue.
+ *
+ * @return false if the collector refused a datagram since the last check
+ */
+bool UdpSender::collector_reachable() {
+    int error = 0;
+    socklen_t len = sizeof(error);
+    getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &len);
+
+    uint8_t quote[Config::FALLBACK_EXPORT_MTU];
+    bool queued = false;
+    while (recv(sock, quote, sizeof(quote), MSG_ERRQUEUE | MSG_DONTWAIT) >= 0) {
+        queued = true;
+    }
+    return error == 0 && !queued;
+}
+
+/**
+ * @brief Spools the recently sent datagrams the collector refused. Each queued ICMP error quotes
+ * the start of its datagram, which is matched against the copies of the last sent datagrams.
+ * Datagrams refused earlier than the kept copies are lost.
+ */
+void UdpSender::spool_refused() {
+    std::vector<bool> refused(recent.size(), false);
+    uint8_t quote[Config::FALLBACK_EXPORT_MTU];
+    ssize_t quoted;
+    while ((quoted = recv(sock, quote, sizeof(quote), MSG_ERRQUEUE | MSG_DONTWAIT)) >= 0) {
+        for (size_t i = 0; i < recent.size(); i++) {
+            const std::vector<uint8_t>& datagram = recent[i];
+            if (!datagram.empty() && datagram.size() >= static_cast<size_t>(quoted) &&
+                memcmp(datagram.data(), quote, quoted) == 0) {
+                refused[i] = true;
+                break;
+            }
+        }
+    }
+
+    // Oldest first, so the collector gets them in the order they were exported
+    uint64_t first = recent_count > recent.size() ? recent_count - recent.size() : 0;
+    for (uint64_t n = first; n < recent_count; n++) {
+        size_t slot = n % recent.size();
+        if (refused[slot]) {
+            spool->append(recent[slot].data(), recent[slot].size());
+        }
+    }
+    for (std::vector<uint8_t>& datagram : recent) {
+        datagram.clear();
+    }
+}
+
+/**
+ * @brief End of the export, refused datagrams are spooled and the spool gets a short time
+ * to replay, the rest stays in the spool file for the next run.
+ */
+void UdpSender::flush() {
+    if (!spool) {
+        return;
+    }
+    if (!spool->active()) {
+        // Errors of the last datagrams are not reported by any further send
+        std::this_thread::sleep_for(std::chrono::milliseconds(Config::SPOOL_CONFIRM_MS));
+        int error = 0;
+        socklen_t len = sizeof(error);
+        getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &len);
+        if (error != 0) {
+            spool_refused();
+        }
+    }
+    spool->wait_drained(std::chrono::milliseconds(Config::SPOOL_EXIT_WAIT_MS));
+}
+
+/**
+ * @brief Queries the kernel for the path MTU towards the collector.
+ * The main socket stays unconnected, so a temporary connected socket is used only for the query,
+ * otherwise ICMP port unreachable from a missing collector would turn into send errors.
+ *
+ * @return Path MTU in bytes, Config::FALLBACK_EXPORT_MTU if it cannot be determined.
+ */
+int UdpSender::path_mtu() const {
+    int probe = socket(AF_INET, SOCK_DGRAM, 0);
+    if (probe < 0) {
+        return Config::FALLBACK_EXPORT_MTU;
+    }
+
+    int mtu = Config::FALLBACK_EXPORT_MTU;
+    if (connect(probe, reinterpret_cast<const struct sockaddr*>(&server_addr), sizeof(server_addr)) == 0) {
+        int value = 0;
+        socklen_t len = sizeof(value);
+        if (getsockopt(probe, IPPROTO_IP, IP_MTU, &value, &len) == 0 && value > 0) {
+            mtu = value;
+        }
+    }
+    close(probe);
+
+    if (mtu > Config::MAX_EXPORT_MTU) {
+        mtu = Config::MAX_EXPORT_MTU;
+    }
+    return mtu;
+}
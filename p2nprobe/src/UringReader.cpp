@@ -0,0 +1,359 @@
+////////////////////////////////////////////////////
+// File: UringReader.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "UringReader.h"
+#include "Config.h"
+#include "Logger.h"
+
+namespace {
+    int uring_setup(unsigned entries, struct io_uring_params* params) {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    size_t align_up(size_t value) {
+        return (value + Config::URING_ALIGNMENT - 1) & ~(Config::URING_ALIGNMENT - 1);
+    }
+
+    static_assert(Config::URING_BUFFER_SIZE % Config::URING_ALIGNMENT == 0,
+                  "io_uring buffer size must be a multiple of the alignment");
+}
+
+/**
+ * @brief Constructor of the reader, the file is opened by start.
+ *
+ * @param path Path of the capture
+ * @param direct Read with O_DIRECT, bypassing the page cache
+ */
+UringReader::UringReader(const std::string& path, bool direct)
+    : path(path), direct(direct) {}
+
+/**
+ * @brief Destructor. Waits for the reads in flight, the kernel still writes into their buffers.
+ */
+UringReader::~UringReader() {
+    if (ring_fd >= 0) {
+        while (std::any_of(buffers.begin(), buffers.end(), [](const Buffer& buffer) { return buffer.pending; })) {
+            if (!reap(true)) {
+                break;
+            }
+        }
+        if (sqes != nullptr) {
+            munmap(sqes, sqes_size);
+        }
+        if (cq_ring != nullptr && cq_ring != sq_ring) {
+            munmap(cq_ring, cq_ring_size);
+        }
+        if (sq_ring != nullptr) {
+            munmap(sq_ring, sq_ring_size);
+        }
+        close(ring_fd);
+    }
+    for (Buffer& buffer : buffers) {
+        free(buffer.data);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+/**
+ * @brief Stores the error, the reader reports it when the data runs out.
+ *
+ * @return false
+ */
+bool UringReader::fail(const std::string& message) {
+    if (error_message.empty()) {
+        error_message = message;
+    }
+    return false;
+}
+
+/**
+ * @brief Whether reading stopped on an error.
+ */
+bool UringReader::failed() const {
+    return !error_message.empty();
+}
+
+/**
+ * @brief Error of the reading.
+ */
+std::string UringReader::error() const {
+    return error_message;
+}
+
+/**
+ * @brief Creates the ring and maps its submission and completion queues.
+ *
+ * @return false if io_uring is not available (old kernel, disabled by seccomp or sysctl)
+ */
+bool UringReader::setup_ring() {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring_fd = uring_setup(Config::URING_BUFFERS, &params);
+    if (ring_fd < 0) {
+        return fail(std::string("io_uring_setup: ") + strerror(errno));
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        sq_ring = nullptr;
+        return fail(std::string("cannot map submission queue: ") + strerror(errno));
+    }
+    cq_ring = single_mmap ? sq_ring
+                          : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                                 IORING_OFF_CQ_RING);
+    if (cq_ring == MAP_FAILED) {
+        cq_ring = nullptr;
+        return fail(std::string("cannot map completion queue: ") + strerror(errno));
+    }
+    sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes_mapping = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                              IORING_OFF_SQES);
+    if (sqes_mapping == MAP_FAILED) {
+        return fail(std::string("cannot map submission entries: ") + strerror(errno));
+    }
+    sqes = static_cast<struct io_uring_sqe*>(sqes_mapping);
+
+    uint8_t* sq = static_cast<uint8_t*>(sq_ring);
+    uint8_t* cq = static_cast<uint8_t*>(cq_ring);
+    sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+/**
+ * @brief Opens the file, sets up the ring and submits the first reads.
+ *
+ * @return false if the file cannot be opened or io_uring is not available
+ */
+bool UringReader::start() {
+    if (direct) {
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+        if (fd < 0 && errno == EINVAL) {
+            LOG_WARNING("O_DIRECT is not supported for ", path, ", reading through the page cache");
+            direct = false;
+        }
+    }
+    if (fd < 0) {
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        return fail(std::string("cannot open file: ") + strerror(errno));
+    }
+    file_size = static_cast<uint64_t>(st.st_size);
+
+    if (!setup_ring()) {
+        return false;
+    }
+
+    buffers.resize(Config::URING_BUFFERS);
+    for (Buffer& buffer : buffers) {
+        void* data = nullptr;
+        if (posix_memalign(&data, Config::URING_ALIGNMENT, Config::URING_BUFFER_SIZE) != 0) {
+            return fail("cannot allocate read buffers");
+        }
+        buffer.data = static_cast<uint8_t*>(data);
+    }
+
+    start_time = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < buffers.size(); i++) {
+        if (!schedule(i)) {
+            return false;
+        }
+    }
+    LOG_INFO("Reading ", path, " with io_uring", direct ? " (O_DIRECT)" : "", ", ",
+             buffers.size(), " reads of ", Config::URING_BUFFER_SIZE / 1024, " KiB in flight");
+    return true;
+}
+
+/**
+ * @brief Assigns the next chunk of the file to the buffer and submits its read.
+ *
+ * @param index Index of the free buffer
+ */
+bool UringReader::schedule(unsigned index) {
+    Buffer& buffer = buffers[index];
+    buffer.offset = next_chunk * Config::URING_BUFFER_SIZE;
+    buffer.filled = 0;
+    if (buffer.offset >= file_size) {
+        buffer.expected = 0;
+        return true;
+    }
+    buffer.expected = static_cast<size_t>(std::min<uint64_t>(Config::URING_BUFFER_SIZE, file_size - buffer.offset));
+    next_chunk++;
+    return submit(index);
+}
+
+/**
+ * @brief Submits the read of the rest of the buffer's chunk.
+ *
+ * @param index Index of the buffer, used as the user data of the request
+ */
+bool UringReader::submit(unsigned index) {
+    Buffer& buffer = buffers[index];
+    size_t length = buffer.expected - buffer.filled;
+    if (direct) { // The last chunk is read whole, the read ends at the end of the file
+        length = std::min(align_up(length), Config::URING_BUFFER_SIZE - buffer.filled);
+    }
+    buffer.iov.iov_base = buffer.data + buffer.filled;
+    buffer.iov.iov_len = length;
+
+    unsigned tail = *sq_tail;
+    unsigned slot = tail & *sq_mask;
+    struct io_uring_sqe& sqe = sqes[slot];
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READV;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<uint64_t>(&buffer.iov);
+    sqe.len = 1;
+    sqe.off = buffer.offset + buffer.filled;
+    sqe.user_data = index;
+    sq_array[slot] = slot;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    int submitted;
+    do {
+        submitted = uring_enter(ring_fd, 1, 0, 0);
+    } while (submitted < 0 && errno == EINTR);
+    if (submitted < 0) {
+        return fail(std::string("io_uring_enter: ") + strerror(errno));
+    }
+    buffer.pending = true;
+    return true;
+}
+
+/**
+ * @brief Processes the completed reads, short reads are continued.
+ *
+ * @param block Wait for at least one completion
+ *
+ * @return false on a read error
+ */
+bool UringReader::reap(bool block) {
+    if (block) {
+        int result = uring_enter(ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+        if (result < 0 && errno != EINTR) {
+            return fail(std::string("io_uring_enter: ") + strerror(errno));
+        }
+    }
+
+    bool ok = true;
+    unsigned head = *cq_head;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        const struct io_uring_cqe& cqe = cqes[head & *cq_mask];
+        Buffer& buffer = buffers[cqe.user_data];
+        buffer.pending = false;
+        if (cqe.res < 0) {
+            ok = fail(std::string("read failed: ") + strerror(-cqe.res));
+            continue;
+        }
+        if (cqe.res == 0 && buffer.filled < buffer.expected) {
+            ok = fail("file was truncated while reading");
+            continue;
+        }
+        size_t length = std::min(static_cast<size_t>(cqe.res), buffer.expected - buffer.filled);
+        buffer.filled += length;
+        bytes_read += length;
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    if (!ok) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < buffers.size(); i++) {
+        if (!buffers[i].pending && buffers[i].filled < buffers[i].expected && !submit(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Waits until the buffer holds its whole chunk.
+ */
+bool UringReader::wait(unsigned index) {
+    const Buffer& buffer = buffers[index];
+    bool block = false;
+    while (buffer.pending || buffer.filled < buffer.expected) {
+        if (!reap(block)) {
+            return false;
+        }
+        block = true;
+    }
+    return true;
+}
+
+/**
+ * @brief Hands the parsed buffer back for the read of a later chunk and waits for the next chunk.
+ */
+bool UringReader::next_block(const uint8_t*& data, size_t& size) {
+    if (!error_message.empty()) {
+        return false;
+    }
+    if (holding) {
+        unsigned index = static_cast<unsigned>(current_chunk % buffers.size());
+        current_chunk++;
+        holding = false;
+        if (!schedule(index)) {
+            return false;
+        }
+    }
+    if (current_chunk * Config::URING_BUFFER_SIZE >= file_size) {
+        report();
+        return false;
+    }
+
+    unsigned index = static_cast<unsigned>(current_chunk % buffers.size());
+    if (!wait(index)) {
+        return false;
+    }
+    data = buffers[index].data;
+    size = buffers[index].filled;
+    holding = true;
+    return true;
+}
+
+/**
+ * @brief Logs the throughput achieved from the start of reading to the end of the file.
+ */
+void UringReader::report() {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    double gigabytes = static_cast<double>(bytes_read) / 1e9;
+    LOG_INFO("Read ", bytes_read / (1024 * 1024), " MiB with io_uring in ", static_cast<uint64_t>(seconds * 1000),
+             " ms (", seconds > 0 ? gigabytes / seconds : 0.0, " GB/s)");
+}
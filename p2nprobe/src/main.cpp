@@ -10,8 +10,14 @@
 #include <chrono>
 
 #include "ErrorCodes.h"
+#include "Logger.h"
 #include "ArgParser.h"
 #include "FlowManager.h"
+#include "Metrics.h"
+#include "MetricsReporter.h"
+#include "ShmRing.h"
+#include "Trace.h"
+#include "TimeIndex.h"
 
 /**
  * @brief Print program banner with version info
@@ -24,16 +30,73 @@ void printBanner() {
     std::cout << "====================================\n\n";
 }
 
+/**
+ * @brief Name of the export format for the configuration summary
+ */
+const char* exportFormatName(Config::ExportFormat format) {
+    switch (format) {
+        case Config::ExportFormat::NETFLOW_V9: return "NetFlow v9";
+        case Config::ExportFormat::IPFIX:      return "IPFIX";
+        case Config::ExportFormat::ARROW:      return "Apache Arrow IPC";
+        default:                               return "NetFlow v5";
+    }
+}
+
 /**
  * @brief Print processing statistics
  */
-void printStats(int result, const std::chrono::high_resolution_clock::time_point& start_time) {
+void printStats(int result, const std::chrono::high_resolution_clock::time_point& start_time, const FlowManager& manager) {
     auto end_time = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
 
     std::cout << "\n====================================\n";
     std::cout << "Processing completed in " << duration.count() << " ms\n";
 
+    Metrics::Snapshot metrics = Metrics::snapshot();
+    auto counter = [&metrics](Metrics::Counter c) { return metrics.counters[static_cast<size_t>(c)]; };
+    std::cout << "Packets read: " << counter(Metrics::Counter::PACKETS_READ)
+              << " (decoded " << counter(Metrics::Counter::PACKETS_DECODED)
+              << ", not TCP " << counter(Metrics::Counter::REJECTED_NOT_TCP)
+              << ", truncated " << counter(Metrics::Counter::REJECTED_TRUNCATED)
+              << ", bad IP header " << counter(Metrics::Counter::REJECTED_BAD_IP_HEADER);
+    if (counter(Metrics::Counter::PACKETS_DUPLICATE) + counter(Metrics::Counter::DEDUP_EVICTIONS) > 0) {
+        std::cout << ", duplicate " << counter(Metrics::Counter::PACKETS_DUPLICATE)
+                  << ", dedup evictions " << counter(Metrics::Counter::DEDUP_EVICTIONS);
+    }
+    std::cout << ")\n";
+    std::cout << "Flows created: " << manager.get_flow_count();
+    if (counter(Metrics::Counter::FLOWS_PROMOTED) > 0) {
+        std::cout << " (promoted from probation " << counter(Metrics::Counter::FLOWS_PROMOTED) << ")";
+    }
+    if (counter(Metrics::Counter::FLOWS_SPILLED) > 0) {
+        std::cout << " (spilled " << counter(Metrics::Counter::FLOWS_SPILLED)
+                  << ", paged in " << counter(Metrics::Counter::FLOWS_PAGED_IN) << ")";
+    }
+    std::cout << ", exported: " << manager.get_flows_exported()
+              << " (active " << counter(Metrics::Counter::FLOWS_EXPIRED_ACTIVE)
+              << ", inactive " << counter(Metrics::Counter::FLOWS_EXPIRED_INACTIVE)
+              << ", forced " << counter(Metrics::Counter::FLOWS_EXPIRED_FORCED);
+    if (counter(Metrics::Counter::FLOWS_ENDED_FIN) + counter(Metrics::Counter::FLOWS_ENDED_RST) > 0) {
+        std::cout << ", fin " << counter(Metrics::Counter::FLOWS_ENDED_FIN)
+                  << ", rst " << counter(Metrics::Counter::FLOWS_ENDED_RST);
+    }
+    std::cout << ")\n";
+    std::cout << "Datagrams sent: " << counter(Metrics::Counter::DATAGRAMS_SENT)
+              << ", send errors: " << counter(Metrics::Counter::SEND_ERRORS);
+    if (counter(Metrics::Counter::DATAGRAMS_SPOOLED) > 0) {
+        std::cout << ", spooled: " << counter(Metrics::Counter::DATAGRAMS_SPOOLED)
+                  << " (replayed " << counter(Metrics::Counter::DATAGRAMS_REPLAYED)
+                  << ", overflows " << counter(Metrics::Counter::SPOOL_OVERFLOWS) << ")";
+    }
+    if (counter(Metrics::Counter::EXPORT_THROTTLES) > 0) {
+        std::cout << ", throttled: " << counter(Metrics::Counter::EXPORT_THROTTLES)
+                  << " times (" << counter(Metrics::Counter::EXPORT_THROTTLED_US) / 1000 << " ms)";
+    }
+    if (counter(Metrics::Counter::SHM_RING_FULL) > 0) {
+        std::cout << ", waits for the ring reader: " << counter(Metrics::Counter::SHM_RING_FULL);
+    }
+    std::cout << "\n";
+
     if (result == -1) {
         std::cout << "Status: ERROR - Packet reading failed\n";
     } else if (result == -2) {
@@ -54,34 +117,85 @@ void printStats(int result, const std::chrono::high_resolution_clock::time_point
 int main(int argc, char* argv[]) {
     printBanner();
 
+    // Before any thread is started, so SIGUSR1 reaches only the metrics reporter
+    MetricsReporter::block_signals();
+
     auto start_time = std::chrono::high_resolution_clock::now();
 
     try {
         // Parse command line arguments
         ArgParser programArguments(argc, argv);
 
+        if (programArguments.getBuildIndex()) {
+            std::cout << "Building time index of " << programArguments.getPCAPFilePath() << "...\n";
+            if (!TimeIndex::build(programArguments.getPCAPFilePath(), programArguments.getIndexInterval())) {
+                Logger::flush();
+                return 1;
+            }
+            std::cout << "Index written to " << TimeIndex::sidecar_path(programArguments.getPCAPFilePath()) << "\n";
+            return 0;
+        }
+
         std::cout << "Configuration:\n";
-        std::cout << "  Collector: " << programArguments.getHost() << ":" << programArguments.getPort() << "\n";
+        if (!programArguments.getShmName().empty()) {
+            std::cout << "  Shared memory ring: " << ShmRing::segment_name(programArguments.getShmName())
+                      << " (" << (programArguments.getShmSize() >> 20) << " MiB)\n";
+        }
+        else if (programArguments.getOutputPath().empty()) {
+            std::cout << "  Collector: " << programArguments.getHost() << ":" << programArguments.getPort() << "\n";
+        }
+        else {
+            std::cout << "  Output file: " << programArguments.getOutputPath() << "\n";
+        }
         std::cout << "  PCAP file: " << programArguments.getPCAPFilePath() << "\n";
         std::cout << "  Active timeout: " << programArguments.getActiveTimeout() << "s\n";
-        std::cout << "  Inactive timeout: " << programArguments.getInactiveTimeout() << "s\n\n";
+        std::cout << "  Inactive timeout: " << programArguments.getInactiveTimeout() << "s\n";
+        std::cout << "  Export format: " << exportFormatName(programArguments.getExportFormat()) << "\n";
+        if (programArguments.getThreads() > 1) {
+            std::cout << "  Threads: " << programArguments.getThreads() << "\n";
+        }
+        if (programArguments.getBiflow()) {
+            std::cout << "  Biflow: yes\n";
+        }
+        if (!programArguments.getFlowSpillPath().empty()) {
+            std::cout << "  Flow spill file: " << programArguments.getFlowSpillPath()
+                      << " (" << programArguments.getHotFlows() << " flows in memory)\n";
+        }
+        if (programArguments.getAdmission()) {
+            std::cout << "  Flow admission: yes\n";
+        }
+        if (programArguments.getDedup()) {
+            std::cout << "  Duplicate suppression: yes (window " << programArguments.getDedupWindow() << " ms)\n";
+        }
+        if (programArguments.getTcpEnd()) {
+            std::cout << "  TCP termination: yes (FIN linger " << programArguments.getFinLinger() << " ms)\n";
+        }
+        std::cout << "\n";
 
         std::cout << "Starting packet processing...\n";
 
+        Trace::set_output(programArguments.getTracePath());
+        MetricsReporter reporter(programArguments.getStatsInterval(), programArguments.getPrometheusPort());
+
         // Create the flow manager and start processing the packets
         FlowManager manager(programArguments);
 
         // Error while reading packet results in -1 and program termination
         int result = manager.startProcessing();
 
-        std::cout << "Exporting remaining flows...\n";
+        std::cout << (programArguments.getCheckpointPath().empty() ? "Exporting remaining flows...\n"
+                                                                   : "Saving remaining flows to checkpoint...\n");
         // After all packets are processed and aggregated, export the remaining flows
         manager.export_remaining();
 
         // Cleanup
         manager.dispose();
+        reporter.stop();
 
-        printStats(result, start_time);
+        // Log lines of the run come before the summary
+        Logger::flush();
+        printStats(result, start_time, manager);
+        Trace::report();
 
         if (result == -1) {
             std::cerr << "Error: Failed to read packet from PCAP file.\n";
@@ -91,9 +205,11 @@ int main(int argc, char* argv[]) {
         return 0; // Success
 
     } catch (const std::exception& e) {
+        Logger::flush();
         std::cerr << "Fatal error: " << e.what() << std::endl;
         return 1;
     } catch (...) {
+        Logger::flush();
         std::cerr << "Fatal error: Unknown exception occurred" << std::endl;
         return 1;
     }
@@ -0,0 +1,474 @@
+////////////////////////////////////////////////////
+// File: netflowcollector.cpp
+// Pcap Netflow v5 Exporter
+// Author: Michal Balogh, xbalog06
+// Date: 14.10.2024
+////////////////////////////////////////////////////
+
+// NetFlow v5 collector for end-to-end tests at full export speed, the C++ counterpart of
+// netflowcollector.py. Datagrams are received in batches with recvmmsg into a large socket buffer,
+// headers are validated, flow_sequence gaps are counted per exporter and the records are summed.
+// Drops of the collector socket itself are read from SO_RXQ_OVFL and /proc/net/udp, so flows lost
+// by the exporter (sequence gaps) can be told apart from flows lost by the collector (socket drops).
+// Datagrams lost at the end of the export leave no gap, --expect compares with the flow count
+// printed by p2nprobe.
+//
+// Usage: ./netflowcollector [-p <port>] [-b <address>] [-t <idle_timeout_s>] [--rcvbuf <bytes>]
+//                           [--dump <file>] [--expect <flows>]
+// Exit status is 1 when flows were lost, 0 otherwise.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "Config.h"
+
+namespace {
+    constexpr int DEFAULT_PORT = 9995;
+    constexpr int DEFAULT_IDLE_TIMEOUT = 5;             // seconds without a datagram, 0 runs until SIGINT
+    constexpr int DEFAULT_RECEIVE_BUFFER = 64 * 1024 * 1024;
+    constexpr unsigned BATCH_SIZE = 64;                 // datagrams of one recvmmsg
+    constexpr size_t DATAGRAM_SIZE = 65536;
+    constexpr size_t CONTROL_SIZE = 64;                 // ancillary data, only the SO_RXQ_OVFL counter
+
+    std::atomic<bool> stop_requested{false};
+
+    uint16_t get_u16(const uint8_t* buffer) {
+        uint16_t value;
+        memcpy(&value, buffer, sizeof(value));
+        return ntohs(value);
+    }
+
+    uint32_t get_u32(const uint8_t* buffer) {
+        uint32_t value;
+        memcpy(&value, buffer, sizeof(value));
+        return ntohl(value);
+    }
+
+    std::string address(const uint8_t* buffer) {
+        char text[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, buffer, text, sizeof(text));
+        return text;
+    }
+
+    /**
+     * @brief Options of the collector.
+     */
+    struct Options {
+        std::string bind_address = "127.0.0.1";
+        int port = DEFAULT_PORT;
+        int idle_timeout = DEFAULT_IDLE_TIMEOUT;
+        int receive_buffer = DEFAULT_RECEIVE_BUFFER;
+        std::string dump_path;
+        long long expected_flows = -1;  // Flows the exporter sent, negative when unknown
+    };
+
+    /**
+     * @brief Sequence state of one exporter, identified by its address, port, engine type and engine id.
+     */
+    struct Stream {
+        uint32_t next_sequence = 0;     // flow_sequence expected in the next datagram
+        uint64_t lost_flows = 0;        // Flows skipped by sequence gaps
+        uint64_t gaps = 0;
+        uint64_t reordered = 0;         // Datagrams with a sequence lower than expected
+    };
+
+    /**
+     * @brief Totals of the collection.
+     */
+    struct Totals {
+        uint64_t datagrams = 0;
+        uint64_t bytes = 0;
+        uint64_t invalid = 0;           // Not v5, wrong count or size
+        uint64_t flows = 0;
+        uint64_t packets = 0;
+        uint64_t octets = 0;
+        uint32_t socket_drops = 0;      // SO_RXQ_OVFL, datagrams dropped by a full socket buffer
+    };
+
+    /**
+     * @brief Receives and checks the export datagrams.
+     */
+    class Collector {
+    public:
+        explicit Collector(const Options& options) : options(options) {}
+        ~Collector() {
+            if (sock >= 0) {
+                close(sock);
+            }
+        }
+
+        bool open_socket();
+        void run();
+        int report() const;
+
+    private:
+        void process(const uint8_t* datagram, size_t size, const struct sockaddr_in& source);
+        void dump_record(const uint8_t* record);
+        uint32_t proc_drops() const;
+
+        Options options;
+        int sock = -1;
+        std::ofstream dump;
+        std::unordered_map<uint64_t, Stream> streams;
+        Totals totals;
+        std::chrono::steady_clock::time_point first_datagram;
+        std::chrono::steady_clock::time_point last_datagram;
+    };
+
+    /**
+     * @brief Opens the UDP socket, sizes its receive buffer and enables the drop counter.
+     * SO_RCVBUFFORCE exceeds net.core.rmem_max but needs CAP_NET_ADMIN, SO_RCVBUF is the fallback.
+     *
+     * @return true if the socket is ready
+     */
+    bool Collector::open_socket() {
+        sock = socket(AF_INET, SOCK_DGRAM, 0);
+        if (sock < 0) {
+            std::cerr << "Error: Cannot create socket: " << strerror(errno) << "\n";
+            return false;
+        }
+
+        int size = options.receive_buffer;
+        if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) != 0) {
+            setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        }
+        int actual = 0;
+        socklen_t length = sizeof(actual);
+        getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &actual, &length);
+        if (actual / 2 < options.receive_buffer) {
+            std::cerr << "Warning: Receive buffer is " << actual / 2 << " bytes, raise net.core.rmem_max for "
+                      << options.receive_buffer << "\n";
+        }
+
+        int enable = 1;
+        setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+
+        // Idle timeout is checked between batches
+        struct timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 200 * 1000;
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(options.port));
+        if (inet_pton(AF_INET, options.bind_address.c_str(), &address.sin_addr) != 1) {
+            std::cerr << "Error: Invalid bind address '" << options.bind_address << "'.\n";
+            return false;
+        }
+        if (bind(sock, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+            std::cerr << "Error: Cannot bind " << options.bind_address << ":" << options.port << ": "
+                      << strerror(errno) << "\n";
+            return false;
+        }
+
+        if (!options.dump_path.empty()) {
+            dump.open(options.dump_path);
+            if (!dump) {
+                std::cerr << "Error: Cannot open dump file '" << options.dump_path << "'.\n";
+                return false;
+            }
+            dump << "src,dst,nexthop,src_port,dst_port,protocol,tcp_flags,tos,packets,octets,first,last,"
+                    "src_as,dst_as,src_mask,dst_mask\n";
+        }
+        return true;
+    }
+
+    /**
+     * @brief Receives datagrams until the idle timeout passes after the last one or SIGINT arrives.
+     */
+    void Collector::run() {
+        std::vector<uint8_t> buffers(BATCH_SIZE * DATAGRAM_SIZE);
+        std::vector<uint8_t> controls(BATCH_SIZE * CONTROL_SIZE);
+        std::vector<struct mmsghdr> messages(BATCH_SIZE);
+        std::vector<struct iovec> vectors(BATCH_SIZE);
+        std::vector<struct sockaddr_in> sources(BATCH_SIZE);
+
+        auto idle_since = std::chrono::steady_clock::now();
+        while (!stop_requested.load(std::memory_order_relaxed)) {
+            for (unsigned i = 0; i < BATCH_SIZE; i++) {
+                vectors[i].iov_base = &buffers[i * DATAGRAM_SIZE];
+                vectors[i].iov_len = DATAGRAM_SIZE;
+                memset(&messages[i].msg_hdr, 0, sizeof(messages[i].msg_hdr));
+                messages[i].msg_hdr.msg_iov = &vectors[i];
+                messages[i].msg_hdr.msg_iovlen = 1;
+                messages[i].msg_hdr.msg_name = &sources[i];
+                messages[i].msg_hdr.msg_namelen = sizeof(sources[i]);
+                messages[i].msg_hdr.msg_control = &controls[i * CONTROL_SIZE];
+                messages[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+            }
+
+            // Blocks for the first datagram, then takes what is queued without waiting
+            int received = recvmmsg(sock, messages.data(), BATCH_SIZE, MSG_WAITFORONE, nullptr);
+            auto now = std::chrono::steady_clock::now();
+            if (received <= 0) {
+                if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    std::cerr << "Error: recvmmsg failed: " << strerror(errno) << "\n";
+                    return;
+                }
+                if (options.idle_timeout > 0 && now - idle_since >= std::chrono::seconds(options.idle_timeout)) {
+                    return;
+                }
+                continue;
+            }
+
+            if (totals.datagrams == 0) {
+                first_datagram = now;
+            }
+            last_datagram = now;
+            idle_since = now;
+            for (int i = 0; i < received; i++) {
+                struct msghdr& header = messages[i].msg_hdr;
+                for (struct cmsghdr* control = CMSG_FIRSTHDR(&header); control != nullptr;
+                     control = CMSG_NXTHDR(&header, control)) {
+                    if (control->cmsg_level == SOL_SOCKET && control->cmsg_type == SO_RXQ_OVFL) {
+                        uint32_t drops;
+                        memcpy(&drops, CMSG_DATA(control), sizeof(drops));
+                        totals.socket_drops = std::max(totals.socket_drops, drops);
+                    }
+                }
+                process(&buffers[i * DATAGRAM_SIZE], messages[i].msg_len, sources[i]);
+            }
+        }
+    }
+
+    /**
+     * @brief Validates one datagram, follows the sequence of its exporter and sums its records.
+     *
+     * @param datagram Received datagram
+     * @param size Size of the datagram
+     * @param source Address of the exporter
+     */
+    void Collector::process(const uint8_t* datagram, size_t size, const struct sockaddr_in& source) {
+        totals.datagrams++;
+        totals.bytes += size;
+
+        if (size < Config::NETFLOW_HEADER_SIZE || get_u16(datagram) != Config::DEFAULT_NETFLOW_VERSION) {
+            totals.invalid++;
+            return;
+        }
+        uint16_t count = get_u16(datagram + 2);
+        if (count == 0 || count > Config::MAX_FLOWS_PER_PACKET ||
+            size != Config::NETFLOW_HEADER_SIZE + count * Config::NETFLOW_RECORD_SIZE) {
+            totals.invalid++;
+            return;
+        }
+
+        // flow_sequence counts the flows exported before the datagram
+        uint64_t stream_id = (static_cast<uint64_t>(source.sin_addr.s_addr) << 32) |
+                             (static_cast<uint64_t>(source.sin_port) << 16) |
+                             (static_cast<uint64_t>(datagram[20]) << 8) | datagram[21];
+        uint32_t sequence = get_u32(datagram + 16);
+        auto found = streams.find(stream_id);
+        if (found == streams.end()) {
+            found = streams.emplace(stream_id, Stream()).first;
+            found->second.next_sequence = sequence;
+        }
+        Stream& stream = found->second;
+        int32_t difference = static_cast<int32_t>(sequence - stream.next_sequence);
+        if (difference > 0) {
+            stream.gaps++;
+            stream.lost_flows += static_cast<uint32_t>(difference);
+        }
+        if (difference < 0) {
+            stream.reordered++;
+        }
+        else {
+            stream.next_sequence = sequence + count;
+        }
+
+        for (uint16_t i = 0; i < count; i++) {
+            const uint8_t* record = datagram + Config::NETFLOW_HEADER_SIZE + i * Config::NETFLOW_RECORD_SIZE;
+            totals.flows++;
+            totals.packets += get_u32(record + 16);
+            totals.octets += get_u32(record + 20);
+            if (dump.is_open()) {
+                dump_record(record);
+            }
+        }
+    }
+
+    /**
+     * @brief Writes one record as a CSV line, fields in the order of the v5 record.
+     *
+     * @param record Record in the datagram
+     */
+    void Collector::dump_record(const uint8_t* record) {
+        dump << address(record) << ',' << address(record + 4) << ',' << address(record + 8) << ','
+             << get_u16(record + 32) << ',' << get_u16(record + 34) << ','
+             << static_cast<int>(record[38]) << ',' << static_cast<int>(record[37]) << ','
+             << static_cast<int>(record[39]) << ','
+             << get_u32(record + 16) << ',' << get_u32(record + 20) << ','
+             << get_u32(record + 24) << ',' << get_u32(record + 28) << ','
+             << get_u16(record + 40) << ',' << get_u16(record + 42) << ','
+             << static_cast<int>(record[44]) << ',' << static_cast<int>(record[45]) << '\n';
+    }
+
+    /**
+     * @brief Drop counter of the socket in /proc/net/udp, it also counts drops after the last
+     * received datagram, which SO_RXQ_OVFL reports only with a later datagram.
+     *
+     * @return Dropped datagrams, 0 if the socket is not found
+     */
+    uint32_t Collector::proc_drops() const {
+        struct stat info;
+        if (fstat(sock, &info) != 0) {
+            return 0;
+        }
+        std::ifstream table("/proc/net/udp");
+        std::string line;
+        std::getline(table, line); // Column names
+        while (std::getline(table, line)) {
+            // sl local rem st tx:rx tr:when retrnsmt uid timeout inode ref pointer drops
+            std::istringstream fields(line);
+            std::string field;
+            unsigned long long inode = 0;
+            uint32_t drops = 0;
+            for (int column = 0; fields >> field; column++) {
+                if (column == 9) {
+                    inode = std::stoull(field);
+                }
+                else if (column == 12) {
+                    drops = static_cast<uint32_t>(std::stoul(field));
+                }
+            }
+            if (inode == info.st_ino) {
+                return drops;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Prints the totals, the loss of the exporters and of the collector socket.
+     *
+     * @return Exit status, 1 if flows were lost
+     */
+    int Collector::report() const {
+        uint64_t lost_flows = 0;
+        uint64_t gaps = 0;
+        uint64_t reordered = 0;
+        for (const auto& entry : streams) {
+            lost_flows += entry.second.lost_flows;
+            gaps += entry.second.gaps;
+            reordered += entry.second.reordered;
+        }
+        uint32_t socket_drops = std::max(totals.socket_drops, proc_drops());
+        uint64_t missing = options.expected_flows > static_cast<long long>(totals.flows)
+                           ? options.expected_flows - totals.flows : 0;
+        double seconds = std::chrono::duration<double>(last_datagram - first_datagram).count();
+
+        std::cout << "Datagrams: " << totals.datagrams << " (" << totals.bytes << " bytes, invalid "
+                  << totals.invalid << ")\n";
+        std::cout << "Flows: " << totals.flows << ", packets: " << totals.packets << ", octets: "
+                  << totals.octets << "\n";
+        std::cout << "Exporters: " << streams.size() << ", sequence gaps: " << gaps << " (" << lost_flows
+                  << " flows lost), reordered: " << reordered << "\n";
+        std::cout << "Socket drops: " << socket_drops << " datagrams\n";
+        if (options.expected_flows >= 0) {
+            std::cout << "Expected flows: " << options.expected_flows << ", missing: " << missing << "\n";
+        }
+        if (seconds > 0) {
+            std::cout << "Rate: " << static_cast<uint64_t>(totals.datagrams / seconds) << " datagrams/s, "
+                      << static_cast<uint64_t>(totals.flows / seconds) << " flows/s, "
+                      << static_cast<uint64_t>(totals.bytes * 8 / seconds / 1000000) << " Mbit/s over "
+                      << seconds << " s\n";
+        }
+        return lost_flows > 0 || socket_drops > 0 || missing > 0 ? 1 : 0;
+    }
+
+    void printUsage() {
+        std::cerr << "Usage: ./netflowcollector [-p <port>] [-b <address>] [-t <idle_timeout_s>]"
+                     " [--rcvbuf <bytes>] [--dump <file>] [--expect <flows>]\n";
+    }
+
+    /**
+     * @brief Parses the program arguments, exits with the usage on an error.
+     */
+    Options parseArgs(int argc, char* argv[]) {
+        Options options;
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "-h") {
+                printUsage();
+                exit(0);
+            }
+            if (i + 1 >= argc) {
+                std::cerr << "Error: Invalid or unexpected argument '" << arg << "'.\n";
+                printUsage();
+                exit(2);
+            }
+            std::string value = argv[++i];
+            try {
+                if (arg == "-p") {
+                    options.port = std::stoi(value);
+                }
+                else if (arg == "-b") {
+                    options.bind_address = value;
+                }
+                else if (arg == "-t") {
+                    options.idle_timeout = std::stoi(value);
+                }
+                else if (arg == "--rcvbuf") {
+                    options.receive_buffer = std::stoi(value);
+                }
+                else if (arg == "--dump") {
+                    options.dump_path = value;
+                }
+                else if (arg == "--expect") {
+                    options.expected_flows = std::stoll(value);
+                }
+                else {
+                    std::cerr << "Error: Invalid or unexpected argument '" << arg << "'.\n";
+                    printUsage();
+                    exit(2);
+                }
+            } catch (const std::exception&) {
+                std::cerr << "Error: " << arg << " option requires a number.\n";
+                printUsage();
+                exit(2);
+            }
+        }
+        if (options.port < static_cast<int>(Config::MIN_PORT) || options.port > static_cast<int>(Config::MAX_PORT) ||
+            options.idle_timeout < 0 || options.receive_buffer <= 0) {
+            std::cerr << "Error: Option value out of range.\n";
+            printUsage();
+            exit(2);
+        }
+        return options;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Options options = parseArgs(argc, argv);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = [](int) { stop_requested.store(true, std::memory_order_relaxed); };
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    Collector collector(options);
+    if (!collector.open_socket()) {
+        return 3;
+    }
+    std::cerr << "Listening on " << options.bind_address << ":" << options.port << "\n";
+    collector.run();
+    return collector.report();
+}
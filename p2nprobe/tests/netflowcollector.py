@@ -14,7 +14,8 @@ class NetflowCollector:
         self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
         self.sock.bind((host, port))
 
-    def parse_header(self, data: bytes) -> NetflowV5Header:
+    @staticmethod
+    def parse_header(data: bytes) -> NetflowV5Header:
         return NetflowV5Header(
             version=struct.unpack('!H', data[0:2])[0],
             count=struct.unpack('!H', data[2:4])[0],
@@ -27,7 +28,8 @@ class NetflowCollector:
             sampling_interval=struct.unpack('!H', data[22:24])[0]
         )
 
-    def parse_record(self, data: bytes) -> NetflowV5Record:
+    @staticmethod
+    def parse_record(data: bytes) -> NetflowV5Record:
         src_addr = socket.inet_ntoa(data[0:4])
         dst_addr = socket.inet_ntoa(data[4:8])
         return NetflowV5Record(
@@ -53,6 +55,21 @@ class NetflowCollector:
             pad2=struct.unpack('!H', data[46:48])[0]
         )
 
+    @staticmethod
+    def parse_datagrams(data: bytes) -> List[NetflowV5Record]:
+        # Datagrams written back to back, as in an --output file
+        records = []
+        offset = 0
+        while offset + 24 <= len(data):
+            header = NetflowCollector.parse_header(data[offset:offset + 24])
+            if header.version != 5:
+                raise ValueError(f"Unexpected version {header.version}")
+            offset += 24
+            for _ in range(header.count):
+                records.append(NetflowCollector.parse_record(data[offset:offset + 48]))
+                offset += 48
+        return records
+
     def collect_flows(self, timeout: int = 5) -> None:
         self.sock.settimeout(timeout)
         try:
@@ -0,0 +1,144 @@
+import random
+import socket
+import struct
+from typing import List, Tuple
+
+# Capture timestamps in microseconds and the Ethernet frame
+Packet = Tuple[int, bytes]
+
+PCAP_MAGIC = 0xa1b2c3d4
+LINKTYPE_ETHERNET = 1
+ETHERNET_HEADER = b'\x00\x11\x22\x33\x44\x55\x66\x77\x88\x99\xaa\xbb\x08\x00'
+
+TCP_FIN = 0x01
+TCP_SYN = 0x02
+TCP_RST = 0x04
+TCP_PSH = 0x08
+TCP_ACK = 0x10
+
+CAPTURE_START = 1728900000
+
+
+def ipv4_packet(src: str, dst: str, protocol: int, transport: bytes, payload_len: int, ip_id: int,
+                total_len: int = 0) -> bytes:
+    # Payload is not captured, the IP total length carries its size like a capture with a small snaplen
+    length = total_len or min(20 + len(transport) + payload_len, 65535)
+    header = struct.pack('!BBHHHBBH4s4s', 0x45, 0, length, ip_id & 0xffff, 0, 64, protocol, 0,
+                         socket.inet_aton(src), socket.inet_aton(dst))
+    return ETHERNET_HEADER + header + transport
+
+
+def tcp_packet(src: str, dst: str, sport: int, dport: int, flags: int, payload_len: int, ip_id: int,
+               seq: int = 0) -> bytes:
+    transport = struct.pack('!HHIIBBHHH', sport, dport, seq & 0xffffffff, 0, 0x50, flags, 65535, 0, 0)
+    return ipv4_packet(src, dst, 6, transport, payload_len, ip_id)
+
+
+def udp_packet(src: str, dst: str, sport: int, dport: int, payload_len: int, ip_id: int) -> bytes:
+    transport = struct.pack('!HHHH', sport, dport, 8 + payload_len, 0)
+    return ipv4_packet(src, dst, 17, transport, payload_len, ip_id)
+
+
+def write_pcap(path: str, packets: List[Packet]) -> None:
+    with open(path, 'wb') as file:
+        file.write(struct.pack('<IHHiIII', PCAP_MAGIC, 2, 4, 0, 0, 65535, LINKTYPE_ETHERNET))
+        for timestamp, frame in packets:
+            # Original length includes the payload that was not captured
+            ip_len = struct.unpack('!H', frame[16:18])[0]
+            file.write(struct.pack('<IIII', timestamp // 1000000, timestamp % 1000000, len(frame), 14 + ip_len))
+            file.write(frame)
+
+
+def read_pcap(path: str) -> List[Packet]:
+    packets = []
+    with open(path, 'rb') as file:
+        data = file.read()
+    offset = 24
+    while offset + 16 <= len(data):
+        seconds, micros, captured, _ = struct.unpack('<IIII', data[offset:offset + 16])
+        offset += 16
+        packets.append((seconds * 1000000 + micros, data[offset:offset + captured]))
+        offset += captured
+    return packets
+
+
+def burst_capture(bursts: int = 20, connections: int = 1000, length: int = 5, gap: int = 65) -> List[Packet]:
+    """Short bursts of connections separated by silence. Flows open at the end of a burst are checked only by
+    the first packet after the gap, when both timeouts of the tests have passed."""
+    packets = []
+    ip_id = 0
+    for burst in range(bursts):
+        start = (CAPTURE_START + burst * (length + gap)) * 1000000
+        for index in range(connections):
+            src, dst = f"10.1.{index >> 8 & 255}.{index & 255}", f"192.168.{burst % 7}.{1 + index % 13}"
+            time = start + index * length * 1000000 // connections
+            for packet in range(3):
+                ip_id += 1
+                packets.append((time + packet * 1000, tcp_packet(src, dst, 20000 + burst, 80, TCP_ACK, 100, ip_id)))
+    packets.sort(key=lambda packet: packet[0])
+    return packets
+
+
+def synthetic_capture(seed: int = 1, connections: int = 300, udp_flows: int = 100,
+                      duration: int = 600) -> List[Packet]:
+    """TCP connections closed by FIN or RST or left open, and UDP flows, with gaps longer than
+    the test timeouts so active, inactive and end of file expiry all occur."""
+    rng = random.Random(seed)
+    packets = []
+    ip_id = 0
+
+    def client(index: int) -> str:
+        return f"10.{index >> 16 & 255}.{index >> 8 & 255}.{index & 255}"
+
+    for index in range(connections):
+        src, dst = client(index + 1), f"192.168.{index % 7}.{1 + index % 13}"
+        sport, dport = 20000 + index, rng.choice([80, 443, 22, 8080])
+        time = (CAPTURE_START + rng.uniform(0, duration * 0.9)) * 1000000
+        seq_client, seq_server = rng.randrange(1 << 32), rng.randrange(1 << 32)
+        exchanges = rng.randint(1, 25)
+        ending = rng.choice(['fin', 'fin', 'rst', 'open'])
+
+        def add(forward: bool, flags: int, payload: int) -> None:
+            nonlocal ip_id, seq_client, seq_server
+            ip_id += 1
+            if forward:
+                frame = tcp_packet(src, dst, sport, dport, flags, payload, ip_id, seq_client)
+                seq_client += payload
+            else:
+                frame = tcp_packet(dst, src, dport, sport, flags, payload, ip_id, seq_server)
+                seq_server += payload
+            packets.append((int(time), frame))
+
+        add(True, TCP_SYN, 0)
+        time += rng.randint(100, 50000)
+        add(False, TCP_SYN | TCP_ACK, 0)
+        for _ in range(exchanges):
+            # Mostly short gaps, some longer than the inactive timeout of the tests
+            time += rng.choice([rng.randint(1000, 2000000)] * 9 + [rng.randint(40, 90) * 1000000])
+            add(True, TCP_PSH | TCP_ACK, rng.randint(0, 1400))
+            time += rng.randint(100, 100000)
+            add(False, TCP_ACK, rng.randint(0, 1400))
+        time += rng.randint(1000, 1000000)
+        if ending == 'fin':
+            add(True, TCP_FIN | TCP_ACK, 0)
+            time += rng.randint(100, 50000)
+            add(False, TCP_FIN | TCP_ACK, 0)
+            time += rng.randint(100, 50000)
+            add(True, TCP_ACK, 0)
+        elif ending == 'rst':
+            add(rng.random() < 0.5, TCP_RST, 0)
+
+    for index in range(udp_flows):
+        src, dst = client(connections + index + 1), f"172.16.{index % 3}.{1 + index % 5}"
+        sport, dport = 30000 + index, rng.choice([53, 123, 514])
+        time = (CAPTURE_START + rng.uniform(0, duration * 0.9)) * 1000000
+        for _ in range(rng.randint(1, 30)):
+            ip_id += 1
+            packets.append((int(time), udp_packet(src, dst, sport, dport, rng.randint(20, 500), ip_id)))
+            time += rng.choice([rng.randint(1000, 5000000)] * 9 + [rng.randint(40, 90) * 1000000])
+
+    # Everything past the end of the capture is dropped, timestamps are non-decreasing
+    end = (CAPTURE_START + duration) * 1000000
+    packets = [packet for packet in packets if packet[0] < end]
+    packets.sort(key=lambda packet: packet[0])
+    return packets
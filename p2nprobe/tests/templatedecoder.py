@@ -0,0 +1,79 @@
+import struct
+from typing import Dict, List, Tuple
+
+# Field key is the information element ID and the enterprise number (0 for standard elements)
+FieldKey = Tuple[int, int]
+
+V9_HEADER_SIZE = 20
+IPFIX_HEADER_SIZE = 16
+ENTERPRISE_BIT = 0x8000
+
+
+class TemplateDecoder:
+    """Decoder of NetFlow v9 and IPFIX datagrams, keeps the templates seen so far."""
+
+    def __init__(self):
+        self.templates: Dict[int, List[Tuple[FieldKey, int]]] = {}
+        self.records: List[Dict[FieldKey, int]] = []
+        self.headers: List[Tuple[int, int, int]] = []   # version, SysUptime (v9 only) and sequence
+
+    def decode(self, datagram: bytes) -> None:
+        version = struct.unpack('!H', datagram[0:2])[0]
+        if version == 9:
+            _, _, uptime, _, sequence, _ = struct.unpack('!HHIIII', datagram[:V9_HEADER_SIZE])
+            offset, template_set = V9_HEADER_SIZE, 0
+        elif version == 10:
+            _, _, _, sequence, _ = struct.unpack('!HHIII', datagram[:IPFIX_HEADER_SIZE])
+            uptime, offset, template_set = 0, IPFIX_HEADER_SIZE, 2
+        else:
+            raise ValueError(f"Unexpected version {version}")
+        self.headers.append((version, uptime, sequence))
+
+        while offset + 4 <= len(datagram):
+            set_id, set_length = struct.unpack('!HH', datagram[offset:offset + 4])
+            if set_length < 4:
+                raise ValueError("Set shorter than its header")
+            if set_id == template_set:
+                self.decode_templates(datagram[offset + 4:offset + set_length])
+            elif set_id >= 256:
+                self.decode_records(set_id, datagram[offset + 4:offset + set_length])
+            offset += set_length
+
+    def decode_templates(self, data: bytes) -> None:
+        offset = 0
+        while offset + 4 <= len(data):
+            template_id, field_count = struct.unpack('!HH', data[offset:offset + 4])
+            offset += 4
+            fields = []
+            for _ in range(field_count):
+                field_type, length = struct.unpack('!HH', data[offset:offset + 4])
+                offset += 4
+                enterprise = 0
+                if field_type & ENTERPRISE_BIT:
+                    enterprise = struct.unpack('!I', data[offset:offset + 4])[0]
+                    offset += 4
+                fields.append(((field_type & ~ENTERPRISE_BIT, enterprise), length))
+            self.templates[template_id] = fields
+
+    def decode_records(self, template_id: int, data: bytes) -> None:
+        fields = self.templates[template_id]
+        record_size = sum(length for _, length in fields)
+        offset = 0
+        # Whatever is left after the last record is padding
+        while offset + record_size <= len(data):
+            record = {}
+            for key, length in fields:
+                record[key] = int.from_bytes(data[offset:offset + length], 'big')
+                offset += length
+            self.records.append(record)
+
+
+def split_ipfix(data: bytes) -> List[bytes]:
+    """Splits IPFIX messages written back to back by the length of their headers."""
+    messages = []
+    offset = 0
+    while offset + IPFIX_HEADER_SIZE <= len(data):
+        length = struct.unpack('!H', data[offset + 2:offset + 4])[0]
+        messages.append(data[offset:offset + length])
+        offset += length
+    return messages
@@ -5,6 +5,7 @@ from itertools import permutations
 
 SUCCESS = 0
 ERROR = 1
+INVALID_ARGS = 2
 
 EXISTING_PCAP_FILE = "pcaps/tcp.pcap"
 NONEXISTING_PCAP_FILE = "does_not_exist.pcap"
@@ -87,6 +88,91 @@ def main():
         ("Invalid port format", ["localhost:", EXISTING_PCAP_FILE], ERROR),
         ("Valid timeouts", ["localhost:2055", EXISTING_PCAP_FILE, "-a 30", "-i 60"], SUCCESS),
         ("Extra arguments", ["localhost:2055", EXISTING_PCAP_FILE, "extra"], ERROR),
+        # Template based export
+        ("Unknown export format", ["localhost:2055", EXISTING_PCAP_FILE, "--format v7"], INVALID_ARGS),
+        ("MTU too small", ["localhost:2055", EXISTING_PCAP_FILE, "--format ipfix", "--mtu 100"], INVALID_ARGS),
+        ("Invalid template refresh", ["localhost:2055", EXISTING_PCAP_FILE, "--template-refresh 0"], INVALID_ARGS),
+        # Output file
+        ("Output with collector", ["localhost:2055", EXISTING_PCAP_FILE, "--output out.bin"], INVALID_ARGS),
+        ("Unknown compression", ["--output out.bin", EXISTING_PCAP_FILE, "--compress rar"], INVALID_ARGS),
+        ("Compression without output", ["localhost:2055", EXISTING_PCAP_FILE, "--compress zlib"], INVALID_ARGS),
+        ("Direct IO without output", ["localhost:2055", EXISTING_PCAP_FILE, "--direct-io"], INVALID_ARGS),
+        ("Uncompressed v9 output", ["--output out.bin", EXISTING_PCAP_FILE, "--format v9"], INVALID_ARGS),
+        # Arrow output
+        ("Arrow without output", ["localhost:2055", EXISTING_PCAP_FILE, "--format arrow"], INVALID_ARGS),
+        ("Compressed arrow", ["--output out.arrow", EXISTING_PCAP_FILE, "--format arrow", "--compress zlib"], INVALID_ARGS),
+        ("Invalid row group", ["--output out.arrow", EXISTING_PCAP_FILE, "--format arrow", "--row-group 0"], INVALID_ARGS),
+        # Export pacing
+        ("Unknown rate unit", ["localhost:2055", EXISTING_PCAP_FILE, "--rate 10furlongs"], INVALID_ARGS),
+        ("Negative rate", ["localhost:2055", EXISTING_PCAP_FILE, "--rate -5mbps"], INVALID_ARGS),
+        ("Zero replay speed", ["localhost:2055", EXISTING_PCAP_FILE, "--replay-speed 0"], INVALID_ARGS),
+        ("Invalid replay speed", ["localhost:2055", EXISTING_PCAP_FILE, "--replay-speed fast"], INVALID_ARGS),
+        ("Send buffer too small", ["localhost:2055", EXISTING_PCAP_FILE, "--sndbuf 1"], INVALID_ARGS),
+        # Metrics
+        ("Negative stats interval", ["localhost:2055", EXISTING_PCAP_FILE, "--stats-interval -1"], INVALID_ARGS),
+        ("Invalid Prometheus port", ["localhost:2055", EXISTING_PCAP_FILE, "--prometheus 70000"], INVALID_ARGS),
+        # Tracing, rejected by builds without tracing too
+        ("Trace without file", ["localhost:2055", EXISTING_PCAP_FILE, "--trace"], INVALID_ARGS),
+        # Checkpoint
+        ("Checkpoint without file", ["localhost:2055", EXISTING_PCAP_FILE, "--checkpoint"], INVALID_ARGS),
+        ("Missing resume file", ["localhost:2055", EXISTING_PCAP_FILE, "--resume does_not_exist.ckpt"], ERROR),
+        # Time range
+        ("Invalid from time", ["localhost:2055", EXISTING_PCAP_FILE, "--from yesterday"], INVALID_ARGS),
+        ("Infinite from time", ["localhost:2055", EXISTING_PCAP_FILE, "--from inf"], INVALID_ARGS),
+        ("NaN to time", ["localhost:2055", EXISTING_PCAP_FILE, "--to nan"], INVALID_ARGS),
+        ("Huge to time", ["localhost:2055", EXISTING_PCAP_FILE, "--to 1e300"], INVALID_ARGS),
+        ("Negative from time", ["localhost:2055", EXISTING_PCAP_FILE, "--from -1"], INVALID_ARGS),
+        ("From after to", ["localhost:2055", EXISTING_PCAP_FILE, "--from 200", "--to 100"], INVALID_ARGS),
+        ("Invalid index interval", [EXISTING_PCAP_FILE, "--build-index", "--index-interval 0"], INVALID_ARGS),
+        ("Build index with collector", ["localhost:2055", EXISTING_PCAP_FILE, "--build-index"], INVALID_ARGS),
+        # Parallel processing
+        ("Zero threads", ["localhost:2055", EXISTING_PCAP_FILE, "--threads 0"], INVALID_ARGS),
+        ("Too many threads", ["localhost:2055", EXISTING_PCAP_FILE, "--threads 1000"], INVALID_ARGS),
+        ("Threads with time range", ["localhost:2055", EXISTING_PCAP_FILE, "--threads 4", "--from 0"], INVALID_ARGS),
+        # Input reader
+        ("Unknown reader", ["localhost:2055", EXISTING_PCAP_FILE, "--reader mmap"], INVALID_ARGS),
+        ("Direct read without uring", ["localhost:2055", EXISTING_PCAP_FILE, "--direct-read"], INVALID_ARGS),
+        # Biflow
+        ("Biflow with threads", ["localhost:2055", EXISTING_PCAP_FILE, "--biflow", "--threads 2"], INVALID_ARGS),
+        # TCP termination
+        ("Negative FIN linger", ["localhost:2055", EXISTING_PCAP_FILE, "--tcp-end", "--fin-linger -1"], INVALID_ARGS),
+        ("FIN linger too long", ["localhost:2055", EXISTING_PCAP_FILE, "--tcp-end", "--fin-linger 60001"], INVALID_ARGS),
+        ("TCP end with threads", ["localhost:2055", EXISTING_PCAP_FILE, "--tcp-end", "--threads 2"], INVALID_ARGS),
+        # Sketches
+        ("Negative sketch interval", ["localhost:2055", EXISTING_PCAP_FILE, "--sketches", "--sketch-interval -1"], INVALID_ARGS),
+        ("Zero top-k", ["localhost:2055", EXISTING_PCAP_FILE, "--sketches", "--top-k 0"], INVALID_ARGS),
+        ("Top-k over capacity", ["localhost:2055", EXISTING_PCAP_FILE, "--sketches", "--top-k 257"], INVALID_ARGS),
+        ("Sketches with threads", ["localhost:2055", EXISTING_PCAP_FILE, "--sketches", "--threads 2"], INVALID_ARGS),
+        # Rollups
+        ("Unknown rollup field", ["localhost:2055", EXISTING_PCAP_FILE, "--rollup dst,color"], INVALID_ARGS),
+        ("Rollup prefix too long", ["localhost:2055", EXISTING_PCAP_FILE, "--rollup src/33"], INVALID_ARGS),
+        ("Zero rollup interval", ["localhost:2055", EXISTING_PCAP_FILE, "--rollup dst", "--rollup-interval 0"], INVALID_ARGS),
+        ("Rollup only without rollup", ["localhost:2055", EXISTING_PCAP_FILE, "--rollup-only"], INVALID_ARGS),
+        # Routing table
+        ("Routes without file", ["localhost:2055", EXISTING_PCAP_FILE, "--routes"], INVALID_ARGS),
+        ("Missing routes file", ["localhost:2055", EXISTING_PCAP_FILE, "--routes does_not_exist.txt"], ERROR),
+        # Shared memory output
+        ("Shared memory name with slash", [EXISTING_PCAP_FILE, "--shm a/b"], INVALID_ARGS),
+        ("Shared memory size not a power of two", [EXISTING_PCAP_FILE, "--shm ring", "--shm-size 3"], INVALID_ARGS),
+        ("Shared memory with output", [EXISTING_PCAP_FILE, "--shm ring", "--output out.bin"], INVALID_ARGS),
+        ("Shared memory with collector", ["localhost:2055", EXISTING_PCAP_FILE, "--shm ring"], INVALID_ARGS),
+        # Export spool
+        ("Spool without file", ["localhost:2055", EXISTING_PCAP_FILE, "--spool"], INVALID_ARGS),
+        ("Spool without collector", ["--output out.bin", EXISTING_PCAP_FILE, "--spool export.spool"], INVALID_ARGS),
+        ("Zero spool size", ["localhost:2055", EXISTING_PCAP_FILE, "--spool export.spool", "--spool-size 0"], INVALID_ARGS),
+        ("Zero spool rate", ["localhost:2055", EXISTING_PCAP_FILE, "--spool export.spool", "--spool-rate 0"], INVALID_ARGS),
+        # Duplicate suppression
+        ("Zero dedup window", ["localhost:2055", EXISTING_PCAP_FILE, "--dedup", "--dedup-window 0"], INVALID_ARGS),
+        ("Dedup window too long", ["localhost:2055", EXISTING_PCAP_FILE, "--dedup", "--dedup-window 60001"], INVALID_ARGS),
+        ("Dedup with threads", ["localhost:2055", EXISTING_PCAP_FILE, "--dedup", "--threads 2"], INVALID_ARGS),
+        # Flow admission
+        ("Admission with threads", ["localhost:2055", EXISTING_PCAP_FILE, "--admission", "--threads 2"], INVALID_ARGS),
+        # Flow spill
+        ("Spill without file", ["localhost:2055", EXISTING_PCAP_FILE, "--flow-spill"], INVALID_ARGS),
+        ("Too few hot flows", ["localhost:2055", EXISTING_PCAP_FILE, "--flow-spill flows.spill", "--hot-flows 999"], INVALID_ARGS),
+        ("Too many hot flows", ["localhost:2055", EXISTING_PCAP_FILE, "--flow-spill flows.spill", "--hot-flows 100000001"],
+         INVALID_ARGS),
+        ("Spill with threads", ["localhost:2055", EXISTING_PCAP_FILE, "--flow-spill flows.spill", "--threads 2"], INVALID_ARGS),
     ]
 
     print("Running p2nprobe argument tests with permutations...\n")
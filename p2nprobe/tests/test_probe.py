@@ -1,13 +1,32 @@
 #!/usr/bin/env python3
 
+import dataclasses
+import datetime
+import gzip
+import json
+import lzma
+import os
+import re
+import shutil
+import signal
+import socket
+import struct
 import subprocess
 import sys
+import tempfile
 import time
-from typing import Dict, Optional
+import urllib.request
+import zlib
+from typing import Callable, Dict, List, Optional, Tuple
 
 from netflowcollector import NetflowCollector
+from pcapwriter import CAPTURE_START, TCP_ACK, TCP_RST, TCP_SYN, burst_capture, read_pcap, synthetic_capture, tcp_packet, write_pcap
+from templatedecoder import TemplateDecoder, split_ipfix
 
 P2NPROBE_PATH = "./p2nprobe"
+FLOW_CALLBACK_PATH = "./flow_callback"
+SHM_READER_PATH = "./shm_reader"
+COLLECTOR_PATH = "./netflowcollector"
 
 GREEN = '\033[92m'
 RED = '\033[91m'
@@ -97,10 +116,949 @@ def compare_flows(collected: Dict, reference: Dict) -> None:
     print(f"Total octets: {total_octets} (Reference: {ref_octets})")
 
 
+class ProbeRun:
+    """Result of one p2nprobe run, output holds the --output file or the received datagrams."""
+
+    def __init__(self, process: subprocess.CompletedProcess, output: bytes = b"",
+                 datagrams: Optional[List[bytes]] = None):
+        self.returncode = process.returncode
+        self.stdout = process.stdout
+        self.stderr = process.stderr
+        self.output = output
+        self.datagrams = datagrams or []
+
+    def counter(self, name: str) -> int:
+        """Number printed after the name in the final statistics, 0 if it is not printed."""
+        match = re.search(rf"{name}:? (\d+)", self.stdout)
+        return int(match.group(1)) if match else 0
+
+    def records(self) -> List:
+        if self.datagrams:
+            return [record for datagram in self.datagrams for record in NetflowCollector.parse_datagrams(datagram)]
+        return NetflowCollector.parse_datagrams(self.output)
+
+
+class FeatureTestError(Exception):
+    pass
+
+
+def check(condition: bool, message: str) -> None:
+    if not condition:
+        raise FeatureTestError(message)
+
+
+def run_p2nprobe(args: List[str], timeout: int = 120) -> subprocess.CompletedProcess:
+    return subprocess.run([P2NPROBE_PATH] + args, capture_output=True, text=True, timeout=timeout)
+
+
+def export_to_file(workdir: str, pcap_file: str, *options: str) -> ProbeRun:
+    output = os.path.join(workdir, "export.out")
+    if os.path.exists(output):
+        os.unlink(output)
+    process = run_p2nprobe(["--output", output, pcap_file] + list(options))
+    check(process.returncode == 0, f"p2nprobe {' '.join(options)} failed: {process.stderr}")
+    with open(output, "rb") as file:
+        return ProbeRun(process, file.read())
+
+
+class BackgroundExport:
+    """p2nprobe exporting to a local socket while the test interacts with it."""
+
+    def __init__(self, pcap_file: str, *options: str):
+        # Datagrams wait in the socket buffer until p2nprobe finished
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 16 * 1024 * 1024)
+        self.sock.bind(("127.0.0.1", 0))
+        self.options = list(options)
+        self.process = subprocess.Popen([P2NPROBE_PATH, f"127.0.0.1:{self.sock.getsockname()[1]}", pcap_file]
+                                        + self.options, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+
+    def finish(self, timeout: int = 120) -> ProbeRun:
+        try:
+            stdout, stderr = self.process.communicate(timeout=timeout)
+            check(self.process.returncode == 0, f"p2nprobe {' '.join(self.options)} failed: {stderr}")
+            datagrams = []
+            self.sock.settimeout(0.5)
+            try:
+                while True:
+                    datagrams.append(self.sock.recv(65535))
+            except socket.timeout:
+                pass
+            completed = subprocess.CompletedProcess(self.process.args, self.process.returncode, stdout, stderr)
+            return ProbeRun(completed, datagrams=datagrams)
+        finally:
+            if self.process.poll() is None:
+                self.process.kill()
+                self.process.wait()
+            self.sock.close()
+
+
+def export_to_socket(pcap_file: str, *options: str) -> ProbeRun:
+    return BackgroundExport(pcap_file, *options).finish()
+
+
+def free_tcp_port() -> int:
+    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as sock:
+        sock.bind(("127.0.0.1", 0))
+        return sock.getsockname()[1]
+
+
+def flow_set(records: List) -> List[Tuple]:
+    """Exported v5 flows in a comparable form, independent of the export order and of the device start
+    (wall clock time of the run) that First and Last are relative to."""
+    start = min((r.first_time for r in records), default=0)
+    return sorted((r.src_addr, r.dst_addr, r.src_port, r.dst_port, r.protocol, r.packets, r.octets,
+                   (r.first_time - start) & 0xffffffff, (r.last_time - start) & 0xffffffff, r.tcp_flags)
+                  for r in records)
+
+
+def totals(records: List) -> Tuple[int, int]:
+    return sum(r.packets for r in records), sum(r.octets for r in records)
+
+
+def decode_templates(datagrams: List[bytes]) -> TemplateDecoder:
+    decoder = TemplateDecoder()
+    for datagram in datagrams:
+        decoder.decode(datagram)
+    return decoder
+
+
+FEATURE_TESTS: List[Tuple[str, Callable[[str, str], None]]] = []
+
+
+def feature_test(function: Callable[[str, str], None]) -> Callable[[str, str], None]:
+    FEATURE_TESTS.append((function.__name__, function))
+    return function
+
+
+@feature_test
+def test_v9_export(workdir: str, pcap_file: str) -> None:
+    v5 = export_to_socket(pcap_file, "-a", "60", "-i", "30")
+    v9 = export_to_socket(pcap_file, "-a", "60", "-i", "30", "--format", "v9")
+    decoder = decode_templates(v9.datagrams)
+    check(list(decoder.templates) == [256], f"Unexpected templates {list(decoder.templates)}")
+    fields = [key for key, _ in decoder.templates[256]]
+    check((152, 0) not in fields and (153, 0) not in fields, "v9 template carries IPFIX timestamps")
+
+    # FIRST_SWITCHED/LAST_SWITCHED are SysUptime relative like First/Last of v5, the device start
+    # is the wall clock time of each run
+    v5_start = min(r.first_time for r in v5.records())
+    v9_start = min(r[(22, 0)] for r in decoder.records)
+    expected = sorted((r.packets, r.octets, r.first_time - v5_start, r.last_time - v5_start) for r in v5.records())
+    actual = sorted((r[(2, 0)], r[(1, 0)], r[(22, 0)] - v9_start, r[(21, 0)] - v9_start) for r in decoder.records)
+    check(actual == expected, f"v9 records differ from v5: {len(actual)} vs {len(expected)} flows")
+    check(all(version == 9 for version, _, _ in decoder.headers), "Unexpected message version")
+    check([sequence for _, _, sequence in decoder.headers] == list(range(len(decoder.headers))),
+          "v9 sequence does not count the datagrams")
+
+
+@feature_test
+def test_ipfix_export(workdir: str, pcap_file: str) -> None:
+    v5 = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30")
+    ipfix = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30", "--format", "ipfix")
+    decoder = decode_templates(split_ipfix(ipfix.output))
+    fields = [key for key, _ in decoder.templates[256]]
+    check((152, 0) in fields and (153, 0) in fields, "IPFIX template has no millisecond timestamps")
+
+    # Absolute timestamps, the capture starts at CAPTURE_START
+    records = decoder.records
+    check(all(r[(152, 0)] >= CAPTURE_START * 1000 for r in records), "flowStartMilliseconds is not absolute")
+    expected = sorted((r.packets, r.octets, r.last_time - r.first_time) for r in v5.records())
+    actual = sorted((r[(2, 0)], r[(1, 0)], r[(153, 0)] - r[(152, 0)]) for r in records)
+    check(actual == expected, f"IPFIX records differ from v5: {len(actual)} vs {len(expected)} flows")
+    sequences = [sequence for _, _, sequence in decoder.headers]
+    check(sequences[0] == 0 and sequences == sorted(sequences), "IPFIX sequence does not count the records")
+
+
+def read_block_container(data: bytes) -> List[bytes]:
+    """Datagrams of a compressed --output file: header, blocks and length prefixed datagrams."""
+    check(data[:4] == b"P2NF", "Missing file magic")
+    compression = data[6]
+    stream = bytearray()
+    offset = 16
+    while offset + 8 <= len(data):
+        size, stored = struct.unpack("!II", data[offset:offset + 8])
+        block = data[offset + 8:offset + 8 + stored]
+        offset += 8 + stored
+        if stored == size:
+            stream += block
+        elif compression == 1:
+            stream += zlib.decompress(block)
+        else:
+            raise FeatureTestError(f"Compression {compression} cannot be read by the test")
+    datagrams = []
+    offset = 0
+    while offset + 2 <= len(stream):
+        length = struct.unpack("!H", stream[offset:offset + 2])[0]
+        datagrams.append(bytes(stream[offset + 2:offset + 2 + length]))
+        offset += 2 + length
+    return datagrams
+
+
+@feature_test
+def test_output_file(workdir: str, pcap_file: str) -> None:
+    udp = export_to_socket(pcap_file, "-a", "60", "-i", "30")
+    file = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30")
+    check(flow_set(file.records()) == flow_set(udp.records()), "Output file differs from the collector export")
+    check(len(file.records()) == file.counter("exported"), "Output file misses flows")
+
+    direct = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30", "--direct-io")
+    check(flow_set(direct.records()) == flow_set(file.records()), "--direct-io output differs")
+
+
+@feature_test
+def test_compressed_output(workdir: str, pcap_file: str) -> None:
+    plain = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30")
+    compressed = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30", "--compress", "zlib")
+    datagrams = read_block_container(compressed.output)
+    check(b"".join(datagrams) != b"" and len(compressed.output) < len(plain.output), "Output is not compressed")
+    records = [record for datagram in datagrams for record in NetflowCollector.parse_datagrams(datagram)]
+    check(flow_set(records) == flow_set(plain.records()), "Decompressed output differs")
+
+    # v9 datagrams have no length, they are written only into the length prefixed container
+    v9 = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30", "--compress", "zlib", "--format", "v9")
+    decoder = decode_templates(read_block_container(v9.output))
+    check(len(decoder.records) == len(plain.records()), "v9 output file misses flows")
+
+
+@feature_test
+def test_arrow_output(workdir: str, pcap_file: str) -> None:
+    v5 = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30")
+    arrow = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30", "--format", "arrow", "--row-group", "100")
+    # Arrow IPC stream: messages start with the continuation marker, the stream ends with an empty one
+    check(arrow.output[:4] == b"\xff\xff\xff\xff", "Missing continuation marker")
+    check(arrow.output[-8:] == b"\xff\xff\xff\xff\x00\x00\x00\x00", "Missing end of stream marker")
+    try:
+        import pyarrow
+        import pyarrow.ipc
+    except ImportError:
+        print("  pyarrow is not installed, the columns are not checked")
+        return
+
+    batches = list(pyarrow.ipc.open_stream(arrow.output))
+    table = pyarrow.Table.from_batches(batches).to_pydict()
+    rows = len(table["packets"])
+    check(rows == len(v5.records()) and len(batches) == (rows + 99) // 100, f"{rows} rows in {len(batches)} batches")
+    actual = sorted(zip(table["src_port"], table["dst_port"], table["protocol"], table["packets"], table["bytes"],
+                        [(last - first) // datetime.timedelta(milliseconds=1) for first, last in zip(table["first"], table["last"])]))
+    expected = sorted((r.src_port, r.dst_port, r.protocol, r.packets, r.octets, r.last_time - r.first_time)
+                      for r in v5.records())
+    check(actual == expected, "Arrow columns differ from the v5 export")
+
+
+def timed_export(pcap_file: str, *options: str) -> Tuple[ProbeRun, float]:
+    start = time.monotonic()
+    run = export_to_socket(pcap_file, *options)
+    return run, time.monotonic() - start
+
+
+@feature_test
+def test_rate_limit(workdir: str, pcap_file: str) -> None:
+    plain = export_to_socket(pcap_file, "-a", "60", "-i", "30")
+    bits = sum(len(datagram) for datagram in plain.datagrams) * 8
+
+    # The bucket holds one datagram of the path MTU, everything else waits for the rate
+    rate = bits * 2
+    paced, elapsed = timed_export(pcap_file, "-a", "60", "-i", "30", "--rate", f"{rate}bps")
+    check(flow_set(paced.records()) == flow_set(plain.records()), "Paced export differs")
+    minimum = (bits - 65535 * 8) / rate     # Path MTU of the loopback
+    check(elapsed >= minimum, f"Export took {elapsed:.2f} s, at least {minimum:.2f} s expected")
+    check(paced.counter("throttled") > 0, "Throttles are not counted")
+
+    datagrams = len(plain.datagrams)
+    paced, elapsed = timed_export(pcap_file, "-a", "60", "-i", "30", "--rate", f"{datagrams * 2}dps")
+    check(elapsed >= 0.4, f"{datagrams} datagrams at {datagrams * 2} dps took {elapsed:.2f} s")
+
+
+@feature_test
+def test_replay_speed(workdir: str, pcap_file: str) -> None:
+    plain, fast = timed_export(pcap_file, "-a", "60", "-i", "30")
+    # Exports follow the capture time, which spans several minutes
+    paced, elapsed = timed_export(pcap_file, "-a", "60", "-i", "30", "--replay-speed", "500")
+    check(flow_set(paced.records()) == flow_set(plain.records()), "Paced export differs")
+    check(elapsed >= fast + 0.5, f"Replay took {elapsed:.2f} s, without pacing {fast:.2f} s")
+
+
+def stats_lines(stdout: str) -> List[Dict]:
+    return [json.loads(line) for line in stdout.splitlines() if line.startswith("{\"timestamp_ms\"")]
+
+
+@feature_test
+def test_stats_interval(workdir: str, pcap_file: str) -> None:
+    # Paced to a few seconds, so the interval elapses during the run
+    run = export_to_socket(pcap_file, "-a", "60", "-i", "30", "--replay-speed", "200", "--stats-interval", "1")
+    lines = stats_lines(run.stdout)
+    check(len(lines) >= 2, f"{len(lines)} stats lines")
+    check(all("latency_ns" in line and "export" in line["latency_ns"] for line in lines), "Latencies are missing")
+    # The last line is printed after the export, it matches the final statistics
+    check(lines[-1]["flows_exported"] == run.counter("exported"), "flows_exported differs from the statistics")
+    check(lines[-1]["packets_read"] == run.counter("Packets read"), "packets_read differs")
+    check(lines[-1]["datagrams_sent"] == len(run.datagrams), "datagrams_sent differs from the received datagrams")
+
+
+@feature_test
+def test_prometheus_and_sigusr1(workdir: str, pcap_file: str) -> None:
+    port = free_tcp_port()
+    export = BackgroundExport(pcap_file, "-a", "60", "-i", "30", "--replay-speed", "200", "--prometheus", str(port))
+    body = ""
+    deadline = time.monotonic() + 10
+    while not body and time.monotonic() < deadline:
+        try:
+            with urllib.request.urlopen(f"http://127.0.0.1:{port}/metrics", timeout=2) as response:
+                body = response.read().decode()
+        except OSError:
+            time.sleep(0.1)
+    export.process.send_signal(signal.SIGUSR1)
+    time.sleep(0.5)
+    run = export.finish()
+
+    check("# TYPE p2nprobe_packets_read_total counter" in body, "Prometheus counters are missing")
+    check("p2nprobe_stage_latency_seconds{stage=\"decode\",quantile=\"0.99\"}" in body, "Latency summary is missing")
+    # Without --stats-interval only the signal prints a stats line
+    check(len(stats_lines(run.stdout)) == 1, "SIGUSR1 did not print one stats line")
+
+
+@feature_test
+def test_trace(workdir: str, pcap_file: str) -> None:
+    trace_file = os.path.join(workdir, "trace.json")
+    output = os.path.join(workdir, "export.out")
+    process = run_p2nprobe(["--output", output, pcap_file, "--trace", trace_file])
+    if process.returncode != 0:
+        # Tracing is compiled in with make TRACE=1 (cmake -DP2NPROBE_TRACE=ON) only
+        check(process.returncode == 2 and "requires a build with tracing" in process.stderr,
+              f"--trace failed: {process.stderr}")
+        plain = run_p2nprobe(["--output", output, pcap_file])
+        check("Hot path breakdown" not in plain.stdout, "Breakdown printed without tracing")
+        print("  Tracing is not compiled in, only the rejection is checked")
+        return
+
+    check("Hot path breakdown" in process.stdout, "Breakdown is missing")
+    decode = re.search(r"^  decode +(\d+)", process.stdout, re.MULTILINE)
+    check(decode is not None and int(decode.group(1)) == ProbeRun(process).counter("Packets read"),
+          "Decode calls differ from the packets read")
+    with open(trace_file) as file:
+        events = json.load(file)["traceEvents"]
+    check(events and all(event["ph"] == "X" and event["dur"] >= 0 for event in events), "Invalid trace events")
+    check({event["name"] for event in events} <= {"read", "decode", "lookup", "expiry", "export"},
+          "Unknown stage in the trace events")
+
+
+LOG_LINE = re.compile(r"^\[\d{4}-\d\d-\d\d \d\d:\d\d:\d\d\.\d{3}\] \[(DEBUG|INFO |WARN |ERROR)\] ")
+
+
+@feature_test
+def test_async_logger(workdir: str, pcap_file: str) -> None:
+    # Every packet has an invalid IP header length and logs a warning from the same call site
+    bad_file = os.path.join(workdir, "bad_header.pcap")
+    frames = []
+    for index in range(200):
+        frame = bytearray(tcp_packet("10.0.0.1", "10.0.0.2", 1000 + index, 80, TCP_ACK, 100, index))
+        frame[14] = 0x44
+        frames.append(((CAPTURE_START + index) * 1000000, bytes(frame)))
+    write_pcap(bad_file, frames)
+
+    run = export_to_socket(bad_file, "--rate", "1000dps")
+    check(run.counter("bad IP header") == 200, "Invalid headers are not counted")
+    warnings = [line for line in run.stderr.splitlines() if "Invalid IP header length" in line]
+    check(0 < len(warnings) <= 10, f"{len(warnings)} warnings of one call site, the rate limit allows 10")
+    log_lines = [line for line in (run.stdout + run.stderr).splitlines() if line.startswith("[")]
+    check(all(LOG_LINE.match(line) for line in log_lines), "Malformed or interleaved log line")
+    # Logged by the sender destructor during the shutdown, the writer thread drains the ring before exit
+    check(any("Export throttled" in line for line in run.stdout.splitlines()), "Messages of the shutdown are lost")
+
+    # Errors are written before the usage text and the exit message that follow them on stderr
+    for _ in range(5):
+        process = run_p2nprobe(["localhost:99999", pcap_file])
+        lines = process.stderr.splitlines()
+        error = next((index for index, line in enumerate(lines) if "[ERROR] Port number out of valid range" in line), None)
+        usage = next((index for index, line in enumerate(lines) if line.startswith("Usage:")), None)
+        check(error is not None and usage is not None and error < usage, "Error log line is written after the usage")
+        check(lines[-1] == "Program terminated with: 2", "Exit message is not the last line")
+
+
+def split_capture(workdir: str, pcap_file: str, parts: int) -> List[str]:
+    """Splits the capture into consecutive files of about the same number of packets."""
+    packets = read_pcap(pcap_file)
+    paths = []
+    for part in range(parts):
+        path = os.path.join(workdir, f"part{part}.pcap")
+        write_pcap(path, packets[len(packets) * part // parts:len(packets) * (part + 1) // parts])
+        paths.append(path)
+    return paths
+
+
+@feature_test
+def test_checkpoint_resume(workdir: str, pcap_file: str) -> None:
+    whole = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30")
+    checkpoint = os.path.join(workdir, "flows.checkpoint")
+    records = []
+    sequences = []
+    for index, part in enumerate(split_capture(workdir, pcap_file, 3)):
+        options = ["-a", "60", "-i", "30"]
+        if index > 0:
+            options += ["--resume", checkpoint]
+        if index < 2:
+            options += ["--checkpoint", checkpoint]
+        run = export_to_file(workdir, part, *options)
+        if run.output:
+            sequences.append((NetflowCollector.parse_header(run.output[:24]).flow_sequence, len(records)))
+        records += run.records()
+
+    # Flows open at a split continue in the next run, the device start and the sequence are kept
+    check(flow_set(records) == flow_set(whole.records()), "Resumed runs differ from one run over the capture")
+    check(all(sequence == flows for sequence, flows in sequences), "flow_sequence does not continue")
+
+    run_p2nprobe(["--output", os.path.join(workdir, "v5.out"), pcap_file, "--checkpoint", checkpoint])
+    process = run_p2nprobe(["--output", os.path.join(workdir, "ipfix.out"), pcap_file, "--format", "ipfix",
+                            "--resume", checkpoint])
+    check(process.returncode == 3 and "Invalid checkpoint file" in process.stderr,
+          "Checkpoint of another export format was accepted")
+
+
+@feature_test
+def test_time_range(workdir: str, pcap_file: str) -> None:
+    packets = read_pcap(pcap_file)
+    first, last = packets[0][0], packets[-1][0]
+    whole = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30")
+    covering = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30",
+                              "--from", str(first // 1000000), "--to", str(last // 1000000 + 1))
+    check(flow_set(covering.records()) == flow_set(whole.records()), "Range covering the capture changes the flows")
+
+    # Packets at or after --from and before --to, only TCP is decoded
+    start, end = first + (last - first) // 3, first + 2 * (last - first) // 3
+    expected = sum(1 for timestamp, frame in packets if start <= timestamp < end and frame[23] == 6)
+    options = ["-a", "60", "-i", "30", "--from", f"{start / 1000000:.6f}", "--to", f"{end / 1000000:.6f}"]
+    scanned = export_to_file(workdir, pcap_file, *options)
+    check(totals(scanned.records())[0] == expected, "Packets outside of the range are exported")
+
+    # The index only changes how the start of the range is found
+    index_copy = os.path.join(workdir, "indexed.pcap")
+    write_pcap(index_copy, packets)
+    process = run_p2nprobe([index_copy, "--build-index", "--index-interval", "16"])
+    check(process.returncode == 0 and os.path.exists(index_copy + ".p2ni"), "Time index was not written")
+    indexed = export_to_file(workdir, index_copy, *options)
+    check(flow_set(indexed.records()) == flow_set(scanned.records()), "Range found by the index differs")
+
+    # A compressed capture cannot seek, it is filtered whole with the same result
+    compressed = os.path.join(workdir, "capture.pcap.gz")
+    with open(pcap_file, "rb") as source, gzip.open(compressed, "wb") as target:
+        target.write(source.read())
+    streamed = export_to_file(workdir, compressed, *options)
+    check(flow_set(streamed.records()) == flow_set(scanned.records()), "Range of a compressed capture differs")
+
+
+@feature_test
+def test_threads(workdir: str, pcap_file: str) -> None:
+    # Ranges of a thread are at least 1 MiB of the file
+    capture = os.path.join(workdir, "threads.pcap")
+    write_pcap(capture, synthetic_capture(seed=7, connections=4000, udp_flows=200, duration=900))
+    bursts = os.path.join(workdir, "bursts.pcap")
+    write_pcap(bursts, burst_capture())
+    for capture in (capture, bursts):
+        sequential = export_to_file(workdir, capture, "-a", "60", "-i", "30")
+        for threads in ("2", "4", "7"):
+            parallel = export_to_file(workdir, capture, "-a", "60", "-i", "30", "--threads", threads)
+            check(flow_set(parallel.records()) == flow_set(sequential.records()),
+                  f"Flows of {threads} threads differ from the sequential run")
+            # Expiry reasons of flows carried over the end of a range
+            for counter in ("Flows created", "exported", "active", "inactive", "forced"):
+                check(parallel.counter(counter) == sequential.counter(counter),
+                      f"{counter} of {threads} threads: {parallel.counter(counter)}, "
+                      f"sequential: {sequential.counter(counter)}")
+
+
+@feature_test
+def test_compressed_input(workdir: str, pcap_file: str) -> None:
+    with open(pcap_file, "rb") as file:
+        capture = file.read()
+    plain = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30")
+    half = len(capture) // 2
+    compressed = {
+        "capture.pcap.gz": gzip.compress(capture),
+        "members.pcap.gz": gzip.compress(capture[:half]) + gzip.compress(capture[half:]),
+        "capture.pcap.xz": lzma.compress(capture),
+    }
+    if shutil.which("zstd"):
+        compressed["capture.pcap.zst"] = subprocess.run(["zstd", "-q", "-c"], input=capture, capture_output=True).stdout
+
+    for name, data in compressed.items():
+        path = os.path.join(workdir, name)
+        with open(path, "wb") as file:
+            file.write(data)
+        process = run_p2nprobe(["--output", os.path.join(workdir, "probe.out"), path])
+        if process.returncode == 3 and "not supported in this build" in process.stderr:
+            continue
+        run = export_to_file(workdir, path, "-a", "60", "-i", "30")
+        check(flow_set(run.records()) == flow_set(plain.records()), f"Flows of {name} differ from the capture")
+
+    # Packets decompressed before the data ends are aggregated, the run reports the read error
+    truncated = os.path.join(workdir, "truncated.pcap.gz")
+    with open(truncated, "wb") as file:
+        file.write(compressed["capture.pcap.gz"][:len(compressed["capture.pcap.gz"]) // 2])
+    process = run_p2nprobe(["--output", os.path.join(workdir, "truncated.out"), truncated])
+    read = int(re.search(r"Packets read: (\d+)", process.stdout).group(1))
+    check(process.returncode == 1 and 0 < read < len(read_pcap(pcap_file)), "Truncated compressed capture was not reported")
+
+
+@feature_test
+def test_uring_reader(workdir: str, pcap_file: str) -> None:
+    # Records cross the seams of the 4 MiB reads in flight
+    capture = os.path.join(workdir, "bursts.pcap")
+    write_pcap(capture, burst_capture(bursts=50))
+    truncated = os.path.join(workdir, "truncated.pcap")
+    with open(capture, "rb") as source, open(truncated, "wb") as target:
+        target.write(source.read()[:os.path.getsize(capture) // 2 + 7])
+
+    for path in (pcap_file, capture):
+        libpcap = export_to_file(workdir, path, "-a", "60", "-i", "30")
+        for options in (["--reader", "uring"], ["--reader", "uring", "--direct-read"]):
+            run = export_to_file(workdir, path, "-a", "60", "-i", "30", *options)
+            check("with io_uring" in run.stdout, f"{' '.join(options)} did not use io_uring")
+            check(flow_set(run.records()) == flow_set(libpcap.records()), f"Flows of {' '.join(options)} differ")
+            check(run.counter("Packets read") == libpcap.counter("Packets read"), "Packet counts differ")
+
+    # A record cut by the end of the file fails the run the same way as with libpcap
+    results = []
+    for options in ([], ["--reader", "uring"]):
+        process = run_p2nprobe(["--output", os.path.join(workdir, "truncated.out"), truncated] + options)
+        results.append((process.returncode, re.search(r"Packets read: (\d+)", process.stdout).group(1)))
+    check(results[0] == results[1], f"Truncated capture: libpcap {results[0]}, io_uring {results[1]}")
+
+
+@feature_test
+def test_biflow(workdir: str, pcap_file: str) -> None:
+    plain = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30")
+    biflow = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30", "--biflow")
+    endpoints = lambda run: {(r.src_addr, r.dst_addr, r.src_port, r.dst_port) for r in run.records()}
+    check(totals(biflow.records()) == totals(plain.records()), "Biflows do not keep the packets of both directions")
+    check(endpoints(biflow) == endpoints(plain), "Biflow records of a direction are missing")
+    check(biflow.counter("Flows created") < plain.counter("Flows created"), "Directions of a connection share no entry")
+
+    # One IPFIX record holds both directions in RFC 5103 reverse fields
+    ipfix = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30", "--biflow", "--format", "ipfix")
+    decoder = decode_templates(split_ipfix(ipfix.output))
+    reverse = [((2, 29305), (2, 0)), ((1, 29305), (1, 0))]
+    check(all(key in record for record in decoder.records for key, _ in reverse), "IPFIX biflow has no reverse fields")
+    packets = sum(r[(2, 0)] + r[(2, 29305)] for r in decoder.records)
+    octets = sum(r[(1, 0)] + r[(1, 29305)] for r in decoder.records)
+    check((packets, octets) == totals(plain.records()), "IPFIX biflow counters differ from both directions")
+    check(len(decoder.records) == biflow.counter("Flows created"), "IPFIX exports more than one record per biflow")
+    check(any(r[(2, 29305)] > 0 for r in decoder.records), "No biflow has packets of the reverse direction")
+
+
+@feature_test
+def test_tcp_end(workdir: str, pcap_file: str) -> None:
+    plain = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30")
+    ended = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30", "--tcp-end")
+    check(totals(ended.records()) == totals(plain.records()), "Ended flows lose packets")
+    check(ended.counter("fin") > 0 and ended.counter("rst") > 0, "No flow ended by FIN or RST")
+    reasons = sum(ended.counter(reason) for reason in ("active", "inactive", "forced", "fin", "rst"))
+    check(reasons == ended.counter("exported") == len(ended.records()), "Expiry reasons do not add up to the exported flows")
+
+    # The final ACK after both FINs arrives within the linger, without it the ACK opens a new flow
+    no_linger = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30", "--tcp-end", "--fin-linger", "0")
+    check(no_linger.counter("Flows created") > ended.counter("Flows created"), "Linger does not keep the final ACK")
+    check(totals(no_linger.records()) == totals(plain.records()), "Flows without linger lose packets")
+
+
+@feature_test
+def test_sketches(workdir: str, pcap_file: str) -> None:
+    run = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30", "--sketches", "--sketch-interval", "60",
+                         "--top-k", "3")
+    lines = run.stdout.splitlines()
+    reports = [json.loads(line)["sketch"] for line in lines if line.startswith("{\"sketch\"")]
+    summary = next(index for index, line in enumerate(lines) if line.startswith("Processing completed"))
+    check(all(index < summary for index, line in enumerate(lines) if line.startswith("{\"sketch\"")),
+          "Sketch reports follow the final summary")
+
+    # One report per interval of 60 s holding decoded (TCP) packets
+    tcp = [(timestamp // 1000, frame) for timestamp, frame in read_pcap(pcap_file) if frame[23] == 6]
+    check(len(reports) == len({timestamp // 60000 for timestamp, _ in tcp}), f"{len(reports)} sketch reports")
+    check(sum(report["packets"] for report in reports) == run.counter("decoded"), "Reports miss packets")
+    check(sum(report["bytes"] for report in reports) == totals(run.records())[1], "Reports miss bytes")
+    check(all(len(report["top_src_bytes"]) <= 3 and len(report["top_dst_port_packets"]) <= 3 for report in reports),
+          "More than --top-k keys reported")
+
+    # Distinct sources of the first interval within the error of the estimate, exact top source by packets
+    first = [frame for timestamp, frame in tcp if timestamp // 60000 == tcp[0][0] // 60000]
+    sources = [socket.inet_ntoa(frame[26:30]) for frame in first]
+    distinct = len(set(sources))
+    check(abs(reports[0]["distinct_src"] - distinct) <= max(2, distinct // 20),
+          f"distinct_src {reports[0]['distinct_src']}, exact {distinct}")
+    top = reports[0]["top_src_packets"][0]
+    check(top["error"] > 0 or top["value"] == max(sources.count(source) for source in set(sources)),
+          "Top source by packets is not the heaviest")
+
+    # With periodic stats the reports are printed by the same thread, whole lines before the stats lines
+    run = export_to_socket(pcap_file, "-a", "60", "-i", "30", "--replay-speed", "300", "--stats-interval", "1",
+                           "--sketches", "--sketch-interval", "60")
+    lines = [line for line in run.stdout.splitlines() if line.startswith("{")]
+    check(all(json.loads(line) for line in lines), "Report lines are interleaved")
+    check(len([line for line in lines if line.startswith("{\"sketch\"")]) == len(reports), "Reports are lost")
+    check(lines[-1].startswith("{\"timestamp_ms\""), "Final stats line does not follow the last report")
+
+
+@feature_test
+def test_rollup(workdir: str, pcap_file: str) -> None:
+    plain = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30")
+    only = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30", "--rollup", "dst/24,dport", "--rollup-only")
+    check(totals(only.records()) == totals(plain.records()), "Rollups lose packets of the flows")
+    check(len(only.records()) < len(plain.records()), "Rollups do not merge flows")
+    both = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30", "--rollup", "dst/24,dport")
+    check(len(both.records()) == len(plain.records()) + len(only.records()), "Flows and rollups are not both exported")
+
+    # 70000 full size packets of 100 flows sum to more than the 32-bit octet counter of one bin
+    packets = []
+    for index in range(70000):
+        frame = tcp_packet(f"10.2.0.{index % 100}", "192.168.9.1", 40000, 80, TCP_ACK, 65535, index)
+        packets.append(((CAPTURE_START + index // 100) * 1000000, frame))
+    capture = os.path.join(workdir, "large.pcap")
+    write_pcap(capture, packets)
+    run = export_to_file(workdir, capture, "--rollup", "dst", "--rollup-interval", "3600", "--rollup-only")
+    records = run.records()
+    check(len(records) == 1 and records[0].packets == 70000, f"Rollup of the bin: {len(records)} records")
+    check(records[0].octets == 0xffffffff, f"dOctets {records[0].octets} wrapped instead of saturating")
+
+
+@feature_test
+def test_routes(workdir: str, pcap_file: str) -> None:
+    routes = os.path.join(workdir, "routes.txt")
+    with open(routes, "w") as file:
+        file.write("# prefix nexthop AS\n10.0.0.0/8 - 64500\n192.168.0.0/16 198.51.100.1 64501\n"
+                   "192.168.3.0/24 198.51.100.3 64502   # more specific\n10.0.0.5/32 - 64503\n")
+    plain = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30")
+    routed = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30", "--routes", routes)
+    check(totals(routed.records()) == totals(plain.records()), "Routes change the flows")
+
+    def route(address: str) -> Tuple[int, int]:
+        if address == "10.0.0.5":
+            return 64503, 32
+        if address.startswith("10."):
+            return 64500, 8
+        return (64502, 24) if address.startswith("192.168.3.") else (64501, 16)
+
+    for r in routed.records():
+        check((r.src_as, r.src_mask) == route(r.src_addr), f"Source route of {r.src_addr}: {r.src_as}/{r.src_mask}")
+        check((r.dst_as, r.dst_mask) == route(r.dst_addr), f"Destination route of {r.dst_addr}: {r.dst_as}/{r.dst_mask}")
+        nexthop = {64501: "198.51.100.1", 64502: "198.51.100.3"}.get(route(r.dst_addr)[0], "0.0.0.0")
+        check(r.next_hop == nexthop, f"Nexthop of {r.dst_addr}: {r.next_hop}")
+
+    # Trailing characters of the prefix length are an error on their line
+    with open(routes, "w") as file:
+        file.write("192.168.0.0/16 - 64501\n10.0.0.0/8abc - 64500\n")
+    process = run_p2nprobe(["--output", os.path.join(workdir, "routes.out"), pcap_file, "--routes", routes])
+    check(process.returncode == 3 and "line 2" in process.stderr, "Prefix length with trailing characters was accepted")
+
+
+@feature_test
+def test_flow_policies(workdir: str, pcap_file: str) -> None:
+    # Every instantiation of the aggregation core keeps the packets, only the flow boundaries differ
+    plain = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30")
+    for options in (["--biflow"], ["--tcp-end"], ["--biflow", "--tcp-end"]):
+        run = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30", *options)
+        check(totals(run.records()) == totals(plain.records()), f"{' '.join(options)} loses packets")
+        if "--tcp-end" in options:
+            check(run.counter("fin") > 0 and run.counter("rst") > 0, f"{' '.join(options)} ends no flow by TCP")
+
+    # Biflows of the template encoder are split into two records as in v5
+    v9 = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30", "--biflow", "--tcp-end", "--format", "v9",
+                        "--compress", "zlib")
+    records = decode_templates(read_block_container(v9.output)).records
+    check((sum(r[(2, 0)] for r in records), sum(r[(1, 0)] for r in records)) == totals(plain.records()),
+          "v9 biflows lose packets")
+
+    # Options of a policy that is not selected leave the default one
+    linger = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30", "--fin-linger", "500")
+    check(flow_set(linger.records()) == flow_set(plain.records()), "--fin-linger without --tcp-end changes the flows")
+
+
+def v5_datagrams(data: bytes) -> List[Tuple]:
+    """Datagrams of a v5 output file with the record count, sequence and records. The uptime starts at the
+    wall clock time of the run, so First and Last are taken relative to the SysUptime of their datagram."""
+    datagrams = []
+    offset = 0
+    while offset + 24 <= len(data):
+        header = NetflowCollector.parse_header(data[offset:offset + 24])
+        records = [NetflowCollector.parse_record(data[offset + 24 + index * 48:offset + 72 + index * 48])
+                   for index in range(header.count)]
+        datagrams.append((header.count, header.flow_sequence,
+                          [dataclasses.replace(record, first_time=(header.sys_uptime - record.first_time) & 0xffffffff,
+                                               last_time=(header.sys_uptime - record.last_time) & 0xffffffff)
+                           for record in records]))
+        offset += 24 + header.count * 48
+    return datagrams
+
+
+@feature_test
+def test_library_callback(workdir: str, pcap_file: str) -> None:
+    # The example aggregates through libp2nprobe with the timeouts of the CLI run
+    plain = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30")
+    process = subprocess.run([FLOW_CALLBACK_PATH, pcap_file, "60", "30"], capture_output=True, text=True, timeout=120)
+    check(process.returncode == 0, f"flow_callback failed: {process.stderr}")
+    rows = [line.split(",") for line in process.stdout.splitlines()[1:]]
+    start = min(int(row[6]) for row in rows)
+    library = sorted((row[0], row[1], int(row[2]), int(row[3]), int(row[4]), int(row[5]),
+                      int(row[6]) - start, int(row[7]) - start) for row in rows)
+    cli = sorted(flow[:4] + flow[5:9] for flow in flow_set(plain.records()))
+    check(library == cli, f"Library flows differ from the CLI: {len(library)} vs {len(cli)}")
+    check(f"Flows: {plain.counter('Flows created')} created, {len(rows)} expired" in process.stderr,
+          "Flow counts of the library differ")
+
+    # The callback sees every flow the exporter gets
+    for port, octets in re.findall(r"port (\d+): (\d+) bytes", process.stderr):
+        check(int(octets) == sum(int(row[5]) for row in rows if row[3] == port), f"Callback bytes of port {port}")
+
+    # A probe with the v5 exporter writes the datagrams of the CLI
+    output = os.path.join(workdir, "library.out")
+    started = time.monotonic()
+    plain = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30")
+    process = subprocess.run([FLOW_CALLBACK_PATH, pcap_file, "60", "30", "--v5", output],
+                             capture_output=True, text=True, timeout=120)
+    elapsed_ms = (time.monotonic() - started) * 1000
+    check(process.returncode == 0, f"flow_callback --v5 failed: {process.stderr}")
+    with open(output, "rb") as file:
+        library = file.read()
+    check(v5_datagrams(library) == v5_datagrams(plain.output), "Library datagrams differ from the CLI")
+    # Both start the uptime at the wall clock time of their run, First of a flow differs only by the time between them
+    shift = (NetflowCollector.parse_datagrams(plain.output)[0].first_time
+             - NetflowCollector.parse_datagrams(library)[0].first_time) & 0xffffffff
+    check(shift <= elapsed_ms + 1000, f"Uptime of the library starts {shift} ms apart from the CLI")
+
+    usage = subprocess.run([FLOW_CALLBACK_PATH], capture_output=True, text=True, timeout=10)
+    missing = subprocess.run([FLOW_CALLBACK_PATH, os.path.join(workdir, "missing.pcap")], capture_output=True,
+                             text=True, timeout=10)
+    check(usage.returncode == 2 and missing.returncode == 3, "flow_callback accepts invalid arguments")
+
+
+@feature_test
+def test_shm_ring(workdir: str, pcap_file: str) -> None:
+    # The flows of the capture are several times the 1 MiB ring, the producer waits for the reader
+    capture = os.path.join(workdir, "bursts.pcap")
+    write_pcap(capture, burst_capture())
+    plain = export_to_file(workdir, capture, "-a", "60", "-i", "30")
+    name = f"p2nprobe_test_{os.getpid()}"
+    reader = subprocess.Popen([SHM_READER_PATH, name, "10"], stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+    try:
+        process = run_p2nprobe([capture, "--shm", name, "--shm-size", "1", "-a", "60", "-i", "30"])
+        stdout, stderr = reader.communicate(timeout=30)
+    finally:
+        if reader.poll() is None:
+            reader.kill()
+            reader.wait()
+    check(process.returncode == 0 and reader.returncode == 0, f"Shared memory export failed: {process.stderr}{stderr}")
+
+    packets, octets = totals(plain.records())
+    datagrams = re.search(r"Datagrams sent: (\d+)", process.stdout).group(1)
+    check(f"Datagrams: {datagrams}," in stdout, "Reader lost datagrams")
+    check(f"NetFlow v5 flows: {plain.counter('exported')}, packets: {packets}, octets: {octets}" in stdout,
+          f"Reader flows differ from the file export: {stdout}")
+    check(not os.path.exists(f"/dev/shm/{name}"), "Ring is left in /dev/shm")
+
+
+def collect_with_netflowcollector(pcap_file: str, expect: int, *options: str) -> Tuple[ProbeRun, subprocess.CompletedProcess]:
+    """Exports the capture over UDP to the C++ collector, which validates the sequence numbers."""
+    port = free_tcp_port()
+    collector = subprocess.Popen([COLLECTOR_PATH, "-p", str(port), "-t", "2", "--expect", str(expect)],
+                                 stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+    try:
+        check(collector.stderr.readline().startswith("Listening"), "netflowcollector did not start")
+        process = run_p2nprobe([f"127.0.0.1:{port}", pcap_file] + list(options))
+        stdout, stderr = collector.communicate(timeout=60)
+    finally:
+        if collector.poll() is None:
+            collector.kill()
+            collector.wait()
+    return ProbeRun(process), subprocess.CompletedProcess(collector.args, collector.returncode, stdout, stderr)
+
+
+@feature_test
+def test_netflowcollector(workdir: str, pcap_file: str) -> None:
+    # Sent at full speed, the collector reports sequence gaps, socket drops and missing flows
+    capture = os.path.join(workdir, "bursts.pcap")
+    write_pcap(capture, burst_capture())
+    plain = export_to_file(workdir, capture, "-a", "60", "-i", "30")
+    exported = plain.counter("exported")
+    run, collected = collect_with_netflowcollector(capture, exported, "-a", "60", "-i", "30")
+    check(run.returncode == 0 and run.counter("exported") == exported, f"p2nprobe failed: {run.stderr}")
+    check(collected.returncode == 0, f"netflowcollector reports loss: {collected.stdout}")
+    packets, octets = totals(plain.records())
+    for expected in (f"Flows: {exported}, packets: {packets}, octets: {octets}", "sequence gaps: 0 (0 flows lost)",
+                     "Socket drops: 0 datagrams", f"Expected flows: {exported}, missing: 0"):
+        check(expected in collected.stdout, f"netflowcollector did not report '{expected}': {collected.stdout}")
+
+    # Flows missing at the end of the export are caught by --expect
+    _, collected = collect_with_netflowcollector(pcap_file, plain.counter("exported") * 100, "-a", "60", "-i", "30")
+    check(collected.returncode == 1, "netflowcollector did not report the missing flows")
+
+
+@feature_test
+def test_spool(workdir: str, pcap_file: str) -> None:
+    plain = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30")
+    spool = os.path.join(workdir, "export.spool")
+
+    # Nothing listens on the port, ICMP port unreachable sends every datagram to the spool
+    refused = run_p2nprobe([f"127.0.0.1:{free_tcp_port()}", pcap_file, "-a", "60", "-i", "30", "--spool", spool,
+                            "--spool-size", "1", "--replay-speed", "600"])
+    check(refused.returncode == 0, f"p2nprobe failed: {refused.stderr}")
+    spooled = int(re.search(r"spooled: (\d+)", refused.stdout).group(1))
+    check(spooled > 0 and "for the next run" in refused.stderr, "Refused datagrams were not spooled")
+
+    # The next run replays the leftovers first, its own datagrams queue behind them in the spool
+    run = export_to_socket(pcap_file, "-a", "60", "-i", "30", "--spool", spool)
+    queued = int(re.search(r"spooled: (\d+)", run.stdout).group(1))
+    check(run.counter("replayed") == spooled + queued == len(run.datagrams),
+          f"{run.counter('replayed')} of {spooled} + {queued} spooled datagrams replayed")
+    check("for the next run" not in run.stderr, "Spool was not emptied")
+    packets, octets = totals(plain.records())
+    check(totals(run.records()) == (2 * packets, 2 * octets), "Flows of the spooled datagrams are lost")
+
+
+@feature_test
+def test_dedup(workdir: str, pcap_file: str) -> None:
+    packets = read_pcap(pcap_file)
+    tcp = sum(1 for _, frame in packets if frame[23] == 6)
+    plain = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30")
+    unique = export_to_file(workdir, pcap_file, "-a", "60", "-i", "30", "--dedup")
+    check(flow_set(unique.records()) == flow_set(plain.records()) and unique.counter("duplicate") == 0,
+          "Packets of a capture without copies were dropped")
+
+    # A mirror port delivers every packet twice, the copy a few ms later
+    def mirrored(delay_us: int) -> str:
+        path = os.path.join(workdir, f"mirrored_{delay_us}.pcap")
+        copies = packets + [(timestamp + delay_us, frame) for timestamp, frame in packets]
+        write_pcap(path, sorted(copies, key=lambda packet: packet[0]))
+        return path
+
+    run = export_to_file(workdir, mirrored(3000), "-a", "60", "-i", "30", "--dedup")
+    check(flow_set(run.records()) == flow_set(plain.records()), "Flows of the mirrored capture differ")
+    check(run.counter("duplicate") == tcp, f"{run.counter('duplicate')} of {tcp} copies dropped")
+
+    # Copies later than the window are counted as packets
+    late = export_to_file(workdir, mirrored(200000), "-a", "60", "-i", "30", "--dedup", "--dedup-window", "50")
+    packets_plain, octets_plain = totals(plain.records())
+    check(totals(late.records()) == (2 * packets_plain, 2 * octets_plain), "Copies outside the window were dropped")
+
+
+def scan_capture(seed: int = 3, probes: int = 20000) -> List:
+    """Port scan of single SYN packets, most answered by a RST, mixed into the generated capture."""
+    packets = synthetic_capture(seed=seed)
+    for index in range(probes):
+        timestamp = (CAPTURE_START + index * 500 // probes) * 1000000 + index
+        dport = 1 + index % 1024
+        packets.append((timestamp, tcp_packet("10.9.9.9", f"192.168.50.{index // 1024 % 250}", 50000, dport, TCP_SYN, 0,
+                                              index)))
+        if index % 3:
+            packets.append((timestamp + 200, tcp_packet(f"192.168.50.{index // 1024 % 250}", "10.9.9.9", dport, 50000,
+                                                        TCP_RST | TCP_ACK, 0, index)))
+    return sorted(packets, key=lambda packet: packet[0])
+
+
+@feature_test
+def test_admission(workdir: str, pcap_file: str) -> None:
+    scan = os.path.join(workdir, "scan.pcap")
+    write_pcap(scan, scan_capture())
+    for capture in (pcap_file, scan):
+        for policy in ([], ["--tcp-end"], ["--biflow"]):
+            plain = export_to_file(workdir, capture, "-a", "60", "-i", "30", *policy)
+            admitted = export_to_file(workdir, capture, "-a", "60", "-i", "30", "--admission", *policy)
+            check(flow_set(admitted.records()) == flow_set(plain.records()),
+                  f"Admission {' '.join(policy)} changes the flows")
+            for counter in ("active", "inactive", "forced", "fin", "rst"):
+                check(admitted.counter(counter) == plain.counter(counter), f"Admission changes the {counter} count")
+            if not policy:
+                # Every flow starts in probation, those with a second packet are promoted once
+                promoted = sum(1 for r in admitted.records() if r.packets > 1)
+                check(admitted.counter("promoted from probation") == promoted,
+                      f"{admitted.counter('promoted from probation')} flows promoted, {promoted} have several packets")
+
+
+def concurrent_capture(connections: int) -> List:
+    """One packet of each of many connections within seconds, all flows are open at the end of the capture."""
+    return [(CAPTURE_START * 1000000 + index * 50,
+             tcp_packet(f"10.{index >> 16 & 255}.{index >> 8 & 255}.{index & 255}", "192.168.0.1", 1024 + index % 50000, 80,
+                        TCP_ACK, 40, index))
+            for index in range(connections)]
+
+
+# Peak resident set of a command in kilobytes, measured by a fresh interpreter so the test does not count
+MEASURE_PEAK_RSS = ("import resource, subprocess, sys; subprocess.run(sys.argv[1:], stdout=subprocess.DEVNULL, check=True); "
+                    "print(resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss)")
+
+
+def peak_rss(args: List[str]) -> int:
+    process = subprocess.run([sys.executable, "-c", MEASURE_PEAK_RSS, P2NPROBE_PATH] + args,
+                             capture_output=True, text=True, timeout=300)
+    check(process.returncode == 0, f"p2nprobe {' '.join(args)} failed: {process.stderr}")
+    return int(process.stdout)
+
+
+@feature_test
+def test_flow_spill(workdir: str, pcap_file: str) -> None:
+    spill = os.path.join(workdir, "flows.spill")
+    scan = os.path.join(workdir, "scan.pcap")
+    write_pcap(scan, scan_capture())
+    bursts = os.path.join(workdir, "bursts.pcap")
+    write_pcap(bursts, burst_capture(bursts=4, connections=5000))
+    for capture in (pcap_file, scan, bursts):
+        for policy in ([], ["--tcp-end"], ["--biflow"], ["--admission"]):
+            plain = export_to_file(workdir, capture, "-a", "60", "-i", "30", *policy)
+            spilled = export_to_file(workdir, capture, "-a", "60", "-i", "30", "--flow-spill", spill, "--hot-flows", "1000",
+                                     *policy)
+            check(flow_set(spilled.records()) == flow_set(plain.records()), f"Flow spill {' '.join(policy)} changes the flows")
+            for counter in ("active", "inactive", "forced", "fin", "rst"):
+                check(spilled.counter(counter) == plain.counter(counter), f"Flow spill changes the {counter} count")
+            check(capture == pcap_file or policy or spilled.counter("spilled") > 0, "No flow was spilled")
+
+    # Spilled flows only keep their index and heap entries resident, also while all of them are exported at the end
+    peaks = {}
+    for connections in (50000, 200000):
+        capture = os.path.join(workdir, f"concurrent{connections}.pcap")
+        write_pcap(capture, concurrent_capture(connections))
+        output = os.path.join(workdir, "export.out")
+        peaks[connections] = peak_rss(["--output", output, capture, "-a", "600", "-i", "600",
+                                       "--flow-spill", spill, "--hot-flows", "1000"])
+        with open(output, "rb") as file:
+            records = NetflowCollector.parse_datagrams(file.read())
+        check(len(records) == connections, f"{len(records)} flows exported of {connections}")
+    per_flow = (peaks[200000] - peaks[50000]) * 1024 / 150000
+    check(per_flow < 64, f"Resident set grows by {per_flow:.0f} bytes per spilled flow")
+
+
+def run_feature_tests(pcap_file: Optional[str], selected: List[str]) -> int:
+    passed = 0
+    failed = 0
+    with tempfile.TemporaryDirectory() as workdir:
+        if pcap_file is None:
+            pcap_file = os.path.join(workdir, "synthetic.pcap")
+            write_pcap(pcap_file, synthetic_capture())
+
+        for name, function in FEATURE_TESTS:
+            if selected and name not in selected:
+                continue
+            with tempfile.TemporaryDirectory(dir=workdir) as testdir:
+                try:
+                    function(testdir, pcap_file)
+                    print(f"{GREEN}[PASS]{RESET} {name}")
+                    passed += 1
+                except (FeatureTestError, subprocess.SubprocessError, OSError, ValueError, KeyError) as e:
+                    print(f"{RED}[FAIL]{RESET} {name}: {e}")
+                    failed += 1
+
+    print(f"\nSummary: {passed}/{passed + failed} feature tests passed")
+    return 0 if failed == 0 else 1
+
+
 def main():
+    if len(sys.argv) >= 2 and sys.argv[1] == "--features":
+        # Options of p2nprobe checked on a generated capture (or the given one) without softflowd
+        pcap_file = sys.argv[2] if len(sys.argv) > 2 and sys.argv[2].endswith(".pcap") else None
+        selected = [arg for arg in sys.argv[2:] if arg != pcap_file]
+        sys.exit(run_feature_tests(pcap_file, selected))
+
     if len(sys.argv) < 2:
         print(
-            "Usage: ./test_probe.py <pcap_file> [collector_port] [active_timeout] [inactive_timeout]")
+            "Usage: ./test_probe.py <pcap_file> [collector_port] [active_timeout] [inactive_timeout]\n"
+            "       ./test_probe.py --features [pcap_file] [test_name...]")
         sys.exit(1)
 
     pcap_file = sys.argv[1]